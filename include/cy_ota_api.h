@@ -208,6 +208,7 @@ extern "C" {
 #define CY_RSLT_OTA_USE_JOB_FLOW                ( (cy_rslt_t)(CY_RSLT_SUCCESS          ) ) /**< Use Job flow for update.                 */
 #define CY_RSLT_OTA_USE_DIRECT_FLOW             ( (cy_rslt_t)(CY_RSLT_OTA_INFO_BASE + 4) ) /**< Use Direct flow for update.              */
 #define CY_RSLT_OTA_NO_UPDATE_AVAILABLE         ( (cy_rslt_t)(CY_RSLT_OTA_INFO_BASE + 5) ) /**< No OTA update on the server.             */
+#define CY_RSLT_OTA_POLL_AGAIN                  ( (cy_rslt_t)(CY_RSLT_OTA_INFO_BASE + 6) ) /**< Update in progress, call cy_ota_agent_poll() again. */
 
 /** \} group_ota_macros */
 
@@ -276,6 +277,21 @@ extern "C" {
  */
 #define CY_OTA_HTTP_FILENAME_SIZE               (256)
 
+/**
+ * @brief Size of the SHA-256 digest in @ref cy_ota_storage_context_t.
+ */
+#define CY_OTA_SHA256_DIGEST_SIZE               (32)
+
+/**
+ * @brief cy_ota_storage_context_t image_digest_flags: image_sha256 is valid.
+ */
+#define CY_OTA_IMAGE_DIGEST_FLAG_SHA256         (0x01)
+
+/**
+ * @brief cy_ota_storage_context_t image_digest_flags: image_crc32 is valid.
+ */
+#define CY_OTA_IMAGE_DIGEST_FLAG_CRC32          (0x02)
+
 /**
  * @brief First part of the topic to subscribe / publish.
  *
@@ -503,6 +519,14 @@ extern "C" {
  */
 #define CY_OTA_UNIQUE_TOPIC_FIELD           "UniqueTopicName"
 
+/**
+ * @brief The Delta Base field in a JSON Job document.
+ *
+ * The OTA image is a patch against this application version (for example,"1.6.2").
+ * The update is rejected when the running application is a different version.
+ */
+#define CY_OTA_DELTA_BASE_FIELD             "DeltaBase"
+
 /**
  * @brief The MQTT Connection Type used in a JSON Job document.
  *
@@ -725,7 +749,7 @@ typedef void *cy_ota_context_ptr;
  *                                      - Error function succeeded.
  *                                   - CY_OTA_REASON_FAILURE:
  *                                      - Error function failed.
- *      cb_data->error              - Same as cy_ota_get_last_error().
+ *      cb_data->error              - Same as cy_ota_get_agent_last_error() for this OTA Agent.
  *      cb_data->storage            - For the CY_OTA_STATE_STORAGE_WRITE callback, points to the storage info.
  *      cb_data->total_size         - Total # bytes to be downloaded.
  *      cb_data->bytes_written      - Total # bytes written.
@@ -828,10 +852,14 @@ typedef struct cy_ota_storage_context_s
     uint16_t    total_packets;              /**< Total number of Packets of data for the OTA Image              */
     uint16_t    num_packets_received;       /**< Total number of Packets received                               */
     uint16_t    last_num_packets_received;  /**< last time we saw how many were received, per-packet timer      */
-    uint8_t     ota_is_tar_archive;         /**< !=0, this is a tar file                                        */
+    uint8_t     ota_is_tar_archive;         /**< !=0, this is a tar file (not set when CY_OTA_TAR_PARSER splits it) */
     uint8_t     reboot_upon_completion;     /**< 1 = Automatically reboot upon download completion and verify.  */
     uint8_t     validate_after_reboot;      /**< 0 = OTA will set upgrade image as permanent before reboot.
                                              *   1 = The application should validate and set the upgrade image as the permanent image after reboot. */
+    uint8_t     image_digest_flags;         /**< CY_OTA_IMAGE_DIGEST_FLAG_xxx for the digests computed while writing.
+                                             *   Set before ota_file_verify() is called, 0 = read back the OTA Image. */
+    uint8_t     image_sha256[CY_OTA_SHA256_DIGEST_SIZE];    /**< SHA-256 of the whole OTA Image as written      */
+    uint32_t    image_crc32;                /**< CRC32 of the whole OTA Image as written                        */
 }cy_ota_storage_context_t;
 
 #ifdef COMPONENT_OTA_HTTP
@@ -923,6 +951,56 @@ typedef struct cy_ota_cb_struct_s
 
 } cy_ota_cb_struct_t;
 
+/**
+ * @brief OTA Agent callback data, borrowed from the OTA Agent.
+ *
+ * Passed to @ref cy_ota_callback_v2_t. The pointers are to the OTA Agent's own data,
+ * nothing is copied, and they are only valid during the callback. To change the Job
+ * document, file, topic, connection or credentials, call @ref cy_ota_callback_override()
+ * from the callback.
+ * \struct cy_ota_cb_struct_v2_t
+ */
+typedef struct cy_ota_cb_struct_v2_s
+{
+    cy_ota_context_ptr          ota_ptr;        /**< OTA Agent context, for cy_ota_callback_override().      */
+    cy_ota_cb_reason_t          reason;         /**< Reason for the callback.                               */
+    void                        *cb_arg;        /**< Argument passed when registering the callback.         */
+
+    cy_ota_agent_state_t        ota_agt_state;  /**< Current OTA Agent state.                               */
+    cy_rslt_t                   error;          /**< Current OTA Agent error status.                        */
+
+    cy_ota_storage_write_info_t *storage;       /**< Pointer to a chunk of data to write.                   */
+    uint32_t                    total_size;     /**< Total # bytes to be downloaded.                        */
+    uint32_t                    bytes_written;  /**< Total # bytes downloaded.                              */
+    uint32_t                    percentage;     /**< Percentage of bytes downloaded.                        */
+
+    cy_ota_connection_t         connection_type; /**< Connection type @ref cy_ota_connection_t.             */
+
+#if defined(COMPONENT_OTA_HTTP) || defined(COMPONENT_OTA_MQTT)
+    const cy_awsport_server_info_t      *broker_server; /**< MQTT Broker (or HTTP server) for connection, or NULL. */
+    const cy_awsport_ssl_credentials_t  *credentials;   /**< Credentials for the connection (NULL == non-TLS).  */
+
+    const char                  *json_doc;      /**< Message to request the OTA data, or NULL.              */
+    uint32_t                    json_doc_len;   /**< Length of json_doc.                                    */
+    const char                  *file;          /**< File name to request OTA data (HTTP), or NULL.         */
+    uint32_t                    file_len;       /**< Length of file.                                        */
+    const char                  *unique_topic;  /**< Topic for receiving the OTA data (MQTT), or NULL.      */
+    uint32_t                    unique_topic_len; /**< Length of unique_topic.                              */
+#endif
+} cy_ota_cb_struct_v2_t;
+
+/**
+ * @brief Data the Application can replace from a @ref cy_ota_callback_v2_t callback.
+ */
+typedef enum
+{
+    CY_OTA_CB_OVERRIDE_JOB_DOC = 0,     /**< Job document (string), in CY_OTA_STATE_JOB_PARSE or when connecting.   */
+    CY_OTA_CB_OVERRIDE_FILE,            /**< HTTP file name (string), when connecting.                              */
+    CY_OTA_CB_OVERRIDE_UNIQUE_TOPIC,    /**< MQTT topic for the OTA data (string), when connecting.                 */
+    CY_OTA_CB_OVERRIDE_CONNECTION,      /**< Application's cy_mqtt_t or cy_http_client_t, when connecting.          */
+    CY_OTA_CB_OVERRIDE_CREDENTIALS,     /**< cy_awsport_ssl_credentials_t pointer for the connection, NULL = non-TLS. */
+} cy_ota_cb_override_t;
+
 /**
  * @brief OTA App file information.
  *
@@ -941,6 +1019,43 @@ typedef struct cy_ota_app_info_s
     uint16_t product_id; /**< Product ID.                 */
 } cy_ota_app_info_t;
 
+/**
+ * @brief Magic value for a valid @ref cy_ota_checkpoint_t.
+ */
+#define CY_OTA_CHECKPOINT_MAGIC     (0x4F544143UL)  /* "OTAC" */
+
+/**
+ * @brief Size of the HTTP ETag saved in a @ref cy_ota_checkpoint_t, including the '\0'.
+ */
+#define CY_OTA_CHECKPOINT_ETAG_SIZE (64)
+
+/**
+ * @brief OTA download checkpoint.
+ *
+ * Saved and loaded through the optional storage interface checkpoint functions,
+ * so that a download interrupted by a reset continues where it left off.
+ * The download is only resumed when the checkpoint matches the OTA Image offered now:
+ * the Job (Job flow), the HTTP ETag (HTTP Direct flow) or the first packet, which the
+ * Device requests again, with the OTA Image size and packet count from its header
+ * (MQTT Direct flow). Otherwise the checkpoint is discarded.
+ * \struct cy_ota_checkpoint_t
+ */
+typedef struct cy_ota_checkpoint_s
+{
+    uint32_t    magic;                                  /**< CY_OTA_CHECKPOINT_MAGIC when valid.                    */
+    uint16_t    ver_major;                              /**< Major version of the OTA Image (Job flow), else 0.     */
+    uint16_t    ver_minor;                              /**< Minor version of the OTA Image (Job flow), else 0.     */
+    uint16_t    ver_build;                              /**< Build version of the OTA Image (Job flow), else 0.     */
+    uint32_t    total_image_size;                       /**< Total size of the OTA Image.                           */
+    uint32_t    offset;                                 /**< Bytes [0, offset) of the OTA Image are in storage.     */
+    char        file[CY_OTA_MQTT_FILENAME_BUFF_SIZE];   /**< File name of the OTA Image, if known.                  */
+    uint32_t    job_crc32;                              /**< CRC32 of the Job fields naming the OTA Image (Job flow). */
+    char        etag[CY_OTA_CHECKPOINT_ETAG_SIZE];      /**< HTTP ETag of the OTA Image, "" if the server sent none. */
+    uint32_t    first_block_crc32;                      /**< CRC32 of the first MQTT packet of the OTA Image.       */
+    uint32_t    first_block_size;                       /**< Size of the first MQTT packet, 0 if not received.      */
+    uint32_t    total_packets;                          /**< Number of MQTT packets in the OTA Image, 0 if unknown. */
+} cy_ota_checkpoint_t;
+
 /** \} group_ota_structures */
 
 
@@ -963,6 +1078,57 @@ typedef struct cy_ota_app_info_s
  */
 typedef cy_ota_callback_results_t ( *cy_ota_callback_t ) ( cy_ota_cb_struct_t *cb_data );
 
+/**
+ * @brief OTA Agent callback to the application, with borrowed data.
+ *
+ * Same reasons, states and return values as @ref cy_ota_callback_t. Use
+ * @ref cy_ota_callback_override() to change the data instead of writing to cb_data.
+ *
+ * @param[in]       cb_data   Current information, valid during the callback only.
+ *
+ * @return          CY_OTA_CB_RSLT_OTA_CONTINUE
+ *                  CY_OTA_CB_RSLT_OTA_STOP
+ *                  CY_OTA_CB_RSLT_APP_SUCCESS
+ *                  CY_OTA_CB_RSLT_APP_FAILED
+ */
+typedef cy_ota_callback_results_t ( *cy_ota_callback_v2_t ) ( const cy_ota_cb_struct_v2_t *cb_data );
+
+/**
+ * @brief Lightweight OTA Agent callback for each chunk of data to write.
+ *
+ * When set in @ref cy_ota_agent_params_t, it is called instead of @ref cy_ota_callback_t for
+ * CY_OTA_STATE_STORAGE_WRITE. Nothing is copied for the call, the chunk is passed as received.
+ * With CY_OTA_HTTP_PARALLEL_CONNECTIONS > 1 or CY_OTA_STORAGE_WRITER_BUFFERS, it is called from
+ * an OTA worker thread, one call at a time.
+ *
+ * @param[in]   storage         Chunk of data to write.
+ * @param[in]   bytes_written   Total # bytes downloaded before this chunk.
+ * @param[in]   total_size      Total # bytes to be downloaded.
+ * @param[in]   cb_arg          Argument passed when registering the callback.
+ *
+ * @return          CY_OTA_CB_RSLT_OTA_CONTINUE - OTA Agent writes the chunk.
+ *                  CY_OTA_CB_RSLT_OTA_STOP     - Stop the download.
+ *                  CY_OTA_CB_RSLT_APP_SUCCESS  - Application wrote the chunk.
+ *                  CY_OTA_CB_RSLT_APP_FAILED   - Application failed to write the chunk.
+ */
+typedef cy_ota_callback_results_t ( *cy_ota_write_callback_t ) ( cy_ota_storage_write_info_t *storage, uint32_t bytes_written,
+                                                                 uint32_t total_size, void *cb_arg );
+
+/**
+ * @brief Bit for a callback reason in @ref cy_ota_agent_params_t::cb_reason_mask.
+ */
+#define CY_OTA_CB_REASON_MASK(reason)       ( 1UL << (uint32_t)(reason) )
+
+/**
+ * @brief Bit for an OTA Agent state in @ref cy_ota_agent_params_t::cb_state_mask.
+ */
+#define CY_OTA_CB_STATE_MASK(state)         ( 1UL << (uint32_t)(state) )
+
+/**
+ * @brief Callback masks value to call the callback for all reasons or states.
+ */
+#define CY_OTA_CB_MASK_ALL                  (0)
+
 /**
  * @brief Creates and open new receive file for the data chunks as they come in.
  *
@@ -997,6 +1163,8 @@ typedef cy_rslt_t ( * cy_ota_file_read ) ( cy_ota_storage_context_t *storage_ptr
  * @brief Write a data to the flash at the given offset.
  *
  * @note ota-update library expects user to implement this callback function.
+ * @note With CY_OTA_HTTP_PARALLEL_CONNECTIONS > 1 or CY_OTA_STORAGE_WRITER_BUFFERS,
+ *       this is called from an OTA worker thread, one call at a time.
  *
  * @param[in]   storage_ptr     Pointer to the OTA Agent storage context @ref cy_ota_storage_context_t
  * @param[in]   chunk_info      Pointer to the chunk information which includes buffer, length, and offset.
@@ -1025,6 +1193,10 @@ typedef cy_rslt_t ( * cy_ota_file_close ) ( cy_ota_storage_context_t *storage_pt
  *
  * @note Authentication method is user choice.
  *
+ * @note When storage_ptr->image_digest_flags is not 0, image_sha256 and/or image_crc32 hold the
+ *       digest of the whole OTA Image computed while it was written, so the OTA Image does not
+ *       need to be read back to compute it (see CY_OTA_IMAGE_DIGEST_SHA256).
+ *
  * @param[in]   storage_ptr     Pointer to the OTA Agent storage context @ref cy_ota_storage_context_t
  *
  * @return      CY_RSLT_SUCCESS
@@ -1073,6 +1245,110 @@ typedef cy_rslt_t ( * cy_ota_file_validate ) ( uint16_t app_id );
  */
 typedef cy_rslt_t ( * cy_ota_file_get_app_info ) ( uint16_t slot_id, uint16_t image_num, cy_ota_app_info_t *app_info );
 
+/**
+ * @brief Save the download checkpoint to persistent storage.
+ *
+ * @note This callback is optional. Set to NULL if download resume is not used.
+ *
+ * @param[in]   storage_ptr     Pointer to the OTA Agent storage context @ref cy_ota_storage_context_t
+ * @param[in]   checkpoint      Pointer to the checkpoint to save @ref cy_ota_checkpoint_t
+ *
+ * @return      CY_RSLT_SUCCESS
+ *              CY_RSLT_OTA_ERROR_WRITE_STORAGE
+ */
+typedef cy_rslt_t ( * cy_ota_file_checkpoint_save ) ( cy_ota_storage_context_t *storage_ptr, const cy_ota_checkpoint_t *checkpoint );
+
+/**
+ * @brief Load the download checkpoint from persistent storage.
+ *
+ * @note This callback is optional. Set to NULL if download resume is not used.
+ *
+ * @param[in]   storage_ptr     Pointer to the OTA Agent storage context @ref cy_ota_storage_context_t
+ * @param[out]  checkpoint      Pointer to the checkpoint to fill in @ref cy_ota_checkpoint_t
+ *
+ * @return      CY_RSLT_SUCCESS
+ *              CY_RSLT_OTA_ERROR_READ_STORAGE - no checkpoint saved
+ */
+typedef cy_rslt_t ( * cy_ota_file_checkpoint_load ) ( cy_ota_storage_context_t *storage_ptr, cy_ota_checkpoint_t *checkpoint );
+
+/**
+ * @brief Re-open the receive file to continue a download from a checkpoint.
+ *
+ * @note This callback is optional. Set to NULL if download resume is not used.
+ *
+ * @note Unlike @ref cy_ota_file_open, the data before offset must NOT be erased.
+ *
+ * @param[in]   storage_ptr     Pointer to the OTA Agent storage context @ref cy_ota_storage_context_t
+ * @param[in]   offset          Bytes [0, offset) of the OTA Image are already in storage.
+ *
+ * @return      CY_RSLT_SUCCESS
+ *              CY_RSLT_OTA_ERROR_OPEN_STORAGE
+ */
+typedef cy_rslt_t ( * cy_ota_file_resume ) ( cy_ota_storage_context_t *storage_ptr, uint32_t offset );
+
+/**
+ * @brief Open the receive file without erasing it.
+ *
+ * @note This callback is optional. Set to NULL to erase in @ref cy_ota_file_open.
+ *
+ * @note Used in place of @ref cy_ota_file_open when @ref cy_ota_file_erase is also provided.
+ *       The OTA Agent then erases storage a sector at a time, ahead of the data written.
+ *
+ * @param[in]   storage_ptr     Pointer to the OTA Agent storage context @ref cy_ota_storage_context_t
+ *
+ * @return      CY_RSLT_SUCCESS
+ *              CY_RSLT_OTA_ERROR_OPEN_STORAGE
+ */
+typedef cy_rslt_t ( * cy_ota_file_open_no_erase ) ( cy_ota_storage_context_t *storage_ptr );
+
+/**
+ * @brief Erase part of the receive file.
+ *
+ * @note This callback is optional. Set to NULL to erase in @ref cy_ota_file_open.
+ *
+ * @note offset and size are multiples of CY_OTA_STORAGE_SECTOR_SIZE. The range may extend
+ *       past the end of the OTA Image, anything past the end of the slot must be ignored.
+ *
+ * @param[in]   storage_ptr     Pointer to the OTA Agent storage context @ref cy_ota_storage_context_t
+ * @param[in]   offset          Offset of the first byte to erase.
+ * @param[in]   size            Number of bytes to erase.
+ *
+ * @return      CY_RSLT_SUCCESS
+ *              CY_RSLT_OTA_ERROR_WRITE_STORAGE
+ */
+typedef cy_rslt_t ( * cy_ota_file_erase ) ( cy_ota_storage_context_t *storage_ptr, uint32_t offset, uint32_t size );
+
+/**
+ * @brief Read the running application (primary slot).
+ *
+ * @note This callback is optional. Set to NULL if delta OTA images (CY_OTA_DELTA_UPDATE) are not used.
+ *
+ * @note Used to rebuild the new OTA image from a patch against the running application.
+ *       The offset is from the start of the application, as given to scripts/WiFi_Ethernet/ota_delta.py.
+ *
+ * @param[in]   storage_ptr     Pointer to the OTA Agent storage context @ref cy_ota_storage_context_t
+ * @param[in]   chunk_info      Pointer to the chunk information which includes buffer, length, and offset.
+ *
+ * @return      CY_RSLT_SUCCESS
+ *              CY_RSLT_OTA_ERROR_READ_STORAGE
+ */
+typedef cy_rslt_t ( * cy_ota_file_read_source ) ( cy_ota_storage_context_t *storage_ptr, cy_ota_storage_read_info_t *chunk_info );
+
+/**
+ * @brief Choose the image for a TAR archive member.
+ *
+ * @note This callback is optional. Set to NULL to assign members in archive order (CY_OTA_TAR_PARSER).
+ *
+ * @param[in]   storage_ptr     Pointer to the OTA Agent storage context @ref cy_ota_storage_context_t
+ * @param[in]   name            Member file name.
+ * @param[in]   size            Member size.
+ * @param[out]  imgID           Image to write the member to, 0 = skip the member.
+ *
+ * @return      CY_RSLT_SUCCESS
+ *              CY_RSLT_OTA_ERROR_UNSUPPORTED - reject the archive
+ */
+typedef cy_rslt_t ( * cy_ota_file_tar_member ) ( cy_ota_storage_context_t *storage_ptr, const char *name, uint32_t size, uint8_t *imgID );
+
 /** \} group_ota_callback */
 
 /**
@@ -1099,6 +1375,21 @@ typedef struct
     cy_ota_update_flow_t        use_get_job_flow;   /**< Job flow (CY_OTA_JOB_FLOW or CY_OTA_DIRECT_FLOW).   */
 } cy_ota_network_params_t;
 
+/**
+ * @brief CRC32 calculation function
+ *
+ * Used to replace the software CRC32 with a hardware CRC block.
+ * Must give the same CRC as the software (reflected polynomial 0xEDB88320,
+ * ~prev_crc32 on entry and ~crc32 on exit), so the CRC can be calculated piece by piece.
+ *
+ * @param[in]   prev_crc32  CRC of the data so far, 0 (CRC32_INITIAL_VALUE) to start.
+ * @param[in]   buffer      Pointer to the data.
+ * @param[in]   length      Length of the data.
+ *
+ * @return      CRC including this data.
+ */
+typedef uint32_t (*cy_ota_crc32_func_t)(uint32_t prev_crc32, const uint8_t *buffer, uint32_t length);
+
 /**
  * @brief OTA Agent parameters structure.
  *
@@ -1114,6 +1405,20 @@ typedef struct cy_ota_agent_params_s
 
     cy_ota_callback_t   cb_func;            /**< Notification callback function.                                */
     void                *cb_arg;            /**< Opaque argument passed to the notification callback function.  */
+
+    cy_ota_crc32_func_t crc32_func;         /**< Optional: Bluetooth® CRC32 calculation, ex: hardware CRC.
+                                             *   NULL = software CRC32 selected by CY_OTA_CRC32_ENGINE.         */
+
+    uint32_t    cb_reason_mask;             /**< Optional: CY_OTA_CB_REASON_MASK() bits of the reasons to call
+                                             *   cb_func for. CY_OTA_CB_MASK_ALL (0) = all reasons.             */
+    uint32_t    cb_state_mask;              /**< Optional: CY_OTA_CB_STATE_MASK() bits of the states to call
+                                             *   cb_func for. CY_OTA_CB_MASK_ALL (0) = all states.              */
+    cy_ota_write_callback_t write_cb_func;  /**< Optional: Called for each chunk instead of cb_func with
+                                             *   CY_OTA_STATE_STORAGE_WRITE. NULL = use cb_func.                */
+    cy_ota_callback_v2_t    cb_func_v2;     /**< Optional: Notification callback with borrowed data, used
+                                             *   instead of cb_func. Masks and cb_arg apply the same way.       */
+    bool        use_poll;                   /**< Optional: true = no OTA Agent thread, the Application calls
+                                             *   cy_ota_agent_poll() from its own loop (HTTP and MQTT only).    */
 } cy_ota_agent_params_t;
 
 /**
@@ -1132,6 +1437,13 @@ typedef struct cy_ota_storage_interface_s
     cy_ota_file_set_pending    ota_file_set_boot_pending; /**< To Mark the image in the inactive slot as pending. */
     cy_ota_file_validate       ota_file_validate;         /**< To validate current application.             */
     cy_ota_file_get_app_info   ota_file_get_app_info;     /**< To get application information.              */
+    cy_ota_file_checkpoint_save ota_file_checkpoint_save; /**< Optional: To save the download checkpoint.    */
+    cy_ota_file_checkpoint_load ota_file_checkpoint_load; /**< Optional: To load the download checkpoint.    */
+    cy_ota_file_resume         ota_file_resume;           /**< Optional: To re-open without erasing saved data. */
+    cy_ota_file_open_no_erase  ota_file_open_no_erase;    /**< Optional: To open without erasing, see ota_file_erase. */
+    cy_ota_file_erase          ota_file_erase;            /**< Optional: To erase storage ahead of the data written. */
+    cy_ota_file_read_source    ota_file_read_source;      /**< Optional: To read the running application for delta OTA images. */
+    cy_ota_file_tar_member     ota_file_tar_member;       /**< Optional: To choose the image for a TAR archive member. */
 } cy_ota_storage_interface_t;
 
 /** \} group_ota_structures */
@@ -1171,6 +1483,47 @@ cy_rslt_t cy_ota_agent_start(cy_ota_network_params_t *network_params,
                              cy_ota_storage_interface_t *storage_interface,
                              cy_ota_context_ptr *ctx_ptr);
 
+/**
+ * @brief Start the OTA Background Agent in memory provided by the Application.
+ *
+ * Same as cy_ota_agent_start(), but the OTA Agent context, all buffers used while
+ * downloading and the OTA Agent thread stacks (except with COMPONENT_THREADX, which
+ * has static stacks) are placed in memory instead of being allocated by the OTA Agent.
+ * The RTOS may still allocate for the events, mutexes, timers and queues (ex: FreeRTOS),
+ * and cy_http_client / cy_mqtt allocate their own memory for the connections.
+ * memory must stay valid until cy_ota_agent_stop() returns, which does not free it.
+ *
+ * @param[in]   network_params     Pointer to cy_ota_network_params_t.
+ * @param[in]   agent_params       Pointer to cy_ota_agent_params_t.
+ * @param[in]   storage_interface  Pointer to cy_ota_storage_interface_t.
+ * @param[in]   memory             Memory for the OTA Agent, 8 byte aligned (ex: a static uint64_t array).
+ * @param[in]   size               Size of memory, at least cy_ota_agent_memory_size().
+ * @param[out]  ctx_ptr            Handle to store the OTA Agent context structure pointer,
+ *                                 Which is used for other OTA calls.
+ *
+ * @return      CY_RSLT_SUCCESS
+ *              CY_RSLT_OTA_ERROR_BADARG
+ *              CY_RSLT_OTA_ERROR_OUT_OF_MEMORY
+ *              CY_RSLT_OTA_ERROR_ALREADY_STARTED
+ *              CY_RSLT_OTA_ERROR
+ */
+cy_rslt_t cy_ota_agent_start_static(cy_ota_network_params_t *network_params,
+                                    cy_ota_agent_params_t *agent_params,
+                                    cy_ota_storage_interface_t *storage_interface,
+                                    void *memory, uint32_t size,
+                                    cy_ota_context_ptr *ctx_ptr);
+
+/**
+ * @brief Get the size of the memory needed by cy_ota_agent_start_static().
+ *
+ * The size depends on the enabled transports (COMPONENT_OTA_HTTP, COMPONENT_OTA_MQTT,
+ * COMPONENT_OTA_BLUETOOTH) and the cy_ota_config.h buffer settings, not on the OTA Image.
+ * Define CY_OTA_AGENT_MEMORY_SIZE in cy_ota_config.h to check a static buffer when building.
+ *
+ * @return      Bytes needed.
+ */
+uint32_t cy_ota_agent_memory_size(void);
+
 /**
  * @brief Stop OTA Background Agent.
  *
@@ -1183,6 +1536,28 @@ cy_rslt_t cy_ota_agent_start(cy_ota_network_params_t *network_params,
  */
 cy_rslt_t cy_ota_agent_stop(cy_ota_context_ptr *ctx_ptr);
 
+/**
+ * @brief Run an OTA Agent started with agent_params->use_poll = true.
+ *
+ *  The OTA Agent does not have a thread; call this from the Application's loop.
+ *  While the OTA Agent waits for the next check it returns at once.
+ *  During an update it runs OTA Agent states until budget_ms has passed. The Data download
+ *  does one step per state run: one HTTP range request, or one MQTT event without waiting.
+ *  An MQTT connect subscribes on the run after the connection is made. Other states (HTTP connect,
+ *  Job download, etc.) and an HTTP range run to their end, so one call can take longer than budget_ms.
+ *  Call from the thread that calls cy_ota_agent_start() and cy_ota_agent_stop().
+ *
+ * @param[in]   ctx_ptr         Pointer to the OTA Agent context storage returned from @ref cy_ota_agent_start();
+ * @param[in]   budget_ms       Milliseconds to run states for, 0 = one state.
+ *
+ * @return      CY_RSLT_SUCCESS             - OTA Agent waiting for the next check
+ *              CY_RSLT_OTA_POLL_AGAIN      - update in progress, call again soon
+ *              CY_RSLT_OTA_EXITING
+ *              CY_RSLT_OTA_ERROR_BADARG
+ *              CY_RSLT_OTA_ERROR_UNSUPPORTED   - OTA Agent not started with use_poll, or Bluetooth(r)
+ */
+cy_rslt_t cy_ota_agent_poll(cy_ota_context_ptr ctx_ptr, uint32_t budget_ms);
+
 /**
  * @brief Check for OTA update availability and download update now.
  *
@@ -1225,15 +1600,64 @@ void cy_ota_set_log_level(CY_LOG_LEVEL_T level);
  */
 cy_rslt_t cy_ota_get_state(cy_ota_context_ptr ota_ptr, cy_ota_agent_state_t *ota_state);
 
+/**
+ * @brief Set which callbacks the Application receives.
+ *
+ * The OTA Agent does not fill in @ref cy_ota_cb_struct_t or call cb_func for other
+ * reasons or states, it does its default action (CY_OTA_CB_RSLT_OTA_CONTINUE).
+ * The masks can also be set in @ref cy_ota_agent_params_t when starting the OTA Agent.
+ *
+ * @param[in]  ota_ptr          Pointer to the OTA Agent context returned from @ref cy_ota_agent_start();
+ * @param[in]  reason_mask      CY_OTA_CB_REASON_MASK() bits, CY_OTA_CB_MASK_ALL for all reasons.
+ * @param[in]  state_mask       CY_OTA_CB_STATE_MASK() bits, CY_OTA_CB_MASK_ALL for all states.
+ *
+ * @result     CY_RSLT_SUCCESS
+ *             CY_RSLT_OTA_ERROR_BADARG
+ */
+cy_rslt_t cy_ota_set_callback_mask(cy_ota_context_ptr ota_ptr, uint32_t reason_mask, uint32_t state_mask);
+
+/**
+ * @brief Replace OTA Agent data from a @ref cy_ota_callback_v2_t callback.
+ *
+ * Call only from the callback. The changes are taken in the same states as the
+ * changes made to @ref cy_ota_cb_struct_t by a @ref cy_ota_callback_t callback.
+ *
+ * @param[in]  ota_ptr          Pointer to the OTA Agent context, cy_ota_cb_struct_v2_t::ota_ptr.
+ * @param[in]  field            Data to replace @ref cy_ota_cb_override_t.
+ * @param[in]  value            String, connection or credentials, see @ref cy_ota_cb_override_t.
+ * @param[in]  length           Length of a string value, without the terminating NUL.
+ *
+ * @result     CY_RSLT_SUCCESS
+ *             CY_RSLT_OTA_ERROR_BADARG
+ *             CY_RSLT_OTA_ERROR_GENERAL      - not called from the callback
+ *             CY_RSLT_OTA_ERROR_UNSUPPORTED  - field is not used in this state or connection
+ */
+cy_rslt_t cy_ota_callback_override(cy_ota_context_ptr ota_ptr, cy_ota_cb_override_t field, const void *value, uint32_t length);
+
 /**
  * @brief Get the last OTA error.
  *
  * The last error value is persistent, and can be queried after @ref cy_ota_agent_stop().
+ * With more than one OTA Agent running (CY_OTA_MAX_AGENTS > 1), this is the last error of any of them,
+ *  use @ref cy_ota_get_agent_last_error() while the OTA Agent is running.
  *
  * @result the last error that occurred (see cy_rslt_t).
  */
 cy_rslt_t cy_ota_get_last_error(void);
 
+/**
+ * @brief Get the last error of one OTA Agent.
+ *
+ * Can be called while the OTA Agent runs, including from its callback.
+ *
+ * @param[in]   ctx_ptr     - pointer to OTA agent context @ref cy_ota_context_ptr
+ * @param[out]  error       - last error of this OTA Agent (see cy_rslt_t)
+ *
+ * @result  CY_RSLT_SUCCESS
+ *          CY_RSLT_OTA_ERROR_BADARG
+ */
+cy_rslt_t cy_ota_get_agent_last_error(cy_ota_context_ptr ctx_ptr, cy_rslt_t *error);
+
 /**
  * @brief Get a string representation of the error.
  *
@@ -1332,6 +1756,50 @@ cy_rslt_t cy_ota_update_image_set_pending(cy_ota_context_ptr ctx_ptr);
  */
 cy_rslt_t cy_ota_update_abort(cy_ota_context_ptr ctx_ptr);
 
+/**
+ * @brief Calculate a CRC32 with the engine selected by CY_OTA_CRC32_ENGINE
+ *
+ * Same CRC as used to check Bluetooth® downloads, can be called piece by piece.
+ *
+ * @param[in]   prev_crc32  CRC of the data so far, 0 to start.
+ * @param[in]   buffer      Pointer to the data.
+ * @param[in]   length      Length of the data.
+ *
+ * @return      CRC including this data.
+ */
+uint32_t cy_ota_crc32_update(uint32_t prev_crc32, const uint8_t *buffer, uint32_t length);
+
+#if defined(CY_OTA_CRC32_BENCHMARK) || defined(CY_DOXYGEN)
+/**
+ * @brief Compare the speed of the CRC32 engines
+ *
+ * Logs the time (and cycles/byte if CY_OTA_CRC32_BENCHMARK_CPU_HZ is defined)
+ * for each engine, and checks that all engines give the same CRC.
+ *
+ * @param[in]   hw_func     Optional hardware CRC function to include, NULL to skip.
+ *
+ * @return      CY_RSLT_SUCCESS
+ *              CY_RSLT_OTA_ERROR_GENERAL - an engine gave a different CRC
+ */
+cy_rslt_t cy_ota_crc32_benchmark(cy_ota_crc32_func_t hw_func);
+#endif
+
+#if ( defined(CY_OTA_STATE_BENCHMARK) && (defined(COMPONENT_OTA_HTTP) || defined(COMPONENT_OTA_MQTT)) ) || defined(CY_DOXYGEN)
+/**
+ * @brief Measure the OTA Agent overhead for each state transition
+ *
+ * Runs each state of the OTA Agent state machine with a state function that does nothing,
+ * and logs the time (and cycles/transition if CY_OTA_STATE_BENCHMARK_CPU_HZ is defined).
+ * Call before cy_ota_agent_start() or after cy_ota_agent_stop(), ex: on a host build.
+ *
+ * @param[in]   cb_func     Optional Application callback to include, NULL to skip.
+ *
+ * @return      CY_RSLT_SUCCESS
+ *              CY_RSLT_OTA_ERROR_ALREADY_STARTED - the OTA Agent is running
+ */
+cy_rslt_t cy_ota_state_benchmark(cy_ota_callback_t cb_func);
+#endif
+
 #if defined(COMPONENT_OTA_BLUETOOTH) || defined(CY_DOXYGEN)
 /**
  * @brief Prepare for OTA Download
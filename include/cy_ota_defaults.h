@@ -180,6 +180,258 @@ extern "C" {
 #define CY_OTA_MAX_DOWNLOAD_TRIES               (3)         /* 3 download OTA image retries. */
 #endif
 
+/**
+ * @brief Download progress between saved checkpoints.
+ *
+ * When the storage interface provides the optional checkpoint functions,
+ * the OTA Agent saves a @ref cy_ota_checkpoint_t each time this many more
+ * contiguous bytes of the OTA Image have been written.
+ * A smaller value re-downloads less after a reset, at the cost of more
+ * writes to the checkpoint storage.
+ */
+#ifndef CY_OTA_CHECKPOINT_INTERVAL
+#define CY_OTA_CHECKPOINT_INTERVAL              (64 * 1024)  /* Save every 64k bytes. */
+#endif
+
+/**
+ * @brief Number of chunk buffers for the storage writer thread.
+ *
+ * 0 - Data is written to storage on the network thread as it is received.
+ * 2 or more - Received data is copied into one of these CY_OTA_CHUNK_SIZE buffers
+ *     and written to storage by a separate thread, so receiving the next chunk
+ *     overlaps writing the current one. When all buffers are waiting to be written,
+ *     the network thread waits for the writer (backpressure).
+ *
+ * NOTE: With the writer thread, the CY_OTA_STATE_STORAGE_WRITE callback is
+ *       called from the writer thread. bytes_written and percentage in the
+ *       callbacks count only the chunks the writer has stored. Not used with use_poll.
+ */
+#ifndef CY_OTA_STORAGE_WRITER_BUFFERS
+#define CY_OTA_STORAGE_WRITER_BUFFERS           (0)          /* Write on the network thread. */
+#endif
+
+/**
+ * @brief FLASH program (page) size used to align writes to storage.
+ *
+ * Writes collected by the OTA Agent start and end on a multiple of this size,
+ * so the storage layer does not need to read-modify-write partial pages.
+ */
+#ifndef CY_OTA_STORAGE_PAGE_SIZE
+#define CY_OTA_STORAGE_PAGE_SIZE                (512)
+#endif
+
+/**
+ * @brief Size of the storage write coalescing buffer.
+ *
+ * 0 - Each received chunk is passed to ota_file_write() as it arrives.
+ * Otherwise - Contiguous data is collected in a buffer of this size and passed to
+ *     ota_file_write() in writes that end on a CY_OTA_STORAGE_PAGE_SIZE boundary.
+ *     The tail is written when the download finishes (Bluetooth: at verify).
+ *     Must be a multiple of CY_OTA_STORAGE_PAGE_SIZE.
+ */
+#ifndef CY_OTA_STORAGE_COALESCE_SIZE
+#define CY_OTA_STORAGE_COALESCE_SIZE            (0)
+#endif
+
+/**
+ * @brief FLASH erase (sector) size used for erase-ahead.
+ */
+#ifndef CY_OTA_STORAGE_SECTOR_SIZE
+#define CY_OTA_STORAGE_SECTOR_SIZE              (4096)
+#endif
+
+/**
+ * @brief How far ahead of the data written to erase storage.
+ *
+ * Only used when the storage interface provides ota_file_open_no_erase() and ota_file_erase().
+ * Storage under a write is always erased first. Writes that do not need that erase one more
+ * sector, until storage is erased this many bytes past the data written. No write waits for
+ * more than one erase once storage is erased ahead.
+ *
+ * 0 - Do not use erase-ahead, ota_file_open() erases the slot.
+ */
+#ifndef CY_OTA_STORAGE_ERASE_AHEAD_SIZE
+#define CY_OTA_STORAGE_ERASE_AHEAD_SIZE         (4 * CY_OTA_STORAGE_SECTOR_SIZE)
+#endif
+
+/**
+ * @brief Compute the SHA-256 of the OTA Image while it is written.
+ *
+ * 1 - The digest is passed to ota_file_verify() in cy_ota_storage_context_t image_sha256,
+ *     so verify does not need to read the OTA Image back from storage.
+ *     Data written out of order is read back once with ota_file_read() when the data
+ *     before it has been written. Without ota_file_read(), no digest is passed.
+ */
+#ifndef CY_OTA_IMAGE_DIGEST_SHA256
+#define CY_OTA_IMAGE_DIGEST_SHA256              (0)
+#endif
+
+/**
+ * @brief Compute the CRC32 of the OTA Image while it is written.
+ *
+ * 1 - Passed to ota_file_verify() in cy_ota_storage_context_t image_crc32.
+ *     See CY_OTA_IMAGE_DIGEST_SHA256.
+ */
+#ifndef CY_OTA_IMAGE_DIGEST_CRC32
+#define CY_OTA_IMAGE_DIGEST_CRC32               (0)
+#endif
+
+/**
+ * @brief Compressed OTA Image formats for CY_OTA_DECOMPRESS
+ */
+#define CY_OTA_DECOMPRESS_NONE                  (0)         /**< Compressed OTA Images not supported        */
+#define CY_OTA_DECOMPRESS_LZSS                  (1)         /**< LZSS, heatshrink bit stream                */
+
+/**
+ * @brief Compressed OTA Image support.
+ *
+ * CY_OTA_DECOMPRESS_LZSS - An OTA Image packaged with scripts/WiFi_Ethernet/ota_compress.py
+ *     is decoded as it is received and written to storage uncompressed. Uncompressed
+ *     OTA Images are still accepted, the first 4 bytes of the OTA Image tell them apart
+ *     and must arrive before any later data.
+ *
+ * NOTE: Compressed data must reach storage in order: use a single HTTP connection,
+ *       or MQTT with CY_OTA_MQTT_REASSEMBLY_SIZE. A compressed download is not resumed
+ *       from a checkpoint.
+ */
+#ifndef CY_OTA_DECOMPRESS
+#define CY_OTA_DECOMPRESS                       (CY_OTA_DECOMPRESS_NONE)
+#endif
+
+/**
+ * @brief Largest LZSS window accepted, in bits.
+ *
+ * The window (2^bits bytes) plus CY_OTA_STORAGE_PAGE_SIZE is allocated while
+ * a compressed OTA Image is downloaded.
+ */
+#ifndef CY_OTA_DECOMPRESS_WINDOW_BITS_MAX
+#define CY_OTA_DECOMPRESS_WINDOW_BITS_MAX       (11)
+#endif
+
+/**
+ * @brief Delta (patch) OTA Image support.
+ *
+ * 1 - An OTA Image packaged with scripts/WiFi_Ethernet/ota_delta.py is a patch against
+ *     the running application. The new application is rebuilt from the patch and the
+ *     running application, read through ota_file_read_source(), as the patch is received.
+ *     Full OTA Images are still accepted, the first 4 bytes of the OTA Image tell them
+ *     apart and must arrive before any later data.
+ *
+ * NOTE: Patch data must reach storage in order (see CY_OTA_DECOMPRESS). A patch download
+ *       is not resumed from a checkpoint.
+ */
+#ifndef CY_OTA_DELTA_UPDATE
+#define CY_OTA_DELTA_UPDATE                     (0)
+#endif
+
+/**
+ * @brief TAR archive parsing in the OTA Agent.
+ *
+ * 0 - A TAR archive is passed to ota_file_write() as received, the storage
+ *     interface finds the images in it (ota_is_tar_archive). Use HTTP.
+ * 1 - The OTA Agent splits a TAR archive as it is received and writes each member
+ *     to the slot of its image (imgID) at offsets from the start of the member.
+ *     Members are assigned by ota_file_tar_member(), or in archive order, skipping
+ *     "*.json" files. Other OTA Images are written as received.
+ */
+#ifndef CY_OTA_TAR_PARSER
+#define CY_OTA_TAR_PARSER                       (0)
+#endif
+
+/**
+ * @brief Size of the TAR archive reorder buffer.
+ *
+ * The archive is parsed in order. Data arriving ahead of the next byte to parse
+ * (ex: MQTT) is held in this buffer until the gap is filled.
+ * 0 - Archive data must arrive in order.
+ */
+#ifndef CY_OTA_TAR_REORDER_SIZE
+#define CY_OTA_TAR_REORDER_SIZE                 (8 * 1024)
+#endif
+
+/**
+ * @brief Verify each image as soon as its TAR archive member is complete.
+ *
+ * 1 - ota_file_verify() is called for the member's imgID when the member is complete,
+ *     a bad image stops the download. Images already verified are not verified again
+ *     after the download.
+ * 0 - All images are verified after the download.
+ */
+#ifndef CY_OTA_TAR_VERIFY_MEMBERS
+#define CY_OTA_TAR_VERIFY_MEMBERS               (1)
+#endif
+
+/**
+ * @brief CRC32 implementations for CY_OTA_CRC32_ENGINE
+ */
+#define CY_OTA_CRC32_ENGINE_BITWISE             (0)         /**< One bit at a time, no table                */
+#define CY_OTA_CRC32_ENGINE_TABLE               (1)         /**< One byte at a time, 1 KB table in FLASH    */
+#define CY_OTA_CRC32_ENGINE_SLICE_BY_4          (2)         /**< Four bytes at a time, 4 KB of tables       */
+#define CY_OTA_CRC32_ENGINE_SLICE_BY_8          (3)         /**< Eight bytes at a time, 8 KB of tables      */
+
+/**
+ * @brief CRC32 implementation used to check Bluetooth® downloads.
+ *
+ * All engines give the same CRC. To use a hardware CRC block instead,
+ * set cy_ota_agent_params_t::crc32_func.
+ */
+#ifndef CY_OTA_CRC32_ENGINE
+#define CY_OTA_CRC32_ENGINE                     CY_OTA_CRC32_ENGINE_TABLE
+#endif
+
+/**
+ * @brief Define CY_OTA_CRC32_BENCHMARK to build cy_ota_crc32_benchmark().
+ *
+ * The benchmark runs each CRC32 engine over CY_OTA_CRC32_BENCHMARK_LOOPS passes of a
+ * CY_OTA_CRC32_BENCHMARK_BUFFER_SIZE buffer. Define CY_OTA_CRC32_BENCHMARK_CPU_HZ
+ * (ex: to the CPU clock frequency) to also log cycles/byte.
+ *
+ * The best CY_OTA_CRC32_ENGINE depends on the target's flash wait states and cache, so
+ * the benchmark is run on the target, next to the optional hardware CRC. Only
+ * cy_ota_crc32.c builds all the engines at once, so that is where it lives.
+ */
+#ifndef CY_OTA_CRC32_BENCHMARK_LOOPS
+#define CY_OTA_CRC32_BENCHMARK_LOOPS            (256)
+#endif
+
+/**
+ * @brief Size of the buffer used by cy_ota_crc32_benchmark().
+ */
+#ifndef CY_OTA_CRC32_BENCHMARK_BUFFER_SIZE
+#define CY_OTA_CRC32_BENCHMARK_BUFFER_SIZE      (4096)
+#endif
+
+/**
+ * @brief Keep the cy_ota_cb_struct_t callback (cy_ota_agent_params_t::cb_func).
+ *
+ * Set to 0 when the Application uses cb_func_v2 only, to remove the copy of
+ * the callback data (1.6 KB with HTTP, MQTT and the default buffer sizes) from the OTA Agent context.
+ */
+#ifndef CY_OTA_CALLBACK_V1
+#define CY_OTA_CALLBACK_V1                      (1)
+#endif
+
+/**
+ * @brief Define CY_OTA_STATE_BENCHMARK to build cy_ota_state_benchmark().
+ *
+ * The benchmark runs each OTA Agent state CY_OTA_STATE_BENCHMARK_LOOPS times, with the
+ * state function replaced so only the OTA Agent overhead is timed. Define
+ * CY_OTA_STATE_BENCHMARK_CPU_HZ (ex: to the CPU clock frequency) to also log cycles/transition.
+ *
+ * The state table and the loop that runs it are private to cy_ota_agent.c, so the
+ * benchmark is built there. Leave CY_OTA_STATE_BENCHMARK undefined in production builds.
+ */
+#ifndef CY_OTA_STATE_BENCHMARK_LOOPS
+#define CY_OTA_STATE_BENCHMARK_LOOPS            (10000)
+#endif
+
+/*
+ * Define CY_OTA_AGENT_MEMORY_SIZE to the size of the memory passed to cy_ota_agent_start_static().
+ *
+ * The OTA Agent then fails to build if CY_OTA_AGENT_MEMORY_SIZE is smaller than
+ * cy_ota_agent_memory_size() for the enabled transports and features.
+ */
+
 /**
  * @brief HTTP timeout for sending messages
  *
@@ -197,6 +449,103 @@ extern "C" {
 #define CY_OTA_HTTP_TIMEOUT_RECEIVE             (3000)         /* 3 second receive timeout. */
 #endif
 
+/**
+ * @brief HTTP data download pipeline depth.
+ *
+ * Number of CY_OTA_CHUNK_SIZE chunks requested from the server with a single
+ * ranged GET on the keep-alive connection. The response body is consumed in order
+ * and handed to storage one CY_OTA_CHUNK_SIZE chunk at a time, so the storage layer
+ * sees the same write sizes as with a depth of 1, while the round trip to the
+ * server is paid once per CY_OTA_HTTP_PIPELINE_DEPTH chunks.
+ *
+ * NOTE: The HTTP receive buffer grows to (CY_OTA_CHUNK_SIZE * CY_OTA_HTTP_PIPELINE_DEPTH).
+ *       Use 1 to get the original one-chunk-per-request behavior.
+ */
+#ifndef CY_OTA_HTTP_PIPELINE_DEPTH
+#define CY_OTA_HTTP_PIPELINE_DEPTH              (1)            /* 1 chunk per request. */
+#endif
+
+/**
+ * @brief Use a single streaming GET for the HTTP data download.
+ *
+ * When set to 1, the OTA Agent requests the whole OTA Image with one GET and streams
+ * the response body through the chunk buffer straight into storage as it arrives.
+ * Ranged requests (see CY_OTA_HTTP_PIPELINE_DEPTH) are only used to resume the
+ * download from the last written offset if the stream fails part way.
+ *
+ * NOTE: Not used when the Application passes in the HTTP connection, or with use_poll.
+ */
+#ifndef CY_OTA_HTTP_USE_STREAMING_GET
+#define CY_OTA_HTTP_USE_STREAMING_GET           (0)            /* Use ranged requests. */
+#endif
+
+/**
+ * @brief Number of consecutive receive timeouts before a streaming GET is abandoned.
+ *
+ * Each timeout is CY_OTA_HTTP_TIMEOUT_RECEIVE milliseconds long.
+ */
+#ifndef CY_OTA_HTTP_STREAM_MAX_IDLE_RECEIVES
+#define CY_OTA_HTTP_STREAM_MAX_IDLE_RECEIVES    (5)
+#endif
+
+/**
+ * @brief Number of parallel HTTP connections used for the data download.
+ *
+ * When larger than 1, the OTA Agent opens (CY_OTA_HTTP_PARALLEL_CONNECTIONS - 1) additional
+ * connections to the data server once the OTA Image size is known, and fetches disjoint
+ * ranges of the OTA Image concurrently. Each range is written at its own offset.
+ * Ranges that could not be fetched are filled in afterwards on the main connection.
+ *
+ * NOTE: Each additional connection uses a worker thread and a receive buffer
+ *       of (CY_OTA_CHUNK_SIZE * CY_OTA_HTTP_PIPELINE_DEPTH) + CY_OTA_CHUNK_HEADER_SIZE bytes
+ *       allocated for the duration of the download. Not used with use_poll.
+ *
+ * NOTE: The storage interface functions and the CY_OTA_STATE_STORAGE_WRITE callback
+ *       are called from the worker threads as well as the OTA Agent thread.
+ *       The calls are serialized, but must not depend on the calling thread.
+ */
+#ifndef CY_OTA_HTTP_PARALLEL_CONNECTIONS
+#define CY_OTA_HTTP_PARALLEL_CONNECTIONS        (1)            /* Single connection. */
+#endif
+
+/**
+ * @brief Adapt the HTTP range size to the link at runtime.
+ *
+ * 0 - Every ranged GET asks for (CY_OTA_CHUNK_SIZE * CY_OTA_HTTP_PIPELINE_DEPTH) bytes.
+ * 1 - The range size starts at CY_OTA_HTTP_RANGE_SIZE_MIN and is adjusted after each
+ *     request, like TCP slow-start: it doubles while requests complete faster than
+ *     CY_OTA_HTTP_RANGE_TARGET_MS, then grows by one chunk at a time. It is halved
+ *     when a request is slow, and drops back to the minimum when a request fails.
+ *
+ * NOTE: A receive buffer of up to CY_OTA_HTTP_RANGE_SIZE_MAX + CY_OTA_CHUNK_HEADER_SIZE bytes
+ *       is allocated for the duration of the download. If that is not available,
+ *       a smaller maximum is used.
+ */
+#ifndef CY_OTA_HTTP_ADAPTIVE_RANGE
+#define CY_OTA_HTTP_ADAPTIVE_RANGE              (0)            /* Fixed range size. */
+#endif
+
+/**
+ * @brief Smallest range size requested with CY_OTA_HTTP_ADAPTIVE_RANGE.
+ */
+#ifndef CY_OTA_HTTP_RANGE_SIZE_MIN
+#define CY_OTA_HTTP_RANGE_SIZE_MIN              (CY_OTA_CHUNK_SIZE)
+#endif
+
+/**
+ * @brief Largest range size requested with CY_OTA_HTTP_ADAPTIVE_RANGE.
+ */
+#ifndef CY_OTA_HTTP_RANGE_SIZE_MAX
+#define CY_OTA_HTTP_RANGE_SIZE_MAX              (64 * 1024)
+#endif
+
+/**
+ * @brief Target time for one ranged GET with CY_OTA_HTTP_ADAPTIVE_RANGE, in milliseconds.
+ */
+#ifndef CY_OTA_HTTP_RANGE_TARGET_MS
+#define CY_OTA_HTTP_RANGE_TARGET_MS             (1000)
+#endif
+
 /**********************************************************************
  * Message Defines
  **********************************************************************/
@@ -312,6 +661,28 @@ extern "C" {
 }"
 #endif
 
+/**
+ * @brief Device message to the Publisher to ask for the rest of a download with one request.
+ * *
+ * Used instead of CY_OTA_DOWNLOAD_REQUEST when resuming from a checkpoint.
+ * Used with sprintf() to insert the current version, UniqueTopicName and Offset at runtime.
+ * Override if required by defining in cy_ota_config.h.
+ */
+#ifndef CY_OTA_DOWNLOAD_RESUME_REQUEST
+#define CY_OTA_DOWNLOAD_RESUME_REQUEST \
+"{\
+\"Message\":\"Request Update\", \
+\"Manufacturer\": \"Express Widgits Corporation\", \
+\"ManufacturerID\": \"EWCO\", \
+\"ProductID\": \"Easy Widgit\", \
+\"SerialNumber\": \"ABC213450001\", \
+\"BoardName\": \"CY8CPROTO_062_4343W\", \
+\"Version\": \"%d.%d.%d\", \
+\"UniqueTopicName\": \"%s\", \
+\"Offset\": \"%ld\"\
+}"
+#endif
+
 /**
  * @brief Device message to the Publisher to ask for a chunk of data at a time.
  * *
@@ -335,6 +706,28 @@ extern "C" {
 }"
 #endif
 
+/**
+ * @brief Device JSON document to ask the Publisher to resend missing packets
+ *
+ * "Offset" is the offset the download started from (non-zero when resuming).
+ * "Packets" is a list of missing payload indices, ex: "3,7-9".
+ */
+#ifndef CY_OTA_DOWNLOAD_REPAIR_REQUEST
+#define CY_OTA_DOWNLOAD_REPAIR_REQUEST \
+"{\
+\"Message\":\"Request Repair\", \
+\"Manufacturer\": \"Express Widgits Corporation\", \
+\"ManufacturerID\": \"EWCO\", \
+\"ProductID\": \"Easy Widgit\", \
+\"SerialNumber\": \"ABC213450001\", \
+\"BoardName\": \"CY8CPROTO_062_4343W\", \
+\"Version\": \"%d.%d.%d\", \
+\"UniqueTopicName\": \"%s\", \
+\"Offset\": \"%ld\", \
+\"Packets\": \"%s\"\
+}"
+#endif
+
 /**
  * @brief Device JSON document to respond to the MQTT Publisher.
  *
@@ -390,6 +783,22 @@ extern "C" {
     "\r\n"
 #endif
 
+/**
+ * @brief HTTP GET streaming template.
+ *
+ * Used with sprintf() to create the GET request for the HTTP server
+ * when streaming the OTA Image from an offset to the end of the file.
+ * Override if required by defining in cy_ota_config.h.
+ */
+#ifndef CY_OTA_HTTP_GET_STREAM_TEMPLATE
+#define CY_OTA_HTTP_GET_STREAM_TEMPLATE \
+    "GET %s HTTP/1.1\r\n" \
+    "Host: %s:%d \r\n" \
+    "Range: bytes=%ld- \r\n" \
+    "Connection: close\r\n" \
+    "\r\n"
+#endif
+
 /**
  * @brief HTTP POST template.
  *
@@ -448,6 +857,116 @@ extern "C" {
 #define CY_OTA_MQTT_CLIENT_ID_PREFIX                "cy_device"
 #endif
 
+/**
+ * @brief Number of chunk requests outstanding when the Device requests each chunk separately.
+ *
+ * Only used when CY_MQTT_GET_ALL_DATA_WITH_ONE_CALL is not defined in cy_ota_mqtt.c.
+ * The Device keeps up to this many CY_OTA_DOWNLOAD_CHUNK_REQUEST messages outstanding
+ *  and requests the next chunk as each one is written.
+ * 1 = request the next chunk only after the previous one arrived.
+ */
+#ifndef CY_OTA_MQTT_CHUNK_WINDOW
+#define CY_OTA_MQTT_CHUNK_WINDOW                    (4)
+#endif
+
+/**
+ * @brief Number of received MQTT data payloads buffered for the OTA Agent thread.
+ *
+ * The MQTT receive callback only copies each data payload into one of these
+ *  buffers. The OTA Agent thread parses and writes it, so the MQTT library never
+ *  waits for a FLASH write. A payload that arrives while all buffers are full waits
+ *  up to CY_OTA_MQTT_RX_WAIT_MS for one, then it is dropped and requested again by the
+ *  repair phase (CY_OTA_MQTT_REPAIR_TRIES).
+ * Each buffer holds one payload (CY_OTA_CHUNK_SIZE plus the chunk header).
+ * Must be a power of 2.
+ */
+#ifndef CY_OTA_MQTT_RX_BUFFERS
+#define CY_OTA_MQTT_RX_BUFFERS                      (4)
+#endif
+
+/**
+ * @brief Milliseconds the MQTT receive callback waits for a free receive buffer.
+ *
+ * While it waits, the MQTT library does not read the socket, so the Broker is held
+ *  off instead of the payload being lost.
+ */
+#ifndef CY_OTA_MQTT_RX_WAIT_MS
+#define CY_OTA_MQTT_RX_WAIT_MS                      (5000)
+#endif
+
+/**
+ * @brief Size of the MQTT reassembly buffer.
+ *
+ * 0 - Each MQTT chunk is written at its offset when it arrives.
+ * Otherwise - Chunks are collected in a buffer of this size, starting at the first
+ *     byte of the OTA Image not yet written. Only contiguous data is written, ending
+ *     on a CY_OTA_STORAGE_PAGE_SIZE boundary (except at the end of the OTA Image),
+ *     so chunks the Broker delivers out of order do not cause scattered partial page
+ *     writes. A chunk that does not fit in the buffer is written directly.
+ *     Must be a multiple of CY_OTA_STORAGE_PAGE_SIZE and at least CY_OTA_CHUNK_SIZE.
+ */
+#ifndef CY_OTA_MQTT_REASSEMBLY_SIZE
+#define CY_OTA_MQTT_REASSEMBLY_SIZE                 (0)
+#endif
+
+/**
+ * @brief Largest number of MQTT packets in an OTA Image started with cy_ota_agent_start_static().
+ *
+ * The bit set of received packets has a fixed size in the caller's memory,
+ *  (CY_OTA_MQTT_STATIC_MAX_PACKETS + 31) / 32 * 4 bytes. A download with more
+ *  packets fails with CY_RSLT_OTA_ERROR_OUT_OF_MEMORY.
+ * Not used with cy_ota_agent_start(), the bit set is allocated for each download.
+ */
+#ifndef CY_OTA_MQTT_STATIC_MAX_PACKETS
+#define CY_OTA_MQTT_STATIC_MAX_PACKETS              (1024)
+#endif
+
+/**
+ * @brief Number of OTA Agents that can run at the same time.
+ *
+ * Each cy_ota_agent_start() or cy_ota_agent_start_static() gets its own context, connection,
+ *  storage interface and thread. cy_ota_agent_start() fails with CY_RSLT_OTA_ERROR_ALREADY_STARTED
+ *  when this many are running. Start and stop the OTA Agents from one Application thread.
+ * With COMPONENT_THREADX, each OTA Agent has its own static thread stacks, otherwise they
+ *  are in the memory passed to cy_ota_agent_start_static(), or allocated by the RTOS.
+ */
+#ifndef CY_OTA_MAX_AGENTS
+#define CY_OTA_MAX_AGENTS                           (1)
+#endif
+
+/**
+ * @brief Number of times to ask the Publisher to resend missing packets.
+ *
+ * When packets are missing at the end of the download, or no packet arrives
+ *  within the packet timeout, the Device sends CY_OTA_DOWNLOAD_REPAIR_REQUEST
+ *  listing only the missing packets instead of failing the whole download.
+ * The next repair is sent once the packets of the last one are in, or after
+ *  CY_OTA_MQTT_REPAIR_TIMEOUT_SECS, until no packet is missing. This is the number
+ *  of repairs in a row that do not get any missing packet before the download fails.
+ * 0 = no repair, fail the download.
+ */
+#ifndef CY_OTA_MQTT_REPAIR_TRIES
+#define CY_OTA_MQTT_REPAIR_TRIES                    (3)
+#endif
+
+/**
+ * @brief Size of the list of missing packets in one repair request.
+ *
+ * Missing packets that do not fit are requested in the next repair.
+ */
+#ifndef CY_OTA_MQTT_REPAIR_LIST_SIZE
+#define CY_OTA_MQTT_REPAIR_LIST_SIZE                (128)
+#endif
+
+/**
+ * @brief Seconds to wait for the packets of a repair request before sending the next one.
+ *
+ * Used instead of the packet timeout while repairing, when shorter.
+ */
+#ifndef CY_OTA_MQTT_REPAIR_TIMEOUT_SECS
+#define CY_OTA_MQTT_REPAIR_TIMEOUT_SECS             (5)
+#endif
+
 /** \} group_ota_typedefs */
 
 #ifdef __cplusplus
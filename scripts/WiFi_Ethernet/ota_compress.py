@@ -0,0 +1,184 @@
+#
+#   Package an OTA Image for a device built with CY_OTA_DECOMPRESS=CY_OTA_DECOMPRESS_LZSS.
+#
+#   The output is served by the HTTP server or publisher.py in place of the OTA Image.
+#   The device decodes it as it is received, storage gets the original OTA Image.
+#
+#   usage:
+#       python ota_compress.py <ota_image.bin> <ota_image.bin.z> [-w <window_bits>] [-l <lookahead_bits>]
+#
+#   -w  Window bits, 2^bits bytes of history (default 10).
+#       Must be <= CY_OTA_DECOMPRESS_WINDOW_BITS_MAX on the device.
+#   -l  Lookahead bits, longest match 2^bits bytes (default 4).
+#
+#   Compressed OTA Image:
+#       "OTAZ", version (1), algorithm (1 = LZSS), window_bits, lookahead_bits,
+#       uncompressed size (4 bytes little endian), then the LZSS bit stream
+#       (MSB first, heatshrink format):
+#           1 + 8 bits                      literal byte
+#           0 + window_bits + lookahead_bits    offset - 1, length - 1
+#
+
+import struct
+import sys
+
+MAGIC = b"OTAZ"
+VERSION = 1
+ALGORITHM_LZSS = 1
+
+DEFAULT_WINDOW_BITS = 10
+DEFAULT_LOOKAHEAD_BITS = 4
+
+# Candidates checked per position, more is slower but compresses better
+MAX_CHAIN = 64
+
+
+class BitWriter:
+    def __init__(self):
+        self.out = bytearray()
+        self.bits = 0
+        self.nbits = 0
+
+    def put(self, value, count):
+        self.bits = (self.bits << count) | value
+        self.nbits += count
+        while self.nbits >= 8:
+            self.nbits -= 8
+            self.out.append((self.bits >> self.nbits) & 0xFF)
+        self.bits &= (1 << self.nbits) - 1
+
+    def flush(self):
+        if self.nbits > 0:
+            self.out.append((self.bits << (8 - self.nbits)) & 0xFF)
+            self.bits = 0
+            self.nbits = 0
+        return bytes(self.out)
+
+
+def compress(data, window_bits, lookahead_bits):
+    window = 1 << window_bits
+    max_len = 1 << lookahead_bits
+    # A back reference must be shorter than the literals it replaces
+    min_len = (1 + window_bits + lookahead_bits) // 9 + 1
+
+    writer = BitWriter()
+    chains = {}
+    pos = 0
+    size = len(data)
+
+    def remember(p):
+        if p + 2 < size:
+            chains.setdefault(data[p:p + 3], []).append(p)
+
+    while pos < size:
+        best_len = 0
+        best_off = 0
+        if pos + 2 < size:
+            candidates = chains.get(data[pos:pos + 3], [])
+            limit = min(max_len, size - pos)
+            for cand in reversed(candidates[-MAX_CHAIN:]):
+                off = pos - cand
+                if off > window:
+                    break
+                length = 3
+                while length < limit and data[cand + length] == data[pos + length]:
+                    length += 1
+                if length > best_len:
+                    best_len = length
+                    best_off = off
+                    if length == limit:
+                        break
+        if best_len >= min_len:
+            writer.put(0, 1)
+            writer.put(best_off - 1, window_bits)
+            writer.put(best_len - 1, lookahead_bits)
+            for p in range(pos, pos + best_len):
+                remember(p)
+            pos += best_len
+        else:
+            writer.put(1, 1)
+            writer.put(data[pos], 8)
+            remember(pos)
+            pos += 1
+
+    header = MAGIC + struct.pack("<BBBBI", VERSION, ALGORITHM_LZSS, window_bits, lookahead_bits, size)
+    return header + writer.flush()
+
+
+def decompress(blob):
+    if blob[:4] != MAGIC:
+        raise ValueError("not a compressed OTA Image")
+    version, algorithm, window_bits, lookahead_bits, size = struct.unpack("<BBBBI", blob[4:12])
+    if version != VERSION or algorithm != ALGORITHM_LZSS:
+        raise ValueError("unsupported version {} algorithm {}".format(version, algorithm))
+    out = bytearray()
+    bits = 0
+    nbits = 0
+    stream = iter(blob[12:])
+
+    def get(count):
+        nonlocal bits, nbits
+        while nbits < count:
+            bits = (bits << 8) | next(stream)
+            nbits += 8
+        nbits -= count
+        value = (bits >> nbits) & ((1 << count) - 1)
+        bits &= (1 << nbits) - 1
+        return value
+
+    while len(out) < size:
+        if get(1):
+            out.append(get(8))
+        else:
+            off = get(window_bits) + 1
+            length = get(lookahead_bits) + 1
+            for _ in range(length):
+                out.append(out[-off])
+    return bytes(out[:size])
+
+
+def usage():
+    print("usage: python ota_compress.py <ota_image.bin> <output> [-w <window_bits>] [-l <lookahead_bits>]")
+    sys.exit(1)
+
+
+if __name__ == "__main__":
+    window_bits = DEFAULT_WINDOW_BITS
+    lookahead_bits = DEFAULT_LOOKAHEAD_BITS
+    files = []
+    i = 1
+    while i < len(sys.argv):
+        arg = sys.argv[i]
+        if arg == "-w" and i + 1 < len(sys.argv):
+            i += 1
+            window_bits = int(sys.argv[i])
+        elif arg == "-l" and i + 1 < len(sys.argv):
+            i += 1
+            lookahead_bits = int(sys.argv[i])
+        elif arg.startswith("-"):
+            usage()
+        else:
+            files.append(arg)
+        i += 1
+
+    if len(files) != 2:
+        usage()
+    if not (4 <= window_bits <= 15) or not (3 <= lookahead_bits < window_bits):
+        print("Need 4 <= window_bits <= 15 and 3 <= lookahead_bits < window_bits")
+        sys.exit(1)
+
+    with open(files[0], "rb") as f:
+        image = f.read()
+    if len(image) == 0:
+        print("Empty OTA Image")
+        sys.exit(1)
+
+    packed = compress(image, window_bits, lookahead_bits)
+    if decompress(packed) != image:
+        print("Internal error: round trip failed")
+        sys.exit(1)
+
+    with open(files[1], "wb") as f:
+        f.write(packed)
+    print("{}: {} -> {} bytes ({:.1f}%), window {} lookahead {}".format(
+        files[1], len(image), len(packed), 100.0 * len(packed) / len(image), 1 << window_bits, 1 << lookahead_bits))
@@ -0,0 +1,218 @@
+#
+#   Make a delta OTA Image (patch) for a device built with CY_OTA_DELTA_UPDATE=1.
+#
+#   The patch rebuilds <new_image.bin> from <base_image.bin>, the application running
+#   on the device. It is served by the HTTP server or publisher.py in place of the
+#   OTA Image, with "DeltaBase":"<base_version>" in the Job document.
+#   The device applies it as it is received, storage gets <new_image.bin>.
+#
+#   usage:
+#       python ota_delta.py <base_image.bin> <new_image.bin> <patch.bin> -b <base_version>
+#
+#   -b  Version of <base_image.bin>, "<major>.<minor>.<build>" (ex: "1.6.2").
+#
+#   The images are the application as read through ota_file_read_source() on the device,
+#   and the OTA Image as usual. Changed code is sent as ADD differences, which are
+#   mostly 0x00: compress the patch with ota_compress.py for the smallest download.
+#
+#   Delta OTA Image:
+#       "OTAD", version (1), reserved (0), base version (3 x 2 bytes little endian),
+#       source size, source CRC32, new image size (4 bytes little endian each),
+#       then operations until the new image is built:
+#           0, src_offset, length           copy from <base_image.bin>
+#           1, src_offset, length, diff[]   <base_image.bin> byte + diff byte (mod 256)
+#           2, length, data[]               new data
+#       src_offset and length are LEB128 varints.
+#
+
+import struct
+import sys
+import zlib
+
+MAGIC = b"OTAD"
+VERSION = 1
+
+OP_COPY = 0
+OP_ADD = 1
+OP_DATA = 2
+
+# Bytes hashed to find a match in the base image
+BLOCK = 8
+
+# Shortest COPY, shorter matches cost more than they save
+MIN_COPY = 12
+
+# An ADD is used when at least this part of the bytes are unchanged
+ADD_MATCH_PERCENT = 50
+
+
+def varint(value):
+    out = bytearray()
+    while True:
+        byte = value & 0x7F
+        value >>= 7
+        if value:
+            out.append(byte | 0x80)
+        else:
+            out.append(byte)
+            return bytes(out)
+
+
+def match_length(base, base_pos, new, new_pos):
+    limit = min(len(base) - base_pos, len(new) - new_pos)
+    length = 0
+    # compare in blocks first, then byte by byte
+    while length + 64 <= limit and base[base_pos + length:base_pos + length + 64] == new[new_pos + length:new_pos + length + 64]:
+        length += 64
+    while length < limit and base[base_pos + length] == new[new_pos + length]:
+        length += 1
+    return length
+
+
+def diff(base, new):
+    index = {}
+    for pos in range(len(base) - BLOCK, -1, -1):
+        index[base[pos:pos + BLOCK]] = pos
+
+    ops = bytearray()
+    pending = 0             # start of new data not covered yet
+    displacement = 0        # base offset - new offset of the last match
+
+    def flush_pending(end):
+        # new[pending:end] has no exact match, use ADD against the last match or DATA
+        if end <= pending:
+            return
+        src = pending + displacement
+        length = end - pending
+        if 0 <= src and src + length <= len(base):
+            same = sum(1 for i in range(length) if base[src + i] == new[pending + i])
+            if same * 100 >= length * ADD_MATCH_PERCENT:
+                ops.extend(bytes([OP_ADD]) + varint(src) + varint(length))
+                ops.extend(bytes((new[pending + i] - base[src + i]) & 0xFF for i in range(length)))
+                return
+        ops.extend(bytes([OP_DATA]) + varint(length))
+        ops.extend(new[pending:end])
+
+    pos = 0
+    while pos < len(new):
+        best_src = -1
+        best_len = 0
+        # Code moves as a whole, try where the last match continues first
+        src = pos + displacement
+        if 0 <= src < len(base):
+            best_len = match_length(base, src, new, pos)
+            best_src = src
+        if best_len < MIN_COPY and pos + BLOCK <= len(new):
+            cand = index.get(new[pos:pos + BLOCK])
+            if cand is not None:
+                length = match_length(base, cand, new, pos)
+                if length > best_len:
+                    best_len = length
+                    best_src = cand
+        if best_len >= MIN_COPY:
+            flush_pending(pos)
+            ops.extend(bytes([OP_COPY]) + varint(best_src) + varint(best_len))
+            displacement = best_src - pos
+            pos += best_len
+            pending = pos
+        else:
+            pos += 1
+    flush_pending(len(new))
+    return bytes(ops)
+
+
+def make_patch(base, new, base_version):
+    header = MAGIC + struct.pack("<BBHHHIII", VERSION, 0, base_version[0], base_version[1], base_version[2],
+                                 len(base), zlib.crc32(base) & 0xFFFFFFFF, len(new))
+    return header + diff(base, new)
+
+
+def apply_patch(base, patch):
+    if patch[:4] != MAGIC:
+        raise ValueError("not a delta OTA Image")
+    version, _, _, _, _, source_size, source_crc, size = struct.unpack("<BBHHHIII", patch[4:24])
+    if version != VERSION:
+        raise ValueError("unsupported version {}".format(version))
+    if source_size > len(base) or zlib.crc32(base[:source_size]) & 0xFFFFFFFF != source_crc:
+        raise ValueError("patch is for a different base image")
+    pos = 24
+
+    def get_varint():
+        nonlocal pos
+        value = 0
+        shift = 0
+        while True:
+            byte = patch[pos]
+            pos += 1
+            value |= (byte & 0x7F) << shift
+            shift += 7
+            if not byte & 0x80:
+                return value
+
+    out = bytearray()
+    while len(out) < size:
+        op = patch[pos]
+        pos += 1
+        if op == OP_DATA:
+            length = get_varint()
+            out.extend(patch[pos:pos + length])
+            pos += length
+        else:
+            src = get_varint()
+            length = get_varint()
+            if op == OP_COPY:
+                out.extend(base[src:src + length])
+            elif op == OP_ADD:
+                out.extend((base[src + i] + patch[pos + i]) & 0xFF for i in range(length))
+                pos += length
+            else:
+                raise ValueError("bad operation {}".format(op))
+    return bytes(out)
+
+
+def usage():
+    print("usage: python ota_delta.py <base_image.bin> <new_image.bin> <patch.bin> -b <base_version>")
+    sys.exit(1)
+
+
+if __name__ == "__main__":
+    base_version = None
+    files = []
+    i = 1
+    while i < len(sys.argv):
+        arg = sys.argv[i]
+        if arg == "-b" and i + 1 < len(sys.argv):
+            i += 1
+            try:
+                base_version = [int(part) for part in sys.argv[i].split(".")]
+            except ValueError:
+                usage()
+        elif arg.startswith("-"):
+            usage()
+        else:
+            files.append(arg)
+        i += 1
+
+    if len(files) != 3 or base_version is None:
+        usage()
+    if len(base_version) != 3 or not all(0 <= part <= 0xFFFF for part in base_version):
+        print("Base version must be <major>.<minor>.<build>")
+        sys.exit(1)
+
+    with open(files[0], "rb") as f:
+        base = f.read()
+    with open(files[1], "rb") as f:
+        new = f.read()
+    if len(base) == 0 or len(new) == 0:
+        print("Empty image")
+        sys.exit(1)
+
+    patch = make_patch(base, new, base_version)
+    if apply_patch(base, patch) != new:
+        print("Internal error: patch does not rebuild the new image")
+        sys.exit(1)
+
+    with open(files[2], "wb") as f:
+        f.write(patch)
+    print("{}: {} bytes, {:.1f}% of {} byte image, against {}".format(
+        files[2], len(patch), 100.0 * len(patch) / len(new), len(new), ".".join(str(part) for part in base_version)))
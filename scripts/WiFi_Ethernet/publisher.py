@@ -1,6 +1,7 @@
 import json
 import paho.mqtt.client as mqtt
 import os
+import queue
 import random
 import signal
 import struct
@@ -165,6 +166,7 @@ random.seed()
 #       "BoardName": "CY8CPROTO_062_4343W",
 #       "Version": "<software version>",
 #       "UniqueTopicName": "<my unique topic>",
+#       "Offset": "<offset>",   (optional - resume an interrupted download from this offset)
 #       ... other info as desired ...
 #   }
 #
@@ -182,6 +184,16 @@ random.seed()
 #       "Length":"4096"
 #   }
 #
+# To request the packets that did not arrive (payload indices, as runs)
+#
+#   {
+#       "Message": "Request Repair",
+#       ... Device info as above ...
+#       "UniqueTopicName": "<my unique topic>",
+#       "Offset":"0",               (offset the download started from)
+#       "Packets":"3,7-9"
+#   }
+#
 #==============================================================================
 # Debugging help
 #   To turn on logging, Set DEBUG_LOG to 1 (or use command line arg "-l")
@@ -220,6 +232,7 @@ UPDATE_AVAILABLE_REQUEST = "Update Availability"    # Device requests if there i
 SEND_UPDATE_REQUEST = "Request Update"              # Device requests Publisher send the OTA Image
 SEND_DIRECT_UPDATE = "Send Direct Update"           # Device sent Update Direct request
 SEND_CHUNK = "Request Data Chunk"                   # Device sent Request for a chunk of the data file
+SEND_REPAIR = "Request Repair"                      # Device sent Request to resend missing packets
 REPORTING_RESULT_SUCCESS = "Success"                # Device sends the OTA result Success
 REPORTING_RESULT_FAILURE = "Failure"                # Device sends the OTA result Failure
 
@@ -230,6 +243,7 @@ MSG_TYPE_RESULT_SUCCESS = 3         # Device sent REPORTING_RESULT_SUCCESS
 MSG_TYPE_RESULT_FAILURE = 4         # Device sent REPORTING_RESULT_FAILURE
 MSG_TYPE_SEND_DIRECT = 5            # Device sent SEND_DIRECT_UPDATE
 MSG_TYPE_SEND_CHUNK = 6             # Device sent SEND_CHUNK
+MSG_TYPE_SEND_REPAIR = 7            # Device sent SEND_REPAIR
 
 NO_AVAILABLE_REPONSE = "No Update Available"    # Publisher sends back to Device when no update available
 AVAILABLE_REPONSE = "Update Available"          # Publisher sends back to Device when update is available
@@ -360,9 +374,10 @@ def do_chunking(image_file, whole_file, file_offset, send_size):
     if ((image_size % send_size) != 0):
         pub_total_payloads += 1
 
+    # a whole file request may resume from an offset
+    offset = file_offset
+    payload_index = int(file_offset/send_size)
     if (whole_file == False):
-        offset = file_offset
-        payload_index = int(file_offset/send_size)
         if DEBUG_LOG:
             print("Send Image CHUNK offset: " + str(file_offset) + "Image size: " + str(image_size) + " idx: " + str(payload_index) )
     else:
@@ -512,6 +527,14 @@ def parse_incoming_request(message_string):
             print(" SUBSCRIBER ASKED FOR A SINGLE CHUNK !!!!!")
         return request,MSG_TYPE_SEND_CHUNK,unique_topic_name
 
+    if request == SEND_REPAIR:
+        #
+        # Resend the packets the Device is missing
+        #
+        if (DEBUG_LOG):
+            print(" SUBSCRIBER ASKED FOR MISSING PACKETS: " + request_json["Packets"])
+        return request,MSG_TYPE_SEND_REPAIR,unique_topic_name
+
     print("Could not understand the message!")
     return BAD_JSON_DOC,MSG_TYPE_ERROR,BAD_JSON_DOC
 # -----------------------------------------------------------
@@ -527,15 +550,80 @@ def on_send_publish(client, userdata, mid):
     client.publish_mid = mid
 
 
+# ---------------------------------------------------------
+#   Chunk request servicing
+#       A Device that requests each chunk separately keeps several
+#       requests outstanding (CY_OTA_MQTT_CHUNK_WINDOW on the Device).
+#       Requests for a unique topic are queued to one sender thread
+#       that keeps its MQTT connection open and publishes the chunks
+#       as the requests arrive.
+# ---------------------------------------------------------
+CHUNK_SENDER_IDLE_SECS = 30         # sender thread exits after this long without a request
+
+chunk_senders = {}                  # unique_topic -> queue of chunk requests
+chunk_senders_lock = threading.Lock()
+
+def queue_chunk_request(message_string, unique_topic):
+    with chunk_senders_lock:
+        request_queue = chunk_senders.get(unique_topic)
+        if request_queue is None:
+            request_queue = queue.Queue()
+            chunk_senders[unique_topic] = request_queue
+            # Create a new thread to send the data. This will allow for multiple, overlapping requests.
+            print("Publisher: Start Sending CHUNK Thread")
+            send_thread = threading.Thread(None, send_image_chunk_thread, None, args=(request_queue, unique_topic))
+            send_thread.start()
+        request_queue.put(message_string)
+
+# ---------------------------------------------------------
+#   requested_chunks()
+#       Return the list of (offset, size) chunks asked for by a
+#       "Request Data Chunk" or "Request Repair" message.
+#   job_dict    - the parsed request
+#   image_size  - size of the OTA Image file
+# ---------------------------------------------------------
+def requested_chunks(job_dict, image_size):
+    chunks = []
+    if job_dict["Message"] == SEND_REPAIR:
+        # Payload indices are counted from the start of the file, the first payload
+        # sent holds "Offset" (see do_chunking())
+        file_offset = int(job_dict.get("Offset", "0"))
+        first_index = file_offset // CHUNK_SIZE
+        for run in job_dict["Packets"].split(","):
+            if run == "":
+                continue
+            if "-" in run:
+                first,last = run.split("-")
+            else:
+                first = last = run
+            for index in range(int(first), int(last) + 1):
+                offset = file_offset + ((index - first_index) * CHUNK_SIZE)
+                if (offset >= file_offset) and (offset < image_size):
+                    chunks.append((offset, CHUNK_SIZE))
+        print("Send Repair: resending " + str(len(chunks)) + " packets")
+        return chunks
+
+    offset = int(job_dict["Offset"])
+    size = int(job_dict["Size"])
+    # do_chunking() numbers payloads by size, keep the numbering based on CHUNK_SIZE
+    # (the last chunk of the file is short either way)
+    if (size <= 0) or (size > CHUNK_SIZE) or ((offset + size) >= image_size):
+        size = CHUNK_SIZE
+    if offset >= image_size:
+        print("Send Chunk: offset " + str(offset) + " is past end of image (" + str(image_size) + ")")
+        return chunks
+    chunks.append((offset, size))
+    return chunks
+
 # ---------------------------------------------------------
 #   send_image_chunk_thread()
 #       This is used in a separate thread.
-#       Call do_chunking() to send one chunk to the Device.
-#   message_string  - The Initial "Update Availability" message
+#       Call do_chunking() to send each requested chunk to the Device.
+#   request_queue   - Queue of "Request Data Chunk" messages for this topic
 #   unique_topic    - The unique topic to send the OTA Image on.
 # ---------------------------------------------------------
 
-def send_image_chunk_thread(message_string, unique_topic):
+def send_image_chunk_thread(request_queue, unique_topic):
     global terminate
 
     # Create unique MQTT ID
@@ -565,24 +653,43 @@ def send_image_chunk_thread(message_string, unique_topic):
         if terminate:
             exit(0)
 
+    # Service the connection in the background so several chunks can be in flight
+    send_client.loop_start()
+    last_request_time = time.time()
+    last_message = None
+
     try:
-        time_string = time.asctime()
-        if (DEBUG_LOG):
-            print("Send Chunk Begins..." + time_string + " ")
+        image_size = os.path.getsize(OTA_IMAGE_FILE)
+        while True:
+            if terminate:
+                exit(0)
 
-        job_dict = json.loads(message_string)
-        offset = int(job_dict["Offset"])
-        size = int(job_dict["Size"])
+            try:
+                message_string = request_queue.get(timeout=0.1)
+            except queue.Empty:
+                if (time.time() - last_request_time) < CHUNK_SENDER_IDLE_SECS:
+                    continue
+                # Do not drop a request that arrives while we are leaving
+                with chunk_senders_lock:
+                    if request_queue.empty():
+                        del chunk_senders[unique_topic]
+                        break
+                continue
+
+            last_request_time = time.time()
+            job_dict = json.loads(message_string)
+            for offset,size in requested_chunks(job_dict, image_size):
+                if terminate:
+                    exit(0)
+                pub_mqtt_msgs,pub_total_payloads = do_chunking(OTA_IMAGE_FILE, False, offset, size)
 
-        pub_mqtt_msgs,pub_total_payloads = do_chunking(OTA_IMAGE_FILE, False, offset, size)
+                if (DEBUG_LOG):
+                    print(" Sending Chunk  offset:" + str(offset) + " size:" + str(size) + " to: " + unique_topic)
+                last_message = send_client.publish(unique_topic, pub_mqtt_msgs[0], PUBLISHER_PUBLISH_QOS)
 
-        # print(" Sending Chunk  offset:" + str(offset) + " size:" + str(size) + " packet sz: " + str( len(pub_mqtt_msgs[0])) + " to: " + unique_topic)
-        result,messageID = send_client.publish(unique_topic, pub_mqtt_msgs[0], PUBLISHER_PUBLISH_QOS)
-        while send_client.publish_mid != messageID:
-            send_client.loop(0.1)
-            time.sleep(0.1)
-            if terminate:
-                exit(0)
+        # Let the last chunks reach the broker before disconnecting
+        if last_message is not None:
+            last_message.wait_for_publish()
 
         time_string = time.asctime()
         if (DEBUG_LOG):
@@ -594,6 +701,9 @@ def send_image_chunk_thread(message_string, unique_topic):
         traceback.print_exc()
         exit(0)
 
+    send_client.loop_stop()
+    send_client.disconnect()
+
     # we're done
     exit(0)
 
@@ -638,10 +748,19 @@ def send_image_thread(message_string, unique_topic):
     try:
         time_string = time.asctime()
         print("Publishing Begins..." + time_string + " ")
-        pub_mqtt_msgs,pub_total_payloads = do_chunking(OTA_IMAGE_FILE, True, 0, CHUNK_SIZE)
+        # A Device resuming an interrupted download sends the offset to start from
+        file_offset = 0
+        try:
+            request_json = json.loads(message_string)
+            if "Offset" in request_json:
+                file_offset = int(request_json["Offset"])
+        except Exception:
+            file_offset = 0
+
+        pub_mqtt_msgs,pub_total_payloads = do_chunking(OTA_IMAGE_FILE, True, file_offset, CHUNK_SIZE)
 
         # for chunk in pub_mqtt_msgs:
-        for chunk in range(0,pub_total_payloads):
+        for chunk in range(0,len(pub_mqtt_msgs)):
             if terminate:
                 exit(0)
             # print(" Sending Chunk " + str(chunk)  + " of " + str(pub_total_payloads) + " to: " + unique_topic)
@@ -767,10 +886,14 @@ def publisher_recv_message(client, userdata, message):
 
         # print( "Publisher: Send Chunk of OTA Image on topic:" + unique_topic )
 
-        # Create a new thread to send the data. This will allow for multiple, overlapping requests.
-        print("Publisher: Start Sending CHUNK Thread")
-        send_thread = threading.Thread(None, send_image_chunk_thread, None, args=(message_string, unique_topic))
-        send_thread.start()
+        # The Device may have several chunk requests outstanding, queue to the sender for this topic.
+        queue_chunk_request(message_string, unique_topic)
+        return
+
+    # Handle incoming "Request Repair" request
+    if message_type == MSG_TYPE_SEND_REPAIR:
+        # Resend only the missing packets, using the chunk sender for this topic.
+        queue_chunk_request(message_string, unique_topic)
         return
 
     # Handle incoming "result" notification
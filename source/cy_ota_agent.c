@@ -32,6 +32,7 @@
  */
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <ctype.h>
@@ -48,13 +49,10 @@
  * defines & enums
  *
  **********************************************************************/
-/* We have a callback that calls into the application, and we don't want to have a stack overflow */
-#define OTA_AGENT_THREAD_STACK_SIZE    (12 * 1024)
-
 #if defined(COMPONENT_OTA_HTTP) || defined(COMPONENT_OTA_MQTT)
 #ifdef COMPONENT_THREADX
 __attribute__((aligned(8)))
-static uint8_t ota_agent_thread_stack[OTA_AGENT_THREAD_STACK_SIZE] = {0};
+static uint8_t ota_agent_thread_stack[CY_OTA_MAX_AGENTS][OTA_AGENT_THREAD_STACK_SIZE] = { {0} };
 #endif
 #endif
 
@@ -136,143 +134,156 @@ static cy_rslt_t cy_ota_complete(cy_ota_context_t *ctx);
  *       CY_OTA_STATE_INITIALIZING      - just for reporting to Application
  *       CY_OTA_STATE_AGENT_STARTED     - just for reporting to Application
  *       CY_OTA_STATE_STORAGE_WRITE     - Used when we are about to write, not a true state
+ *       CY_OTA_STATE_RESULT_RESPONSE   - not run by the OTA Agent
  *
  */
 #if defined(COMPONENT_OTA_HTTP) || defined(COMPONENT_OTA_MQTT)
-static cy_ota_agent_state_table_entry_t    cy_ota_state_table[] =
+/*
+ * State table, one ENTRY() per state run by the OTA Agent
+ *
+ *  Current State                                send_start_cb flag
+ *      function call                           New State for success
+ *      Failure result                          New State for failure
+ *      app_stop_state
+ *
+ *      app_stop_state is the state to change to if the application callback returns
+ *      STOP
+ */
+#define CY_OTA_STATE_TABLE(ENTRY)                                                                                   \
+    /* Wait for timer signal */                                                                                     \
+    ENTRY( CY_OTA_STATE_AGENT_WAITING,              true,                                                           \
+            cy_ota_wait_for_start,                  CY_OTA_STATE_START_UPDATE,                                      \
+            CY_RSLT_OTA_EXITING,                    CY_OTA_STATE_EXITING,                                           \
+            CY_OTA_STATE_EXITING )                                                                                  \
+                                                                                                                    \
+    /* Determine if Job or Direct                                                                                   \
+     * Being a little tricky here in that cy_ota_determine_flow returns:                                            \
+     * CY_RSLT_MODULE_USE_JOB_FLOW for Job Flow ( alias for CY_RSLT_SUCCESS)                                        \
+     * CY_RSLT_OTA_USE_DIRECT_FLOW Direct Flow                                                                      \
+     */                                                                                                             \
+    ENTRY( CY_OTA_STATE_START_UPDATE,               true,                                                           \
+            cy_ota_determine_flow,                  CY_OTA_STATE_JOB_CONNECT,                                       \
+            CY_RSLT_OTA_USE_DIRECT_FLOW,            CY_OTA_STATE_STORAGE_OPEN,  /* we use non-success to mean skip Job Flow */ \
+            CY_OTA_STATE_OTA_COMPLETE )                                                                             \
+                                                                                                                    \
+    /* Get the Job */                                                                                               \
+    ENTRY( CY_OTA_STATE_JOB_CONNECT,                true,                                                           \
+            cy_ota_connect,                         CY_OTA_STATE_JOB_DOWNLOAD,                                      \
+            CY_RSLT_OTA_ERROR_CONNECT,              CY_OTA_STATE_AGENT_WAITING, /* if we failed to connect, wait and try again */ \
+            CY_OTA_STATE_OTA_COMPLETE )                                                                             \
+    ENTRY( CY_OTA_STATE_JOB_DOWNLOAD,               false,  /* CY_OTA_REASON_STATE_CHANGE called from cy_ota_xxxx_get_job() */ \
+            cy_ota_job_download,                    CY_OTA_STATE_JOB_DISCONNECT,                                    \
+            CY_RSLT_OTA_ERROR_GET_JOB,              CY_OTA_STATE_JOB_DISCONNECT,                                    \
+            CY_OTA_STATE_JOB_DISCONNECT )                                                                           \
+    ENTRY( CY_OTA_STATE_JOB_DISCONNECT,             true,                                                           \
+            cy_ota_disconnect,                      CY_OTA_STATE_JOB_PARSE,                                         \
+            CY_RSLT_OTA_ERROR_DISCONNECT,           CY_OTA_STATE_OTA_COMPLETE,      /* if error in getting job, no update avail */ \
+            CY_OTA_STATE_OTA_COMPLETE )                                                                             \
+                                                                                                                    \
+    /* Parse the Job */                                                                                             \
+    ENTRY( CY_OTA_STATE_JOB_PARSE,                  true,                                                           \
+            cy_ota_job_parse,                       CY_OTA_STATE_JOB_REDIRECT,                                      \
+            CY_RSLT_OTA_ERROR_MALFORMED_JOB_DOC,    CY_OTA_STATE_RESULT_REDIRECT,   /* failed to parse, send result */ \
+            CY_OTA_STATE_OTA_COMPLETE )                                                                             \
+    ENTRY( CY_OTA_STATE_JOB_REDIRECT,               true,                                                           \
+            cy_ota_job_redirect,                    CY_OTA_STATE_STORAGE_OPEN,                                      \
+            CY_RSLT_OTA_ERROR_REDIRECT,             CY_OTA_STATE_RESULT_REDIRECT,                                   \
+            CY_OTA_STATE_OTA_COMPLETE )                                                                             \
+                                                                                                                    \
+    /* Open the file system */                                                                                      \
+    ENTRY( CY_OTA_STATE_STORAGE_OPEN,               true,                                                           \
+            cy_ota_open_filesystem,                 CY_OTA_STATE_DATA_CONNECT,                                      \
+            CY_RSLT_OTA_ERROR_OPEN_STORAGE,         CY_OTA_STATE_RESULT_REDIRECT,   /* failed to open storage, send result */ \
+            CY_OTA_STATE_OTA_COMPLETE )                                                                             \
+                                                                                                                    \
+    /* Get the Data */                                                                                              \
+    ENTRY( CY_OTA_STATE_DATA_CONNECT,               true,                                                           \
+            cy_ota_connect,                         CY_OTA_STATE_DATA_DOWNLOAD,                                     \
+            CY_RSLT_OTA_ERROR_CONNECT,              CY_OTA_STATE_RESULT_REDIRECT,                                   \
+            CY_OTA_STATE_OTA_COMPLETE )                                                                             \
+    ENTRY( CY_OTA_STATE_DATA_DOWNLOAD,              false,  /* CY_OTA_REASON_STATE_CHANGE called from cy_ota_xxxx_get_job() */ \
+            cy_ota_data_download,                   CY_OTA_STATE_DATA_DISCONNECT,                                   \
+            CY_RSLT_OTA_ERROR_GET_DATA,             CY_OTA_STATE_DATA_DISCONNECT,                                   \
+            CY_OTA_STATE_DATA_DISCONNECT )                                                                          \
+    ENTRY( CY_OTA_STATE_DATA_DISCONNECT,            true,                                                           \
+            cy_ota_disconnect,                      CY_OTA_STATE_STORAGE_CLOSE,                                     \
+            CY_RSLT_OTA_ERROR_DISCONNECT,           CY_OTA_STATE_STORAGE_CLOSE,                                     \
+            CY_OTA_STATE_OTA_COMPLETE )                                                                             \
+                                                                                                                    \
+    /* Close the storage area */                                                                                    \
+    ENTRY( CY_OTA_STATE_STORAGE_CLOSE,              true,                                                           \
+            cy_ota_close_filesystem,                CY_OTA_STATE_VERIFY,                                            \
+            CY_RSLT_OTA_ERROR_CLOSE_STORAGE,        CY_OTA_STATE_RESULT_REDIRECT,                                   \
+            CY_OTA_STATE_OTA_COMPLETE )                                                                             \
+                                                                                                                    \
+    /* Verify the download */                                                                                       \
+    ENTRY( CY_OTA_STATE_VERIFY,                     true,                                                           \
+            cy_ota_verify_data,                     CY_OTA_STATE_RESULT_REDIRECT,                                   \
+            CY_RSLT_OTA_ERROR_VERIFY,               CY_OTA_STATE_RESULT_REDIRECT,   /* always send result */        \
+            CY_OTA_STATE_RESULT_REDIRECT )                                                                          \
+                                                                                                                    \
+    /* Redirect for sending result */                                                                               \
+    ENTRY( CY_OTA_STATE_RESULT_REDIRECT,            true,                                                           \
+            cy_ota_result_redirect,                 CY_OTA_STATE_RESULT_CONNECT,                                    \
+            CY_RSLT_OTA_USE_DIRECT_FLOW,            CY_OTA_STATE_OTA_COMPLETE,      /* we use non-success to mean skip Job Flow (and result) */ \
+            CY_OTA_STATE_OTA_COMPLETE )                                                                             \
+                                                                                                                    \
+    /* Send the Result */                                                                                           \
+    ENTRY( CY_OTA_STATE_RESULT_CONNECT,             true,                                                           \
+            cy_ota_connect,                         CY_OTA_STATE_RESULT_SEND,                                       \
+            CY_RSLT_OTA_ERROR_CONNECT,              CY_OTA_STATE_OTA_COMPLETE,                                      \
+            CY_OTA_STATE_OTA_COMPLETE )                                                                             \
+    ENTRY( CY_OTA_STATE_RESULT_SEND,                false,                                                          \
+            cy_ota_result_send,                     CY_OTA_STATE_RESULT_DISCONNECT,                                 \
+            CY_RSLT_OTA_ERROR_SENDING_RESULT,       CY_OTA_STATE_RESULT_DISCONNECT,                                 \
+            CY_OTA_STATE_RESULT_DISCONNECT )                                                                        \
+    ENTRY( CY_OTA_STATE_RESULT_DISCONNECT,          true,                                                           \
+            cy_ota_disconnect,                      CY_OTA_STATE_OTA_COMPLETE,                                      \
+            CY_RSLT_OTA_ERROR_DISCONNECT,           CY_OTA_STATE_OTA_COMPLETE,                                      \
+            CY_OTA_STATE_OTA_COMPLETE )                                                                             \
+                                                                                                                    \
+    /* Check for reboot after result sent */                                                                        \
+    ENTRY( CY_OTA_STATE_OTA_COMPLETE,               true,                                                           \
+            cy_ota_complete,                        CY_OTA_STATE_AGENT_WAITING,                                     \
+            CY_RSLT_SUCCESS,                        CY_OTA_STATE_AGENT_WAITING,                                     \
+            CY_OTA_STATE_AGENT_WAITING )                                                                            \
+                                                                                                                    \
+    /* exit the OTA Agent */                                                                                        \
+    ENTRY( CY_OTA_STATE_EXITING,                    true,                                                           \
+            NULL,                                   CY_OTA_STATE_AGENT_WAITING,                                     \
+            CY_RSLT_OTA_EXITING,                    CY_OTA_STATE_AGENT_WAITING,                                     \
+            CY_OTA_STATE_AGENT_WAITING )
+
+/* Each state is its own index, the Agent does not search the table */
+#define CY_OTA_STATE_TABLE_ENTRY(state, send_start_cb, state_function, success_state, failure_result, failure_state, app_stop_state) \
+    [state] = { state, send_start_cb, state_function, success_state, failure_result, failure_state, app_stop_state },
+
+static const cy_ota_agent_state_table_entry_t cy_ota_state_table[CY_OTA_NUM_STATES] =
 {
-    /* Current State                                send_start_cb flag
-     *      function call                           New State for success
-     *      Failure result                          New State for failure
-     *      app_stop_state
-     *
-     *      app_stop_state is the state to change to if the application callback returns
-     *      STOP
-     */
-        /* Wait for timer signal */
-    { CY_OTA_STATE_AGENT_WAITING,                   true,
-            cy_ota_wait_for_start,                  CY_OTA_STATE_START_UPDATE,
-            CY_RSLT_OTA_EXITING,                    CY_OTA_STATE_EXITING,
-            CY_OTA_STATE_EXITING
-    },
-
-    /* Determine if Job or Direct
-     * Being a little tricky here in that cy_ota_determine_flow returns:
-     * CY_RSLT_MODULE_USE_JOB_FLOW for Job Flow ( alias for CY_RSLT_SUCCESS)
-     * CY_RSLT_OTA_USE_DIRECT_FLOW Direct Flow
-     */
-    { CY_OTA_STATE_START_UPDATE,                    true,
-            cy_ota_determine_flow,                  CY_OTA_STATE_JOB_CONNECT,
-            CY_RSLT_OTA_USE_DIRECT_FLOW,            CY_OTA_STATE_STORAGE_OPEN,  /* we use non-success to mean skip Job Flow */
-            CY_OTA_STATE_OTA_COMPLETE
-    },
-
-    /* Get the Job */
-    { CY_OTA_STATE_JOB_CONNECT,                     true,
-            cy_ota_connect,                         CY_OTA_STATE_JOB_DOWNLOAD,
-            CY_RSLT_OTA_ERROR_CONNECT,              CY_OTA_STATE_AGENT_WAITING, /* if we failed to connect, wait and try again */
-            CY_OTA_STATE_OTA_COMPLETE
-    },
-    { CY_OTA_STATE_JOB_DOWNLOAD,                    false,  /* CY_OTA_REASON_STATE_CHANGE called from cy_ota_xxxx_get_job() */
-            cy_ota_job_download,                    CY_OTA_STATE_JOB_DISCONNECT,
-            CY_RSLT_OTA_ERROR_GET_JOB,              CY_OTA_STATE_JOB_DISCONNECT,
-            CY_OTA_STATE_JOB_DISCONNECT
-    },
-    { CY_OTA_STATE_JOB_DISCONNECT,                  true,
-            cy_ota_disconnect,                      CY_OTA_STATE_JOB_PARSE,
-            CY_RSLT_OTA_ERROR_DISCONNECT,           CY_OTA_STATE_OTA_COMPLETE,      /* if error in getting job, no update avail */
-            CY_OTA_STATE_OTA_COMPLETE
-    },
-
-    /* Parse the Job */
-    { CY_OTA_STATE_JOB_PARSE,                       true,
-            cy_ota_job_parse,                       CY_OTA_STATE_JOB_REDIRECT,
-            CY_RSLT_OTA_ERROR_MALFORMED_JOB_DOC,    CY_OTA_STATE_RESULT_REDIRECT,   /* failed to parse, send result */
-            CY_OTA_STATE_OTA_COMPLETE
-    },
-    { CY_OTA_STATE_JOB_REDIRECT,                    true,
-            cy_ota_job_redirect,                    CY_OTA_STATE_STORAGE_OPEN,
-            CY_RSLT_OTA_ERROR_REDIRECT,             CY_OTA_STATE_RESULT_REDIRECT,
-            CY_OTA_STATE_OTA_COMPLETE
-    },
-
-    /* Open the file system */
-    { CY_OTA_STATE_STORAGE_OPEN,                    true,
-            cy_ota_open_filesystem,                 CY_OTA_STATE_DATA_CONNECT,
-            CY_RSLT_OTA_ERROR_OPEN_STORAGE,         CY_OTA_STATE_RESULT_REDIRECT,   /* failed to open storage, send result */
-            CY_OTA_STATE_OTA_COMPLETE
-    },
-
-    /* Get the Data */
-    { CY_OTA_STATE_DATA_CONNECT,                    true,
-            cy_ota_connect,                         CY_OTA_STATE_DATA_DOWNLOAD,
-            CY_RSLT_OTA_ERROR_CONNECT,              CY_OTA_STATE_RESULT_REDIRECT,
-            CY_OTA_STATE_OTA_COMPLETE
-    },
-    { CY_OTA_STATE_DATA_DOWNLOAD,                   false,  /* CY_OTA_REASON_STATE_CHANGE called from cy_ota_xxxx_get_job() */
-            cy_ota_data_download,                   CY_OTA_STATE_DATA_DISCONNECT,
-            CY_RSLT_OTA_ERROR_GET_DATA,             CY_OTA_STATE_DATA_DISCONNECT,
-            CY_OTA_STATE_DATA_DISCONNECT
-    },
-    { CY_OTA_STATE_DATA_DISCONNECT,                 true,
-            cy_ota_disconnect,                      CY_OTA_STATE_STORAGE_CLOSE,
-            CY_RSLT_OTA_ERROR_DISCONNECT,           CY_OTA_STATE_STORAGE_CLOSE,
-            CY_OTA_STATE_OTA_COMPLETE
-    },
-
-    /* Close the storage area */
-    { CY_OTA_STATE_STORAGE_CLOSE,                   true,
-            cy_ota_close_filesystem,                CY_OTA_STATE_VERIFY,
-            CY_RSLT_OTA_ERROR_CLOSE_STORAGE,        CY_OTA_STATE_RESULT_REDIRECT,
-            CY_OTA_STATE_OTA_COMPLETE
-    },
-
-    /* Verify the download */
-    { CY_OTA_STATE_VERIFY,                          true,
-            cy_ota_verify_data,                     CY_OTA_STATE_RESULT_REDIRECT,
-            CY_RSLT_OTA_ERROR_VERIFY,               CY_OTA_STATE_RESULT_REDIRECT,   /* always send result */
-            CY_OTA_STATE_RESULT_REDIRECT
-    },
-
-    /* Redirect for sending result */
-    { CY_OTA_STATE_RESULT_REDIRECT,                 true,
-            cy_ota_result_redirect,                 CY_OTA_STATE_RESULT_CONNECT,
-            CY_RSLT_OTA_USE_DIRECT_FLOW,            CY_OTA_STATE_OTA_COMPLETE,      /* we use non-success to mean skip Job Flow (and result) */
-            CY_OTA_STATE_OTA_COMPLETE
-    },
-
-    /* Send the Result */
-    { CY_OTA_STATE_RESULT_CONNECT,                  true,
-            cy_ota_connect,                         CY_OTA_STATE_RESULT_SEND,
-            CY_RSLT_OTA_ERROR_CONNECT,              CY_OTA_STATE_OTA_COMPLETE,
-            CY_OTA_STATE_OTA_COMPLETE
-    },
-    { CY_OTA_STATE_RESULT_SEND,                     false,
-            cy_ota_result_send,                     CY_OTA_STATE_RESULT_DISCONNECT,
-            CY_RSLT_OTA_ERROR_SENDING_RESULT,       CY_OTA_STATE_RESULT_DISCONNECT,
-            CY_OTA_STATE_RESULT_DISCONNECT
-    },
-    { CY_OTA_STATE_RESULT_DISCONNECT,               true,
-            cy_ota_disconnect,                      CY_OTA_STATE_OTA_COMPLETE,
-            CY_RSLT_OTA_ERROR_DISCONNECT,           CY_OTA_STATE_OTA_COMPLETE,
-            CY_OTA_STATE_OTA_COMPLETE
-    },
-
-    /* Check for reboot after result sent */
-    { CY_OTA_STATE_OTA_COMPLETE,                    true,
-            cy_ota_complete,                        CY_OTA_STATE_AGENT_WAITING,
-            CY_RSLT_SUCCESS,                        CY_OTA_STATE_AGENT_WAITING,
-            CY_OTA_STATE_AGENT_WAITING
-    },
-
-    /* exit the OTA Agent */
-    { CY_OTA_STATE_EXITING,                         true,
-            NULL,                                   CY_OTA_STATE_AGENT_WAITING,
-            CY_RSLT_OTA_EXITING,                    CY_OTA_STATE_AGENT_WAITING,
-            CY_OTA_STATE_AGENT_WAITING
-    },
+    CY_OTA_STATE_TABLE(CY_OTA_STATE_TABLE_ENTRY)
 };
-#define CY_OTA_NUM_STATE_TABLE_ENTRIES  ( sizeof(cy_ota_state_table) / sizeof(cy_ota_state_table[0]) )
+
+/* States not run by the OTA Agent, their table entries are all zero */
+#define CY_OTA_STATE_NOT_IN_TABLE(ENTRY)        \
+    ENTRY(CY_OTA_STATE_NOT_INITIALIZED)         \
+    ENTRY(CY_OTA_STATE_INITIALIZING)            \
+    ENTRY(CY_OTA_STATE_AGENT_STARTED)           \
+    ENTRY(CY_OTA_STATE_STORAGE_WRITE)           \
+    ENTRY(CY_OTA_STATE_RESULT_RESPONSE)
+
+/*
+ * Build time check that each cy_ota_agent_state_t is listed exactly once:
+ *  a state listed twice is a duplicate enumerator, a missing state makes the count short.
+ */
+#define CY_OTA_STATE_TABLE_CHECK(state, ...)    CY_OTA_STATE_CHECK_##state,
+#define CY_OTA_STATE_NOT_IN_TABLE_CHECK(state)  CY_OTA_STATE_CHECK_##state,
+enum
+{
+    CY_OTA_STATE_TABLE(CY_OTA_STATE_TABLE_CHECK)
+    CY_OTA_STATE_NOT_IN_TABLE(CY_OTA_STATE_NOT_IN_TABLE_CHECK)
+    CY_OTA_STATE_CHECK_COUNT
+};
+typedef char cy_ota_state_table_check_t[((int)CY_OTA_STATE_CHECK_COUNT == (int)CY_OTA_NUM_STATES) ? 1 : -1];
 #endif
 
 static const char *cy_ota_reason_strings[CY_OTA_LAST_REASON] = {
@@ -362,6 +373,7 @@ static cy_ota_error_string_lookup_t cy_ota_error_strings[] =
     { CY_RSLT_OTA_USE_DIRECT_FLOW, "OTA Agent use Direct data download flow" },
 
     { CY_RSLT_OTA_NO_UPDATE_AVAILABLE, "OTA ERROR No Update Available" },
+    { CY_RSLT_OTA_POLL_AGAIN, "OTA Update in progress, poll again" },
 
 };
 #define CY_OTA_NUM_ERROR_STRINGS    (sizeof(cy_ota_error_strings)/sizeof(cy_ota_error_strings[0]) )
@@ -373,10 +385,20 @@ static cy_ota_error_string_lookup_t cy_ota_error_strings[] =
  *
  **********************************************************************/
 
-/* so we only allow one instance of the ota context */
-static void *ota_context_only_one;
+/* Build fails if chunk_buffer and data_buffer do not share storage */
+#if defined(COMPONENT_OTA_HTTP) || defined(COMPONENT_OTA_MQTT)
+typedef char cy_ota_context_shared_check_t[(offsetof(cy_ota_context_t, data_buffer) == offsetof(cy_ota_context_t, chunk_buffer)) ? 1 : -1];
+#endif
+
+/* Build fails if the memory for cy_ota_agent_start_static() is too small */
+#ifdef CY_OTA_AGENT_MEMORY_SIZE
+typedef char cy_ota_agent_memory_size_check_t[( (CY_OTA_AGENT_MEMORY_SIZE) >= CY_OTA_AGENT_MEMORY_REQUIRED) ? 1 : -1];
+#endif
+
+/* running OTA Agents, CY_OTA_MAX_AGENTS at a time */
+static cy_ota_context_t *ota_contexts[CY_OTA_MAX_AGENTS];
 
-/* hold last error so app can retrieve after OTA exits */
+/* hold last error of any OTA Agent so app can retrieve after OTA exits */
 static cy_rslt_t cy_ota_last_error;        /**< Last OTA error                             */
 
 /* default / user's logging level */
@@ -426,298 +448,581 @@ void cy_ota_print_data(const char *buffer, uint32_t length)
     }
 }
 #endif
+
+/***********************************************************************
+ *
+ * Range map
+ *
+ **********************************************************************/
+
+void cy_ota_range_map_clear(cy_ota_range_map_t *map)
+{
+    if (map != NULL)
+    {
+        memset(map, 0x00, sizeof(cy_ota_range_map_t));
+    }
+}
+
+cy_rslt_t cy_ota_range_map_add(cy_ota_range_map_t *map, uint32_t offset, uint32_t size)
+{
+    uint16_t i;
+    uint16_t first;
+    uint16_t last;
+    uint32_t end;
+
+    if ( (map == NULL) || (size == 0) )
+    {
+        return CY_RSLT_SUCCESS;
+    }
+    end = offset + size;
+
+    /* first range that ends at or after the new start (may merge) */
+    for (first = 0; first < map->num_ranges; first++)
+    {
+        if (map->range[first].end >= offset)
+        {
+            break;
+        }
+    }
+
+    /* first range that starts after the new end (cannot merge) */
+    for (last = first; last < map->num_ranges; last++)
+    {
+        if (map->range[last].start > end)
+        {
+            break;
+        }
+    }
+
+    if (first == last)
+    {
+        /* no overlap - insert a new range at index first */
+        if (map->num_ranges >= CY_OTA_RANGE_MAP_MAX_RANGES)
+        {
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Range map full (%d ranges)\n", __func__, map->num_ranges);
+            return CY_RSLT_OTA_ERROR_OUT_OF_MEMORY;
+        }
+        for (i = map->num_ranges; i > first; i--)
+        {
+            map->range[i] = map->range[i - 1];
+        }
+        map->range[first].start = offset;
+        map->range[first].end   = end;
+        map->num_ranges++;
+        return CY_RSLT_SUCCESS;
+    }
+
+    /* merge ranges [first, last) with the new range into range[first] */
+    if (map->range[first].start < offset)
+    {
+        offset = map->range[first].start;
+    }
+    if (map->range[last - 1].end > end)
+    {
+        end = map->range[last - 1].end;
+    }
+    map->range[first].start = offset;
+    map->range[first].end   = end;
+
+    for (i = 0; (last + i) < map->num_ranges; i++)
+    {
+        map->range[first + 1 + i] = map->range[last + i];
+    }
+    map->num_ranges -= (uint16_t)(last - first - 1);
+
+    return CY_RSLT_SUCCESS;
+}
+
+uint32_t cy_ota_range_map_next_hole(const cy_ota_range_map_t *map, uint32_t total_size, uint32_t *hole_size)
+{
+    uint32_t hole_start = 0;
+    uint32_t hole_end;
+
+    if ( (map != NULL) && (map->num_ranges > 0) && (map->range[0].start == 0) )
+    {
+        hole_start = map->range[0].end;
+    }
+
+    if ( (map != NULL) && (map->num_ranges > 0) && (map->range[0].start > 0) )
+    {
+        hole_end = map->range[0].start;
+    }
+    else if ( (map != NULL) && (map->num_ranges > 1) )
+    {
+        hole_end = map->range[1].start;
+    }
+    else if (total_size != 0)
+    {
+        hole_end = total_size;
+    }
+    else
+    {
+        /* size not known yet - hole to the end of the address space */
+        hole_end = UINT32_MAX;
+    }
+
+    if ( (total_size != 0) && (hole_end > total_size) )
+    {
+        hole_end = total_size;
+    }
+
+    if (hole_size != NULL)
+    {
+        *hole_size = (hole_end > hole_start) ? (hole_end - hole_start) : 0;
+    }
+    return hole_start;
+}
+
+bool cy_ota_range_map_is_complete(const cy_ota_range_map_t *map, uint32_t total_size)
+{
+    if ( (map == NULL) || (total_size == 0) )
+    {
+        return false;
+    }
+    return ( (map->num_ranges > 0) && (map->range[0].start == 0) && (map->range[0].end >= total_size) );
+}
+
 /***********************************************************************
  *
  * Callback to Application
  *
  **********************************************************************/
 
+#if (CY_OTA_CALLBACK_V1 == 1)
 /**
- * @brief OTA internal Callback to Application
+ * @brief Fill in cy_ota_cb_struct_t, call cb_func and pick up the changes made by the Application
  *
  * @param   ctx     - OTA context
  * @param   reason  - OTA Callback reason
  * @param   state   - OTA State to report in callback
- *                      This is usually ctx->curr_state
- *                      When downloading Data and Storage Writing it will be CY_OTA_STATE_STORAGE_WRITE
  *
  * @return  return value from callback
  */
-cy_ota_callback_results_t cy_ota_internal_call_cb( cy_ota_context_t *ctx,
-                                                   cy_ota_cb_reason_t reason,
-                                                   cy_ota_agent_state_t report_state)
+static cy_ota_callback_results_t cy_ota_call_cb_v1( cy_ota_context_t *ctx,
+                                                    cy_ota_cb_reason_t reason,
+                                                    cy_ota_agent_state_t report_state)
 {
-    /* default result is for OTA Agent to continue with default functionality */
-    cy_ota_callback_results_t   cb_result = CY_OTA_CB_RSLT_OTA_CONTINUE;
+    cy_ota_callback_results_t   cb_result;
 
-    CY_OTA_CONTEXT_ASSERT(ctx);
-    if (ctx->agent_params.cb_func != NULL)
-    {
-        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG3, "%s() CB reason:%d\n", __func__, reason);
+    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG3, "%s() CB reason:%d\n", __func__, reason);
 
-        /* set up callback data */
-        memset(&ctx->callback_data, 0x00, sizeof(ctx->callback_data));
+    /* set up callback data */
+    memset(&ctx->callback_data, 0x00, sizeof(ctx->callback_data));
 
-        ctx->callback_data.reason = reason;
-        ctx->callback_data.cb_arg = ctx->agent_params.cb_arg;
+    ctx->callback_data.reason = reason;
+    ctx->callback_data.cb_arg = ctx->agent_params.cb_arg;
 
-        ctx->callback_data.ota_agt_state = report_state;
-        ctx->callback_data.error = cy_ota_last_error;
+    ctx->callback_data.ota_agt_state = report_state;
+    ctx->callback_data.error = ctx->last_error;
 
-        /* fill in callback structure data for connection info */
+    /* fill in callback structure data for connection info */
 #if defined(COMPONENT_OTA_HTTP) || defined(COMPONENT_OTA_MQTT)
-        ctx->callback_data.connection_type = ctx->curr_connect_type;
-        if (ctx->curr_server != NULL)
-        {
-            ctx->callback_data.broker_server.host_name = ctx->curr_server->host_name;
-            ctx->callback_data.broker_server.port = ctx->curr_server->port;
-        }
+    ctx->callback_data.connection_type = ctx->curr_connect_type;
+    if (ctx->curr_server != NULL)
+    {
+        ctx->callback_data.broker_server.host_name = ctx->curr_server->host_name;
+        ctx->callback_data.broker_server.port = ctx->curr_server->port;
+    }
 
-        /* copy connection specific fields */
-        memset(ctx->callback_data.file, 0x00, sizeof(ctx->callback_data.file) );
-        memset(ctx->callback_data.json_doc, 0x00, sizeof(ctx->callback_data.json_doc));
+    /* copy connection specific fields */
+    memset(ctx->callback_data.file, 0x00, sizeof(ctx->callback_data.file) );
+    memset(ctx->callback_data.json_doc, 0x00, sizeof(ctx->callback_data.json_doc));
 #endif
 
 #ifdef COMPONENT_OTA_MQTT
-        if (ctx->callback_data.connection_type == CY_OTA_CONNECTION_MQTT)
-        {
-            strncpy(ctx->callback_data.json_doc, ctx->mqtt.json_doc, sizeof(ctx->callback_data.json_doc) );
-            strncpy(ctx->callback_data.unique_topic, ctx->mqtt.unique_topic, sizeof(ctx->callback_data.unique_topic) );
-            ctx->callback_data.credentials = &ctx->network_params.mqtt.credentials;
-        }
+    if (ctx->callback_data.connection_type == CY_OTA_CONNECTION_MQTT)
+    {
+        strncpy(ctx->callback_data.json_doc, ctx->json_doc, sizeof(ctx->callback_data.json_doc) );
+        strncpy(ctx->callback_data.unique_topic, ctx->mqtt.unique_topic, sizeof(ctx->callback_data.unique_topic) );
+        ctx->callback_data.credentials = &ctx->network_params.mqtt.credentials;
+    }
 #endif
 
 #ifdef COMPONENT_OTA_HTTP
-        if ( (ctx->callback_data.connection_type == CY_OTA_CONNECTION_HTTP) ||
-                  (ctx->callback_data.connection_type == CY_OTA_CONNECTION_HTTPS) )
+    if ( (ctx->callback_data.connection_type == CY_OTA_CONNECTION_HTTP) ||
+              (ctx->callback_data.connection_type == CY_OTA_CONNECTION_HTTPS) )
+    {
+        strncpy(ctx->callback_data.json_doc, ctx->json_doc, (sizeof(ctx->callback_data.json_doc) - 1) );
+        strncpy(ctx->callback_data.file, ctx->http.file, (sizeof(ctx->callback_data.file) - 1) );
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG3, "------------> cb file: '%s'    http.file'%s' params:'%s'\n", ctx->callback_data.file, ctx->http.file, ctx->network_params.http.file);
+        if ( (ctx->curr_state == CY_OTA_STATE_DATA_CONNECT) &&
+             (ctx->network_params.use_get_job_flow == CY_OTA_JOB_FLOW) )
         {
-            strncpy(ctx->callback_data.json_doc, ctx->http.json_doc, (sizeof(ctx->callback_data.json_doc) - 1) );
-            strncpy(ctx->callback_data.file, ctx->http.file, (sizeof(ctx->callback_data.file) - 1) );
-            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG3, "------------> cb file: '%s'    http.file'%s' params:'%s'\n", ctx->callback_data.file, ctx->http.file, ctx->network_params.http.file);
-            if ( (ctx->curr_state == CY_OTA_STATE_DATA_CONNECT) &&
-                 (ctx->network_params.use_get_job_flow == CY_OTA_JOB_FLOW) )
-            {
-                strncpy(ctx->callback_data.file, ctx->parsed_job.file, (sizeof(ctx->callback_data.file) - 1) );
-            }
-            ctx->callback_data.credentials = &ctx->network_params.http.credentials;
+            strncpy(ctx->callback_data.file, ctx->parsed_job.file, (sizeof(ctx->callback_data.file) - 1) );
         }
+        ctx->callback_data.credentials = &ctx->network_params.http.credentials;
+    }
 #endif
 
 #if defined(COMPONENT_OTA_HTTP) || defined(COMPONENT_OTA_MQTT)
-        if (ctx->curr_state == CY_OTA_STATE_JOB_PARSE)
-        {
-            strncpy(ctx->callback_data.json_doc, ctx->job_doc, (sizeof(ctx->callback_data.json_doc) - 1) );
-        }
+    if (ctx->curr_state == CY_OTA_STATE_JOB_PARSE)
+    {
+        strncpy(ctx->callback_data.json_doc, ctx->job_doc, (sizeof(ctx->callback_data.json_doc) - 1) );
+    }
 #endif
 
-        /* For STORAGE info */
-        ctx->callback_data.storage = ctx->storage;
+    /* For STORAGE info */
+    ctx->callback_data.storage = ctx->storage;
 
-        /* Total data info */
-        ctx->callback_data.total_size    = ctx->ota_storage_context.total_image_size;
-        ctx->callback_data.bytes_written = ctx->ota_storage_context.total_bytes_written;
-        if (ctx->ota_storage_context.total_image_size > 0)
-        {
-           ctx->callback_data.percentage = (ctx->ota_storage_context.total_bytes_written * 100) / ctx->ota_storage_context.total_image_size;
-        }
+    /* Total data info, bytes in storage so far */
+    cy_ota_writer_lock(ctx);
+    ctx->callback_data.total_size    = ctx->ota_storage_context.total_image_size;
+    ctx->callback_data.bytes_written = ctx->ota_storage_context.total_bytes_written;
+    cy_ota_writer_unlock(ctx);
+    if (ctx->callback_data.total_size > 0)
+    {
+       ctx->callback_data.percentage = (ctx->callback_data.bytes_written * 100) / ctx->callback_data.total_size;
+    }
 
-        /* call the Application Callback function */
-        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "%s() calling OTA Callback state: %d\n", __func__, ctx->curr_state);
-        cb_result = ctx->agent_params.cb_func(&ctx->callback_data);
-        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "%s()\n                         ----> CB returned: %d\n", __func__, cb_result);
+    /* call the Application Callback function */
+    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "%s() calling OTA Callback state: %d\n", __func__, ctx->curr_state);
+    cb_result = ctx->agent_params.cb_func(&ctx->callback_data);
+    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "%s()\n                         ----> CB returned: %d\n", __func__, cb_result);
 
-        /* copy connection specific fields */
-        if (ctx->curr_state == CY_OTA_STATE_JOB_PARSE)
-        {
+    /* copy connection specific fields */
+    if (ctx->curr_state == CY_OTA_STATE_JOB_PARSE)
+    {
 #if defined(COMPONENT_OTA_HTTP) || defined(COMPONENT_OTA_MQTT)
-            if (strlen(ctx->callback_data.json_doc) > 0)
-            {
-                memcpy(ctx->job_doc, ctx->callback_data.json_doc, sizeof(ctx->job_doc));
-            }
-#endif
-        }
-        else if(  (ctx->curr_state == CY_OTA_STATE_JOB_CONNECT) ||
-                  (ctx->curr_state == CY_OTA_STATE_DATA_CONNECT) ||
-                  (ctx->curr_state == CY_OTA_STATE_RESULT_CONNECT) ||
-                  (ctx->curr_state == CY_OTA_STATE_JOB_DOWNLOAD) )
+        if (strlen(ctx->callback_data.json_doc) > 0)
         {
+            memcpy(ctx->job_doc, ctx->callback_data.json_doc, sizeof(ctx->job_doc));
+        }
+#endif
+    }
+    else if(  (ctx->curr_state == CY_OTA_STATE_JOB_CONNECT) ||
+              (ctx->curr_state == CY_OTA_STATE_DATA_CONNECT) ||
+              (ctx->curr_state == CY_OTA_STATE_RESULT_CONNECT) ||
+              (ctx->curr_state == CY_OTA_STATE_JOB_DOWNLOAD) )
+    {
 #ifdef COMPONENT_OTA_MQTT
-            if (ctx->callback_data.connection_type == CY_OTA_CONNECTION_MQTT)
+        if (ctx->callback_data.connection_type == CY_OTA_CONNECTION_MQTT)
+        {
+            if (ctx->callback_data.mqtt_connection != NULL)
             {
-                if (ctx->callback_data.mqtt_connection != NULL)
-                {
-                    /* Application is supplying the MQTT connection.
-                     *   Store application's connection in mqtt.mqtt_connection.
-                     * NOTE: We are not connected at this time,
-                     *       saving the connection is ok.
-                     */
-                    ctx->mqtt.connection_from_app = true;
-                    ctx->mqtt.connection_established = true;
-                    ctx->mqtt.mqtt_connection = ctx->callback_data.mqtt_connection;
-                }
+                /* Application is supplying the MQTT connection.
+                 *   Store application's connection in mqtt.mqtt_connection.
+                 * NOTE: We are not connected at this time,
+                 *       saving the connection is ok.
+                 */
+                ctx->mqtt.connection_from_app = true;
+                ctx->mqtt.connection_established = true;
+                ctx->mqtt.mqtt_connection = ctx->callback_data.mqtt_connection;
+            }
 
-                if ( (strlen(ctx->callback_data.json_doc) > 0) &&
-                     (strcmp(ctx->mqtt.json_doc, ctx->callback_data.json_doc) != 0) )
-                {
-                    strncpy(ctx->mqtt.json_doc, ctx->callback_data.json_doc, (sizeof(ctx->mqtt.json_doc) - 1));
-                    strncpy(ctx->job_doc, ctx->callback_data.json_doc, (sizeof(ctx->job_doc) - 1));
-                }
-                if ( (strlen(ctx->callback_data.unique_topic) > 0) &&
-                     (strcmp(ctx->mqtt.unique_topic, ctx->callback_data.unique_topic) != 0) )
-                {
-                    strncpy(ctx->mqtt.unique_topic, ctx->callback_data.unique_topic, (sizeof(ctx->mqtt.unique_topic) - 1));
-                }
-            } /* MQTT type */
-#endif
-#ifdef COMPONENT_OTA_HTTP
-            if ( (ctx->callback_data.connection_type == CY_OTA_CONNECTION_HTTP) ||
-                      (ctx->callback_data.connection_type == CY_OTA_CONNECTION_HTTPS) )
+            if ( (strlen(ctx->callback_data.json_doc) > 0) &&
+                 (strcmp(ctx->json_doc, ctx->callback_data.json_doc) != 0) )
             {
-                if (ctx->callback_data.http_connection != NULL)
-                {
-                    /* Application is supplying the HTTP connection.
-                     *   Store application's connection in http.http_connection.
-                     * NOTE: We are not connected at this time,
-                     *       saving the connection is ok.
-                     */
-                    ctx->http.connection_from_app = true;
-                    ctx->http.connection = ctx->callback_data.http_connection;
-                }
-                if ( (strlen(ctx->callback_data.json_doc) > 0) &&
-                     (strcmp(ctx->http.json_doc, ctx->callback_data.json_doc) != 0) )
-                {
-                    strncpy(ctx->http.json_doc, ctx->callback_data.json_doc, (sizeof(ctx->http.json_doc) - 1) );
-                    strncpy(ctx->job_doc, ctx->callback_data.json_doc, (sizeof(ctx->job_doc) - 1));
-                }
-                if ( (strlen(ctx->callback_data.file) > 0) &&
-                     (strcmp(ctx->http.file, ctx->callback_data.file) != 0) )
-                {
-                    strncpy(ctx->http.file, ctx->callback_data.file, (sizeof(ctx->http.file) - 1) );
-                }
-            } /* HTTP type */
-#endif
-        } /* if starting a connection */
-        else
-        {
-            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "%s() %d Not starting a connection\n", __func__, __LINE__);
-        }
-
-        if ( (cb_result == CY_OTA_CB_RSLT_APP_SUCCESS) &&
-             ( (ctx->curr_state == CY_OTA_STATE_JOB_DISCONNECT) ||
-               (ctx->curr_state == CY_OTA_STATE_DATA_DISCONNECT) ||
-               (ctx->curr_state == CY_OTA_STATE_RESULT_DISCONNECT) ) )
-        {
-            /*
-             * The app has taken care of the disconnect operation. Clean up
-             * our connection information.
-             */
-
-
-#ifdef COMPONENT_OTA_MQTT
-            if (ctx->callback_data.connection_type == CY_OTA_CONNECTION_MQTT)
+                strncpy(ctx->json_doc, ctx->callback_data.json_doc, (sizeof(ctx->json_doc) - 1));
+                strncpy(ctx->job_doc, ctx->callback_data.json_doc, (sizeof(ctx->job_doc) - 1));
+            }
+            if ( (strlen(ctx->callback_data.unique_topic) > 0) &&
+                 (strcmp(ctx->mqtt.unique_topic, ctx->callback_data.unique_topic) != 0) )
             {
-                ctx->mqtt.connection_from_app    = false;
-                ctx->mqtt.connection_established = false;
-                ctx->mqtt.mqtt_connection        = NULL;
+                strncpy(ctx->mqtt.unique_topic, ctx->callback_data.unique_topic, (sizeof(ctx->mqtt.unique_topic) - 1));
             }
+        } /* MQTT type */
 #endif
 #ifdef COMPONENT_OTA_HTTP
-            if ( (ctx->callback_data.connection_type == CY_OTA_CONNECTION_HTTP) ||
-                 (ctx->callback_data.connection_type == CY_OTA_CONNECTION_HTTPS) )
+        if ( (ctx->callback_data.connection_type == CY_OTA_CONNECTION_HTTP) ||
+                  (ctx->callback_data.connection_type == CY_OTA_CONNECTION_HTTPS) )
+        {
+            if (ctx->callback_data.http_connection != NULL)
+            {
+                /* Application is supplying the HTTP connection.
+                 *   Store application's connection in http.http_connection.
+                 * NOTE: We are not connected at this time,
+                 *       saving the connection is ok.
+                 */
+                ctx->http.connection_from_app = true;
+                ctx->http.connection = ctx->callback_data.http_connection;
+            }
+            if ( (strlen(ctx->callback_data.json_doc) > 0) &&
+                 (strcmp(ctx->json_doc, ctx->callback_data.json_doc) != 0) )
             {
-                ctx->http.connection_from_app = false;
-                ctx->http.connection          = NULL;
+                strncpy(ctx->json_doc, ctx->callback_data.json_doc, (sizeof(ctx->json_doc) - 1) );
+                strncpy(ctx->job_doc, ctx->callback_data.json_doc, (sizeof(ctx->job_doc) - 1));
             }
+            if ( (strlen(ctx->callback_data.file) > 0) &&
+                 (strcmp(ctx->http.file, ctx->callback_data.file) != 0) )
+            {
+                strncpy(ctx->http.file, ctx->callback_data.file, (sizeof(ctx->http.file) - 1) );
+            }
+        } /* HTTP type */
 #endif
-        }
-        else
-        {
-            /* Nothing to do here - Needed for Coverity (MISRA C 2012 Rule 15.7) */
-        }
-    } /* called callback */
+    } /* if starting a connection */
+    else
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "%s() %d Not starting a connection\n", __func__, __LINE__);
+    }
 
-    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "%s(reason:%d) CB returning 0x%lx\n", __func__, reason, cb_result);
+#if defined(COMPONENT_OTA_HTTP) || defined(COMPONENT_OTA_MQTT)
+    /* Used for the connection, the Application may have changed it */
+    ctx->cb_credentials = ctx->callback_data.credentials;
+#endif
 
     return cb_result;
 }
+#endif
 
-/***********************************************************************
+/**
+ * @brief Call cb_func_v2 with pointers to the OTA Agent data, nothing is copied
  *
- * Miscellaneous Functions
+ * The Application uses cy_ota_callback_override() from the callback to change the data.
  *
- **********************************************************************/
-void cy_ota_set_state(cy_ota_context_t *ctx, cy_ota_agent_state_t ota_state)
+ * @param   ctx     - OTA context
+ * @param   reason  - OTA Callback reason
+ * @param   state   - OTA State to report in callback
+ *
+ * @return  return value from callback
+ */
+static cy_ota_callback_results_t cy_ota_call_cb_v2( cy_ota_context_t *ctx,
+                                                    cy_ota_cb_reason_t reason,
+                                                    cy_ota_agent_state_t report_state)
 {
-    CY_OTA_CONTEXT_ASSERT(ctx);
+    cy_ota_callback_results_t   cb_result;
+    cy_ota_cb_struct_v2_t       cb_data;
 
-    /* sanity check */
-    if (ota_state >= CY_OTA_NUM_STATES )
-    {
-        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() BAD STATE: %d\n", __func__, ota_state);
-    }
-    else
+    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG3, "%s() CB reason:%d\n", __func__, reason);
+
+    memset(&cb_data, 0x00, sizeof(cb_data));
+    cb_data.ota_ptr       = (cy_ota_context_ptr)ctx;
+    cb_data.reason        = reason;
+    cb_data.cb_arg        = ctx->agent_params.cb_arg;
+    cb_data.ota_agt_state = report_state;
+    cb_data.error         = ctx->last_error;
+
+    cb_data.storage       = ctx->storage;
+    cy_ota_writer_lock(ctx);
+    cb_data.total_size    = ctx->ota_storage_context.total_image_size;
+    cb_data.bytes_written = ctx->ota_storage_context.total_bytes_written;
+    cy_ota_writer_unlock(ctx);
+    if (cb_data.total_size > 0)
     {
-        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_INFO, "%s() state: %d\n", __func__, ota_state);
-        ctx->curr_state = ota_state;
+        cb_data.percentage = (cb_data.bytes_written * 100) / cb_data.total_size;
     }
-}
 
 #if defined(COMPONENT_OTA_HTTP) || defined(COMPONENT_OTA_MQTT)
-static void cy_ota_set_last_error(cy_ota_context_t *ctx, cy_rslt_t error)
-{
-    CY_OTA_CONTEXT_ASSERT(ctx);
-
-    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "%s(0x%lx) state:%d\n", __func__, error, ctx->curr_state);
-
+    cb_data.connection_type = ctx->curr_connect_type;
+    cb_data.broker_server   = ctx->curr_server;
+#endif
 
-    if (error == CY_RSLT_SUCCESS)
+#ifdef COMPONENT_OTA_MQTT
+    if (cb_data.connection_type == CY_OTA_CONNECTION_MQTT)
     {
-        if ( (ctx->curr_state <= CY_OTA_STATE_AGENT_WAITING) ||
-             (ctx->curr_state == CY_OTA_STATE_START_UPDATE) ||
-             (ctx->curr_state == CY_OTA_STATE_JOB_CONNECT) ||
-             (ctx->curr_state == CY_OTA_STATE_DATA_CONNECT) ||
-             (ctx->curr_state == CY_OTA_STATE_DATA_DOWNLOAD) ||
-             (ctx->curr_state == CY_OTA_STATE_RESULT_CONNECT) )
+        cb_data.json_doc         = ctx->json_doc;
+        cb_data.unique_topic     = ctx->mqtt.unique_topic;
+        cb_data.unique_topic_len = strnlen(ctx->mqtt.unique_topic, sizeof(ctx->mqtt.unique_topic));
+        cb_data.credentials      = &ctx->network_params.mqtt.credentials;
+    }
+#endif
+#ifdef COMPONENT_OTA_HTTP
+    if ( (cb_data.connection_type == CY_OTA_CONNECTION_HTTP) ||
+         (cb_data.connection_type == CY_OTA_CONNECTION_HTTPS) )
+    {
+        cb_data.json_doc = ctx->json_doc;
+        cb_data.file     = ctx->http.file;
+        if ( (ctx->curr_state == CY_OTA_STATE_DATA_CONNECT) &&
+             (ctx->network_params.use_get_job_flow == CY_OTA_JOB_FLOW) )
         {
-            cy_ota_last_error = CY_RSLT_SUCCESS;
+            cb_data.file = ctx->parsed_job.file;
         }
+        cb_data.credentials = &ctx->network_params.http.credentials;
     }
-    else if (cy_ota_last_error != CY_RSLT_OTA_ERROR_APP_RETURNED_STOP)
+#endif
+#if defined(COMPONENT_OTA_HTTP) || defined(COMPONENT_OTA_MQTT)
+    if (ctx->curr_state == CY_OTA_STATE_JOB_PARSE)
     {
-        cy_ota_last_error = error;
+        cb_data.json_doc = ctx->job_doc;
     }
-    else
+    if (cb_data.json_doc != NULL)
     {
-        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "%s(0x%lx) DID NOT SET STATE curr state:%d\n", __func__, error, ctx->curr_state);
+        cb_data.json_doc_len = strnlen(cb_data.json_doc, CY_OTA_JSON_DOC_BUFF_SIZE);
+    }
+    if (cb_data.file != NULL)
+    {
+        cb_data.file_len = strnlen(cb_data.file, CY_OTA_HTTP_FILENAME_SIZE);
     }
-}
-#endif
 
-/* --------------------------------------------------------------- *
- * Timer Functions
- * --------------------------------------------------------------- */
+    /* Used for the connection unless the Application overrides it */
+    ctx->cb_credentials = (cy_awsport_ssl_credentials_t *)cb_data.credentials;
+#endif
 
-static void cy_ota_timer_callback(cy_timer_callback_arg_t arg)
-{
-    cy_ota_context_t *ctx = (cy_ota_context_t *)arg;
-    CY_OTA_CONTEXT_ASSERT(ctx);
+    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "%s() calling OTA Callback state: %d\n", __func__, ctx->curr_state);
+    ctx->cb_v2_active = true;
+    cb_result = ctx->agent_params.cb_func_v2(&cb_data);
+    ctx->cb_v2_active = false;
 
-    if (ctx->curr_state < CY_OTA_STATE_AGENT_WAITING )
-    {
-        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Timer event with bad state: %s\n", __func__, cy_ota_get_state_string(ctx->curr_state));
-    }
-    else
-    {
-        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "%s() new timer event: 0x%lx\n", __func__, ctx->ota_timer_event);
-        cy_rtos_setbits_event(&ctx->ota_event, (uint32_t)ctx->ota_timer_event, 0);
-    }
+    return cb_result;
 }
 
-#if defined(COMPONENT_OTA_HTTP) || defined(COMPONENT_OTA_MQTT)
-static cy_rslt_t cy_ota_stop_timer(cy_ota_context_t *ctx)
-{
-    CY_OTA_CONTEXT_ASSERT(ctx);
-    return cy_rtos_stop_timer(&ctx->ota_timer);
+/**
+ * @brief OTA internal Callback to Application
+ *
+ * @param   ctx     - OTA context
+ * @param   reason  - OTA Callback reason
+ * @param   state   - OTA State to report in callback
+ *                      This is usually ctx->curr_state
+ *                      When downloading Data and Storage Writing it will be CY_OTA_STATE_STORAGE_WRITE
+ *
+ * @return  return value from callback
+ */
+cy_ota_callback_results_t cy_ota_internal_call_cb( cy_ota_context_t *ctx,
+                                                   cy_ota_cb_reason_t reason,
+                                                   cy_ota_agent_state_t report_state)
+{
+    /* default result is for OTA Agent to continue with default functionality */
+    cy_ota_callback_results_t   cb_result = CY_OTA_CB_RSLT_OTA_CONTINUE;
+
+    CY_OTA_CONTEXT_ASSERT(ctx);
+
+    /* Chunks go to the lightweight callback as received */
+    if ( (report_state == CY_OTA_STATE_STORAGE_WRITE) && (ctx->agent_params.write_cb_func != NULL) )
+    {
+        return ctx->agent_params.write_cb_func(ctx->storage, ctx->ota_storage_context.total_bytes_written,
+                                               ctx->ota_storage_context.total_image_size, ctx->agent_params.cb_arg);
+    }
+
+    /* Not subscribed, nothing to fill in */
+    if ( ( (ctx->agent_params.cb_reason_mask != CY_OTA_CB_MASK_ALL) &&
+           ( (ctx->agent_params.cb_reason_mask & CY_OTA_CB_REASON_MASK(reason)) == 0) ) ||
+         ( (ctx->agent_params.cb_state_mask != CY_OTA_CB_MASK_ALL) &&
+           ( (ctx->agent_params.cb_state_mask & CY_OTA_CB_STATE_MASK(report_state)) == 0) ) )
+    {
+        return cb_result;
+    }
+
+    if (ctx->agent_params.cb_func_v2 != NULL)
+    {
+        cb_result = cy_ota_call_cb_v2(ctx, reason, report_state);
+    }
+#if (CY_OTA_CALLBACK_V1 == 1)
+    else if (ctx->agent_params.cb_func != NULL)
+    {
+        cb_result = cy_ota_call_cb_v1(ctx, reason, report_state);
+    }
+#endif
+    else
+    {
+        return cb_result;
+    }
+
+    if ( (cb_result == CY_OTA_CB_RSLT_APP_SUCCESS) &&
+         ( (ctx->curr_state == CY_OTA_STATE_JOB_DISCONNECT) ||
+           (ctx->curr_state == CY_OTA_STATE_DATA_DISCONNECT) ||
+           (ctx->curr_state == CY_OTA_STATE_RESULT_DISCONNECT) ) )
+    {
+        /*
+         * The app has taken care of the disconnect operation. Clean up
+         * our connection information.
+         */
+
+
+#ifdef COMPONENT_OTA_MQTT
+        if (ctx->curr_connect_type == CY_OTA_CONNECTION_MQTT)
+        {
+            ctx->mqtt.connection_from_app    = false;
+            ctx->mqtt.connection_established = false;
+            ctx->mqtt.mqtt_connection        = NULL;
+        }
+#endif
+#ifdef COMPONENT_OTA_HTTP
+        if ( (ctx->curr_connect_type == CY_OTA_CONNECTION_HTTP) ||
+             (ctx->curr_connect_type == CY_OTA_CONNECTION_HTTPS) )
+        {
+            ctx->http.connection_from_app = false;
+            ctx->http.connection          = NULL;
+        }
+#endif
+    }
+    else
+    {
+        /* Nothing to do here - Needed for Coverity (MISRA C 2012 Rule 15.7) */
+    }
+
+    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "%s(reason:%d) CB returning 0x%lx\n", __func__, reason, cb_result);
+
+    return cb_result;
+}
+
+/***********************************************************************
+ *
+ * Miscellaneous Functions
+ *
+ **********************************************************************/
+void cy_ota_set_state(cy_ota_context_t *ctx, cy_ota_agent_state_t ota_state)
+{
+    CY_OTA_CONTEXT_ASSERT(ctx);
+
+    /* sanity check */
+    if (ota_state >= CY_OTA_NUM_STATES )
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() BAD STATE: %d\n", __func__, ota_state);
+    }
+    else
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_INFO, "%s() state: %d\n", __func__, ota_state);
+        ctx->curr_state = ota_state;
+    }
+}
+
+#if defined(COMPONENT_OTA_HTTP) || defined(COMPONENT_OTA_MQTT)
+static void cy_ota_set_last_error(cy_ota_context_t *ctx, cy_rslt_t error)
+{
+    CY_OTA_CONTEXT_ASSERT(ctx);
+
+    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "%s(0x%lx) state:%d\n", __func__, error, ctx->curr_state);
+
+
+    if (error == CY_RSLT_SUCCESS)
+    {
+        if ( (ctx->curr_state <= CY_OTA_STATE_AGENT_WAITING) ||
+             (ctx->curr_state == CY_OTA_STATE_START_UPDATE) ||
+             (ctx->curr_state == CY_OTA_STATE_JOB_CONNECT) ||
+             (ctx->curr_state == CY_OTA_STATE_DATA_CONNECT) ||
+             (ctx->curr_state == CY_OTA_STATE_DATA_DOWNLOAD) ||
+             (ctx->curr_state == CY_OTA_STATE_RESULT_CONNECT) )
+        {
+            ctx->last_error = CY_RSLT_SUCCESS;
+            cy_ota_last_error = CY_RSLT_SUCCESS;
+        }
+    }
+    else if (ctx->last_error != CY_RSLT_OTA_ERROR_APP_RETURNED_STOP)
+    {
+        ctx->last_error = error;
+        cy_ota_last_error = error;
+    }
+    else
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "%s(0x%lx) DID NOT SET STATE curr state:%d\n", __func__, error, ctx->curr_state);
+    }
+}
+#endif
+
+/* --------------------------------------------------------------- *
+ * Timer Functions
+ * --------------------------------------------------------------- */
+
+static void cy_ota_timer_callback(cy_timer_callback_arg_t arg)
+{
+    cy_ota_context_t *ctx = (cy_ota_context_t *)arg;
+    CY_OTA_CONTEXT_ASSERT(ctx);
+
+    if (ctx->curr_state < CY_OTA_STATE_AGENT_WAITING )
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Timer event with bad state: %s\n", __func__, cy_ota_get_state_string(ctx->curr_state));
+    }
+    else
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "%s() new timer event: 0x%lx\n", __func__, ctx->ota_timer_event);
+        cy_rtos_setbits_event(&ctx->ota_event, (uint32_t)ctx->ota_timer_event, 0);
+    }
+}
+
+#if defined(COMPONENT_OTA_HTTP) || defined(COMPONENT_OTA_MQTT)
+static cy_rslt_t cy_ota_stop_timer(cy_ota_context_t *ctx)
+{
+    CY_OTA_CONTEXT_ASSERT(ctx);
+    return cy_rtos_stop_timer(&ctx->ota_timer);
 }
 
 static cy_rslt_t cy_ota_start_timer(cy_ota_context_t *ctx, uint32_t secs, ota_events_t event)
@@ -814,6 +1119,39 @@ static cy_rslt_t cy_ota_setup_connection_type(cy_ota_context_t *ctx)
 }
 
 #if defined(COMPONENT_OTA_HTTP) || defined(COMPONENT_OTA_MQTT)
+/** Split a "<major>.<minor>.<build>" version string
+ *
+ * @param[in]   version : NUL terminated version string
+ * @param[out]  major   : Major Version
+ * @param[out]  minor   : Minor Version
+ * @param[out]  build   : Build Version
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          CY_RSLT_OTA_ERROR_MALFORMED_JOB_DOC
+ */
+static cy_rslt_t cy_ota_split_version(const char *version, uint16_t *major, uint16_t *minor, uint16_t *build)
+{
+    const char  *dot;
+
+    *major = atoi(version);
+    dot = strchr(version, '.');
+    if (dot == NULL)
+    {
+        return CY_RSLT_OTA_ERROR_MALFORMED_JOB_DOC;
+    }
+    dot++;
+    *minor = atoi(dot);
+    dot = strchr(dot, '.');
+    if (dot == NULL)
+    {
+        return CY_RSLT_OTA_ERROR_MALFORMED_JOB_DOC;
+    }
+    dot++;
+    *build = atoi(dot);
+
+    return CY_RSLT_SUCCESS;
+}
+
 /** Callback function used JSON parse
  *
  * @param[in] json_obj : JSON object which contains the key=value pair parsed by the JSON parser
@@ -899,32 +1237,35 @@ static cy_rslt_t cy_OTA_JSON_callback(cy_JSON_object_t* json_obj, void *arg)
                       (strncasecmp(obj, CY_OTA_VERSION_FIELD, obj_len) == 0) )
             {
                 /* copy version string, and split into parts */
-                const char  *dot;
                 if (val_len > sizeof(ctx->parsed_job.app_ver) )
                 {
                     cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_WARNING, "Job parse: Version Number text too long!\n");
                     val_len = sizeof(ctx->parsed_job.app_ver) - 1;
                 }
                 memcpy(ctx->parsed_job.app_ver, val, val_len);
-                /* split into parts */
-                ctx->parsed_job.ver_major = atoi(ctx->parsed_job.app_ver);
-                dot = strchr(ctx->parsed_job.app_ver, '.');
-                if (dot == NULL)
+                if (cy_ota_split_version(ctx->parsed_job.app_ver, &ctx->parsed_job.ver_major,
+                                         &ctx->parsed_job.ver_minor, &ctx->parsed_job.ver_build) != CY_RSLT_SUCCESS)
                 {
                     cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_WARNING, "%s() OTA Job Bad Version field %.*s\n", __func__, val_len, val);
                     return CY_RSLT_OTA_ERROR_MALFORMED_JOB_DOC;
                 }
-                dot++;
-                ctx->parsed_job.ver_minor = atoi(dot);
-                dot = strchr(dot, '.');
-                if (dot == NULL)
+            }
+            else if ( (obj_len == strlen(CY_OTA_DELTA_BASE_FIELD) ) &&
+                      (strncasecmp(obj, CY_OTA_DELTA_BASE_FIELD, obj_len) == 0) )
+            {
+                /* OTA Image is a patch against this version */
+                if (val_len > sizeof(ctx->parsed_job.delta_base) )
                 {
-                    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_WARNING, "%s() OTA Job Bad Version field %.*s\n", __func__, val_len, val);
+                    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_WARNING, "Job parse: Delta Base text too long!\n");
+                    val_len = sizeof(ctx->parsed_job.delta_base) - 1;
+                }
+                memcpy(ctx->parsed_job.delta_base, val, val_len);
+                if (cy_ota_split_version(ctx->parsed_job.delta_base, &ctx->parsed_job.delta_major,
+                                         &ctx->parsed_job.delta_minor, &ctx->parsed_job.delta_build) != CY_RSLT_SUCCESS)
+                {
+                    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_WARNING, "%s() OTA Job Bad Delta Base field %.*s\n", __func__, val_len, val);
                     return CY_RSLT_OTA_ERROR_MALFORMED_JOB_DOC;
                 }
-                dot++;
-                ctx->parsed_job.ver_build = atoi(dot);
-
             }
             else if ( (obj_len == strlen(CY_OTA_BOARD_FIELD) ) &&
                       (strncasecmp(obj, CY_OTA_BOARD_FIELD, obj_len) == 0) )
@@ -1036,6 +1377,11 @@ static void cy_ota_print_parsed_doc_info(cy_ota_context_t *ctx)
     cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_NOTICE, "   Version  : %s (%d.%d.%d)\n", ctx->parsed_job.app_ver, ctx->parsed_job.ver_major,
                                              ctx->parsed_job.ver_minor, ctx->parsed_job.ver_build);
     cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_NOTICE, "   Board    : %s\n", ctx->parsed_job.board);
+    if (ctx->parsed_job.delta_base[0] != 0)
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_NOTICE, "   Delta    : %s (%d.%d.%d)\n", ctx->parsed_job.delta_base, ctx->parsed_job.delta_major,
+                                                 ctx->parsed_job.delta_minor, ctx->parsed_job.delta_build);
+    }
     cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_NOTICE, "  Connection: %s\n", (ctx->parsed_job.connect_type == CY_OTA_CONNECTION_MQTT) ? CY_OTA_MQTT_STRING :
                                 (ctx->parsed_job.connect_type == CY_OTA_CONNECTION_HTTP) ? CY_OTA_HTTP_STRING :
                                 (ctx->parsed_job.connect_type == CY_OTA_CONNECTION_HTTPS) ? CY_OTA_HTTPS_STRING :
@@ -1137,6 +1483,33 @@ static cy_rslt_t cy_ota_parse_job_info(cy_ota_context_t *ctx, const char *buffer
         goto _end_JSON_parse;
     }
 
+    /* validate a patch applies to the current application */
+    if (ctx->parsed_job.delta_base[0] != 0)
+    {
+#if (CY_OTA_DELTA_UPDATE == 1)
+        if (ctx->storage_iface.ota_file_read_source == NULL)
+        {
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "OTA Job - Delta update needs ota_file_read_source(). Fail.\n");
+            result = CY_RSLT_OTA_ERROR_UNSUPPORTED;
+            goto _end_JSON_parse;
+        }
+        if ( (APP_VERSION_MAJOR != ctx->parsed_job.delta_major) ||
+             (APP_VERSION_MINOR != ctx->parsed_job.delta_minor) ||
+             (APP_VERSION_BUILD != ctx->parsed_job.delta_build) )
+        {
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "OTA Job - Current Application version %d.%d.%d patch for %d.%d.%d. Fail.\n",
+                        APP_VERSION_MAJOR, APP_VERSION_MINOR, APP_VERSION_BUILD,
+                        ctx->parsed_job.delta_major, ctx->parsed_job.delta_minor, ctx->parsed_job.delta_build);
+            result = CY_RSLT_OTA_ERROR_INVALID_VERSION;
+            goto _end_JSON_parse;
+        }
+#else
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "OTA Job - Delta update, build with CY_OTA_DELTA_UPDATE=1. Fail.\n");
+        result = CY_RSLT_OTA_ERROR_UNSUPPORTED;
+        goto _end_JSON_parse;
+#endif
+    }
+
     /* validate kit type */
     if (strcmp(ctx->parsed_job.board, CY_TARGET_BOARD_STRING) != 0)
     {
@@ -1229,6 +1602,9 @@ static cy_rslt_t cy_ota_clear_received_stats(cy_ota_context_t *ctx)
     ctx->ota_storage_context.total_bytes_written = 0;
     ctx->ota_storage_context.total_image_size = 0;
     ctx->ota_storage_context.total_packets = 0;
+    cy_ota_range_map_clear(&ctx->written_ranges);
+    cy_ota_range_map_clear(&ctx->received_ranges);
+    ctx->received_bytes = 0;
 
     return CY_RSLT_SUCCESS;
 }
@@ -1301,9 +1677,12 @@ static cy_rslt_t cy_ota_wait_for_start(cy_ota_context_t *ctx)
             COMPANY_TOPIC_PREPEND, CY_TARGET_BOARD_STRING, CY_OTA_MQTT_MAGIC, (uint16_t)(tval & 0x0000FFFF) );
 #endif
 
-    /* clear any old events */
-    waitfor = CY_OTA_EVENT_THREAD_EVENTS;
-    cy_rtos_waitbits_event(&ctx->ota_event, &waitfor, 1, 0, 1);
+    /* clear any old events, cy_ota_agent_poll() only gets here with an event to act on */
+    if (ctx->agent_params.use_poll == false)
+    {
+        waitfor = CY_OTA_EVENT_THREAD_EVENTS;
+        cy_rtos_waitbits_event(&ctx->ota_event, &waitfor, 1, 0, 1);
+    }
 
     while ( true )
     {
@@ -1311,7 +1690,8 @@ static cy_rslt_t cy_ota_wait_for_start(cy_ota_context_t *ctx)
 
         /* get event */
         waitfor = CY_OTA_EVENT_THREAD_EVENTS;
-        result = cy_rtos_waitbits_event(&ctx->ota_event, &waitfor, 1, 0, CY_OTA_WAIT_FOR_EVENTS_MS);
+        result = cy_rtos_waitbits_event(&ctx->ota_event, &waitfor, 1, 0,
+                                        (ctx->agent_params.use_poll == false) ? CY_OTA_WAIT_FOR_EVENTS_MS : 0);
         cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG3, "%s() OTA Agent cy_rtos_waitbits_event: 0x%lx type:%d mod:0x%lx code:%d\n", __func__, waitfor,
                     CY_RSLT_GET_TYPE(result), CY_RSLT_GET_MODULE(result), CY_RSLT_GET_CODE(result) );
 
@@ -1405,80 +1785,416 @@ static cy_rslt_t cy_ota_determine_flow(cy_ota_context_t *ctx)
     return result;
 }
 
-static cy_rslt_t cy_ota_open_filesystem(cy_ota_context_t *ctx)
-{
-    cy_rslt_t                   result = CY_RSLT_SUCCESS;
+/***********************************************************************
+ *
+ * Download checkpoint
+ *
+ **********************************************************************/
 
-    /* If we are retrying to download the Data and we didn't write anything
-     *   we do not need to erase the FLASH.
-     */
-    if ( (ctx->download_retry_count == 0) ||
-         (ctx->ota_storage_context.total_bytes_written > 0) )
+/* File name that identifies the OTA Image being downloaded */
+static const char *cy_ota_checkpoint_file(cy_ota_context_t *ctx)
+{
+    if (ctx->network_params.use_get_job_flow == CY_OTA_JOB_FLOW)
     {
-        result = ctx->storage_iface.ota_file_open(&(ctx->ota_storage_context));
+        return ctx->parsed_job.file;
     }
-
-    if (result == CY_RSLT_SUCCESS)
+#ifdef COMPONENT_OTA_HTTP
+    if ( (ctx->network_params.initial_connection != CY_OTA_CONNECTION_MQTT) &&
+         (ctx->network_params.http.file != NULL) )
     {
-        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_NOTICE, "Filesystem open\n");
-        ctx->storage_open = 1;
+        return ctx->network_params.http.file;
     }
+#endif
+    return "";
+}
 
-    return result;
+/* CRC32 of the Job fields that name the OTA Image.
+ * The whole Job document also carries per-session fields (ex: UniqueTopicName).
+ */
+static uint32_t cy_ota_checkpoint_job_crc32(cy_ota_context_t *ctx)
+{
+    const cy_ota_job_parsed_info_t  *job = &ctx->parsed_job;
+    uint32_t                        crc32 = 0;
+
+    crc32 = cy_ota_crc32_update(crc32, (const uint8_t *)job->manuf, strlen(job->manuf));
+    crc32 = cy_ota_crc32_update(crc32, (const uint8_t *)job->manuf_id, strlen(job->manuf_id));
+    crc32 = cy_ota_crc32_update(crc32, (const uint8_t *)job->product, strlen(job->product));
+    crc32 = cy_ota_crc32_update(crc32, (const uint8_t *)job->board, strlen(job->board));
+    crc32 = cy_ota_crc32_update(crc32, (const uint8_t *)job->app_ver, strlen(job->app_ver));
+    crc32 = cy_ota_crc32_update(crc32, (const uint8_t *)job->new_host_name, strlen(job->new_host_name));
+    crc32 = cy_ota_crc32_update(crc32, (const uint8_t *)job->file, strlen(job->file));
+    crc32 = cy_ota_crc32_update(crc32, (const uint8_t *)&job->file_size, sizeof(job->file_size));
+    crc32 = cy_ota_crc32_update(crc32, (const uint8_t *)job->delta_base, strlen(job->delta_base));
+
+    return crc32;
 }
 
-static cy_rslt_t cy_ota_close_filesystem(cy_ota_context_t *ctx)
+static bool cy_ota_checkpoint_supported(cy_ota_context_t *ctx)
 {
-    cy_rslt_t   result = CY_RSLT_SUCCESS;
+    return ( (ctx->storage_iface.ota_file_checkpoint_save != NULL) &&
+             (ctx->storage_iface.ota_file_checkpoint_load != NULL) &&
+             (ctx->storage_iface.ota_file_resume != NULL) );
+}
 
-    if (ctx->storage_open == 1)
+static void cy_ota_checkpoint_store(cy_ota_context_t *ctx, uint32_t offset)
+{
+    if (cy_ota_checkpoint_supported(ctx) == false)
     {
-        result = ctx->storage_iface.ota_file_close(&(ctx->ota_storage_context));
-        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_NOTICE, "Filesystem closed\n");
+        return;
     }
 
-    ctx->storage_open = 0;
+#if (CY_OTA_DECOMPRESS != CY_OTA_DECOMPRESS_NONE)
+    /* The decoder state cannot be restored, a compressed download starts over */
+    if ( (offset > 0) && ( (ctx->decompress.active == true) || (ctx->decompress.checked == false) ) )
+    {
+        return;
+    }
+#endif
+#if (CY_OTA_DELTA_UPDATE == 1)
+    /* The patch state cannot be restored, a delta download starts over */
+    if ( (offset > 0) && ( (ctx->delta.active == true) || (ctx->delta.checked == false) ) )
+    {
+        return;
+    }
+#endif
+#if (CY_OTA_TAR_PARSER == 1)
+    /* The archive position cannot be restored, a TAR download starts over */
+    if ( (offset > 0) && ( (ctx->tar.active == true) || (ctx->tar.decided == false) ) )
+    {
+        return;
+    }
+#endif
+#if (CY_OTA_STORAGE_COALESCE_SIZE > 0)
+    /* The checkpoint must not cover data still in the coalescing buffer */
+    if ( (offset > 0) && (cy_ota_coalesce_flush(ctx) != CY_RSLT_SUCCESS) )
+    {
+        return;
+    }
+#endif
 
-    return result;
+    memset(&ctx->checkpoint, 0x00, sizeof(ctx->checkpoint));
+    if (offset > 0)
+    {
+        ctx->checkpoint.magic = CY_OTA_CHECKPOINT_MAGIC;
+        if (ctx->network_params.use_get_job_flow == CY_OTA_JOB_FLOW)
+        {
+            ctx->checkpoint.ver_major = ctx->parsed_job.ver_major;
+            ctx->checkpoint.ver_minor = ctx->parsed_job.ver_minor;
+            ctx->checkpoint.ver_build = ctx->parsed_job.ver_build;
+            ctx->checkpoint.job_crc32 = cy_ota_checkpoint_job_crc32(ctx);
+        }
+        ctx->checkpoint.total_image_size = ctx->ota_storage_context.total_image_size;
+        ctx->checkpoint.offset = offset;
+        strncpy(ctx->checkpoint.file, cy_ota_checkpoint_file(ctx), (sizeof(ctx->checkpoint.file) - 1) );
+#ifdef COMPONENT_OTA_HTTP
+        strncpy(ctx->checkpoint.etag, ctx->http.etag, (sizeof(ctx->checkpoint.etag) - 1) );
+#endif
+        ctx->checkpoint.first_block_crc32 = ctx->first_block_crc32;
+        ctx->checkpoint.first_block_size = ctx->first_block_size;
+        ctx->checkpoint.total_packets = ctx->ota_storage_context.total_packets;
+    }
+
+    if (ctx->storage_iface.ota_file_checkpoint_save(&(ctx->ota_storage_context), &ctx->checkpoint) != CY_RSLT_SUCCESS)
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_WARNING, "%s() Checkpoint save failed\n", __func__);
+    }
 }
 
-static cy_rslt_t cy_ota_connect(cy_ota_context_t *ctx)
+/* Returns the number of bytes that can be kept in storage, 0 to start over */
+static uint32_t cy_ota_checkpoint_load(cy_ota_context_t *ctx)
 {
-    cy_rslt_t                   result = CY_RSLT_SUCCESS;
+    if (cy_ota_checkpoint_supported(ctx) == false)
+    {
+        return 0;
+    }
 
-    /* ChecK if we are already connected */
-    if (ctx->device_connected == 1)
+    memset(&ctx->checkpoint, 0x00, sizeof(ctx->checkpoint));
+    if (ctx->storage_iface.ota_file_checkpoint_load(&(ctx->ota_storage_context), &ctx->checkpoint) != CY_RSLT_SUCCESS)
     {
-        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_WARNING, "%s() Already connected!\n", __func__);
-        return CY_RSLT_OTA_ALREADY_CONNECTED;
+        return 0;
     }
 
-    /* let's clear up any errors so that we are starting this phase clean.
-     * We would not get here if there were errors before this step.
-     */
-    /* reset counters & flags */
-    ctx->contact_server_retry_count = 0;
-    ctx->stop_OTA_session = 0;
-    cy_ota_set_last_error(ctx, CY_RSLT_SUCCESS);
+    if ( (ctx->checkpoint.magic != CY_OTA_CHECKPOINT_MAGIC) ||
+         (ctx->checkpoint.offset == 0) ||
+         (ctx->checkpoint.offset >= ctx->checkpoint.total_image_size) )
+    {
+        return 0;
+    }
 
-    /* make the connection */
-#ifdef COMPONENT_OTA_MQTT
-    if (ctx->curr_connect_type == CY_OTA_CONNECTION_MQTT)
+    ctx->checkpoint.file[sizeof(ctx->checkpoint.file) - 1] = '\0';
+    if (strcmp(ctx->checkpoint.file, cy_ota_checkpoint_file(ctx)) != 0)
     {
-        /* check if app provided connection */
-        if (ctx->mqtt.connection_from_app == true)
-        {
-            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_NOTICE, "%s() App provided MQTT connection.\n", __func__);
-            return CY_RSLT_SUCCESS;
-        }
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_NOTICE, "Checkpoint for a different file, start over\n");
+        return 0;
+    }
 
-        if (ctx->mqtt.connection_established == true)
-        {
-            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_NOTICE, "%s() MQTT Already connected.\n", __func__);
+    if ( (ctx->network_params.use_get_job_flow == CY_OTA_JOB_FLOW) &&
+         ( (ctx->checkpoint.ver_major != ctx->parsed_job.ver_major) ||
+           (ctx->checkpoint.ver_minor != ctx->parsed_job.ver_minor) ||
+           (ctx->checkpoint.ver_build != ctx->parsed_job.ver_build) ||
+           ( (ctx->parsed_job.file_size != 0) && (ctx->parsed_job.file_size != ctx->checkpoint.total_image_size) ) ) )
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_NOTICE, "Checkpoint for a different version, start over\n");
+        return 0;
+    }
+
+    /* Name, version and size do not tell two builds apart, something must identify the content */
+    ctx->checkpoint.etag[sizeof(ctx->checkpoint.etag) - 1] = '\0';
+    if (ctx->network_params.use_get_job_flow == CY_OTA_JOB_FLOW)
+    {
+        if (ctx->checkpoint.job_crc32 != cy_ota_checkpoint_job_crc32(ctx))
+        {
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_NOTICE, "Checkpoint for a different Job, start over\n");
+            return 0;
+        }
+        ctx->resume_verified = true;
+    }
+    else if ( (ctx->checkpoint.etag[0] == '\0') && (ctx->checkpoint.first_block_size == 0) )
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_NOTICE, "Checkpoint does not identify the OTA Image, start over\n");
+        return 0;
+    }
+
+    /* Keep the identity for the checkpoints saved while resuming */
+    ctx->first_block_crc32 = ctx->checkpoint.first_block_crc32;
+    ctx->first_block_size = ctx->checkpoint.first_block_size;
+
+    return ctx->checkpoint.offset;
+}
+
+void cy_ota_checkpoint_discard(cy_ota_context_t *ctx)
+{
+    ctx->resume_offset = 0;
+    ctx->resume_verified = false;
+    ctx->first_block_crc32 = 0;
+    ctx->first_block_size = 0;
+    cy_ota_writer_lock(ctx);
+    cy_ota_range_map_clear(&ctx->written_ranges);
+    cy_ota_writer_unlock(ctx);
+    cy_ota_range_map_clear(&ctx->received_ranges);
+    cy_ota_checkpoint_store(ctx, 0);
+}
+
+cy_rslt_t cy_ota_checkpoint_check_image(cy_ota_context_t *ctx, uint32_t total_size, const char *etag)
+{
+    if (ctx->resume_offset == 0)
+    {
+        return CY_RSLT_SUCCESS;
+    }
+
+    if ( (total_size != 0) && (total_size != ctx->checkpoint.total_image_size) )
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "OTA Image size %ld does not match checkpoint %ld, start over\n",
+                       total_size, ctx->checkpoint.total_image_size);
+        cy_ota_checkpoint_discard(ctx);
+        return CY_RSLT_OTA_ERROR_GET_DATA;
+    }
+
+    /* A server that sent an ETag before must send the same one now */
+    if ( (etag != NULL) && (ctx->checkpoint.etag[0] != '\0') )
+    {
+        if (strcmp(etag, ctx->checkpoint.etag) != 0)
+        {
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "OTA Image ETag %s does not match checkpoint %s, start over\n",
+                           etag, ctx->checkpoint.etag);
+            cy_ota_checkpoint_discard(ctx);
+            return CY_RSLT_OTA_ERROR_GET_DATA;
+        }
+        ctx->resume_verified = true;
+    }
+
+    if ( (etag != NULL) && (ctx->resume_verified == false) )
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "OTA Image cannot be matched to the checkpoint, start over\n");
+        cy_ota_checkpoint_discard(ctx);
+        return CY_RSLT_OTA_ERROR_GET_DATA;
+    }
+
+    return CY_RSLT_SUCCESS;
+}
+
+cy_rslt_t cy_ota_checkpoint_first_block(cy_ota_context_t *ctx, const cy_ota_storage_write_info_t *chunk_info)
+{
+    uint32_t    crc32;
+
+    crc32 = cy_ota_crc32_update(0, chunk_info->buffer, chunk_info->size);
+    if (ctx->resume_offset == 0)
+    {
+        ctx->first_block_crc32 = crc32;
+        ctx->first_block_size = chunk_info->size;
+        return CY_RSLT_SUCCESS;
+    }
+
+    /* A CRC32 of one packet is weak on its own, the header must describe the same OTA Image */
+    if ( (ctx->checkpoint.total_image_size != chunk_info->total_size) ||
+         (ctx->checkpoint.total_packets != chunk_info->total_packets) )
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "OTA Image size %ld / %d packets does not match checkpoint %ld / %ld, start over\n",
+                       chunk_info->total_size, chunk_info->total_packets,
+                       ctx->checkpoint.total_image_size, ctx->checkpoint.total_packets);
+        cy_ota_checkpoint_discard(ctx);
+        return CY_RSLT_OTA_ERROR_GET_DATA;
+    }
+
+    if ( (ctx->checkpoint.first_block_size != chunk_info->size) ||
+         (ctx->checkpoint.first_block_crc32 != crc32) )
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "OTA Image first packet does not match checkpoint, start over\n");
+        cy_ota_checkpoint_discard(ctx);
+        return CY_RSLT_OTA_ERROR_GET_DATA;
+    }
+
+    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_NOTICE, "OTA Image first packet matches checkpoint\n");
+    ctx->resume_verified = true;
+    return CY_RSLT_SUCCESS;
+}
+
+void cy_ota_checkpoint_update(cy_ota_context_t *ctx, const cy_ota_range_map_t *persisted)
+{
+    uint32_t    offset;
+
+    if (cy_ota_checkpoint_supported(ctx) == false)
+    {
+        return;
+    }
+
+    /* Only the contiguous part from the start of the OTA Image can be resumed */
+    offset = cy_ota_range_map_next_hole(persisted, ctx->ota_storage_context.total_image_size, NULL);
+    if ( (offset < ctx->ota_storage_context.total_image_size) &&
+         (offset >= (ctx->checkpoint.offset + CY_OTA_CHECKPOINT_INTERVAL) ) )
+    {
+        cy_ota_checkpoint_store(ctx, offset);
+    }
+}
+
+void cy_ota_storage_written(cy_ota_context_t *ctx, const cy_ota_storage_write_info_t *chunk_info)
+{
+    /* the network side may read these while the writer thread runs */
+    cy_ota_writer_lock(ctx);
+    ctx->ota_storage_context.total_bytes_written   += chunk_info->size;
+    ctx->ota_storage_context.last_offset            = chunk_info->offset;
+    ctx->ota_storage_context.last_size              = chunk_info->size;
+    (void)cy_ota_range_map_add(&ctx->written_ranges, chunk_info->offset, chunk_info->size);
+    cy_ota_writer_unlock(ctx);
+
+    cy_ota_checkpoint_update(ctx, &ctx->written_ranges);
+}
+
+static cy_rslt_t cy_ota_open_filesystem(cy_ota_context_t *ctx)
+{
+    cy_rslt_t                   result = CY_RSLT_SUCCESS;
+    bool                        resume_failed = false;
+
+    /* Continue from a saved checkpoint without erasing what is already in storage */
+    ctx->resume_verified = false;
+    ctx->first_block_crc32 = 0;
+    ctx->first_block_size = 0;
+    ctx->resume_offset = cy_ota_checkpoint_load(ctx);
+    if (ctx->resume_offset > 0)
+    {
+        result = ctx->storage_iface.ota_file_resume(&(ctx->ota_storage_context), ctx->resume_offset);
+        if (result == CY_RSLT_SUCCESS)
+        {
+            /* ota_file_resume() prepares the rest of storage */
+            ctx->erase_ahead = false;
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_NOTICE, "Resume download at %ld of %ld\n",
+                           ctx->resume_offset, ctx->checkpoint.total_image_size);
+            ctx->storage_open = 1;
+            return result;
+        }
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_WARNING, "%s() Resume failed 0x%lx, start over\n", __func__, result);
+        ctx->resume_offset = 0;
+        ctx->first_block_crc32 = 0;
+        ctx->first_block_size = 0;
+        resume_failed = true;
+    }
+    else if (ctx->checkpoint.magic == CY_OTA_CHECKPOINT_MAGIC)
+    {
+        /* stale checkpoint - storage is about to be erased */
+        cy_ota_checkpoint_store(ctx, 0);
+    }
+
+    /* If we are retrying to download the Data and we didn't write anything
+     *   we do not need to erase the FLASH.
+     */
+    if ( (ctx->download_retry_count == 0) ||
+         (ctx->ota_storage_context.total_bytes_written > 0) ||
+         (resume_failed == true) )
+    {
+        result = cy_ota_storage_open(ctx);
+    }
+
+    if (result == CY_RSLT_SUCCESS)
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_NOTICE, "Filesystem open\n");
+        ctx->storage_open = 1;
+    }
+
+    return result;
+}
+
+static cy_rslt_t cy_ota_close_filesystem(cy_ota_context_t *ctx)
+{
+    cy_rslt_t   result = CY_RSLT_SUCCESS;
+
+    if (ctx->storage_open == 1)
+    {
+        result = ctx->storage_iface.ota_file_close(&(ctx->ota_storage_context));
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_NOTICE, "Filesystem closed\n");
+    }
+
+    ctx->storage_open = 0;
+
+    return result;
+}
+
+static cy_rslt_t cy_ota_connect(cy_ota_context_t *ctx)
+{
+    cy_rslt_t                   result = CY_RSLT_SUCCESS;
+
+    /* ChecK if we are already connected */
+    if ( (ctx->device_connected == 1) && (ctx->state_in_progress == false) )
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_WARNING, "%s() Already connected!\n", __func__);
+        return CY_RSLT_OTA_ALREADY_CONNECTED;
+    }
+
+    /* let's clear up any errors so that we are starting this phase clean.
+     * We would not get here if there were errors before this step.
+     * A polled OTA Agent may come back to finish connecting, keep what it did so far.
+     */
+    if (ctx->state_in_progress == false)
+    {
+        /* reset counters & flags */
+        ctx->contact_server_retry_count = 0;
+        ctx->stop_OTA_session = 0;
+        cy_ota_set_last_error(ctx, CY_RSLT_SUCCESS);
+    }
+
+    /* make the connection */
+#ifdef COMPONENT_OTA_MQTT
+    if (ctx->curr_connect_type == CY_OTA_CONNECTION_MQTT)
+    {
+        /* check if app provided connection */
+        if (ctx->mqtt.connection_from_app == true)
+        {
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_NOTICE, "%s() App provided MQTT connection.\n", __func__);
+            return CY_RSLT_SUCCESS;
+        }
+
+        if ( (ctx->mqtt.connection_established == true) && (ctx->state_in_progress == false) )
+        {
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_NOTICE, "%s() MQTT Already connected.\n", __func__);
             return CY_RSLT_OTA_ALREADY_CONNECTED;
         }
 
         result = cy_ota_mqtt_connect(ctx);
+        if (result == CY_RSLT_OTA_POLL_AGAIN)
+        {
+            /* Connected, subscribe on the next cy_ota_agent_poll() */
+            ctx->device_connected = 1;
+            return result;
+        }
     }
     else
 #endif
@@ -1676,7 +2392,8 @@ static cy_rslt_t cy_ota_job_redirect(cy_ota_context_t *ctx)
     return result;
 }
 
-static cy_rslt_t cy_ota_data_download(cy_ota_context_t *ctx)
+/* Set up for the download, then start it with the transport */
+static cy_rslt_t cy_ota_data_download_start(cy_ota_context_t *ctx)
 {
     cy_rslt_t result = CY_RSLT_SUCCESS;
 
@@ -1692,37 +2409,240 @@ static cy_rslt_t cy_ota_data_download(cy_ota_context_t *ctx)
 
     /* clear received / written info before we start */
     cy_ota_clear_received_stats(ctx);
+    if (ctx->resume_offset > 0)
+    {
+        /* Data before the checkpoint is already in storage */
+        ctx->ota_storage_context.total_bytes_written = ctx->resume_offset;
+        (void)cy_ota_range_map_add(&ctx->written_ranges, 0, ctx->resume_offset);
+        ctx->received_bytes = ctx->resume_offset;
+        (void)cy_ota_range_map_add(&ctx->received_ranges, 0, ctx->resume_offset);
+    }
+
+#if (CY_OTA_DECOMPRESS != CY_OTA_DECOMPRESS_NONE)
+    cy_ota_decompress_start(ctx, ctx->resume_offset);
+#endif
+#if (CY_OTA_DELTA_UPDATE == 1)
+    cy_ota_delta_start(ctx, ctx->resume_offset);
+#endif
+#if (CY_OTA_TAR_PARSER == 1)
+    cy_ota_tar_start(ctx, ctx->resume_offset);
+#endif
+#if (CY_OTA_IMAGE_DIGEST)
+    cy_ota_digest_start(ctx, ctx->resume_offset);
+#endif
+
+#if (CY_OTA_STORAGE_COALESCE_SIZE > 0)
+    if (cy_ota_coalesce_start(ctx) != CY_RSLT_SUCCESS)
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_WARNING, "%s() No coalescing buffer, write each chunk to storage\n", __func__);
+    }
+#endif
+
+#if (CY_OTA_STORAGE_WRITER_BUFFERS > 0)
+    if (ctx->agent_params.use_poll != false)
+    {
+        /* A polled OTA Agent has no threads, write from cy_ota_agent_poll() */
+        ctx->writer.running = false;
+    }
+    else if (cy_ota_writer_start(ctx) != CY_RSLT_SUCCESS)
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_WARNING, "%s() Storage writer not started, write on the network thread\n", __func__);
+    }
+#endif
 
     /* get_data functions */
 #ifdef COMPONENT_OTA_MQTT
     if (ctx->curr_connect_type == CY_OTA_CONNECTION_MQTT)
     {
-        result = cy_ota_mqtt_get_data(ctx);
+        result = cy_ota_mqtt_get_data_start(ctx);
+    }
+#endif
+#ifdef COMPONENT_OTA_HTTP
+    if ( (ctx->curr_connect_type == CY_OTA_CONNECTION_HTTP) ||
+              (ctx->curr_connect_type == CY_OTA_CONNECTION_HTTPS) )
+    {
+        result = cy_ota_http_get_data_start(ctx);
+    }
+#endif
+
+    return result;
+}
+
+/* One range / event of the download, CY_RSLT_OTA_POLL_AGAIN until the transport is done */
+static cy_rslt_t cy_ota_data_download_step(cy_ota_context_t *ctx)
+{
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+
+#ifdef COMPONENT_OTA_MQTT
+    if (ctx->curr_connect_type == CY_OTA_CONNECTION_MQTT)
+    {
+        result = cy_ota_mqtt_get_data_step(ctx);
     }
 #endif
 #ifdef COMPONENT_OTA_HTTP
     if ( (ctx->curr_connect_type == CY_OTA_CONNECTION_HTTP) ||
               (ctx->curr_connect_type == CY_OTA_CONNECTION_HTTPS) )
     {
-        result = cy_ota_http_get_data(ctx);
+        result = cy_ota_http_get_data_step(ctx);
     }
 #endif
 
+    return result;
+}
+
+/* Stop the transport before it is done */
+static cy_rslt_t cy_ota_data_download_abort(cy_ota_context_t *ctx, cy_rslt_t result)
+{
+#ifdef COMPONENT_OTA_MQTT
+    if (ctx->curr_connect_type == CY_OTA_CONNECTION_MQTT)
+    {
+        result = cy_ota_mqtt_get_data_end(ctx, result);
+    }
+#endif
+#ifdef COMPONENT_OTA_HTTP
+    if ( (ctx->curr_connect_type == CY_OTA_CONNECTION_HTTP) ||
+              (ctx->curr_connect_type == CY_OTA_CONNECTION_HTTPS) )
+    {
+        result = cy_ota_http_get_data_end(ctx, result);
+    }
+#endif
+
+    return result;
+}
+
+/* Flush and close the download once the transport is done */
+static cy_rslt_t cy_ota_data_download_end(cy_ota_context_t *ctx, cy_rslt_t result)
+{
+#if (CY_OTA_STORAGE_WRITER_BUFFERS > 0)
+    cy_rslt_t writer_result;
+#endif
+#if (CY_OTA_STORAGE_COALESCE_SIZE > 0)
+    cy_rslt_t coalesce_result;
+#endif
+#if (CY_OTA_DECOMPRESS != CY_OTA_DECOMPRESS_NONE)
+    cy_rslt_t decompress_result;
+#endif
+#if (CY_OTA_DELTA_UPDATE == 1)
+    cy_rslt_t delta_result;
+#endif
+#if (CY_OTA_TAR_PARSER == 1)
+    cy_rslt_t tar_result;
+#endif
+
     /* stop the "check for an update" timer */
     cy_ota_stop_timer(ctx);
 
+#if (CY_OTA_STORAGE_WRITER_BUFFERS > 0)
+    /* Data is only downloaded once it is all in storage */
+    writer_result = cy_ota_writer_stop(ctx);
+    if ( (result == CY_RSLT_SUCCESS) && (writer_result != CY_RSLT_SUCCESS) )
+    {
+        result = writer_result;
+    }
+#endif
+
+#if (CY_OTA_DECOMPRESS != CY_OTA_DECOMPRESS_NONE)
+    /* Write the last decoded data */
+    decompress_result = cy_ota_decompress_finish(ctx);
+    if ( (result == CY_RSLT_SUCCESS) && (decompress_result != CY_RSLT_SUCCESS) )
+    {
+        result = CY_RSLT_OTA_ERROR_GET_DATA;
+    }
+#endif
+
+#if (CY_OTA_DELTA_UPDATE == 1)
+    /* Write the last patched data */
+    delta_result = cy_ota_delta_finish(ctx);
+    if ( (result == CY_RSLT_SUCCESS) && (delta_result != CY_RSLT_SUCCESS) )
+    {
+        result = CY_RSLT_OTA_ERROR_GET_DATA;
+    }
+#endif
+
+#if (CY_OTA_TAR_PARSER == 1)
+    /* Write data held for reordering, check the archive is complete */
+    tar_result = cy_ota_tar_finish(ctx);
+    if ( (result == CY_RSLT_SUCCESS) && (tar_result != CY_RSLT_SUCCESS) )
+    {
+        result = CY_RSLT_OTA_ERROR_GET_DATA;
+    }
+#endif
+
+#if (CY_OTA_STORAGE_COALESCE_SIZE > 0)
+    /* Write the tail held in the coalescing buffer */
+    coalesce_result = cy_ota_coalesce_stop(ctx);
+    if ( (result == CY_RSLT_SUCCESS) && (coalesce_result != CY_RSLT_SUCCESS) )
+    {
+        result = CY_RSLT_OTA_ERROR_WRITE_STORAGE;
+    }
+#endif
+
+#if (CY_OTA_IMAGE_DIGEST)
+    /* Passed to ota_file_verify() */
+    cy_ota_digest_finish(ctx);
+#endif
+
+    if (result == CY_RSLT_SUCCESS)
+    {
+        /* Nothing left to resume */
+        ctx->resume_offset = 0;
+        cy_ota_checkpoint_store(ctx, 0);
+    }
+    else
+    {
+        /* Keep as much of the download as possible for the next attempt */
+        uint32_t offset = cy_ota_range_map_next_hole(&ctx->written_ranges, ctx->ota_storage_context.total_image_size, NULL);
+        if ( (offset > ctx->checkpoint.offset) && (offset < ctx->ota_storage_context.total_image_size) )
+        {
+            cy_ota_checkpoint_store(ctx, offset);
+        }
+    }
+
     cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_NOTICE, "Data Download %s\n",
                         (result == CY_RSLT_SUCCESS) ? "Succeeded" :
                                 cy_ota_get_error_string(result));
     return result;
 }
 
+static cy_rslt_t cy_ota_data_download(cy_ota_context_t *ctx)
+{
+    cy_rslt_t result;
+
+    if (ctx->state_in_progress == false)
+    {
+        result = cy_ota_data_download_start(ctx);
+    }
+    else
+    {
+        result = cy_ota_data_download_step(ctx);
+    }
+
+    /* A polled OTA Agent does one step per run, cy_ota_agent_poll() calls again */
+    while ( (result == CY_RSLT_OTA_POLL_AGAIN) && (ctx->agent_params.use_poll == false) )
+    {
+        result = cy_ota_data_download_step(ctx);
+    }
+    if (result == CY_RSLT_OTA_POLL_AGAIN)
+    {
+        return result;
+    }
+
+    return cy_ota_data_download_end(ctx, result);
+}
+
 static cy_rslt_t cy_ota_verify_data(cy_ota_context_t *ctx)
 {
     cy_rslt_t                   result = CY_RSLT_SUCCESS;
 
     for(int i = 1; i <= CY_OTA_IMAGE_NUMBER; i++)
     {
+#if (CY_OTA_TAR_PARSER == 1)
+        /* Already verified when its archive member completed */
+        if (cy_ota_tar_verified(ctx, i) == true)
+        {
+            continue;
+        }
+#endif
         ctx->ota_storage_context.imgID = i;
         result = ctx->storage_iface.ota_file_verify(&(ctx->ota_storage_context));
     }
@@ -1774,14 +2694,14 @@ static cy_rslt_t cy_ota_result_send(cy_ota_context_t *ctx)
 #ifdef COMPONENT_OTA_MQTT
     if (ctx->curr_connect_type == CY_OTA_CONNECTION_MQTT)
     {
-        result = cy_ota_mqtt_report_result(ctx, cy_ota_last_error);
+        result = cy_ota_mqtt_report_result(ctx, ctx->last_error);
     }
 #endif
 #ifdef COMPONENT_OTA_HTTP
     if ( (ctx->curr_connect_type == CY_OTA_CONNECTION_HTTP) ||
               (ctx->curr_connect_type == CY_OTA_CONNECTION_HTTPS) )
     {
-        result = cy_ota_http_report_result(ctx, cy_ota_last_error);
+        result = cy_ota_http_report_result(ctx, ctx->last_error);
     }
 #endif
 
@@ -1803,8 +2723,8 @@ static cy_rslt_t cy_ota_complete(cy_ota_context_t *ctx)
     /* close the storage (if still open) */
     cy_ota_close_filesystem(ctx);
 
-    if ( ( (cy_ota_last_error == CY_RSLT_SUCCESS) ||
-           (cy_ota_last_error == CY_RSLT_OTA_USE_DIRECT_FLOW) ) &&
+    if ( ( (ctx->last_error == CY_RSLT_SUCCESS) ||
+           (ctx->last_error == CY_RSLT_OTA_USE_DIRECT_FLOW) ) &&
          (ctx->stop_OTA_session == 0) &&
          (ctx->reboot_after_sending_result != 0) )
     {
@@ -1822,21 +2742,342 @@ static cy_rslt_t cy_ota_complete(cy_ota_context_t *ctx)
     cy_ota_start_next_timer(ctx);
 
     cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_NOTICE, "OTA Session done:%s\n",
-                        (cy_ota_get_last_error() == CY_RSLT_SUCCESS) ? "Succeeded" :
-                         cy_ota_get_error_string(cy_ota_get_last_error() ) );
+                        (ctx->last_error == CY_RSLT_SUCCESS) ? "Succeeded" :
+                         cy_ota_get_error_string(ctx->last_error) );
     return result;
 }
 #endif
 
+/*****************************************************************************
+ * Run one state of the State Machine
+ *****************************************************************************/
+
+#if defined(COMPONENT_OTA_HTTP) || defined(COMPONENT_OTA_MQTT)
+/**
+ * @brief Get the state table entry for a state
+ *
+ * @param[in]   state   - OTA Agent state
+ *
+ * @return  state table entry, NULL if the state is not run by the OTA Agent
+ */
+static inline const cy_ota_agent_state_table_entry_t *cy_ota_state_entry(cy_ota_agent_state_t state)
+{
+    /* Entries for states not in the table are zero, no state changes to CY_OTA_STATE_NOT_INITIALIZED */
+    if ( (state >= CY_OTA_NUM_STATES) || (cy_ota_state_table[state].success_state == CY_OTA_STATE_NOT_INITIALIZED) )
+    {
+        return NULL;
+    }
+    return &cy_ota_state_table[state];
+}
+
+/**
+ * @brief Run the current state and change to the next state
+ *
+ * Calls the App callback with the start reason, the state function, the App callback
+ * with the success or failure reason, and handles retries and stop requests.
+ *
+ * @param[in]   ctx     - pointer to OTA agent context @ref cy_ota_context_t
+ * @param[in]   entry   - state table entry for ctx->curr_state
+ *
+ * @return  true  - continue the State Machine
+ *          false - the session finished, exit the OTA Agent
+ */
+static bool cy_ota_agent_run_state(cy_ota_context_t *ctx, const cy_ota_agent_state_table_entry_t *entry)
+{
+    cy_ota_callback_results_t   cb_result;
+    cy_rslt_t                   result;
+    cy_ota_agent_state_t        new_state = ctx->curr_state;
+
+    /* Assume success */
+    result = CY_RSLT_SUCCESS;
+
+    /*  Call the App callback function */
+    cb_result = CY_OTA_CB_RSLT_OTA_CONTINUE;
+    if ( (entry->send_start_cb != false) && (ctx->state_in_progress == false) )
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "%d : %s() CALLING CB STATE_CHANGE %s stop_OTA_session:%d\n", __LINE__, __func__,
+                cy_ota_get_state_string(ctx->curr_state), ctx->stop_OTA_session);
+        cb_result = cy_ota_internal_call_cb(ctx, CY_OTA_REASON_STATE_CHANGE, ctx->curr_state);
+    }
+    switch( cb_result )
+    {
+        default:
+        case CY_OTA_CB_RSLT_OTA_CONTINUE:
+            if (entry->state_function != NULL)
+            {
+                result = entry->state_function(ctx);
+                if (result == CY_RSLT_OTA_POLL_AGAIN)
+                {
+                    /* Not done yet, the next cy_ota_agent_poll() continues this state */
+                    ctx->state_in_progress = true;
+                    return true;
+                }
+                ctx->state_in_progress = false;
+                if ( (ctx->curr_state == CY_OTA_STATE_AGENT_WAITING) &&
+                     (result == CY_RSLT_OTA_EXITING) )
+                {
+                    /* exit state_machine_loop, as we finished the session */
+                    return false;
+                }
+                else if ( ( (ctx->curr_state == CY_OTA_STATE_JOB_CONNECT) ||
+                       (ctx->curr_state == CY_OTA_STATE_DATA_CONNECT) ||
+                       (ctx->curr_state == CY_OTA_STATE_RESULT_CONNECT) ) &&
+                     (result == CY_RSLT_OTA_ALREADY_CONNECTED) )
+                {
+                    /* If we are already connected, move along */
+                    result = CY_RSLT_SUCCESS;
+                }
+                else
+                {
+                    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "%d: App callback OTA CONTINUE \n", __LINE__);
+                }
+            }
+            break;
+        case CY_OTA_CB_RSLT_OTA_STOP:
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "%d: App callback STATE_CHANGE for state %s - App returned Stop OTA session\n",
+                    __LINE__, cy_ota_get_state_string(entry->curr_state));
+            result = CY_RSLT_OTA_ERROR_APP_RETURNED_STOP;
+            ctx->stop_OTA_session = 1;
+            break;
+        case CY_OTA_CB_RSLT_APP_SUCCESS:
+            result = CY_RSLT_SUCCESS;
+            break;
+        case CY_OTA_CB_RSLT_APP_FAILED:
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "%d: App callback STATE_CHANGE for state %s - App returned failure.\n",
+                    __LINE__, cy_ota_get_state_string(entry->curr_state));
+            result = CY_RSLT_OTA_ERROR_APP_RETURNED_STOP;
+            break;
+    }
+
+    /* When we get here, either the OTA Agent function or the App function has been called.
+     * Look at the result to see if we succeeded or not.
+     */
+    if (result == CY_RSLT_SUCCESS)  /* Note: CY_RSLT_OTA_USE_JOB_FLOW == CY_RSLT_SUCCESS */
+    {
+        /* assume new success state */
+        new_state = entry->success_state;
+
+        /* call the App callback function with success if there is a reason */
+        cb_result = CY_OTA_CB_RSLT_OTA_CONTINUE;
+        cb_result = cy_ota_internal_call_cb(ctx, CY_OTA_REASON_SUCCESS, ctx->curr_state);
+        switch( cb_result )
+        {
+            default:
+            case CY_OTA_CB_RSLT_OTA_CONTINUE:
+                /* nothing to do here */
+                break;
+            case CY_OTA_CB_RSLT_OTA_STOP:
+                cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "%d: App callback SUCCESS for state %s - App returned Stop OTA session\n",
+                        __LINE__, cy_ota_get_state_string(entry->curr_state));
+                result = CY_RSLT_OTA_ERROR_APP_RETURNED_STOP;
+                ctx->stop_OTA_session = 1;
+                break;
+            case CY_OTA_CB_RSLT_APP_SUCCESS:
+                /* nothing to do here */
+                break;
+            case CY_OTA_CB_RSLT_APP_FAILED:
+                cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "%d: App callback SUCCESS for state %s - App returned failure.\n",
+                        __LINE__, cy_ota_get_state_string(entry->curr_state));
+                result = entry->failure_result;
+                break;
+        }
+    }
+
+    /* Fast path: the state succeeded, no stop request and no error to handle */
+    if ( (result == CY_RSLT_SUCCESS) && (ctx->stop_OTA_session == 0) && (ctx->last_error == CY_RSLT_SUCCESS) )
+    {
+        cy_ota_set_state(ctx, new_state);
+        return true;
+    }
+
+    /* Here we have:
+     * - called the App CB with the start reason
+     * - possibly called the OTA Agent function
+     * - called the App CB with the success reason
+     *
+     * Some non-success results are actually OK, as they
+     * are used to signal other things to do:
+     *  CY_RSLT_OTA_USE_DIRECT_FLOW - Indicates Direct flow (skip Job & Result)
+     *  CY_RSLT_OTA_CHANGING_SERVER - Indicates Job flow changing server for Data / Result
+     */
+    if (result != CY_RSLT_SUCCESS)
+    {
+        /* either the complete callback or the function failed */
+        new_state = entry->failure_state;
+
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG2, "%d: state %s result:0x%lx %s\n",
+                __LINE__, cy_ota_get_state_string(entry->curr_state),
+                result, cy_ota_get_error_string(result));
+
+        if ( ( (ctx->curr_state == CY_OTA_STATE_START_UPDATE) ||
+                (ctx->curr_state == CY_OTA_STATE_RESULT_REDIRECT) ) &&
+             ( (result == CY_RSLT_OTA_USE_DIRECT_FLOW) ||
+               (result == CY_RSLT_OTA_CHANGING_SERVER) ) )
+        {
+            /* this case means we skip sending the Result, but no error */
+            result = CY_RSLT_SUCCESS;
+            cy_ota_set_last_error(ctx, CY_RSLT_SUCCESS);
+        }
+        else if (result == CY_RSLT_OTA_ERROR_APP_RETURNED_STOP)
+        {
+            cy_ota_set_last_error(ctx, CY_RSLT_OTA_ERROR_APP_RETURNED_STOP);
+        }
+        else
+        {
+            switch(result)
+            {
+                case CY_RSLT_OTA_ERROR_NOT_A_JOB_DOC:
+                case CY_RSLT_OTA_ERROR_MALFORMED_JOB_DOC:
+                case CY_RSLT_OTA_ERROR_WRONG_BOARD:
+                case CY_RSLT_OTA_ERROR_INVALID_VERSION:
+                    cy_ota_set_last_error(ctx,result);
+                    break;
+                default:
+                    cy_ota_set_last_error(ctx, entry->failure_result);
+                    break;
+            }
+        }
+    }
+
+    /*
+     *  If we have a bad result here, we call the APP with the failure result.
+     */
+    if (result != CY_RSLT_SUCCESS)
+    {
+        /* call the App callback function with failure if there is a reason */
+        cb_result = CY_OTA_CB_RSLT_OTA_CONTINUE;
+        cb_result = cy_ota_internal_call_cb(ctx, CY_OTA_REASON_FAILURE, ctx->curr_state);
+        switch( cb_result )
+        {
+            default:
+            case CY_OTA_CB_RSLT_OTA_CONTINUE:
+                /* nothing to do here */
+                break;
+            case CY_OTA_CB_RSLT_OTA_STOP:
+                cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "%d: App callback FAILURE for state %s - App returned Stop OTA session\n",
+                        __LINE__, cy_ota_get_state_string(entry->curr_state));
+                result = CY_RSLT_OTA_ERROR_APP_RETURNED_STOP;
+                ctx->stop_OTA_session = 1;
+                break;
+            case CY_OTA_CB_RSLT_APP_SUCCESS:
+                /* don't care about success here */
+                break;
+            case CY_OTA_CB_RSLT_APP_FAILED:
+                /* nothing to do here */
+                cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "%d: App callback FAILURE for state %s - App returned failure.\n",
+                        __LINE__, cy_ota_get_state_string(entry->curr_state));
+                break;
+        }
+    }
+
+    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG2, "%d : %s() mid State Machine result:0x%lx   last_error:%s   curr state: %s   new state: %s\n",
+                __LINE__, __func__, result, cy_ota_get_error_string(ctx->last_error),
+                cy_ota_get_state_string(ctx->curr_state), cy_ota_get_state_string(new_state));
+
+    /* Check for a last_error or CY_OTA_CB_RSLT_OTA_STOP
+     */
+    if (ctx->stop_OTA_session != 0)
+    {
+        new_state = entry->app_stop_state;
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_NOTICE, "%d : %s() stop_OTA_session:%d - change to state: %d %s\n", __LINE__, __func__,
+                    ctx->stop_OTA_session, new_state, cy_ota_get_state_string(new_state));
+    }
+    else if ( (ctx->curr_state == CY_OTA_STATE_DATA_DOWNLOAD) &&
+              (ctx->last_error == CY_RSLT_OTA_ERROR_GET_DATA) )
+    {
+        /* Data Download failed */
+        /* We may be heading for a data download retry. */
+        if (++ctx->download_retry_count < CY_OTA_MAX_DOWNLOAD_TRIES)
+        {
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_NOTICE, "%d : %s() state:%s retry_count:%d\n", __LINE__, __func__,
+                        cy_ota_get_state_string(ctx->curr_state), ctx->download_retry_count);
+            /* We are still connected, just try to download again
+             * Always check if we need to erase the storage
+             */
+            new_state = CY_OTA_STATE_STORAGE_OPEN;
+            cy_ota_set_last_error(ctx, CY_RSLT_SUCCESS);
+            result = CY_RSLT_SUCCESS;
+        }
+        else
+        {
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "OTA Agent state :%s, Data download retry count exceeded CY_OTA_MAX_DOWNLOAD_TRIES(%d) !!!",
+                                                    cy_ota_get_state_string(ctx->curr_state), CY_OTA_MAX_DOWNLOAD_TRIES);
+            /* If Retry exceeds CY_OTA_MAX_DOWNLOAD_TRIES close the file system. */
+            cy_ota_close_filesystem(ctx);
+        }
+    }
+    else if ( ( (ctx->curr_state == CY_OTA_STATE_JOB_CONNECT) ||
+                (ctx->curr_state == CY_OTA_STATE_DATA_CONNECT) ||
+                (ctx->curr_state == CY_OTA_STATE_RESULT_CONNECT) ) &&
+                (ctx->last_error == CY_RSLT_OTA_ERROR_CONNECT) )
+    {
+        /* Re-try Connect */
+        if (result == CY_RSLT_SUCCESS)
+        {
+            /* we connected, reset the retry counter */
+            ctx->contact_server_retry_count = 0;
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_NOTICE, "%d : %s() state:%s set contact_server_retry_count = 0\n",
+                        __LINE__, __func__, cy_ota_get_state_string(ctx->curr_state));
+        }
+        else if (++ctx->contact_server_retry_count < CY_OTA_CONNECT_RETRIES)
+        {
+            /* Retry */
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_NOTICE, "%d : %s() state:%s retry_count:%d\n", __LINE__, __func__,
+                        cy_ota_get_state_string(ctx->curr_state), ctx->contact_server_retry_count);
+            new_state = CY_OTA_STATE_AGENT_WAITING;
+            cy_ota_set_last_error(ctx, CY_RSLT_SUCCESS);
+            cy_ota_start_retry_timer(ctx);
+        }
+        else
+        {
+            /* reconnect tries exceeded, stop here */
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_NOTICE, "%d : %s() state:%s retries failed:%d\n", __LINE__, __func__,
+                        cy_ota_get_state_string(ctx->curr_state), ctx->contact_server_retry_count);
+            new_state = CY_OTA_STATE_AGENT_WAITING;
+            cy_ota_set_last_error(ctx, CY_RSLT_OTA_ERROR_APP_EXCEEDED_RETRIES);
+            cy_ota_start_retry_timer(ctx);
+        }
+    }
+    else if ( ctx->last_error != CY_RSLT_SUCCESS)
+    {
+        new_state = entry->app_stop_state;
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_NOTICE, "%d : %s() last_error: 0x%lx  %s - change to state: %d %s\n", __LINE__, __func__,
+                    ctx->last_error, cy_ota_get_error_string(ctx->last_error),
+                    new_state, cy_ota_get_state_string(new_state));
+    }
+    else
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG2, "No errors new state: %d %s\n\n", new_state, cy_ota_get_state_string(new_state) );
+    }
+
+    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "End of state loop new state: %d %s\n\n", new_state, cy_ota_get_state_string(new_state) );
+
+    cy_ota_set_state(ctx, new_state);
+    return true;
+}
+#endif
+
 /*****************************************************************************
  * This is the main loop for the OTA Agent
  * - incorporates the State Machine
  *****************************************************************************/
 
 #if defined(COMPONENT_OTA_HTTP) || defined(COMPONENT_OTA_MQTT)
+/* Set up for the first check, from the OTA Agent thread or cy_ota_agent_start() with use_poll */
+static void cy_ota_agent_begin(cy_ota_context_t *ctx)
+{
+    /* waiting for an event  to start us off */
+    cy_ota_set_state(ctx, CY_OTA_STATE_AGENT_WAITING);
+
+    ctx->stop_OTA_session = 0;
+    cy_ota_set_last_error(ctx, CY_RSLT_SUCCESS);
+
+    /* Start the initial timer */
+    cy_ota_start_initial_timer(ctx);
+}
+
 static void cy_ota_agent( cy_thread_arg_t arg )
 {
-    cy_ota_callback_results_t   cb_result = CY_OTA_CB_RSLT_OTA_CONTINUE;
     cy_ota_context_t            *ctx = (cy_ota_context_t *)arg;
     bool                        stay_in_state_loop;
     CY_OTA_CONTEXT_ASSERT(ctx);
@@ -1846,329 +3087,250 @@ static void cy_ota_agent( cy_thread_arg_t arg )
     /* let cy_ota_agent_start() know we are alive */
     cy_rtos_setbits_event(&ctx->ota_event, (uint32_t)CY_OTA_EVENT_RUNNING_EXITING, 0);
 
-    /* waiting for an event  to start us off */
-    cy_ota_set_state(ctx, CY_OTA_STATE_AGENT_WAITING);
-
-    ctx->stop_OTA_session = 0;
-    cy_ota_set_last_error(ctx, CY_RSLT_SUCCESS);
-
-    /* Start the initial timer */
-    cy_ota_start_initial_timer(ctx);
+    cy_ota_agent_begin(ctx);
 
     while (ctx->curr_state != CY_OTA_STATE_EXITING)
     {
-        cy_rslt_t   result;
-
         stay_in_state_loop = true;
         while (stay_in_state_loop && (ctx->curr_state != CY_OTA_STATE_EXITING))
         {
-            uint16_t idx;
+            const cy_ota_agent_state_table_entry_t *entry;
             cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG2, "Start of state machine loop: %d %s\n\n",
                         ctx->curr_state, cy_ota_get_state_string(ctx->curr_state));
 
-            /* look through state table and find the state ! */
-            for (idx = 0; idx < CY_OTA_NUM_STATE_TABLE_ENTRIES; idx++)
+            /* the state is the index in the state table */
+            entry = cy_ota_state_entry(ctx->curr_state);
+            if (entry == NULL)
             {
-                if (cy_ota_state_table[idx].curr_state == ctx->curr_state)
-                {
-                    cy_ota_agent_state_t new_state = ctx->curr_state;
+                cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, ">>>>> We are in a state not in the state table! state: %d %s <<<<<<\n",
+                            ctx->curr_state, cy_ota_get_state_string(ctx->curr_state));
+            }
+            else if (cy_ota_agent_run_state(ctx, entry) == false)
+            {
+                /* exit state_machine_loop, as we finished the session */
+                stay_in_state_loop = false;
+                goto _exit_ota_agent;
+            }
 
-                    /* We found our state! Assume success*/
-                    result = CY_RSLT_SUCCESS;
+        }   /* while (stay_in_state_loop && ctx->curr_state != CY_OTA_STATE_EXITING)  State Machine loop */
 
-                    /*  Call the App callback function */
-                    cb_result = CY_OTA_CB_RSLT_OTA_CONTINUE;
-                    if (cy_ota_state_table[idx].send_start_cb != false)
-                    {
-                        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "%d : %s() CALLING CB STATE_CHANGE %s stop_OTA_session:%d\n", __LINE__, __func__,
-                                cy_ota_get_state_string(ctx->curr_state), ctx->stop_OTA_session);
-                        cb_result = cy_ota_internal_call_cb(ctx, CY_OTA_REASON_STATE_CHANGE, ctx->curr_state);
-                    }
-                    switch( cb_result )
-                    {
-                        default:
-                        case CY_OTA_CB_RSLT_OTA_CONTINUE:
-                            if (cy_ota_state_table[idx].state_function != NULL)
-                            {
-                                result = cy_ota_state_table[idx].state_function(ctx);
-                                if ( (ctx->curr_state == CY_OTA_STATE_AGENT_WAITING) &&
-                                     (result == CY_RSLT_OTA_EXITING) )
-                                {
-                                    /* exit state_machine_loop, as we finished the session */
-                                    stay_in_state_loop = false;
-                                    goto _exit_ota_agent;
-                                }
-                                else if ( ( (ctx->curr_state == CY_OTA_STATE_JOB_CONNECT) ||
-                                       (ctx->curr_state == CY_OTA_STATE_DATA_CONNECT) ||
-                                       (ctx->curr_state == CY_OTA_STATE_RESULT_CONNECT) ) &&
-                                     (result == CY_RSLT_OTA_ALREADY_CONNECTED) )
-                                {
-                                    /* If we are already connected, move along */
-                                    result = CY_RSLT_SUCCESS;
-                                }
-                                else
-                                {
-                                    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "%d: App callback OTA CONTINUE \n", __LINE__);
-                                }
-                            }
-                            break;
-                        case CY_OTA_CB_RSLT_OTA_STOP:
-                            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "%d: App callback STATE_CHANGE for state %s - App returned Stop OTA session\n",
-                                    __LINE__, cy_ota_get_state_string(cy_ota_state_table[idx].curr_state));
-                            result = CY_RSLT_OTA_ERROR_APP_RETURNED_STOP;
-                            ctx->stop_OTA_session = 1;
-                            break;
-                        case CY_OTA_CB_RSLT_APP_SUCCESS:
-                            result = CY_RSLT_SUCCESS;
-                            break;
-                        case CY_OTA_CB_RSLT_APP_FAILED:
-                            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "%d: App callback STATE_CHANGE for state %s - App returned failure.\n",
-                                    __LINE__, cy_ota_get_state_string(cy_ota_state_table[idx].curr_state));
-                            result = CY_RSLT_OTA_ERROR_APP_RETURNED_STOP;
-                            break;
-                    }
+    }   /* while (ctx->curr_state != CY_OTA_STATE_EXITING)  Main loop*/
 
-                    /* When we get here, either the OTA Agent function or the App function has been called.
-                     * Look at the result to see if we succeeded or not.
-                     */
-                    if (result == CY_RSLT_SUCCESS)  /* Note: CY_RSLT_OTA_USE_JOB_FLOW == CY_RSLT_SUCCESS */
-                    {
-                        /* assume new success state */
-                        new_state = cy_ota_state_table[idx].success_state;
-
-                        /* call the App callback function with success if there is a reason */
-                        cb_result = CY_OTA_CB_RSLT_OTA_CONTINUE;
-                        cb_result = cy_ota_internal_call_cb(ctx, CY_OTA_REASON_SUCCESS, ctx->curr_state);
-                        switch( cb_result )
-                        {
-                            default:
-                            case CY_OTA_CB_RSLT_OTA_CONTINUE:
-                                /* nothing to do here */
-                                break;
-                            case CY_OTA_CB_RSLT_OTA_STOP:
-                                cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "%d: App callback SUCCESS for state %s - App returned Stop OTA session\n",
-                                        __LINE__, cy_ota_get_state_string(cy_ota_state_table[idx].curr_state));
-                                result = CY_RSLT_OTA_ERROR_APP_RETURNED_STOP;
-                                ctx->stop_OTA_session = 1;
-                                break;
-                            case CY_OTA_CB_RSLT_APP_SUCCESS:
-                                /* nothing to do here */
-                                break;
-                            case CY_OTA_CB_RSLT_APP_FAILED:
-                                cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "%d: App callback SUCCESS for state %s - App returned failure.\n",
-                                        __LINE__, cy_ota_get_state_string(cy_ota_state_table[idx].curr_state));
-                                result = cy_ota_state_table[idx].failure_result;
-                                break;
-                        }
-                    }
+_exit_ota_agent:
 
-                    /* Here we have:
-                     * - called the App CB with the start reason
-                     * - possibly called the OTA Agent function
-                     * - called the App CB with the success reason
-                     *
-                     * Some non-success results are actually OK, as they
-                     * are used to signal other things to do:
-                     *  CY_RSLT_OTA_USE_DIRECT_FLOW - Indicates Direct flow (skip Job & Result)
-                     *  CY_RSLT_OTA_CHANGING_SERVER - Indicates Job flow changing server for Data / Result
-                     */
-                    if (result != CY_RSLT_SUCCESS)
-                    {
-                        /* either the complete callback or the function failed */
-                        new_state = cy_ota_state_table[idx].failure_state;
-
-                        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG2, "%d: state %s result:0x%lx %s\n",
-                                __LINE__, cy_ota_get_state_string(cy_ota_state_table[idx].curr_state),
-                                result, cy_ota_get_error_string(result));
-
-                        if ( ( (ctx->curr_state == CY_OTA_STATE_START_UPDATE) ||
-                                (ctx->curr_state == CY_OTA_STATE_RESULT_REDIRECT) ) &&
-                             ( (result == CY_RSLT_OTA_USE_DIRECT_FLOW) ||
-                               (result == CY_RSLT_OTA_CHANGING_SERVER) ) )
-                        {
-                            /* this case means we skip sending the Result, but no error */
-                            result = CY_RSLT_SUCCESS;
-                            cy_ota_set_last_error(ctx, CY_RSLT_SUCCESS);
-                        }
-                        else if (result == CY_RSLT_OTA_ERROR_APP_RETURNED_STOP)
-                        {
-                            cy_ota_set_last_error(ctx, CY_RSLT_OTA_ERROR_APP_RETURNED_STOP);
-                        }
-                        else
-                        {
-                            switch(result)
-                            {
-                                case CY_RSLT_OTA_ERROR_NOT_A_JOB_DOC:
-                                case CY_RSLT_OTA_ERROR_MALFORMED_JOB_DOC:
-                                case CY_RSLT_OTA_ERROR_WRONG_BOARD:
-                                case CY_RSLT_OTA_ERROR_INVALID_VERSION:
-                                    cy_ota_set_last_error(ctx,result);
-                                    break;
-                                default:
-                                    cy_ota_set_last_error(ctx, cy_ota_state_table[idx].failure_result);
-                                    break;
-                            }
-                        }
-                    }
+    cy_ota_stop_timer(ctx);
 
-                   /*
-                    *  If we have a bad result here, we call the APP with the failure result.
-                    */
-                   if (result != CY_RSLT_SUCCESS)
-                   {
-                       /* call the App callback function with failure if there is a reason */
-                        cb_result = CY_OTA_CB_RSLT_OTA_CONTINUE;
-                        cb_result = cy_ota_internal_call_cb(ctx, CY_OTA_REASON_FAILURE, ctx->curr_state);
-                        switch( cb_result )
-                        {
-                            default:
-                            case CY_OTA_CB_RSLT_OTA_CONTINUE:
-                                /* nothing to do here */
-                                break;
-                            case CY_OTA_CB_RSLT_OTA_STOP:
-                                cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "%d: App callback FAILURE for state %s - App returned Stop OTA session\n",
-                                        __LINE__, cy_ota_get_state_string(cy_ota_state_table[idx].curr_state));
-                                result = CY_RSLT_OTA_ERROR_APP_RETURNED_STOP;
-                                ctx->stop_OTA_session = 1;
-                                break;
-                            case CY_OTA_CB_RSLT_APP_SUCCESS:
-                                /* don't care about success here */
-                                break;
-                            case CY_OTA_CB_RSLT_APP_FAILED:
-                                /* nothing to do here */
-                                cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "%d: App callback FAILURE for state %s - App returned failure.\n",
-                                        __LINE__, cy_ota_get_state_string(cy_ota_state_table[idx].curr_state));
-                                break;
-                        }
-                    }
+    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_WARNING, "%s() exiting\n", __func__);
+    /* let mainline know we are exiting */
+    cy_rtos_setbits_event(&ctx->ota_event, (uint32_t)CY_OTA_EVENT_RUNNING_EXITING, 0);
 
-                    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG2, "%d : %s() mid State Machine result:0x%lx   last_error:%s   curr state: %s   new state: %s\n",
-                                __LINE__, __func__, result, cy_ota_get_error_string(cy_ota_last_error),
-                                cy_ota_get_state_string(ctx->curr_state), cy_ota_get_state_string(new_state));
+    cy_rtos_exit_thread();
 
-                    /* Check for a last_error or CY_OTA_CB_RSLT_OTA_STOP
-                     */
-                    if (ctx->stop_OTA_session != 0)
-                    {
-                        new_state = cy_ota_state_table[idx].app_stop_state;
-                        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_NOTICE, "%d : %s() stop_OTA_session:%d - change to state: %d %s\n", __LINE__, __func__,
-                                    ctx->stop_OTA_session, new_state, cy_ota_get_state_string(new_state));
-                    }
-                    else if ( (ctx->curr_state == CY_OTA_STATE_DATA_DOWNLOAD) &&
-                              (cy_ota_last_error == CY_RSLT_OTA_ERROR_GET_DATA) )
-                    {
-                        /* Data Download failed */
-                        /* We may be heading for a data download retry. */
-                        if (++ctx->download_retry_count < CY_OTA_MAX_DOWNLOAD_TRIES)
-                        {
-                            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_NOTICE, "%d : %s() state:%s retry_count:%d\n", __LINE__, __func__,
-                                        cy_ota_get_state_string(ctx->curr_state), ctx->download_retry_count);
-                            /* We are still connected, just try to download again
-                             * Always check if we need to erase the storage
-                             */
-                            new_state = CY_OTA_STATE_STORAGE_OPEN;
-                            cy_ota_set_last_error(ctx, CY_RSLT_SUCCESS);
-                            result = CY_RSLT_SUCCESS;
-                        }
-                        else
-                        {
-                            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "OTA Agent state :%s, Data download retry count exceeded CY_OTA_MAX_DOWNLOAD_TRIES(%d) !!!",
-                                                                    cy_ota_get_state_string(ctx->curr_state), CY_OTA_MAX_DOWNLOAD_TRIES);
-                            /* If Retry exceeds CY_OTA_MAX_DOWNLOAD_TRIES close the file system. */
-                            cy_ota_close_filesystem(ctx);
-                        }
-                    }
-                    else if ( ( (ctx->curr_state == CY_OTA_STATE_JOB_CONNECT) ||
-                                (ctx->curr_state == CY_OTA_STATE_DATA_CONNECT) ||
-                                (ctx->curr_state == CY_OTA_STATE_RESULT_CONNECT) ) &&
-                                (cy_ota_last_error == CY_RSLT_OTA_ERROR_CONNECT) )
-                    {
-                        /* Re-try Connect */
-                        if (result == CY_RSLT_SUCCESS)
-                        {
-                            /* we connected, reset the retry counter */
-                            ctx->contact_server_retry_count = 0;
-                            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_NOTICE, "%d : %s() state:%s set contact_server_retry_count = 0\n",
-                                        __LINE__, __func__, cy_ota_get_state_string(ctx->curr_state));
-                        }
-                        else if (++ctx->contact_server_retry_count < CY_OTA_CONNECT_RETRIES)
-                        {
-                            /* Retry */
-                            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_NOTICE, "%d : %s() state:%s retry_count:%d\n", __LINE__, __func__,
-                                        cy_ota_get_state_string(ctx->curr_state), ctx->contact_server_retry_count);
-                            new_state = CY_OTA_STATE_AGENT_WAITING;
-                            cy_ota_set_last_error(ctx, CY_RSLT_SUCCESS);
-                            cy_ota_start_retry_timer(ctx);
-                        }
-                        else
-                        {
-                            /* reconnect tries exceeded, stop here */
-                            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_NOTICE, "%d : %s() state:%s retries failed:%d\n", __LINE__, __func__,
-                                        cy_ota_get_state_string(ctx->curr_state), ctx->contact_server_retry_count);
-                            new_state = CY_OTA_STATE_AGENT_WAITING;
-                            cy_ota_set_last_error(ctx, CY_RSLT_OTA_ERROR_APP_EXCEEDED_RETRIES);
-                            cy_ota_start_retry_timer(ctx);
-                        }
-                    }
-                    else if ( cy_ota_last_error != CY_RSLT_SUCCESS)
-                    {
-                        new_state = cy_ota_state_table[idx].app_stop_state;
-                        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_NOTICE, "%d : %s() last_error: 0x%lx  %s - change to state: %d %s\n", __LINE__, __func__,
-                                    cy_ota_last_error, cy_ota_get_error_string(cy_ota_last_error),
-                                    new_state, cy_ota_get_state_string(new_state));
-                    }
-                    else
-                    {
-                        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG2, "No errors new state: %d %s\n\n", new_state, cy_ota_get_state_string(new_state) );
-                    }
+}
 
-                    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "End of state loop new state: %d %s\n\n", new_state, cy_ota_get_state_string(new_state) );
+#if defined(CY_OTA_STATE_BENCHMARK)
+/* Stands in for the state functions, so only the OTA Agent overhead is measured */
+static cy_rslt_t cy_ota_state_benchmark_function(cy_ota_context_t *ctx)
+{
+    (void)ctx;
+    return CY_RSLT_SUCCESS;
+}
 
-                    cy_ota_set_state(ctx, new_state);
-                    break;
-                }
+cy_rslt_t cy_ota_state_benchmark(cy_ota_callback_t cb_func)
+{
+    static cy_ota_context_t                 ctx;
+    cy_ota_agent_state_table_entry_t        entry;
+    const cy_ota_agent_state_table_entry_t  *table_entry;
+    cy_ota_agent_state_t                    state;
+    cy_time_t                               start_ms;
+    cy_time_t                               end_ms;
+    uint32_t                                i;
+
+    /* The benchmark changes the last error, not while the OTA Agent runs */
+    for (i = 0; i < CY_OTA_MAX_AGENTS; i++)
+    {
+        if (ota_contexts[i] != NULL)
+        {
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Stop the OTA Agent first\n", __func__);
+            return CY_RSLT_OTA_ERROR_ALREADY_STARTED;
+        }
+    }
 
-            } /* for state_machine_loop */
+    memset(&ctx, 0x00, sizeof(ctx));
+    ctx.tag = CY_OTA_TAG;
+    ctx.agent_params.cb_func = cb_func;
 
-            if (idx >= CY_OTA_NUM_STATE_TABLE_ENTRIES)
-            {
-                cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, ">>>>> We are in a state not in the state table! state: %d %s <<<<<<\n",
-                            ctx->curr_state, cy_ota_get_state_string(ctx->curr_state));
+    for (state = CY_OTA_STATE_NOT_INITIALIZED; state < CY_OTA_NUM_STATES; state++)
+    {
+        table_entry = cy_ota_state_entry(state);
+        if ( (table_entry == NULL) || (table_entry->state_function == NULL) )
+        {
+            continue;
+        }
+        entry = *table_entry;
+        entry.state_function = cy_ota_state_benchmark_function;
 
-            }
+        cy_rtos_get_time(&start_ms);
+        for (i = 0; i < CY_OTA_STATE_BENCHMARK_LOOPS; i++)
+        {
+            ctx.curr_state = state;
+            (void)cy_ota_agent_run_state(&ctx, &entry);
+        }
+        cy_rtos_get_time(&end_ms);
 
-        }   /* while (stay_in_state_loop && ctx->curr_state != CY_OTA_STATE_EXITING)  State Machine loop */
+#ifdef CY_OTA_STATE_BENCHMARK_CPU_HZ
+        /* cycles/transition = ms * (Hz / 1000) / transitions */
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_NOTICE, "%-40s %ld transitions in %ld ms, %ld cycles/transition\n",
+                       cy_ota_get_state_string(state), (uint32_t)CY_OTA_STATE_BENCHMARK_LOOPS, (uint32_t)(end_ms - start_ms),
+                       (uint32_t)(((uint64_t)(end_ms - start_ms) * (CY_OTA_STATE_BENCHMARK_CPU_HZ / 1000)) / CY_OTA_STATE_BENCHMARK_LOOPS));
+#else
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_NOTICE, "%-40s %ld transitions in %ld ms\n",
+                       cy_ota_get_state_string(state), (uint32_t)CY_OTA_STATE_BENCHMARK_LOOPS, (uint32_t)(end_ms - start_ms));
+#endif
+    }
 
-    }   /* while (ctx->curr_state != CY_OTA_STATE_EXITING)  Main loop*/
+    return CY_RSLT_SUCCESS;
+}
+#endif  /* CY_OTA_STATE_BENCHMARK */
+#endif  /* defined(COMPONENT_OTA_HTTP) || defined(COMPONENT_OTA_MQTT) */
+
+/* --------------------------------------------------------------- */
+
+/**
+ * @brief Size of a buffer in the memory from cy_ota_agent_start_static()
+ *
+ * @param[in]   id - buffer @ref cy_ota_mem_id_t
+ *
+ * @return  size in bytes, 0 if not used in this build
+ */
+static uint32_t cy_ota_mem_size(uint32_t id)
+{
+    if (id >= (uint32_t)CY_OTA_MEM_HTTP_WORKER)
+    {
+        return (id < ( (uint32_t)CY_OTA_MEM_HTTP_WORKER + CY_OTA_MEM_HTTP_WORKERS) ) ? CY_OTA_MEM_HTTP_WORKER_SIZE : 0;
+    }
+
+    switch ( (cy_ota_mem_id_t)id)
+    {
+    case CY_OTA_MEM_DECOMPRESS_WINDOW:
+        return CY_OTA_MEM_DECOMPRESS_WINDOW_SIZE;
+    case CY_OTA_MEM_DELTA_OUT:
+        return CY_OTA_MEM_DELTA_OUT_SIZE;
+    case CY_OTA_MEM_TAR_REORDER:
+        return CY_OTA_MEM_TAR_REORDER_SIZE;
+    case CY_OTA_MEM_DIGEST_READ:
+        return CY_OTA_MEM_DIGEST_READ_SIZE;
+    case CY_OTA_MEM_COALESCE:
+        return CY_OTA_MEM_COALESCE_SIZE;
+    case CY_OTA_MEM_WRITER_SLOTS:
+        return CY_OTA_MEM_WRITER_SLOTS_SIZE;
+    case CY_OTA_MEM_HTTP_RANGE:
+        return CY_OTA_MEM_HTTP_RANGE_SIZE;
+    case CY_OTA_MEM_MQTT_PACKET_MAP:
+        return CY_OTA_MEM_MQTT_PACKET_MAP_SIZE;
+    case CY_OTA_MEM_MQTT_RX:
+        return CY_OTA_MEM_MQTT_RX_SIZE;
+    case CY_OTA_MEM_MQTT_REASSEMBLY:
+        return CY_OTA_MEM_MQTT_REASSEMBLY_SIZE;
+    case CY_OTA_MEM_AGENT_STACK:
+        return CY_OTA_MEM_AGENT_STACK_SIZE;
+    case CY_OTA_MEM_WRITER_STACK:
+        return CY_OTA_MEM_WRITER_STACK_SIZE;
+    case CY_OTA_MEM_HTTP_WORKER_STACKS:
+        return CY_OTA_MEM_HTTP_WORKER_STACKS_SIZE;
+    default:
+        return 0;
+    }
+}
+
+void *cy_ota_mem_alloc(cy_ota_context_t *ctx, cy_ota_mem_id_t id, uint32_t size)
+{
+    uint32_t    offset;
+    uint32_t    i;
+
+    CY_OTA_CONTEXT_ASSERT(ctx);
+
+    if (ctx->memory == NULL)
+    {
+        return malloc(size);
+    }
+
+    if (size > cy_ota_mem_size( (uint32_t)id) )
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() buffer %d needs %ld bytes, %ld reserved\n", __func__, id, size, cy_ota_mem_size( (uint32_t)id) );
+        return NULL;
+    }
+
+    /* Buffers follow the context in cy_ota_mem_id_t order */
+    offset = CY_OTA_MEM_ALIGN(sizeof(cy_ota_context_t) );
+    for (i = 0; i < (uint32_t)id; i++)
+    {
+        offset += CY_OTA_MEM_ALIGN(cy_ota_mem_size(i) );
+    }
+    return &ctx->memory[offset];
+}
+
+void cy_ota_mem_free(cy_ota_context_t *ctx, void *buffer)
+{
+    CY_OTA_CONTEXT_ASSERT(ctx);
 
-_exit_ota_agent:
+    if ( (ctx->memory == NULL) && (buffer != NULL) )
+    {
+        free(buffer);
+    }
+}
 
-    cy_ota_stop_timer(ctx);
+cy_rslt_t cy_ota_mem_thread_stack(cy_ota_context_t *ctx, cy_ota_mem_id_t id, uint32_t index, uint32_t size, void **stack)
+{
+    uint8_t     *stacks;
 
-    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_WARNING, "%s() exiting\n", __func__);
-    /* let mainline know we are exiting */
-    cy_rtos_setbits_event(&ctx->ota_event, (uint32_t)CY_OTA_EVENT_RUNNING_EXITING, 0);
+    CY_OTA_CONTEXT_ASSERT(ctx);
 
-    cy_rtos_exit_thread();
+    *stack = NULL;
+    if (ctx->memory == NULL)
+    {
+        return CY_RSLT_SUCCESS;
+    }
 
+    /* Each stack starts CY_OTA_MEM_ALIGNMENT aligned, as the RTOS requires */
+    stacks = (uint8_t *)cy_ota_mem_alloc(ctx, id, ( (index + 1) * CY_OTA_MEM_ALIGN(size) ) );
+    if (stacks == NULL)
+    {
+        return CY_RSLT_OTA_ERROR_OUT_OF_MEMORY;
+    }
+    *stack = &stacks[index * CY_OTA_MEM_ALIGN(size)];
+    return CY_RSLT_SUCCESS;
 }
-#endif  /* defined(COMPONENT_OTA_HTTP) || defined(COMPONENT_OTA_MQTT) */
 
-/******************************************************************************
+/**
+ * @brief Start the OTA Agent, in memory or a malloc()ed context
  *
- * External Functions
+ * @param[in]   network_params      - @ref cy_ota_network_params_t
+ * @param[in]   agent_params        - @ref cy_ota_agent_params_t
+ * @param[in]   storage_interface   - @ref cy_ota_storage_interface_t
+ * @param[in]   memory              - CY_OTA_AGENT_MEMORY_REQUIRED bytes from cy_ota_agent_start_static(), NULL = heap
+ * @param[out]  ctx_ptr             - OTA Agent context
  *
- *****************************************************************************/
-
-cy_rslt_t cy_ota_agent_start(cy_ota_network_params_t *network_params,
-                             cy_ota_agent_params_t *agent_params,
-                             cy_ota_storage_interface_t *storage_interface,
-                             cy_ota_context_ptr *ctx_ptr)
+ * @return  CY_RSLT_SUCCESS
+ *          CY_RSLT_OTA_ERROR_BADARG
+ *          CY_RSLT_OTA_ERROR_ALREADY_STARTED
+ *          CY_RSLT_TYPE_ERROR
+ */
+static cy_rslt_t cy_ota_agent_init(cy_ota_network_params_t *network_params,
+                                   cy_ota_agent_params_t *agent_params,
+                                   cy_ota_storage_interface_t *storage_interface,
+                                   uint8_t *memory,
+                                   cy_ota_context_ptr *ctx_ptr)
 {
     cy_rslt_t           result = CY_RSLT_TYPE_ERROR;
     cy_ota_context_t    *ctx;
+    uint32_t            agent_index;
+    uint32_t            i;
 #if defined(COMPONENT_OTA_HTTP) || defined(COMPONENT_OTA_MQTT)
     uint32_t            waitfor;
+#ifndef COMPONENT_THREADX
+    void                *stack;
+#endif
 #endif
 
     /* sanity checks */
@@ -2226,26 +3388,58 @@ cy_rslt_t cy_ota_agent_start(cy_ota_network_params_t *network_params,
         return CY_RSLT_OTA_ERROR_BADARG;
     }
 
-    if (ota_context_only_one != NULL)
-    {
-        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() OTA context already created!\n", __func__);
-        return CY_RSLT_OTA_ERROR_ALREADY_STARTED;
-    }
-
     /* Create our OTA context structure
      * If we have any errors after this, we need to free the RAM
      *
      * set result value
      * use goto _ota_init_err;
      */
-    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "%s() allocate OTA context 0x%x bytes!\n", __func__, sizeof(cy_ota_context_t) );
-    ctx = (cy_ota_context_t *)malloc(sizeof(cy_ota_context_t) );
-    if (ctx == NULL)
+    if (memory != NULL)
     {
-        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Out of memory for OTA context!\n", __func__);
-        goto _ota_init_err;
+        ctx = (cy_ota_context_t *)memory;
+    }
+    else
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "%s() allocate OTA context 0x%x bytes!\n", __func__, sizeof(cy_ota_context_t) );
+        ctx = (cy_ota_context_t *)malloc(sizeof(cy_ota_context_t) );
+        if (ctx == NULL)
+        {
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Out of memory for OTA context!\n", __func__);
+            goto _ota_init_err;
+        }
+    }
+
+    /* Take a free slot, memory must not be a running OTA Agent */
+    agent_index = CY_OTA_MAX_AGENTS;
+    for (i = 0; i < CY_OTA_MAX_AGENTS; i++)
+    {
+        if (ota_contexts[i] == ctx)
+        {
+            agent_index = CY_OTA_MAX_AGENTS;
+            break;
+        }
+        if ( (ota_contexts[i] == NULL) && (agent_index == CY_OTA_MAX_AGENTS) )
+        {
+            agent_index = i;
+        }
+    }
+    if (agent_index == CY_OTA_MAX_AGENTS)
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() %d OTA contexts already created!\n", __func__, CY_OTA_MAX_AGENTS);
+        if (memory == NULL)
+        {
+            free(ctx);
+        }
+        *ctx_ptr = NULL;
+        return CY_RSLT_OTA_ERROR_ALREADY_STARTED;
     }
+
     memset(ctx, 0x00, sizeof(cy_ota_context_t) );
+    ctx->memory = memory;
+    ctx->agent_index = (uint8_t)agent_index;
+    ota_contexts[agent_index] = ctx;
+    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_INFO, "%s() OTA context %ld bytes, %ld without shared buffers\n", __func__,
+                   (uint32_t)sizeof(cy_ota_context_t), (uint32_t)(sizeof(cy_ota_context_t) + CY_OTA_CONTEXT_SHARED_SIZE) );
 
     ctx->curr_state = CY_OTA_STATE_INITIALIZING;
 
@@ -2254,6 +3448,13 @@ cy_rslt_t cy_ota_agent_start(cy_ota_network_params_t *network_params,
     memcpy(&ctx->agent_params, agent_params, sizeof(cy_ota_agent_params_t) );
     memcpy(&ctx->storage_iface, storage_interface, sizeof(cy_ota_storage_interface_t) );
 
+#if (CY_OTA_CALLBACK_V1 == 0)
+    if ( (agent_params->cb_func != NULL) && (agent_params->cb_func_v2 == NULL) )
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_WARNING, "%s() cb_func not called with CY_OTA_CALLBACK_V1=0, use cb_func_v2\n", __func__);
+    }
+#endif
+
     ctx->ota_storage_context.reboot_upon_completion = agent_params->reboot_upon_completion;
     ctx->ota_storage_context.validate_after_reboot = agent_params->validate_after_reboot;
 
@@ -2316,21 +3517,31 @@ cy_rslt_t cy_ota_agent_start(cy_ota_network_params_t *network_params,
     * since all the interactions are done with callbacks that the
     * application needs to handle by calling into cy_ota_xxx() functions.
     */
-   if (network_params->initial_connection != CY_OTA_CONNECTION_BLE)
+   if ( (network_params->initial_connection != CY_OTA_CONNECTION_BLE) && (agent_params->use_poll != false) )
+   {
+       /* No thread, the Application calls cy_ota_agent_poll() */
+       cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_INFO, "%s() OTA Agent polled by the Application\n", __func__);
+       cy_ota_agent_begin(ctx);
+   }
+   else if (network_params->initial_connection != CY_OTA_CONNECTION_BLE)
    {
        /* create OTA Agent thread */
 #ifdef COMPONENT_THREADX
         result = cy_rtos_thread_create(&ctx->ota_agent_thread,
                                        &cy_ota_agent,
                                        "CY OTA Agent",
-                                       &ota_agent_thread_stack,
+                                       &ota_agent_thread_stack[ctx->agent_index],
                                        OTA_AGENT_THREAD_STACK_SIZE,
                                        CY_RTOS_PRIORITY_NORMAL,
                                        (cy_thread_arg_t)ctx);
 #else
-        result = cy_rtos_create_thread(&ctx->ota_agent_thread, cy_ota_agent,
-                                        "CY OTA Agent", NULL, OTA_AGENT_THREAD_STACK_SIZE,
-                                        CY_RTOS_PRIORITY_NORMAL, (cy_thread_arg_t)ctx);
+        result = cy_ota_mem_thread_stack(ctx, CY_OTA_MEM_AGENT_STACK, 0, OTA_AGENT_THREAD_STACK_SIZE, &stack);
+        if (result == CY_RSLT_SUCCESS)
+        {
+            result = cy_rtos_create_thread(&ctx->ota_agent_thread, cy_ota_agent,
+                                            "CY OTA Agent", stack, OTA_AGENT_THREAD_STACK_SIZE,
+                                            CY_RTOS_PRIORITY_NORMAL, (cy_thread_arg_t)ctx);
+        }
 #endif
        if (result != CY_RSLT_SUCCESS)
        {
@@ -2353,8 +3564,7 @@ cy_rslt_t cy_ota_agent_start(cy_ota_network_params_t *network_params,
 #endif
 
     /* keep track of the context */
-    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_INFO, "%s() DONE\n", __func__);
-    ota_context_only_one = ctx;
+    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_INFO, "%s() DONE agent %d\n", __func__, ctx->agent_index);
 
     return CY_RSLT_SUCCESS;
 
@@ -2374,6 +3584,196 @@ _ota_init_err:
 
 }
 
+/******************************************************************************
+ *
+ * External Functions
+ *
+ *****************************************************************************/
+
+cy_rslt_t cy_ota_agent_start(cy_ota_network_params_t *network_params,
+                             cy_ota_agent_params_t *agent_params,
+                             cy_ota_storage_interface_t *storage_interface,
+                             cy_ota_context_ptr *ctx_ptr)
+{
+    return cy_ota_agent_init(network_params, agent_params, storage_interface, NULL, ctx_ptr);
+}
+
+/* --------------------------------------------------------------- */
+
+cy_rslt_t cy_ota_agent_start_static(cy_ota_network_params_t *network_params,
+                                    cy_ota_agent_params_t *agent_params,
+                                    cy_ota_storage_interface_t *storage_interface,
+                                    void *memory, uint32_t size,
+                                    cy_ota_context_ptr *ctx_ptr)
+{
+    if ( (memory == NULL) || ( ( (uintptr_t)memory & (CY_OTA_MEM_ALIGNMENT - 1) ) != 0) )
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() memory must be %ld byte aligned\n", __func__, CY_OTA_MEM_ALIGNMENT);
+        return CY_RSLT_OTA_ERROR_BADARG;
+    }
+    if (size < CY_OTA_AGENT_MEMORY_REQUIRED)
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() memory is %ld bytes, needs %ld\n", __func__, size, cy_ota_agent_memory_size() );
+        return CY_RSLT_OTA_ERROR_OUT_OF_MEMORY;
+    }
+
+    return cy_ota_agent_init(network_params, agent_params, storage_interface, (uint8_t *)memory, ctx_ptr);
+}
+
+/* --------------------------------------------------------------- */
+
+uint32_t cy_ota_agent_memory_size(void)
+{
+    return (uint32_t)CY_OTA_AGENT_MEMORY_REQUIRED;
+}
+
+/* --------------------------------------------------------------- */
+cy_rslt_t cy_ota_callback_override(cy_ota_context_ptr ctx_ptr, cy_ota_cb_override_t field, const void *value, uint32_t length)
+{
+    cy_ota_context_t    *ctx = (cy_ota_context_t *)ctx_ptr;
+    bool                connecting;
+
+    /* sanity check */
+    if ( (ctx == NULL) || ( (value == NULL) && (field != CY_OTA_CB_OVERRIDE_CREDENTIALS) ) )
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() BAD ARG\n", __func__);
+        return CY_RSLT_OTA_ERROR_BADARG;
+    }
+    CY_OTA_CONTEXT_ASSERT(ctx);
+
+    if (ctx->cb_v2_active == false)
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Only from the Application callback\n", __func__);
+        return CY_RSLT_OTA_ERROR_GENERAL;
+    }
+
+#if defined(COMPONENT_OTA_HTTP) || defined(COMPONENT_OTA_MQTT)
+    /* The same states as cy_ota_cb_struct_t changes are picked up in */
+    connecting = ( (ctx->curr_state == CY_OTA_STATE_JOB_CONNECT) ||
+                   (ctx->curr_state == CY_OTA_STATE_DATA_CONNECT) ||
+                   (ctx->curr_state == CY_OTA_STATE_RESULT_CONNECT) ||
+                   (ctx->curr_state == CY_OTA_STATE_JOB_DOWNLOAD) );
+
+    switch (field)
+    {
+        case CY_OTA_CB_OVERRIDE_JOB_DOC:
+            if ( (length == 0) || (length >= sizeof(ctx->job_doc)) )
+            {
+                return CY_RSLT_OTA_ERROR_BADARG;
+            }
+            if (ctx->curr_state == CY_OTA_STATE_JOB_PARSE)
+            {
+                memcpy(ctx->job_doc, value, length);
+                ctx->job_doc[length] = 0;
+                return CY_RSLT_SUCCESS;
+            }
+            if (connecting == false)
+            {
+                break;
+            }
+            if ( (ctx->curr_connect_type == CY_OTA_CONNECTION_MQTT) ||
+                 (ctx->curr_connect_type == CY_OTA_CONNECTION_HTTP) ||
+                 (ctx->curr_connect_type == CY_OTA_CONNECTION_HTTPS) )
+            {
+                memcpy(ctx->json_doc, value, length);
+                ctx->json_doc[length] = 0;
+            }
+            memcpy(ctx->job_doc, value, length);
+            ctx->job_doc[length] = 0;
+            return CY_RSLT_SUCCESS;
+
+#ifdef COMPONENT_OTA_HTTP
+        case CY_OTA_CB_OVERRIDE_FILE:
+            if ( (length == 0) || (length >= sizeof(ctx->http.file)) )
+            {
+                return CY_RSLT_OTA_ERROR_BADARG;
+            }
+            if ( (connecting == false) ||
+                 ( (ctx->curr_connect_type != CY_OTA_CONNECTION_HTTP) && (ctx->curr_connect_type != CY_OTA_CONNECTION_HTTPS) ) )
+            {
+                break;
+            }
+            memcpy(ctx->http.file, value, length);
+            ctx->http.file[length] = 0;
+            return CY_RSLT_SUCCESS;
+#endif
+
+#ifdef COMPONENT_OTA_MQTT
+        case CY_OTA_CB_OVERRIDE_UNIQUE_TOPIC:
+            if ( (length == 0) || (length >= sizeof(ctx->mqtt.unique_topic)) )
+            {
+                return CY_RSLT_OTA_ERROR_BADARG;
+            }
+            if ( (connecting == false) || (ctx->curr_connect_type != CY_OTA_CONNECTION_MQTT) )
+            {
+                break;
+            }
+            memcpy(ctx->mqtt.unique_topic, value, length);
+            ctx->mqtt.unique_topic[length] = 0;
+            return CY_RSLT_SUCCESS;
+#endif
+
+        case CY_OTA_CB_OVERRIDE_CONNECTION:
+            if (connecting == false)
+            {
+                break;
+            }
+            /* We are not connected at this time, saving the connection is ok */
+#ifdef COMPONENT_OTA_MQTT
+            if (ctx->curr_connect_type == CY_OTA_CONNECTION_MQTT)
+            {
+                ctx->mqtt.connection_from_app    = true;
+                ctx->mqtt.connection_established = true;
+                ctx->mqtt.mqtt_connection        = (cy_mqtt_t)value;
+                return CY_RSLT_SUCCESS;
+            }
+#endif
+#ifdef COMPONENT_OTA_HTTP
+            if ( (ctx->curr_connect_type == CY_OTA_CONNECTION_HTTP) ||
+                 (ctx->curr_connect_type == CY_OTA_CONNECTION_HTTPS) )
+            {
+                ctx->http.connection_from_app = true;
+                ctx->http.connection          = (cy_http_client_t)value;
+                return CY_RSLT_SUCCESS;
+            }
+#endif
+            break;
+
+        case CY_OTA_CB_OVERRIDE_CREDENTIALS:
+            ctx->cb_credentials = (cy_awsport_ssl_credentials_t *)value;
+            return CY_RSLT_SUCCESS;
+
+        default:
+            break;
+    }
+#else
+    (void)field;
+    (void)length;
+    (void)connecting;
+#endif
+
+    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() %d not used in state %s\n", __func__, field, cy_ota_get_state_string(ctx->curr_state));
+    return CY_RSLT_OTA_ERROR_UNSUPPORTED;
+}
+
+/* --------------------------------------------------------------- */
+cy_rslt_t cy_ota_set_callback_mask(cy_ota_context_ptr ctx_ptr, uint32_t reason_mask, uint32_t state_mask)
+{
+    cy_ota_context_t *ctx = (cy_ota_context_t *)ctx_ptr;
+
+    /* sanity check */
+    if (ctx == NULL)
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() BAD ARG\n", __func__);
+        return CY_RSLT_OTA_ERROR_BADARG;
+    }
+    CY_OTA_CONTEXT_ASSERT(ctx);
+
+    ctx->agent_params.cb_reason_mask = reason_mask;
+    ctx->agent_params.cb_state_mask  = state_mask;
+    return CY_RSLT_SUCCESS;
+}
+
 /* --------------------------------------------------------------- */
 cy_rslt_t cy_ota_get_update_now(cy_ota_context_ptr ctx_ptr)
 {
@@ -2419,6 +3819,7 @@ cy_rslt_t cy_ota_agent_stop(cy_ota_context_ptr *ctx_ptr)
     uint32_t            waitfor;
 #endif
     cy_ota_context_t    *ctx;
+    uint8_t             *memory;
 
     /* sanity check */
     if (ctx_ptr == NULL )
@@ -2433,25 +3834,46 @@ cy_rslt_t cy_ota_agent_stop(cy_ota_context_ptr *ctx_ptr)
     ctx = (cy_ota_context_t *)*ctx_ptr;
     CY_OTA_CONTEXT_ASSERT(ctx);
 
-    ctx->curr_state = CY_OTA_STATE_EXITING;
-
 #if defined(COMPONENT_OTA_HTTP) || defined(COMPONENT_OTA_MQTT)
+    /* cy_ota_agent_poll() may have returned in the middle of a download */
+    if ( (ctx->agent_params.use_poll != false) && (ctx->state_in_progress == true) &&
+         (ctx->curr_state == CY_OTA_STATE_DATA_DOWNLOAD) )
+    {
+        (void)cy_ota_data_download_end(ctx, cy_ota_data_download_abort(ctx, CY_RSLT_OTA_ERROR_APP_RETURNED_STOP));
+    }
+    ctx->state_in_progress = false;
+#endif
 
-    /* Signal thread to end */
-    cy_rtos_setbits_event(&ctx->ota_event, (uint32_t)CY_OTA_EVENT_SHUTDOWN_NOW, 0);
+    ctx->curr_state = CY_OTA_STATE_EXITING;
 
-    /* wait for signal from started thread */
-    waitfor = CY_OTA_EVENT_RUNNING_EXITING;
-    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG1, "%s() Wait for Thread to exit\n", __func__);
-    result = cy_rtos_waitbits_event(&ctx->ota_event, &waitfor, 1, 1, 1000);
-    if (result != CY_RSLT_SUCCESS)
+#if defined(COMPONENT_OTA_HTTP) || defined(COMPONENT_OTA_MQTT)
+    if (ctx->agent_params.use_poll != false)
     {
-        /* Thread exit failed ? */
-        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() OTA Agent Thread Exit No response\n", __func__);
+        /* No thread, cy_ota_agent_poll() is not running */
+        cy_ota_stop_timer(ctx);
+
+        /* Nothing closes what the last cy_ota_agent_poll() left open */
+        (void)cy_ota_disconnect(ctx);
+        (void)cy_ota_close_filesystem(ctx);
     }
+    else
+    {
+        /* Signal thread to end */
+        cy_rtos_setbits_event(&ctx->ota_event, (uint32_t)CY_OTA_EVENT_SHUTDOWN_NOW, 0);
+
+        /* wait for signal from started thread */
+        waitfor = CY_OTA_EVENT_RUNNING_EXITING;
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG1, "%s() Wait for Thread to exit\n", __func__);
+        result = cy_rtos_waitbits_event(&ctx->ota_event, &waitfor, 1, 1, 1000);
+        if (result != CY_RSLT_SUCCESS)
+        {
+            /* Thread exit failed ? */
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() OTA Agent Thread Exit No response\n", __func__);
+        }
 
-    /* wait for thread to exit */
-    cy_rtos_join_thread(&ctx->ota_agent_thread);
+        /* wait for thread to exit */
+        cy_rtos_join_thread(&ctx->ota_agent_thread);
+    }
 #endif
 
     /* clear timer */
@@ -2460,11 +3882,18 @@ cy_rslt_t cy_ota_agent_stop(cy_ota_context_ptr *ctx_ptr)
     /* clear events */
     cy_rtos_deinit_event(&ctx->ota_event);
 
+    memory = ctx->memory;
+    if (ota_contexts[ctx->agent_index] == ctx)
+    {
+        ota_contexts[ctx->agent_index] = NULL;
+    }
     memset(ctx, 0x00, sizeof(cy_ota_context_t) );
-    free(ctx);
+    if (memory == NULL)
+    {
+        free(ctx);
+    }
 
     *ctx_ptr = NULL;
-    ota_context_only_one = NULL;
 
     cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG1, "%s() DONE\n", __func__);
     return CY_RSLT_SUCCESS;
@@ -2472,6 +3901,78 @@ cy_rslt_t cy_ota_agent_stop(cy_ota_context_ptr *ctx_ptr)
 
 /* --------------------------------------------------------------- */
 
+cy_rslt_t cy_ota_agent_poll(cy_ota_context_ptr ctx_ptr, uint32_t budget_ms)
+{
+#if defined(COMPONENT_OTA_HTTP) || defined(COMPONENT_OTA_MQTT)
+    cy_ota_context_t                        *ctx = (cy_ota_context_t *)ctx_ptr;
+    const cy_ota_agent_state_table_entry_t  *entry;
+    cy_time_t                               start_ms;
+    cy_time_t                               now_ms;
+    uint32_t                                events;
+
+    /* sanity check */
+    if (ctx == NULL)
+    {
+        return CY_RSLT_OTA_ERROR_BADARG;
+    }
+    CY_OTA_CONTEXT_ASSERT(ctx);
+
+    if ( (ctx->agent_params.use_poll == false) || (ctx->network_params.initial_connection == CY_OTA_CONNECTION_BLE) )
+    {
+        return CY_RSLT_OTA_ERROR_UNSUPPORTED;
+    }
+
+    cy_rtos_get_time(&start_ms);
+    while (ctx->curr_state != CY_OTA_STATE_EXITING)
+    {
+        if (ctx->curr_state == CY_OTA_STATE_AGENT_WAITING)
+        {
+            /* Only run the waiting state with an event to act on, so it does not block */
+            events = 0;
+            cy_rtos_getbits_event(&ctx->ota_event, &events);
+            if ( (events & CY_OTA_EVENT_THREAD_EVENTS) == 0)
+            {
+                return CY_RSLT_SUCCESS;
+            }
+        }
+
+        /* the state is the index in the state table */
+        entry = cy_ota_state_entry(ctx->curr_state);
+        if (entry == NULL)
+        {
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() state not in the state table! state: %d %s\n", __func__,
+                        ctx->curr_state, cy_ota_get_state_string(ctx->curr_state));
+            return CY_RSLT_OTA_ERROR_GENERAL;
+        }
+        if (cy_ota_agent_run_state(ctx, entry) == false)
+        {
+            /* Same as the OTA Agent thread exiting */
+            cy_ota_stop_timer(ctx);
+            cy_ota_set_state(ctx, CY_OTA_STATE_EXITING);
+            break;
+        }
+
+        cy_rtos_get_time(&now_ms);
+        if ( (uint32_t)(now_ms - start_ms) >= budget_ms)
+        {
+            break;
+        }
+    }
+
+    if (ctx->curr_state == CY_OTA_STATE_EXITING)
+    {
+        return CY_RSLT_OTA_EXITING;
+    }
+    return (ctx->curr_state == CY_OTA_STATE_AGENT_WAITING) ? CY_RSLT_SUCCESS : CY_RSLT_OTA_POLL_AGAIN;
+#else
+    (void)ctx_ptr;
+    (void)budget_ms;
+    return CY_RSLT_OTA_ERROR_UNSUPPORTED;
+#endif
+}
+
+/* --------------------------------------------------------------- */
+
 cy_rslt_t cy_ota_get_state(cy_ota_context_ptr ctx_ptr, cy_ota_agent_state_t *ota_state )
 {
     const cy_ota_context_t *ctx = (const cy_ota_context_t *)ctx_ptr;
@@ -2508,6 +4009,22 @@ cy_rslt_t cy_ota_get_last_error(void)
     return cy_ota_last_error;
 }
 
+/* --------------------------------------------------------------- */
+cy_rslt_t cy_ota_get_agent_last_error(cy_ota_context_ptr ctx_ptr, cy_rslt_t *error)
+{
+    const cy_ota_context_t *ctx = (const cy_ota_context_t *)ctx_ptr;
+
+    /* sanity check */
+    if ( (ctx == NULL) || (error == NULL) )
+    {
+        return CY_RSLT_OTA_ERROR_BADARG;
+    }
+    CY_OTA_CONTEXT_ASSERT(ctx);
+
+    *error = ctx->last_error;
+    return CY_RSLT_SUCCESS;
+}
+
 /* --------------------------------------------------------------- */
 const char *cy_ota_get_error_string(cy_rslt_t error)
 {
@@ -86,32 +86,15 @@
  *
  **********************************************************************/
 
-static uint32_t cy_ota_update_get_calculated_crc32(uint32_t prev_crc32, const uint8_t* buffer, uint16_t buffer_length)
+static uint32_t cy_ota_update_get_calculated_crc32(const cy_ota_context_t *ota_ctx, uint32_t prev_crc32, const uint8_t* buffer, uint16_t buffer_length)
 {
-    uint32_t crc32 = ~prev_crc32;
-    uint16_t i;
-
-    for(i = 0; i < buffer_length; i++)
+    /* Application supplied CRC (ex: hardware CRC block) */
+    if(ota_ctx->agent_params.crc32_func != NULL)
     {
-        uint16_t j;
-
-        crc32 ^= *buffer;
-        buffer++;
-
-        for(j = 0; j < 8; j++)
-        {
-            if(crc32 & (uint32_t)0x1U)
-            {
-                crc32 = (crc32 >> 1) ^ 0xEDB88320U;
-            }
-            else
-            {
-                crc32 = (crc32 >> 1);
-            }
-        }
+        return ota_ctx->agent_params.crc32_func(prev_crc32, buffer, buffer_length);
     }
 
-    return ~crc32;
+    return cy_ota_crc32_update(prev_crc32, buffer, buffer_length);
 }
 
 cy_rslt_t cy_ota_ble_validate_network_params(const cy_ota_network_params_t *network_params)
@@ -136,14 +119,24 @@ cy_rslt_t cy_ota_update_prepare(cy_ota_context_ptr ctx_ptr)
 
     cy_ota_set_state(ota_ctx, CY_OTA_STATE_STORAGE_OPEN);
 
-    /* Call Open Storage - this erases Secondary Slot for storing downloaded OTA Image */
-    result = ota_ctx->storage_iface.ota_file_open(&(ota_ctx->ota_storage_context));
+    /* Call Open Storage - this erases Secondary Slot for storing downloaded OTA Image,
+     * or only opens it when erasing ahead of the writes
+     */
+    result = cy_ota_storage_open(ota_ctx);
     if(result != CY_RSLT_SUCCESS)
     {
         cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "     OTA platform storage open API FAILED\n");
         return CY_RSLT_OTA_ERROR_BLE_STORAGE;
     }
 
+#if (CY_OTA_STORAGE_COALESCE_SIZE > 0)
+    /* Bluetooth writes are small, collect them into page aligned writes */
+    if(cy_ota_coalesce_start(ota_ctx) != CY_RSLT_SUCCESS)
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_WARNING, "     No coalescing buffer, write each packet to storage\n");
+    }
+#endif
+
     cy_ota_set_state(ota_ctx, CY_OTA_STATE_AGENT_WAITING);
     return result;
 }
@@ -160,6 +153,18 @@ cy_rslt_t cy_ota_update_download_start(cy_ota_context_ptr ctx_ptr, uint32_t upda
     ota_ctx->ota_storage_context.total_bytes_written = 0;
     ota_ctx->ble.crc32 = CRC32_INITIAL_VALUE;
     ota_ctx->ble.percent = 0;
+#if (CY_OTA_DECOMPRESS != CY_OTA_DECOMPRESS_NONE)
+    cy_ota_decompress_start(ota_ctx, 0);
+#endif
+#if (CY_OTA_DELTA_UPDATE == 1)
+    cy_ota_delta_start(ota_ctx, 0);
+#endif
+#if (CY_OTA_TAR_PARSER == 1)
+    cy_ota_tar_start(ota_ctx, 0);
+#endif
+#if (CY_OTA_IMAGE_DIGEST)
+    cy_ota_digest_start(ota_ctx, 0);
+#endif
 
     cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_INFO, "Update OTA state to CY_OTA_STATE_START_UPDATE\n");
     cy_ota_set_state(ota_ctx, CY_OTA_STATE_START_UPDATE);
@@ -196,7 +201,7 @@ cy_rslt_t cy_ota_update_write(cy_ota_context_ptr ctx_ptr, uint8_t *data_buf, uin
 
     if(chunk_info.size > 0)
     {
-        result = ota_ctx->storage_iface.ota_file_write(&(ota_ctx->ota_storage_context), &chunk_info);
+        result = cy_ota_storage_write(ota_ctx, &chunk_info);
         if(result != CY_RSLT_SUCCESS)
         {
             cy_rtos_setbits_event(&ota_ctx->ota_event, (uint32_t)CY_OTA_EVENT_DATA_FAIL, 0);
@@ -223,7 +228,7 @@ cy_rslt_t cy_ota_update_write(cy_ota_context_ptr ctx_ptr, uint8_t *data_buf, uin
     }
 
     /* update crc or secure signature as we pull in the data */
-    ota_ctx->ble.crc32 = cy_ota_update_get_calculated_crc32(ota_ctx->ble.crc32, (const uint8_t*)((uint32_t)data_buf + offset), len);
+    ota_ctx->ble.crc32 = cy_ota_update_get_calculated_crc32(ota_ctx, ota_ctx->ble.crc32, (const uint8_t*)((uint32_t)data_buf + offset), len);
     ota_ctx->ble.file_bytes_written += chunk_info.size;
 
     cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_INFO, "   Downloaded 0x%lx of 0x%lx (%d%%)\n", ota_ctx->ota_storage_context.total_bytes_written, ota_ctx->ota_storage_context.total_image_size, ota_ctx->ble.percent);
@@ -240,6 +245,51 @@ cy_rslt_t cy_ota_update_verify(cy_ota_context_ptr ctx_ptr, uint32_t final_crc32,
 
     cy_ota_set_state(ota_ctx, CY_OTA_STATE_VERIFY);
 
+#if (CY_OTA_DECOMPRESS != CY_OTA_DECOMPRESS_NONE)
+    /* Write the last decoded data */
+    if(cy_ota_decompress_finish(ota_ctx) != CY_RSLT_SUCCESS)
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "     Compressed OTA Image not complete\n");
+        cy_ota_set_state(ota_ctx, CY_OTA_STATE_EXITING);
+        cy_ota_set_state(ota_ctx, CY_OTA_STATE_OTA_COMPLETE);
+        return CY_RSLT_OTA_ERROR_BLE_VERIFY;
+    }
+#endif
+#if (CY_OTA_DELTA_UPDATE == 1)
+    /* Write the last patched data */
+    if(cy_ota_delta_finish(ota_ctx) != CY_RSLT_SUCCESS)
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "     Delta OTA Image not applied\n");
+        cy_ota_set_state(ota_ctx, CY_OTA_STATE_EXITING);
+        cy_ota_set_state(ota_ctx, CY_OTA_STATE_OTA_COMPLETE);
+        return CY_RSLT_OTA_ERROR_BLE_VERIFY;
+    }
+#endif
+#if (CY_OTA_TAR_PARSER == 1)
+    /* Write data held for reordering, check the archive is complete */
+    if(cy_ota_tar_finish(ota_ctx) != CY_RSLT_SUCCESS)
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "     TAR archive not complete\n");
+        cy_ota_set_state(ota_ctx, CY_OTA_STATE_EXITING);
+        cy_ota_set_state(ota_ctx, CY_OTA_STATE_OTA_COMPLETE);
+        return CY_RSLT_OTA_ERROR_BLE_VERIFY;
+    }
+#endif
+#if (CY_OTA_STORAGE_COALESCE_SIZE > 0)
+    /* Write the tail held in the coalescing buffer before verifying storage */
+    if(cy_ota_coalesce_stop(ota_ctx) != CY_RSLT_SUCCESS)
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "     OTA platform storage block write API FAILED\n");
+        cy_ota_set_state(ota_ctx, CY_OTA_STATE_EXITING);
+        cy_ota_set_state(ota_ctx, CY_OTA_STATE_OTA_COMPLETE);
+        return CY_RSLT_OTA_ERROR_BLE_STORAGE;
+    }
+#endif
+#if (CY_OTA_IMAGE_DIGEST)
+    /* Passed to ota_file_verify() */
+    cy_ota_digest_finish(ota_ctx);
+#endif
+
     if(verify_crc_or_signature)
     {
         /* non- secure here, check CRC */
@@ -270,6 +320,13 @@ cy_rslt_t cy_ota_update_verify(cy_ota_context_ptr ctx_ptr, uint32_t final_crc32,
     {
         for(uint8_t i = 1; i <= CY_OTA_IMAGE_NUMBER; i++)
         {
+#if (CY_OTA_TAR_PARSER == 1)
+            /* Already verified when its archive member completed */
+            if(cy_ota_tar_verified(ota_ctx, i) == true)
+            {
+                continue;
+            }
+#endif
             ota_ctx->ota_storage_context.imgID = i;
 
             /* Call user image verify callback API. */
@@ -324,6 +381,21 @@ cy_rslt_t cy_ota_update_abort(cy_ota_context_ptr ctx_ptr)
 
     CY_OTA_CONTEXT_ASSERT(ota_ctx);
     cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_INFO, "%s(): Set state\n", __func__);
+#if (CY_OTA_DECOMPRESS != CY_OTA_DECOMPRESS_NONE)
+    (void)cy_ota_decompress_finish(ota_ctx);
+#endif
+#if (CY_OTA_DELTA_UPDATE == 1)
+    (void)cy_ota_delta_finish(ota_ctx);
+#endif
+#if (CY_OTA_TAR_PARSER == 1)
+    (void)cy_ota_tar_finish(ota_ctx);
+#endif
+#if (CY_OTA_STORAGE_COALESCE_SIZE > 0)
+    (void)cy_ota_coalesce_stop(ota_ctx);
+#endif
+#if (CY_OTA_IMAGE_DIGEST)
+    cy_ota_digest_finish(ota_ctx);
+#endif
     cy_ota_set_state(ota_ctx, CY_OTA_STATE_AGENT_WAITING);
 
     return CY_RSLT_SUCCESS;
@@ -0,0 +1,503 @@
+/*
+ * Copyright 2025, Cypress Semiconductor Corporation (an Infineon company) or
+ * an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+ *
+ * This software, including source code, documentation and related
+ * materials ("Software") is owned by Cypress Semiconductor Corporation
+ * or one of its affiliates ("Cypress") and is protected by and subject to
+ * worldwide patent protection (United States and foreign),
+ * United States copyright laws and international treaty provisions.
+ * Therefore, you may use this Software only as provided in the license
+ * agreement accompanying the software package from which you
+ * obtained this Software ("EULA").
+ * If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+ * non-transferable license to copy, modify, and compile the Software
+ * source code solely for use in connection with Cypress's
+ * integrated circuit products.  Any reproduction, modification, translation,
+ * compilation, or representation of this Software except as specified
+ * above is prohibited without the express written permission of Cypress.
+ *
+ * Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+ * reserves the right to make changes to the Software without notice. Cypress
+ * does not assume any liability arising out of the application or use of the
+ * Software or any product or circuit described in the Software. Cypress does
+ * not authorize its products for use in any products where a malfunction or
+ * failure of the Cypress product may reasonably be expected to result in
+ * significant property damage, injury or death ("High Risk Product"). By
+ * including Cypress's product in a High Risk Product, the manufacturer
+ * of such system or application assumes all risk of such use and in doing
+ * so agrees to indemnify Cypress against all liability.
+ */
+
+/*
+ *  Cypress OTA Agent streaming decompression
+ *
+ *  Decodes a compressed OTA Image (see scripts/WiFi_Ethernet/ota_compress.py)
+ *  as it is received, before it is written to storage.
+ *
+ *  Compressed OTA Image:
+ *      "OTAZ"                      4 byte magic
+ *      version                     1 byte, CY_OTA_COMPRESSED_VERSION
+ *      algorithm                   1 byte, CY_OTA_DECOMPRESS_xxx
+ *      window_bits                 1 byte
+ *      lookahead_bits              1 byte
+ *      image size                  4 bytes, little endian, uncompressed size
+ *      LZSS bit stream             MSB first, same format as heatshrink:
+ *          1 + 8 bits              literal byte
+ *          0 + window_bits         back reference offset - 1
+ *            + lookahead_bits      back reference length - 1
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cy_ota_api.h"
+#include "cy_ota_internal.h"
+#include "cy_ota_log.h"
+
+#if (CY_OTA_DECOMPRESS != CY_OTA_DECOMPRESS_NONE)
+
+/***********************************************************************
+ *
+ * defines & enums
+ *
+ **********************************************************************/
+#define CY_OTA_COMPRESSED_MAGIC         "OTAZ"
+#define CY_OTA_COMPRESSED_MAGIC_SIZE    (4)
+#define CY_OTA_COMPRESSED_VERSION       (1)
+
+/* Smallest lookahead the host tool uses */
+#define CY_OTA_LZSS_LOOKAHEAD_BITS_MIN  (3)
+
+typedef enum
+{
+    CY_OTA_DECOMPRESS_STATE_HEADER = 0,     /* collecting the header            */
+    CY_OTA_DECOMPRESS_STATE_TAG,            /* next bit is literal / reference  */
+    CY_OTA_DECOMPRESS_STATE_LITERAL,        /* next 8 bits are a literal        */
+    CY_OTA_DECOMPRESS_STATE_INDEX,          /* next bits are a reference offset */
+    CY_OTA_DECOMPRESS_STATE_COUNT,          /* next bits are a reference length */
+    CY_OTA_DECOMPRESS_STATE_DONE,           /* whole OTA Image decoded          */
+} cy_ota_decompress_state_t;
+
+/***********************************************************************
+ *
+ * Functions
+ *
+ **********************************************************************/
+
+/**
+ * @brief Pass the decoded data to the storage write path
+ *
+ * @param[in]   ctx     - pointer to OTA agent context @ref cy_ota_context_t
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          Error from the storage write path
+ */
+static cy_rslt_t cy_ota_decompress_flush(cy_ota_context_t *ctx)
+{
+    cy_ota_decompress_t         *dc = &ctx->decompress;
+    cy_ota_storage_write_info_t info;
+
+    if(dc->out_len == 0)
+    {
+        return CY_RSLT_SUCCESS;
+    }
+
+    info            = dc->info;
+    info.total_size = dc->image_size;
+    info.offset     = dc->out_pos - dc->out_len;
+    info.buffer     = dc->out;
+    info.size       = dc->out_len;
+    dc->out_len     = 0;
+
+    return cy_ota_storage_write_decoded(ctx, &info);
+}
+
+/**
+ * @brief Add one decoded byte to the window and the output
+ *
+ * @param[in]   ctx     - pointer to OTA agent context @ref cy_ota_context_t
+ * @param[in]   byte    - decoded byte
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          CY_RSLT_OTA_ERROR_GENERAL - more data than the header says
+ *          Error from the storage write path
+ */
+static cy_rslt_t cy_ota_decompress_emit(cy_ota_context_t *ctx, uint8_t byte)
+{
+    cy_ota_decompress_t *dc = &ctx->decompress;
+
+    if(dc->out_pos >= dc->image_size)
+    {
+        return CY_RSLT_OTA_ERROR_GENERAL;
+    }
+
+    dc->window[dc->out_pos & dc->window_mask] = byte;
+    dc->out[dc->out_len++] = byte;
+    dc->out_pos++;
+
+    if(dc->out_len == CY_OTA_STORAGE_PAGE_SIZE)
+    {
+        return cy_ota_decompress_flush(ctx);
+    }
+    return CY_RSLT_SUCCESS;
+}
+
+/**
+ * @brief Check the header and allocate the window
+ *
+ * @param[in]   ctx     - pointer to OTA agent context @ref cy_ota_context_t
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          CY_RSLT_OTA_ERROR_UNSUPPORTED
+ *          CY_RSLT_OTA_ERROR_OUT_OF_MEMORY
+ */
+static cy_rslt_t cy_ota_decompress_header(cy_ota_context_t *ctx)
+{
+    cy_ota_decompress_t *dc = &ctx->decompress;
+
+    dc->window_bits    = dc->header[6];
+    dc->lookahead_bits = dc->header[7];
+    dc->image_size     = ( (uint32_t)dc->header[8]         | ((uint32_t)dc->header[9] << 8) |
+                           ((uint32_t)dc->header[10] << 16) | ((uint32_t)dc->header[11] << 24) );
+
+    if( (dc->header[4] != CY_OTA_COMPRESSED_VERSION) || (dc->header[5] != CY_OTA_DECOMPRESS) ||
+        (dc->window_bits > CY_OTA_DECOMPRESS_WINDOW_BITS_MAX) ||
+        (dc->lookahead_bits < CY_OTA_LZSS_LOOKAHEAD_BITS_MIN) || (dc->lookahead_bits >= dc->window_bits) ||
+        (dc->image_size == 0) )
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Unsupported compressed OTA Image v%d alg %d window %d lookahead %d\n",
+                       __func__, dc->header[4], dc->header[5], dc->window_bits, dc->lookahead_bits);
+        return CY_RSLT_OTA_ERROR_UNSUPPORTED;
+    }
+
+    dc->window_mask = (1UL << dc->window_bits) - 1;
+    dc->window = (uint8_t *)cy_ota_mem_alloc(ctx, CY_OTA_MEM_DECOMPRESS_WINDOW, (1UL << dc->window_bits) + CY_OTA_STORAGE_PAGE_SIZE);
+    if(dc->window == NULL)
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Out of memory for %ld byte window\n", __func__, (1UL << dc->window_bits));
+        return CY_RSLT_OTA_ERROR_OUT_OF_MEMORY;
+    }
+    dc->out = &dc->window[1UL << dc->window_bits];
+
+    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_NOTICE, "Compressed OTA Image, %ld bytes uncompressed, window %d\n",
+                   dc->image_size, (1 << dc->window_bits));
+    return CY_RSLT_SUCCESS;
+}
+
+/**
+ * @brief Decode compressed data
+ *
+ * @param[in]   ctx     - pointer to OTA agent context @ref cy_ota_context_t
+ * @param[in]   buffer  - compressed data
+ * @param[in]   size    - bytes of compressed data
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          CY_RSLT_OTA_ERROR_GENERAL - corrupt data
+ *          Error from the storage write path
+ */
+static cy_rslt_t cy_ota_decompress_data(cy_ota_context_t *ctx, const uint8_t *buffer, uint32_t size)
+{
+    cy_ota_decompress_t *dc = &ctx->decompress;
+    cy_rslt_t           result;
+    uint32_t            value;
+    uint32_t            count;
+    uint32_t            i;
+    uint8_t             need;
+
+    for(i = 0; i < size; i++)
+    {
+        if(dc->state == CY_OTA_DECOMPRESS_STATE_HEADER)
+        {
+            dc->header[dc->header_len++] = buffer[i];
+            if(dc->header_len == sizeof(dc->header))
+            {
+                result = cy_ota_decompress_header(ctx);
+                if(result != CY_RSLT_SUCCESS)
+                {
+                    return result;
+                }
+                dc->state = CY_OTA_DECOMPRESS_STATE_TAG;
+            }
+            continue;
+        }
+
+        if(dc->state == CY_OTA_DECOMPRESS_STATE_DONE)
+        {
+            /* padding in the last byte */
+            break;
+        }
+
+        dc->bits   = (dc->bits << 8) | buffer[i];
+        dc->nbits += 8;
+
+        while(dc->state != CY_OTA_DECOMPRESS_STATE_DONE)
+        {
+            switch(dc->state)
+            {
+                case CY_OTA_DECOMPRESS_STATE_LITERAL:
+                    need = 8;
+                    break;
+                case CY_OTA_DECOMPRESS_STATE_INDEX:
+                    need = dc->window_bits;
+                    break;
+                case CY_OTA_DECOMPRESS_STATE_COUNT:
+                    need = dc->lookahead_bits;
+                    break;
+                default:
+                    need = 1;
+                    break;
+            }
+            if(dc->nbits < need)
+            {
+                break;
+            }
+            dc->nbits -= need;
+            value = (dc->bits >> dc->nbits) & ((1UL << need) - 1);
+
+            switch(dc->state)
+            {
+                case CY_OTA_DECOMPRESS_STATE_TAG:
+                    dc->state = (value != 0) ? CY_OTA_DECOMPRESS_STATE_LITERAL : CY_OTA_DECOMPRESS_STATE_INDEX;
+                    break;
+
+                case CY_OTA_DECOMPRESS_STATE_LITERAL:
+                    result = cy_ota_decompress_emit(ctx, (uint8_t)value);
+                    if(result != CY_RSLT_SUCCESS)
+                    {
+                        return result;
+                    }
+                    dc->state = CY_OTA_DECOMPRESS_STATE_TAG;
+                    break;
+
+                case CY_OTA_DECOMPRESS_STATE_INDEX:
+                    dc->backref_offset = value + 1;
+                    if(dc->backref_offset > dc->out_pos)
+                    {
+                        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Bad back reference at 0x%lx\n", __func__, dc->out_pos);
+                        return CY_RSLT_OTA_ERROR_GENERAL;
+                    }
+                    dc->state = CY_OTA_DECOMPRESS_STATE_COUNT;
+                    break;
+
+                case CY_OTA_DECOMPRESS_STATE_COUNT:
+                    for(count = value + 1; count > 0; count--)
+                    {
+                        result = cy_ota_decompress_emit(ctx, dc->window[(dc->out_pos - dc->backref_offset) & dc->window_mask]);
+                        if(result != CY_RSLT_SUCCESS)
+                        {
+                            return result;
+                        }
+                    }
+                    dc->state = CY_OTA_DECOMPRESS_STATE_TAG;
+                    break;
+
+                default:
+                    break;
+            }
+
+            if(dc->out_pos == dc->image_size)
+            {
+                dc->state = CY_OTA_DECOMPRESS_STATE_DONE;
+            }
+        }
+    }
+
+    return CY_RSLT_SUCCESS;
+}
+
+/**
+ * @brief Collect the first bytes of the OTA Image and decide if it is compressed
+ *
+ * Until CY_OTA_COMPRESSED_MAGIC_SIZE bytes from offset 0 have arrived they are
+ *  held in magic[]. Once decided, the held bytes before chunk_info are written.
+ *
+ * @param[in]   ctx         - pointer to OTA agent context @ref cy_ota_context_t
+ * @param[in]   chunk_info  - received data @ref cy_ota_storage_write_info_t
+ *
+ * @return  CY_RSLT_SUCCESS                 - check dc->checked, false if chunk_info was held
+ *          CY_RSLT_OTA_ERROR_WRITE_STORAGE - data past the first bytes arrived first
+ *          Error from cy_ota_decompress_write()
+ */
+static cy_rslt_t cy_ota_decompress_check(cy_ota_context_t *ctx, cy_ota_storage_write_info_t *chunk_info)
+{
+    cy_ota_decompress_t         *dc = &ctx->decompress;
+    cy_ota_storage_write_info_t held;
+    uint32_t                    copy;
+
+    if(chunk_info->offset > dc->magic_len)
+    {
+        /* Writing it as is could store a compressed OTA Image, never guess */
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Data at offset 0x%lx before the first %d bytes, cannot tell if compressed\n",
+                       __func__, chunk_info->offset, CY_OTA_COMPRESSED_MAGIC_SIZE);
+        dc->result = CY_RSLT_OTA_ERROR_WRITE_STORAGE;
+        return dc->result;
+    }
+
+    copy = 0;
+    if( (chunk_info->offset + chunk_info->size) > dc->magic_len)
+    {
+        copy = (chunk_info->offset + chunk_info->size) - dc->magic_len;
+    }
+    if(copy > (uint32_t)(CY_OTA_COMPRESSED_MAGIC_SIZE - dc->magic_len) )
+    {
+        copy = CY_OTA_COMPRESSED_MAGIC_SIZE - dc->magic_len;
+    }
+    memcpy(&dc->magic[dc->magic_len], &chunk_info->buffer[dc->magic_len - chunk_info->offset], copy);
+    dc->magic_len += (uint8_t)copy;
+    dc->info = *chunk_info;
+    if(dc->magic_len < CY_OTA_COMPRESSED_MAGIC_SIZE)
+    {
+        return CY_RSLT_SUCCESS;
+    }
+
+    dc->checked = true;
+    dc->active  = (memcmp(dc->magic, CY_OTA_COMPRESSED_MAGIC, CY_OTA_COMPRESSED_MAGIC_SIZE) == 0);
+
+    /* Bytes held from earlier writes go first */
+    if(chunk_info->offset == 0)
+    {
+        return CY_RSLT_SUCCESS;
+    }
+    held = *chunk_info;
+    held.buffer = dc->magic;
+    held.offset = 0;
+    held.size   = chunk_info->offset;
+    return cy_ota_decompress_write(ctx, &held);
+}
+
+void cy_ota_decompress_start(cy_ota_context_t *ctx, uint32_t resume_offset)
+{
+    CY_OTA_CONTEXT_ASSERT(ctx);
+
+    if(ctx->decompress.window != NULL)
+    {
+        cy_ota_mem_free(ctx, ctx->decompress.window);
+    }
+    memset(&ctx->decompress, 0x00, sizeof(ctx->decompress));
+    ctx->decompress.result = CY_RSLT_SUCCESS;
+
+    /* A compressed OTA Image is never checkpointed, so a resumed download is not one */
+    if(resume_offset > 0)
+    {
+        ctx->decompress.checked = true;
+    }
+}
+
+cy_rslt_t cy_ota_decompress_write(cy_ota_context_t *ctx, cy_ota_storage_write_info_t *chunk_info)
+{
+    cy_ota_decompress_t *dc = &ctx->decompress;
+    cy_rslt_t           result;
+    uint32_t            skip;
+
+    CY_OTA_CONTEXT_ASSERT(ctx);
+
+    /* The first bytes of the OTA Image decide the format, whatever the chunk sizes */
+    if(dc->checked == false)
+    {
+        if(dc->result != CY_RSLT_SUCCESS)
+        {
+            return dc->result;
+        }
+        result = cy_ota_decompress_check(ctx, chunk_info);
+        if( (result != CY_RSLT_SUCCESS) || (dc->checked == false) )
+        {
+            return result;
+        }
+    }
+    if(dc->active == false)
+    {
+        return cy_ota_storage_write_decoded(ctx, chunk_info);
+    }
+
+    if(dc->result != CY_RSLT_SUCCESS)
+    {
+        return dc->result;
+    }
+
+    /* Data already decoded (ex: MQTT duplicate) */
+    if( (chunk_info->offset + chunk_info->size) <= dc->in_offset)
+    {
+        return CY_RSLT_SUCCESS;
+    }
+    if(chunk_info->offset > dc->in_offset)
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Compressed data out of order, expected offset 0x%lx got 0x%lx\n",
+                       __func__, dc->in_offset, chunk_info->offset);
+        dc->result = CY_RSLT_OTA_ERROR_WRITE_STORAGE;
+        return dc->result;
+    }
+
+    skip = dc->in_offset - chunk_info->offset;
+    dc->info = *chunk_info;
+    dc->result = cy_ota_decompress_data(ctx, &chunk_info->buffer[skip], (chunk_info->size - skip));
+    dc->in_offset = chunk_info->offset + chunk_info->size;
+
+    return dc->result;
+}
+
+cy_rslt_t cy_ota_decompress_finish(cy_ota_context_t *ctx)
+{
+    cy_ota_decompress_t *dc = &ctx->decompress;
+    cy_rslt_t           result;
+
+    CY_OTA_CONTEXT_ASSERT(ctx);
+
+    if( (dc->checked == false) && (dc->result == CY_RSLT_SUCCESS) && (dc->magic_len > 0) )
+    {
+        /* Only an OTA Image shorter than the magic is known not to be compressed */
+        cy_ota_storage_write_info_t held = dc->info;
+
+        if(dc->magic_len != ctx->ota_storage_context.total_image_size)
+        {
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Only %d of the first %d bytes arrived\n", __func__,
+                           dc->magic_len, CY_OTA_COMPRESSED_MAGIC_SIZE);
+            dc->result = CY_RSLT_OTA_ERROR_GENERAL;
+            return dc->result;
+        }
+        dc->checked = true;
+        held.buffer = dc->magic;
+        held.offset = 0;
+        held.size   = dc->magic_len;
+        dc->result  = cy_ota_storage_write_decoded(ctx, &held);
+        if(dc->result != CY_RSLT_SUCCESS)
+        {
+            return dc->result;
+        }
+    }
+    if(dc->active == false)
+    {
+        return dc->result;
+    }
+
+    result = dc->result;
+    if(result == CY_RSLT_SUCCESS)
+    {
+        result = cy_ota_decompress_flush(ctx);
+    }
+    if( (result == CY_RSLT_SUCCESS) && (dc->state != CY_OTA_DECOMPRESS_STATE_DONE) )
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Decoded 0x%lx of 0x%lx bytes\n", __func__, dc->out_pos, dc->image_size);
+        result = CY_RSLT_OTA_ERROR_GENERAL;
+    }
+    if(result == CY_RSLT_SUCCESS)
+    {
+        /* From here on the OTA Image in storage is what matters */
+        ctx->ota_storage_context.total_image_size = dc->image_size;
+    }
+
+    if(dc->window != NULL)
+    {
+        cy_ota_mem_free(ctx, dc->window);
+        dc->window = NULL;
+        dc->out    = NULL;
+    }
+    dc->result = result;
+
+    return result;
+}
+
+#endif  /* CY_OTA_DECOMPRESS != CY_OTA_DECOMPRESS_NONE */
@@ -0,0 +1,661 @@
+/*
+ * Copyright 2025, Cypress Semiconductor Corporation (an Infineon company) or
+ * an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+ *
+ * This software, including source code, documentation and related
+ * materials ("Software") is owned by Cypress Semiconductor Corporation
+ * or one of its affiliates ("Cypress") and is protected by and subject to
+ * worldwide patent protection (United States and foreign),
+ * United States copyright laws and international treaty provisions.
+ * Therefore, you may use this Software only as provided in the license
+ * agreement accompanying the software package from which you
+ * obtained this Software ("EULA").
+ * If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+ * non-transferable license to copy, modify, and compile the Software
+ * source code solely for use in connection with Cypress's
+ * integrated circuit products.  Any reproduction, modification, translation,
+ * compilation, or representation of this Software except as specified
+ * above is prohibited without the express written permission of Cypress.
+ *
+ * Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+ * reserves the right to make changes to the Software without notice. Cypress
+ * does not assume any liability arising out of the application or use of the
+ * Software or any product or circuit described in the Software. Cypress does
+ * not authorize its products for use in any products where a malfunction or
+ * failure of the Cypress product may reasonably be expected to result in
+ * significant property damage, injury or death ("High Risk Product"). By
+ * including Cypress's product in a High Risk Product, the manufacturer
+ * of such system or application assumes all risk of such use and in doing
+ * so agrees to indemnify Cypress against all liability.
+ */
+
+
+/*
+ *  Cypress OTA Agent delta (patch) OTA Images
+ *
+ *  Rebuilds the new OTA Image from a patch (see scripts/WiFi_Ethernet/ota_delta.py)
+ *  and the running application as the patch is received, before it is written to storage.
+ *
+ *  Delta OTA Image:
+ *      "OTAD"                      4 byte magic
+ *      version                     1 byte, CY_OTA_DELTA_VERSION
+ *      reserved                    1 byte, 0
+ *      base version                3 x 2 bytes, little endian, major.minor.build
+ *      source size                 4 bytes, little endian, bytes of the running application used
+ *      source CRC32                4 bytes, little endian, CRC32 of those bytes
+ *      image size                  4 bytes, little endian, new OTA Image size
+ *      operations                  until image size bytes are built:
+ *          0, src_offset, length           copy length bytes of the running application
+ *          1, src_offset, length, diff[]   running application byte + diff byte (mod 256)
+ *          2, length, data[]               new data
+ *      src_offset and length are LEB128 varints (7 bits per byte, low bits first).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cy_ota_api.h"
+#include "cy_ota_internal.h"
+#include "cy_ota_log.h"
+
+#if (CY_OTA_DELTA_UPDATE == 1)
+
+/***********************************************************************
+ *
+ * defines & enums
+ *
+ **********************************************************************/
+#define CY_OTA_DELTA_MAGIC              "OTAD"
+#define CY_OTA_DELTA_MAGIC_SIZE         (4)
+#define CY_OTA_DELTA_VERSION            (1)
+
+/* Patch operations */
+#define CY_OTA_DELTA_OP_COPY            (0)
+#define CY_OTA_DELTA_OP_ADD             (1)
+#define CY_OTA_DELTA_OP_DATA            (2)
+
+typedef enum
+{
+    CY_OTA_DELTA_STATE_HEADER = 0,          /* collecting the header            */
+    CY_OTA_DELTA_STATE_OP,                  /* next byte is an operation        */
+    CY_OTA_DELTA_STATE_SRC_OFFSET,          /* next bytes are the source offset */
+    CY_OTA_DELTA_STATE_LENGTH,              /* next bytes are the length        */
+    CY_OTA_DELTA_STATE_ADD,                 /* next bytes are ADD differences   */
+    CY_OTA_DELTA_STATE_DATA,                /* next bytes are new data          */
+    CY_OTA_DELTA_STATE_DONE,                /* whole OTA Image built            */
+} cy_ota_delta_state_t;
+
+/***********************************************************************
+ *
+ * Functions
+ *
+ **********************************************************************/
+
+static uint32_t cy_ota_delta_get_u32(const uint8_t *buffer)
+{
+    return ( (uint32_t)buffer[0]        | ((uint32_t)buffer[1] << 8) |
+             ((uint32_t)buffer[2] << 16) | ((uint32_t)buffer[3] << 24) );
+}
+
+/**
+ * @brief Read the running application
+ *
+ * @param[in]   ctx     - pointer to OTA agent context @ref cy_ota_context_t
+ * @param[in]   offset  - offset in the running application
+ * @param[out]  buffer  - buffer for the data
+ * @param[in]   size    - bytes to read
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          CY_RSLT_OTA_ERROR_READ_STORAGE
+ */
+static cy_rslt_t cy_ota_delta_read_source(cy_ota_context_t *ctx, uint32_t offset, uint8_t *buffer, uint32_t size)
+{
+    cy_ota_storage_read_info_t  info;
+    cy_rslt_t                   result;
+
+    memset(&info, 0x00, sizeof(info));
+    info.offset = offset;
+    info.buffer = buffer;
+    info.size   = size;
+
+    result = ctx->storage_iface.ota_file_read_source(&ctx->ota_storage_context, &info);
+    if(result != CY_RSLT_SUCCESS)
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() ota_file_read_source() offset 0x%lx size 0x%lx failed 0x%lx\n",
+                       __func__, offset, size, result);
+        return CY_RSLT_OTA_ERROR_READ_STORAGE;
+    }
+    return CY_RSLT_SUCCESS;
+}
+
+/**
+ * @brief Pass the new OTA Image data to the storage write path
+ *
+ * @param[in]   ctx     - pointer to OTA agent context @ref cy_ota_context_t
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          Error from the storage write path
+ */
+static cy_rslt_t cy_ota_delta_flush(cy_ota_context_t *ctx)
+{
+    cy_ota_delta_t              *dt = &ctx->delta;
+    cy_ota_storage_write_info_t info;
+
+    if(dt->out_len == 0)
+    {
+        return CY_RSLT_SUCCESS;
+    }
+
+    info            = dt->info;
+    info.total_size = dt->image_size;
+    info.offset     = dt->out_pos - dt->out_len;
+    info.buffer     = dt->out;
+    info.size       = dt->out_len;
+    dt->out_len     = 0;
+
+    return cy_ota_storage_write_image(ctx, &info);
+}
+
+/**
+ * @brief Add one byte to the output
+ *
+ * @param[in]   ctx     - pointer to OTA agent context @ref cy_ota_context_t
+ * @param[in]   byte    - new OTA Image byte
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          Error from the storage write path
+ */
+static cy_rslt_t cy_ota_delta_emit(cy_ota_context_t *ctx, uint8_t byte)
+{
+    cy_ota_delta_t  *dt = &ctx->delta;
+
+    dt->out[dt->out_len++] = byte;
+    dt->out_pos++;
+    dt->length--;
+
+    if(dt->out_len == CY_OTA_STORAGE_PAGE_SIZE)
+    {
+        return cy_ota_delta_flush(ctx);
+    }
+    return CY_RSLT_SUCCESS;
+}
+
+/**
+ * @brief Apply a COPY operation, the data comes from the running application only
+ *
+ * @param[in]   ctx     - pointer to OTA agent context @ref cy_ota_context_t
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          CY_RSLT_OTA_ERROR_READ_STORAGE
+ *          Error from the storage write path
+ */
+static cy_rslt_t cy_ota_delta_copy(cy_ota_context_t *ctx)
+{
+    cy_ota_delta_t  *dt = &ctx->delta;
+    cy_rslt_t       result;
+    uint32_t        size;
+
+    while(dt->length > 0)
+    {
+        size = CY_OTA_STORAGE_PAGE_SIZE - dt->out_len;
+        if(size > dt->length)
+        {
+            size = dt->length;
+        }
+        result = cy_ota_delta_read_source(ctx, dt->source_offset, &dt->out[dt->out_len], size);
+        if(result != CY_RSLT_SUCCESS)
+        {
+            return result;
+        }
+        dt->source_offset += size;
+        dt->out_len       += size;
+        dt->out_pos       += size;
+        dt->length        -= size;
+
+        if(dt->out_len == CY_OTA_STORAGE_PAGE_SIZE)
+        {
+            result = cy_ota_delta_flush(ctx);
+            if(result != CY_RSLT_SUCCESS)
+            {
+                return result;
+            }
+        }
+    }
+    return CY_RSLT_SUCCESS;
+}
+
+/**
+ * @brief Check the header and the running application, allocate the buffers
+ *
+ * @param[in]   ctx     - pointer to OTA agent context @ref cy_ota_context_t
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          CY_RSLT_OTA_ERROR_UNSUPPORTED
+ *          CY_RSLT_OTA_ERROR_INVALID_VERSION
+ *          CY_RSLT_OTA_ERROR_OUT_OF_MEMORY
+ *          CY_RSLT_OTA_ERROR_READ_STORAGE
+ */
+static cy_rslt_t cy_ota_delta_header(cy_ota_context_t *ctx)
+{
+    cy_ota_delta_t  *dt = &ctx->delta;
+    cy_rslt_t       result;
+    uint16_t        base_major;
+    uint16_t        base_minor;
+    uint16_t        base_build;
+    uint32_t        source_crc32;
+    uint32_t        crc32 = 0;
+    uint32_t        offset;
+    uint32_t        size;
+
+    base_major   = (uint16_t)(dt->header[6]  | (dt->header[7]  << 8));
+    base_minor   = (uint16_t)(dt->header[8]  | (dt->header[9]  << 8));
+    base_build   = (uint16_t)(dt->header[10] | (dt->header[11] << 8));
+    dt->source_size = cy_ota_delta_get_u32(&dt->header[12]);
+    source_crc32    = cy_ota_delta_get_u32(&dt->header[16]);
+    dt->image_size  = cy_ota_delta_get_u32(&dt->header[20]);
+
+    if( (dt->header[4] != CY_OTA_DELTA_VERSION) || (dt->header[5] != 0) ||
+        (dt->source_size == 0) || (dt->image_size == 0) )
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Unsupported delta OTA Image v%d\n", __func__, dt->header[4]);
+        return CY_RSLT_OTA_ERROR_UNSUPPORTED;
+    }
+    if(ctx->storage_iface.ota_file_read_source == NULL)
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Delta OTA Image needs ota_file_read_source()\n", __func__);
+        return CY_RSLT_OTA_ERROR_UNSUPPORTED;
+    }
+    if( (base_major != APP_VERSION_MAJOR) || (base_minor != APP_VERSION_MINOR) || (base_build != APP_VERSION_BUILD) )
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Patch for %d.%d.%d, running %d.%d.%d\n", __func__,
+                       base_major, base_minor, base_build, APP_VERSION_MAJOR, APP_VERSION_MINOR, APP_VERSION_BUILD);
+        return CY_RSLT_OTA_ERROR_INVALID_VERSION;
+    }
+
+    dt->out = (uint8_t *)cy_ota_mem_alloc(ctx, CY_OTA_MEM_DELTA_OUT, 2 * CY_OTA_STORAGE_PAGE_SIZE);
+    if(dt->out == NULL)
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Out of memory for patch buffers\n", __func__);
+        return CY_RSLT_OTA_ERROR_OUT_OF_MEMORY;
+    }
+    dt->source = &dt->out[CY_OTA_STORAGE_PAGE_SIZE];
+
+    /* The patch is only valid against the exact application it was made from */
+    for(offset = 0; offset < dt->source_size; offset += size)
+    {
+        size = dt->source_size - offset;
+        if(size > CY_OTA_STORAGE_PAGE_SIZE)
+        {
+            size = CY_OTA_STORAGE_PAGE_SIZE;
+        }
+        result = cy_ota_delta_read_source(ctx, offset, dt->source, size);
+        if(result != CY_RSLT_SUCCESS)
+        {
+            return result;
+        }
+        crc32 = cy_ota_crc32_update(crc32, dt->source, size);
+    }
+    if(crc32 != source_crc32)
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Running application CRC 0x%lx, patch needs 0x%lx\n", __func__, crc32, source_crc32);
+        return CY_RSLT_OTA_ERROR_INVALID_VERSION;
+    }
+
+    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_NOTICE, "Delta OTA Image against %d.%d.%d, %ld bytes after patching\n",
+                   base_major, base_minor, base_build, dt->image_size);
+    return CY_RSLT_SUCCESS;
+}
+
+/**
+ * @brief Check an operation length, start the operation
+ *
+ * @param[in]   ctx     - pointer to OTA agent context @ref cy_ota_context_t
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          CY_RSLT_OTA_ERROR_GENERAL - corrupt patch
+ *          Error from cy_ota_delta_copy()
+ */
+static cy_rslt_t cy_ota_delta_op_start(cy_ota_context_t *ctx)
+{
+    cy_ota_delta_t  *dt = &ctx->delta;
+
+    if( (dt->length == 0) || (dt->length > (dt->image_size - dt->out_pos)) ||
+        ( (dt->op != CY_OTA_DELTA_OP_DATA) &&
+          ( (dt->length > dt->source_size) || (dt->source_offset > (dt->source_size - dt->length)) ) ) )
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Bad operation %d at 0x%lx, source 0x%lx length 0x%lx\n",
+                       __func__, dt->op, dt->out_pos, dt->source_offset, dt->length);
+        return CY_RSLT_OTA_ERROR_GENERAL;
+    }
+
+    switch(dt->op)
+    {
+        case CY_OTA_DELTA_OP_COPY:
+            dt->state = CY_OTA_DELTA_STATE_OP;
+            return cy_ota_delta_copy(ctx);
+
+        case CY_OTA_DELTA_OP_ADD:
+            dt->source_len = 0;
+            dt->source_pos = 0;
+            dt->state = CY_OTA_DELTA_STATE_ADD;
+            break;
+
+        default:
+            dt->state = CY_OTA_DELTA_STATE_DATA;
+            break;
+    }
+    return CY_RSLT_SUCCESS;
+}
+
+/**
+ * @brief Apply patch data
+ *
+ * @param[in]   ctx     - pointer to OTA agent context @ref cy_ota_context_t
+ * @param[in]   buffer  - patch data
+ * @param[in]   size    - bytes of patch data
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          CY_RSLT_OTA_ERROR_GENERAL - corrupt patch
+ *          Error from the storage read or write path
+ */
+static cy_rslt_t cy_ota_delta_data(cy_ota_context_t *ctx, const uint8_t *buffer, uint32_t size)
+{
+    cy_ota_delta_t  *dt = &ctx->delta;
+    cy_rslt_t       result = CY_RSLT_SUCCESS;
+    uint32_t        read_size;
+    uint32_t        i;
+    uint8_t         byte;
+
+    for(i = 0; (i < size) && (dt->state != CY_OTA_DELTA_STATE_DONE); i++)
+    {
+        byte = buffer[i];
+        switch(dt->state)
+        {
+            case CY_OTA_DELTA_STATE_HEADER:
+                dt->header[dt->header_len++] = byte;
+                if(dt->header_len == sizeof(dt->header))
+                {
+                    result = cy_ota_delta_header(ctx);
+                    dt->state = CY_OTA_DELTA_STATE_OP;
+                }
+                break;
+
+            case CY_OTA_DELTA_STATE_OP:
+                if(byte > CY_OTA_DELTA_OP_DATA)
+                {
+                    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Bad operation %d at 0x%lx\n", __func__, byte, dt->out_pos);
+                    return CY_RSLT_OTA_ERROR_GENERAL;
+                }
+                dt->op           = byte;
+                dt->varint       = 0;
+                dt->varint_shift = 0;
+                dt->state = (byte == CY_OTA_DELTA_OP_DATA) ? CY_OTA_DELTA_STATE_LENGTH : CY_OTA_DELTA_STATE_SRC_OFFSET;
+                break;
+
+            case CY_OTA_DELTA_STATE_SRC_OFFSET:
+            case CY_OTA_DELTA_STATE_LENGTH:
+                if(dt->varint_shift > 28)
+                {
+                    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Bad varint at 0x%lx\n", __func__, dt->out_pos);
+                    return CY_RSLT_OTA_ERROR_GENERAL;
+                }
+                dt->varint |= (uint32_t)(byte & 0x7F) << dt->varint_shift;
+                dt->varint_shift += 7;
+                if( (byte & 0x80) != 0)
+                {
+                    break;
+                }
+                if(dt->state == CY_OTA_DELTA_STATE_SRC_OFFSET)
+                {
+                    dt->source_offset = dt->varint;
+                    dt->varint        = 0;
+                    dt->varint_shift  = 0;
+                    dt->state = CY_OTA_DELTA_STATE_LENGTH;
+                }
+                else
+                {
+                    dt->length = dt->varint;
+                    result = cy_ota_delta_op_start(ctx);
+                }
+                break;
+
+            case CY_OTA_DELTA_STATE_ADD:
+                if(dt->source_pos == dt->source_len)
+                {
+                    read_size = (dt->length < CY_OTA_STORAGE_PAGE_SIZE) ? dt->length : CY_OTA_STORAGE_PAGE_SIZE;
+                    result = cy_ota_delta_read_source(ctx, dt->source_offset, dt->source, read_size);
+                    if(result != CY_RSLT_SUCCESS)
+                    {
+                        return result;
+                    }
+                    dt->source_offset += read_size;
+                    dt->source_len     = read_size;
+                    dt->source_pos     = 0;
+                }
+                result = cy_ota_delta_emit(ctx, (uint8_t)(dt->source[dt->source_pos++] + byte));
+                if(dt->length == 0)
+                {
+                    dt->state = CY_OTA_DELTA_STATE_OP;
+                }
+                break;
+
+            case CY_OTA_DELTA_STATE_DATA:
+                result = cy_ota_delta_emit(ctx, byte);
+                if(dt->length == 0)
+                {
+                    dt->state = CY_OTA_DELTA_STATE_OP;
+                }
+                break;
+
+            default:
+                break;
+        }
+
+        if(result != CY_RSLT_SUCCESS)
+        {
+            return result;
+        }
+        if( (dt->state == CY_OTA_DELTA_STATE_OP) && (dt->out_pos == dt->image_size) )
+        {
+            dt->state = CY_OTA_DELTA_STATE_DONE;
+        }
+    }
+
+    return CY_RSLT_SUCCESS;
+}
+
+/**
+ * @brief Collect the first bytes of the OTA Image and decide if it is a patch
+ *
+ * Until CY_OTA_DELTA_MAGIC_SIZE bytes from offset 0 have arrived they are
+ *  held in magic[]. Once decided, the held bytes before chunk_info are written.
+ *
+ * @param[in]   ctx         - pointer to OTA agent context @ref cy_ota_context_t
+ * @param[in]   chunk_info  - received data @ref cy_ota_storage_write_info_t
+ *
+ * @return  CY_RSLT_SUCCESS                 - check dt->checked, false if chunk_info was held
+ *          CY_RSLT_OTA_ERROR_WRITE_STORAGE - data past the first bytes arrived first
+ *          Error from cy_ota_delta_write()
+ */
+static cy_rslt_t cy_ota_delta_check(cy_ota_context_t *ctx, cy_ota_storage_write_info_t *chunk_info)
+{
+    cy_ota_delta_t              *dt = &ctx->delta;
+    cy_ota_storage_write_info_t held;
+    uint32_t                    copy;
+
+    if(chunk_info->offset > dt->magic_len)
+    {
+        /* Writing it as is could store a patch as the OTA Image, never guess */
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Data at offset 0x%lx before the first %d bytes, cannot tell if a patch\n",
+                       __func__, chunk_info->offset, CY_OTA_DELTA_MAGIC_SIZE);
+        dt->result = CY_RSLT_OTA_ERROR_WRITE_STORAGE;
+        return dt->result;
+    }
+
+    copy = 0;
+    if( (chunk_info->offset + chunk_info->size) > dt->magic_len)
+    {
+        copy = (chunk_info->offset + chunk_info->size) - dt->magic_len;
+    }
+    if(copy > (uint32_t)(CY_OTA_DELTA_MAGIC_SIZE - dt->magic_len) )
+    {
+        copy = CY_OTA_DELTA_MAGIC_SIZE - dt->magic_len;
+    }
+    memcpy(&dt->magic[dt->magic_len], &chunk_info->buffer[dt->magic_len - chunk_info->offset], copy);
+    dt->magic_len += (uint8_t)copy;
+    dt->info = *chunk_info;
+    if(dt->magic_len < CY_OTA_DELTA_MAGIC_SIZE)
+    {
+        return CY_RSLT_SUCCESS;
+    }
+
+    dt->checked = true;
+    dt->active  = (memcmp(dt->magic, CY_OTA_DELTA_MAGIC, CY_OTA_DELTA_MAGIC_SIZE) == 0);
+
+    /* Bytes held from earlier writes go first */
+    if(chunk_info->offset == 0)
+    {
+        return CY_RSLT_SUCCESS;
+    }
+    held = *chunk_info;
+    held.buffer = dt->magic;
+    held.offset = 0;
+    held.size   = chunk_info->offset;
+    return cy_ota_delta_write(ctx, &held);
+}
+
+void cy_ota_delta_start(cy_ota_context_t *ctx, uint32_t resume_offset)
+{
+    CY_OTA_CONTEXT_ASSERT(ctx);
+
+    if(ctx->delta.out != NULL)
+    {
+        cy_ota_mem_free(ctx, ctx->delta.out);
+    }
+    memset(&ctx->delta, 0x00, sizeof(ctx->delta));
+    ctx->delta.result = CY_RSLT_SUCCESS;
+
+    /* A patch is never checkpointed, so a resumed download is not one */
+    if(resume_offset > 0)
+    {
+        ctx->delta.checked = true;
+    }
+}
+
+cy_rslt_t cy_ota_delta_write(cy_ota_context_t *ctx, cy_ota_storage_write_info_t *chunk_info)
+{
+    cy_ota_delta_t  *dt = &ctx->delta;
+    cy_rslt_t       result;
+    uint32_t        skip;
+
+    CY_OTA_CONTEXT_ASSERT(ctx);
+
+    /* The first bytes of the OTA Image decide the format, whatever the chunk sizes */
+    if(dt->checked == false)
+    {
+        if(dt->result != CY_RSLT_SUCCESS)
+        {
+            return dt->result;
+        }
+        result = cy_ota_delta_check(ctx, chunk_info);
+        if( (result != CY_RSLT_SUCCESS) || (dt->checked == false) )
+        {
+            return result;
+        }
+    }
+    if(dt->active == false)
+    {
+        return cy_ota_storage_write_image(ctx, chunk_info);
+    }
+
+    if(dt->result != CY_RSLT_SUCCESS)
+    {
+        return dt->result;
+    }
+
+    /* Data already applied (ex: MQTT duplicate) */
+    if( (chunk_info->offset + chunk_info->size) <= dt->in_offset)
+    {
+        return CY_RSLT_SUCCESS;
+    }
+    if(chunk_info->offset > dt->in_offset)
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Patch data out of order, expected offset 0x%lx got 0x%lx\n",
+                       __func__, dt->in_offset, chunk_info->offset);
+        dt->result = CY_RSLT_OTA_ERROR_WRITE_STORAGE;
+        return dt->result;
+    }
+
+    skip = dt->in_offset - chunk_info->offset;
+    dt->info = *chunk_info;
+    dt->result = cy_ota_delta_data(ctx, &chunk_info->buffer[skip], (chunk_info->size - skip));
+    dt->in_offset = chunk_info->offset + chunk_info->size;
+
+    return dt->result;
+}
+
+cy_rslt_t cy_ota_delta_finish(cy_ota_context_t *ctx)
+{
+    cy_ota_delta_t  *dt = &ctx->delta;
+    cy_rslt_t       result;
+
+    CY_OTA_CONTEXT_ASSERT(ctx);
+
+    if( (dt->checked == false) && (dt->result == CY_RSLT_SUCCESS) && (dt->magic_len > 0) )
+    {
+        /* Only an OTA Image shorter than the magic is known not to be a patch */
+        cy_ota_storage_write_info_t held = dt->info;
+
+        if(dt->magic_len != ctx->ota_storage_context.total_image_size)
+        {
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Only %d of the first %d bytes arrived\n", __func__,
+                           dt->magic_len, CY_OTA_DELTA_MAGIC_SIZE);
+            dt->result = CY_RSLT_OTA_ERROR_GENERAL;
+            return dt->result;
+        }
+        dt->checked = true;
+        held.buffer = dt->magic;
+        held.offset = 0;
+        held.size   = dt->magic_len;
+        dt->result  = cy_ota_storage_write_image(ctx, &held);
+        if(dt->result != CY_RSLT_SUCCESS)
+        {
+            return dt->result;
+        }
+    }
+    if(dt->active == false)
+    {
+        return dt->result;
+    }
+
+    result = dt->result;
+    if(result == CY_RSLT_SUCCESS)
+    {
+        result = cy_ota_delta_flush(ctx);
+    }
+    if( (result == CY_RSLT_SUCCESS) && (dt->state != CY_OTA_DELTA_STATE_DONE) )
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Built 0x%lx of 0x%lx bytes\n", __func__, dt->out_pos, dt->image_size);
+        result = CY_RSLT_OTA_ERROR_GENERAL;
+    }
+    if(result == CY_RSLT_SUCCESS)
+    {
+        /* From here on the OTA Image in storage is what matters */
+        ctx->ota_storage_context.total_image_size = dt->image_size;
+    }
+
+    if(dt->out != NULL)
+    {
+        cy_ota_mem_free(ctx, dt->out);
+        dt->out    = NULL;
+        dt->source = NULL;
+    }
+    dt->result = result;
+
+    return result;
+}
+
+#endif  /* CY_OTA_DELTA_UPDATE == 1 */
@@ -63,6 +63,12 @@
  * defines & enums
  *
  **********************************************************************/
+#if (CY_OTA_HTTP_PARALLEL_CONNECTIONS > 1)
+#ifdef COMPONENT_THREADX
+__attribute__((aligned(8)))
+static uint8_t ota_http_worker_thread_stack[CY_OTA_MAX_AGENTS][CY_OTA_HTTP_PARALLEL_CONNECTIONS - 1][OTA_HTTP_WORKER_THREAD_STACK_SIZE] = { { {0} } };
+#endif
+#endif
 
 /***********************************************************************
  *
@@ -90,6 +96,7 @@
 
 #define HTTP_HEADER_ACCEPT_RANGE        "Accept-Ranges"     /* We are only looking for bytes of data */
 #define HTTP_HEADER_CONTENT_RANGE       "Content-Range"     /* The range will change - look for response values */
+#define HTTP_HEADER_ETAG                "ETag"              /* Identifies the OTA Image for the download checkpoint */
 
 /* For the Job Document, we want to see these values */
 #define HTTP_HEADER_CONTENT_ACCEPT_RANGE_VALUE      "bytes"
@@ -97,9 +104,6 @@
 #define HTTP_HEADER_CONTENT_TYPE_DATA_VALUE         "text/plain"
 #define HTTP_HEADER_CONTENT_RANGE_VALUE             "bytes"
 
-/* For the Data, something a bit different */
-#define CY_HTTP_MAX_HEADERS         10
-#define CY_HTTP_HEADER_VALUE_LEN    32
 
 static cy_http_client_header_t cy_ota_http_job_headers[] =
 {
@@ -128,23 +132,15 @@ static cy_http_client_header_t cy_ota_http_data_headers[] =
 };
 #define CY_NUM_DATA_HEADERS ( sizeof(cy_ota_http_data_headers) / sizeof(cy_http_client_header_t) )
 
-static char cy_ota_http_read_values[CY_HTTP_MAX_HEADERS][CY_HTTP_HEADER_VALUE_LEN];
-
-static cy_http_client_header_t cy_ota_http_read_headers[] =
+/* Headers we read from the response, the values go into ctx->http.read_values[] */
+static const char * const cy_ota_http_read_fields[CY_OTA_HTTP_NUM_READ_HEADERS] =
 {
-    { HTTP_HEADER_CONTENT_TYPE, sizeof(HTTP_HEADER_CONTENT_TYPE) - 1,
-      cy_ota_http_read_values[0], CY_HTTP_HEADER_VALUE_LEN },
-
-    { HTTP_HEADER_CONTENT_LENGTH, sizeof(HTTP_HEADER_CONTENT_LENGTH) - 1,
-      cy_ota_http_read_values[1], CY_HTTP_HEADER_VALUE_LEN },
-
-    { HTTP_HEADER_CONTENT_RANGE, sizeof(HTTP_HEADER_CONTENT_RANGE) - 1,
-      cy_ota_http_read_values[2], CY_HTTP_HEADER_VALUE_LEN },
-
-    { HTTP_HEADER_ACCEPT_RANGE, sizeof(HTTP_HEADER_ACCEPT_RANGE) - 1,
-      cy_ota_http_read_values[3], CY_HTTP_HEADER_VALUE_LEN },
+    HTTP_HEADER_CONTENT_TYPE,
+    HTTP_HEADER_CONTENT_LENGTH,
+    HTTP_HEADER_CONTENT_RANGE,
+    HTTP_HEADER_ACCEPT_RANGE,
+    HTTP_HEADER_ETAG,
 };
-#define CY_NUM_READ_HEADERS ( sizeof(cy_ota_http_read_headers) / sizeof(cy_http_client_header_t) )
 
 static cy_http_client_header_t cy_ota_http_result_headers[] =
 {
@@ -200,6 +196,8 @@ static cy_rslt_t cy_ota_http_init_headers(cy_ota_context_t *ctx,
                                             cy_http_client_header_t **send_headers, uint16_t *num_send_headers,
                                             cy_http_client_header_t **read_headers, uint16_t *num_read_headers)
 {
+    uint16_t    i;
+
     CY_OTA_CONTEXT_ASSERT(ctx);
 
     if( (send_headers == NULL) || (num_send_headers == NULL) ||
@@ -232,15 +230,70 @@ static cy_rslt_t cy_ota_http_init_headers(cy_ota_context_t *ctx,
         return CY_RSLT_OTA_ERROR_GENERAL;
     }
 
-    *read_headers = cy_ota_http_read_headers;
-    *num_read_headers = CY_NUM_READ_HEADERS;
+    /* Per context, the library writes the values and lengths */
+    for (i = 0; i < CY_OTA_HTTP_NUM_READ_HEADERS; i++)
+    {
+        ctx->http.read_headers[i].field     = (char *)cy_ota_http_read_fields[i];
+        ctx->http.read_headers[i].field_len = strlen(cy_ota_http_read_fields[i]);
+        ctx->http.read_headers[i].value     = ctx->http.read_values[i];
+        ctx->http.read_headers[i].value_len = CY_OTA_HTTP_HEADER_VALUE_LEN;
+        memset(ctx->http.read_values[i], 0x00, CY_OTA_HTTP_HEADER_VALUE_LEN);
+    }
+    *read_headers = ctx->http.read_headers;
+    *num_read_headers = CY_OTA_HTTP_NUM_READ_HEADERS;
 
 
     return CY_RSLT_SUCCESS;
 }
 
+/**
+ * @brief Save the ETag of an OTA Image response for the download checkpoint
+ *
+ * @param[in]   ctx     - pointer to OTA agent context @ref cy_ota_context_t
+ * @param[in]   value   - ETag value, NULL if the response did not have one
+ * @param[in]   len     - length of the value
+ */
+static void cy_ota_http_save_etag(cy_ota_context_t *ctx, const char *value, size_t len)
+{
+    memset(ctx->http.etag, 0x00, sizeof(ctx->http.etag));
+    if(value == NULL)
+    {
+        return;
+    }
+    if(len > (sizeof(ctx->http.etag) - 1) )
+    {
+        len = sizeof(ctx->http.etag) - 1;
+    }
+    memcpy(ctx->http.etag, value, len);
+}
+
 /****************************************************************/
 
+#if defined(CY_OTA_LIB_DEBUG_LOGS) || (CY_OTA_HTTP_USE_STREAMING_GET == 1)
+/**
+ * Length limited version of strstr. Ported from wiced_lib.c
+ *
+ * @param s[in]             : The string to be searched.
+ * @param s_len[in]         : The length of the string to be searched.
+ * @param substr[in]        : The string to be found.
+ * @param substr_len[in]    : The length of the string to be found.
+ *
+ * @return    pointer to the found string if search successful, otherwise NULL
+ */
+static char* strnstrn(const char *s, uint16_t s_len, const char *substr, uint16_t substr_len)
+{
+    for(; s_len >= substr_len; s++, s_len--)
+    {
+        if(strncmp(s, substr, substr_len) == 0)
+        {
+            return (char*)s;
+        }
+    }
+
+    return NULL;
+}
+#endif
+
 /* This section is only used for debugging, helps determine HTTP header information */
 #ifdef CY_OTA_LIB_DEBUG_LOGS
 typedef enum
@@ -287,29 +340,6 @@ typedef enum
     HTTP_VERSION_NOT_SUPPORTED           = 505,
 } http_status_code_t;
 
-/**
- * Length limited version of strstr. Ported from wiced_lib.c
- *
- * @param s[in]             : The string to be searched.
- * @param s_len[in]         : The length of the string to be searched.
- * @param substr[in]        : The string to be found.
- * @param substr_len[in]    : The length of the string to be found.
- *
- * @return    pointer to the found string if search successful, otherwise NULL
- */
-static char* strnstrn(const char *s, uint16_t s_len, const char *substr, uint16_t substr_len)
-{
-    for(; s_len >= substr_len; s++, s_len--)
-    {
-        if(strncmp(s, substr, substr_len) == 0)
-        {
-            return (char*)s;
-        }
-    }
-
-    return NULL;
-}
-
 /* This function is not used, but useful for debugging */
 cy_rslt_t cy_ota_http_parse_header(uint8_t **ptr, uint16_t *data_len, uint32_t *file_len, http_status_code_t *response_code)
 {
@@ -424,6 +454,9 @@ cy_rslt_t cy_ota_http_validate_network_params(const cy_ota_network_params_t *net
 static cy_rslt_t cy_ota_http_write_chunk_to_flash(cy_ota_context_t *ctx, cy_ota_storage_write_info_t *chunk_info)
 {
     cy_ota_callback_results_t cb_result;
+#if (CY_OTA_STORAGE_WRITER_BUFFERS > 0)
+    cy_rslt_t                 result;
+#endif
 
     cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG2, "%s()\n", __func__);
 
@@ -436,45 +469,70 @@ static cy_rslt_t cy_ota_http_write_chunk_to_flash(cy_ota_context_t *ctx, cy_ota_
     ctx->ota_storage_context.num_packets_received++;    /* this is so we don't have a false failure with the per packet timer */
     chunk_info->packet_number = ctx->ota_storage_context.num_packets_received;
 
-    /* store the chunk for temporary use in the callback */
-    ctx->storage = chunk_info;
-    cb_result = cy_ota_internal_call_cb(ctx, CY_OTA_REASON_STATE_CHANGE, CY_OTA_STATE_STORAGE_WRITE);
-    switch( cb_result )
+    /* A resumed download must continue the same OTA Image */
+    if(cy_ota_checkpoint_check_image(ctx, chunk_info->total_size, ctx->http.etag) != CY_RSLT_SUCCESS)
     {
-        default:
-        /* Fall through */
-        case CY_OTA_CB_RSLT_OTA_CONTINUE:
-            if(ctx->storage_iface.ota_file_write(&(ctx->ota_storage_context), chunk_info) != CY_RSLT_SUCCESS)
-            {
-                cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Write failed\n", __func__);
-                cy_rtos_setbits_event(&ctx->ota_event, (uint32_t)CY_OTA_EVENT_DATA_FAIL, 0);
-                return CY_RSLT_OTA_ERROR_WRITE_STORAGE;
-            }
-            break;
+        return CY_RSLT_OTA_ERROR_GET_DATA;
+    }
 
-        case CY_OTA_CB_RSLT_OTA_STOP:
-            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%d: %s() App returned OTA Stop for STATE_CHANGE for OTA platform storage block write API\n", __LINE__, __func__);
-            return CY_RSLT_OTA_ERROR_APP_RETURNED_STOP;
+#if (CY_OTA_STORAGE_WRITER_BUFFERS > 0)
+    if(ctx->writer.running == true)
+    {
+        /* The writer thread stores the chunk while we receive the next one */
+        result = cy_ota_writer_submit(ctx, chunk_info);
+        if(result != CY_RSLT_SUCCESS)
+        {
+            return result;
+        }
+    }
+    else
+#endif
+    {
+        /* store the chunk for temporary use in the callback */
+        ctx->storage = chunk_info;
+        cb_result = cy_ota_internal_call_cb(ctx, CY_OTA_REASON_STATE_CHANGE, CY_OTA_STATE_STORAGE_WRITE);
+        switch( cb_result )
+        {
+            default:
+            /* Fall through */
+            case CY_OTA_CB_RSLT_OTA_CONTINUE:
+                if(cy_ota_storage_write(ctx, chunk_info) != CY_RSLT_SUCCESS)
+                {
+                    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Write failed\n", __func__);
+                    cy_rtos_setbits_event(&ctx->ota_event, (uint32_t)CY_OTA_EVENT_DATA_FAIL, 0);
+                    return CY_RSLT_OTA_ERROR_WRITE_STORAGE;
+                }
+                break;
 
-        case CY_OTA_CB_RSLT_APP_SUCCESS:
-            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_NOTICE, "%d: %s() App returned APP_SUCCESS for STATE_CHANGE for OTA platform storage block write API\n", __LINE__, __func__);
-            break;
+            case CY_OTA_CB_RSLT_OTA_STOP:
+                cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%d: %s() App returned OTA Stop for STATE_CHANGE for OTA platform storage block write API\n", __LINE__, __func__);
+                return CY_RSLT_OTA_ERROR_APP_RETURNED_STOP;
 
-        case CY_OTA_CB_RSLT_APP_FAILED:
-            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%d: %s() App returned APP_FAILED for STATE_CHANGE for OTA platform storage block write API\n", __LINE__, __func__);
-            return CY_RSLT_OTA_ERROR_WRITE_STORAGE;
+            case CY_OTA_CB_RSLT_APP_SUCCESS:
+                cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_NOTICE, "%d: %s() App returned APP_SUCCESS for STATE_CHANGE for OTA platform storage block write API\n", __LINE__, __func__);
+                break;
+
+            case CY_OTA_CB_RSLT_APP_FAILED:
+                cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%d: %s() App returned APP_FAILED for STATE_CHANGE for OTA platform storage block write API\n", __LINE__, __func__);
+                return CY_RSLT_OTA_ERROR_WRITE_STORAGE;
+        }
+        cy_ota_storage_written(ctx, chunk_info);
     }
 
     /* update the stats */
-    ctx->ota_storage_context.total_bytes_written   += chunk_info->size;
-    ctx->ota_storage_context.last_offset            = chunk_info->offset;
-    ctx->ota_storage_context.last_size              = chunk_info->size;
     ctx->ota_storage_context.last_packet_received   = chunk_info->packet_number;
     ctx->ota_storage_context.total_packets          = chunk_info->total_packets;
+    ctx->received_bytes                            += chunk_info->size;
+
+    /* Completion is determined by the ranges received, not the byte count */
+    if(cy_ota_range_map_add(&ctx->received_ranges, chunk_info->offset, chunk_info->size) != CY_RSLT_SUCCESS)
+    {
+        return CY_RSLT_OTA_ERROR_WRITE_STORAGE;
+    }
 
-    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG2, "Written to offset:%ld  %ld of %ld (%ld remaining)\n",
-                   ctx->ota_storage_context.last_offset, ctx->ota_storage_context.total_bytes_written, ctx->ota_storage_context.total_image_size,
-                   (ctx->ota_storage_context.total_image_size - ctx->ota_storage_context.total_bytes_written) );
+    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG2, "Received to offset:%ld  %ld of %ld (%ld remaining)\n",
+                   chunk_info->offset, ctx->received_bytes, ctx->ota_storage_context.total_image_size,
+                   (ctx->ota_storage_context.total_image_size - ctx->received_bytes) );
 
     return CY_RSLT_SUCCESS;
 }
@@ -504,54 +562,36 @@ static void cy_ota_http_disconnect_callback(cy_http_client_t handle, cy_http_cli
 }
 
 /**
- * @brief Connect to OTA Update server
- *
- * NOTE: Individual Network Connection type will do whatever is necessary
- *      ex: MQTT
- *          - connect
- *          HTTP
- *          - connect
+ * @brief Determine the server and credentials to use for a connection
  *
- * @param[in]   ctx - pointer to OTA agent context @ref cy_ota_context_t
- * @param[in]   client_init - If true, Call HTTP Client init before connect.
+ * @param[in]   ctx         - pointer to OTA agent context @ref cy_ota_context_t
+ * @param[in]   state       - state the connection is made for @ref cy_ota_agent_state_t
+ * @param[out]  server      - server info to use
+ * @param[out]  credentials - credentials to use, NULL for a non-TLS connection
  *
- * @return  CY_RSLT_SUCCESS
- *          CY_RSLT_OTA_ERROR_GENERAL
+ * @return  N/A
  */
-cy_rslt_t cy_ota_http_connect(cy_ota_context_t *ctx, bool client_init)
+static void cy_ota_http_get_server_info(cy_ota_context_t *ctx,
+                                        cy_ota_agent_state_t state,
+                                        cy_awsport_server_info_t **server,
+                                        cy_awsport_ssl_credentials_t **credentials)
 {
-    cy_rslt_t                    result;
     cy_awsport_ssl_credentials_t *security = NULL;
     cy_awsport_server_info_t     *server_info;
 
-    CY_OTA_CONTEXT_ASSERT(ctx);
-
-    if(ctx->http.connection_established == true)
-    {
-        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "Already connected\n");
-        return CY_RSLT_OTA_ALREADY_CONNECTED;
-    }
-
-    if(ctx->http.connection_from_app == true)
-    {
-        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "Already connected by application\n");
-        ctx->http.connection_established = true;
-        return CY_RSLT_OTA_ALREADY_CONNECTED;
-    }
-
     /* determine server info and credential info */
     server_info = &ctx->network_params.http.server;
     security = &ctx->network_params.http.credentials;
 
     /* If application changed job_doc we need to use the parsed info */
-    if( (ctx->curr_state == CY_OTA_STATE_DATA_CONNECT) &&
+    if( (state == CY_OTA_STATE_DATA_CONNECT) &&
          (ctx->network_params.use_get_job_flow == CY_OTA_JOB_FLOW)  &&
          (ctx->parsed_job.parse_result == CY_RSLT_OTA_CHANGING_SERVER) )
     {
         server_info = &ctx->parsed_job.broker_server;
-        if(ctx->callback_data.credentials != NULL)
+        if(ctx->cb_credentials != NULL)
         {
-            security = ctx->callback_data.credentials;
+            security = ctx->cb_credentials;
         }
     }
 
@@ -561,7 +601,7 @@ cy_rslt_t cy_ota_http_connect(cy_ota_context_t *ctx, bool client_init)
      * in credentials when we really want a TLS connection.
      */
 
-    if( (ctx->network_params.use_get_job_flow == CY_OTA_JOB_FLOW) && (ctx->curr_state == CY_OTA_STATE_DATA_CONNECT) &&
+    if( (ctx->network_params.use_get_job_flow == CY_OTA_JOB_FLOW) && (state == CY_OTA_STATE_DATA_CONNECT) &&
          (ctx->parsed_job.connect_type != CY_OTA_CONNECTION_HTTPS) )
     {
         /* We are using a Job Flow, and we are starting a
@@ -571,7 +611,7 @@ cy_rslt_t cy_ota_http_connect(cy_ota_context_t *ctx, bool client_init)
         security = NULL;
     }
 
-    if( ( (ctx->network_params.use_get_job_flow == CY_OTA_DIRECT_FLOW) || (ctx->curr_state != CY_OTA_STATE_DATA_CONNECT) ) &&
+    if( ( (ctx->network_params.use_get_job_flow == CY_OTA_DIRECT_FLOW) || (state != CY_OTA_STATE_DATA_CONNECT) ) &&
            (ctx->network_params.initial_connection != CY_OTA_CONNECTION_HTTPS) )
     {
         /* We are using a Direct Flow, and we are not starting a
@@ -581,6 +621,51 @@ cy_rslt_t cy_ota_http_connect(cy_ota_context_t *ctx, bool client_init)
         security = NULL;
     }
 
+    *server = server_info;
+    *credentials = security;
+}
+
+/**
+ * @brief Connect to OTA Update server
+ *
+ * NOTE: Individual Network Connection type will do whatever is necessary
+ *      ex: MQTT
+ *          - connect
+ *          HTTP
+ *          - connect
+ *
+ * @param[in]   ctx - pointer to OTA agent context @ref cy_ota_context_t
+ * @param[in]   client_init - If true, Call HTTP Client init before connect.
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          CY_RSLT_OTA_ERROR_GENERAL
+ */
+cy_rslt_t cy_ota_http_connect(cy_ota_context_t *ctx, bool client_init)
+{
+    cy_rslt_t                    result;
+    cy_awsport_ssl_credentials_t *security = NULL;
+    cy_awsport_server_info_t     *server_info;
+
+    CY_OTA_CONTEXT_ASSERT(ctx);
+
+    if(ctx->http.connection_established == true)
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "Already connected\n");
+        return CY_RSLT_OTA_ALREADY_CONNECTED;
+    }
+
+    if(ctx->http.connection_from_app == true)
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "Already connected by application\n");
+        ctx->http.connection_established = true;
+        return CY_RSLT_OTA_ALREADY_CONNECTED;
+    }
+
+    /* A re-connect during the download uses the Data connection server */
+    cy_ota_http_get_server_info(ctx,
+                                (ctx->curr_state == CY_OTA_STATE_DATA_DOWNLOAD) ? CY_OTA_STATE_DATA_CONNECT : ctx->curr_state,
+                                &server_info, &security);
+
     if(client_init == true)
     {
         cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "%s() call cy_http_client_init()\n", __func__);
@@ -708,6 +793,14 @@ static cy_rslt_t cy_ota_http_send_get_response(cy_ota_context_t *ctx,
                 else if(response->status_code < 300)
                 {
                     /* 2xx (Successful): The request was successfully received, understood, and accepted */
+                    cy_ota_http_save_etag(ctx, NULL, 0);
+                    for(i = 0; i < num_read_headers; i++)
+                    {
+                        if(strcmp(read_headers[i].field, HTTP_HEADER_ETAG) == 0)
+                        {
+                            cy_ota_http_save_etag(ctx, read_headers[i].value, read_headers[i].value_len);
+                        }
+                    }
                     if(ctx->ota_storage_context.total_image_size == 0)
                     {
                         char *full_length = NULL;
@@ -784,7 +877,7 @@ cy_rslt_t cy_ota_http_get_job(cy_ota_context_t *ctx)
 
     /* Form GET request - re-use data buffer to save some RAM */
     memset(ctx->http.file, 0x00, sizeof(ctx->http.file));
-    memset(ctx->http.json_doc, 0x00, sizeof(ctx->http.json_doc));
+    memset(ctx->json_doc, 0x00, sizeof(ctx->json_doc));
     if(ctx->network_params.use_get_job_flow == CY_OTA_DIRECT_FLOW)
     {
         /* Caller gave us the file name directly - use what is in params */
@@ -798,7 +891,7 @@ cy_rslt_t cy_ota_http_get_job(cy_ota_context_t *ctx)
             }
             strncpy(ctx->http.file, CY_OTA_HTTP_DATA_FILE, copy_max );
         }
-        snprintf(ctx->http.json_doc, sizeof(ctx->http.json_doc) - 1, CY_OTA_HTTP_GET_TEMPLATE,
+        snprintf(ctx->json_doc, sizeof(ctx->json_doc) - 1, CY_OTA_HTTP_GET_TEMPLATE,
                 ctx->http.file, ctx->curr_server->host_name, ctx->curr_server->port);
     }
     else
@@ -817,14 +910,14 @@ cy_rslt_t cy_ota_http_get_job(cy_ota_context_t *ctx)
                 strcpy(ctx->http.file, CY_OTA_HTTP_JOB_FILE);
             }
         }
-        snprintf(ctx->http.json_doc, sizeof(ctx->http.json_doc), CY_OTA_HTTP_GET_TEMPLATE,
+        snprintf(ctx->json_doc, sizeof(ctx->json_doc), CY_OTA_HTTP_GET_TEMPLATE,
                 ctx->http.file, ctx->curr_server->host_name, ctx->curr_server->port);
     }
 
 #ifdef CY_OTA_LIB_DEBUG_LOGS /* Define for debugging */
     cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "HTTP Get Job \n");
     cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "File before cb: %s\n", ctx->http.file);
-    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "json_doc before cb: %d:%s\n", strlen(ctx->http.json_doc), ctx->http.json_doc);
+    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "json_doc before cb: %d:%s\n", strlen(ctx->json_doc), ctx->json_doc);
 #endif
 
     cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "%d : %s() CALLING CB STATE_CHANGE %s stop_OTA_session:%d\n", __LINE__, __func__,
@@ -834,7 +927,7 @@ cy_rslt_t cy_ota_http_get_job(cy_ota_context_t *ctx)
 
     cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "HTTP Get Job        cb result: 0x%lx\n", cb_result);
     cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "                File After cb: %s\n", ctx->http.file);
-    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "            json_doc After cb: %d:%s\n", strlen(ctx->http.json_doc), ctx->http.json_doc);
+    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "            json_doc After cb: %d:%s\n", strlen(ctx->json_doc), ctx->json_doc);
 
     switch( cb_result )
     {
@@ -850,8 +943,8 @@ cy_rslt_t cy_ota_http_get_job(cy_ota_context_t *ctx)
 
                 request.method        = CY_HTTP_CLIENT_METHOD_GET;
                 request.resource_path = ctx->http.file;                 /* File to load */
-                request.buffer        = (uint8_t*)ctx->http.json_doc;   /* Location to store returned data */
-                request.buffer_len    = sizeof(ctx->http.json_doc);     /* size of buffer */
+                request.buffer        = (uint8_t*)ctx->json_doc;   /* Location to store returned data */
+                request.buffer_len    = sizeof(ctx->json_doc);     /* size of buffer */
                 request.headers_len   = 0;                              /* filled in by cy_http_client_write_header() */
                 request.range_start   = 0;                              /* the job is reasonably small, get the whole thing */
                 request.range_end     = -1;
@@ -916,84 +1009,829 @@ cy_rslt_t cy_ota_http_get_job(cy_ota_context_t *ctx)
 }
 
 
+#if (CY_OTA_HTTP_USE_STREAMING_GET == 1)
 /**
- * @brief get the OTA download
- *
- * NOTE: Individual Network Connection type will do whatever is necessary
- *      ex: MQTT
- *          - subscribe to start data transfer
- *          HTTP
- *          - pull the data from the server
+ * @brief Find the value of a header field in a raw HTTP response header
  *
- * @param[in]   ctx - pointer to OTA agent context @ref cy_ota_context_t
+ * @param[in]   header      - start of the response header
+ * @param[in]   header_len  - length of the response header
+ * @param[in]   field       - header field name, without the ':'
+ * @param[out]  value_len   - length of the value, up to the end of the line
  *
- * @return  CY_RSLT_SUCCESS
- *          CY_RSLT_OTA_ERROR_GENERAL
+ * @return  pointer to the first non-space character of the value
+ *          NULL if the field was not found
  */
-cy_rslt_t cy_ota_http_get_data(cy_ota_context_t *ctx)
+static const char *cy_ota_http_stream_find_value(const char *header, uint32_t header_len, const char *field, uint32_t *value_len)
 {
-    /* static so it is not on the stack */
-    static cy_ota_storage_write_info_t     http_chunk_info;
-    cy_rslt_t       result;
-    uint32_t        waitfor_clear;
-    uint32_t        range_start;
-    uint32_t        range_end;
+    const char  *line = header;
+    const char  *end = &header[header_len];
+    size_t      field_len = strlen(field);
 
-    cy_ota_callback_results_t   cb_result;
+    while(line < end)
+    {
+        const char *next = strnstrn(line, (uint16_t)(end - line), "\r\n", 2);
+        if(next == NULL)
+        {
+            next = end;
+        }
 
-    CY_OTA_CONTEXT_ASSERT(ctx);
+        if( ( (size_t)(next - line) > field_len) &&
+            (strncasecmp(line, field, field_len) == 0) &&
+            (line[field_len] == ':') )
+        {
+            line = &line[field_len + 1];
+            while( (line < next) && (*line == ' ') )
+            {
+                line++;
+            }
+            *value_len = (uint32_t)(next - line);
+            return line;
+        }
+        line = &next[2];
+    }
+    return NULL;
+}
 
-    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG2, "%s()\n", __func__);
+/**
+ * @brief Parse a decimal number from a raw HTTP response header
+ *
+ * The header is not '\0' terminated, parse no more than len characters.
+ *
+ * @param[in]   value   - first character of the number
+ * @param[in]   len     - characters available at value
+ * @param[out]  number  - the number parsed
+ *
+ * @return  true if at least one digit was parsed and the number fits in 32 bits
+ */
+static bool cy_ota_http_stream_parse_number(const char *value, uint32_t len, uint32_t *number)
+{
+    uint32_t    i;
 
-    if(cy_rtos_init_mutex(&ctx->sub_callback_mutex) != CY_RSLT_SUCCESS)
+    *number = 0;
+    for(i = 0; (i < len) && (value[i] >= '0') && (value[i] <= '9'); i++)
     {
-        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() sub_callback_mutex init failed\n", __func__);
-        return CY_RSLT_OTA_ERROR_GET_DATA;
+        uint32_t    digit = (uint32_t)(value[i] - '0');
+        if( (*number > (UINT32_MAX / 10)) || ((*number * 10) > (UINT32_MAX - digit)) )
+        {
+            return false;
+        }
+        *number = (*number * 10) + digit;
     }
-    ctx->sub_callback_mutex_inited = 1;
+    return (i > 0);
+}
 
-    /* clear any lingering events */
-    waitfor_clear = CY_OTA_EVENT_HTTP_EVENTS;
-    result = cy_rtos_waitbits_event(&ctx->ota_event, &waitfor_clear, 1, 0, 1);
-    if(waitfor_clear != 0)
+/**
+ * @brief Receive at least one byte from the streaming socket
+ *
+ * @param[in]   ctx     - pointer to OTA agent context @ref cy_ota_context_t
+ * @param[in]   buffer  - buffer to fill
+ * @param[in]   size    - maximum number of bytes to read
+ *
+ * @return  number of bytes read, 0 when the server closed or stalled the stream
+ */
+static uint32_t cy_ota_http_stream_receive(cy_ota_context_t *ctx, uint8_t *buffer, uint32_t size)
+{
+    int32_t     bytes;
+    uint16_t    idle_count = 0;
+
+    do
     {
-        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG2, "%s() Clearing waitfor: 0x%lx\n", __func__, waitfor_clear);
-    }
+        bytes = cy_awsport_network_receive(&ctx->http.stream_socket, buffer, size);
+        if(bytes < 0)
+        {
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_WARNING, "%s() receive failed %ld\n", __func__, bytes);
+            return 0;
+        }
+    } while( (bytes == 0) && (++idle_count < CY_OTA_HTTP_STREAM_MAX_IDLE_RECEIVES) );
 
-    result = cy_rtos_init_timer(&ctx->http.http_timer, CY_TIMER_TYPE_ONCE,
-                        cy_ota_http_timer_callback, (cy_timer_callback_arg_t)ctx);
+    return (uint32_t)bytes;
+}
+
+/**
+ * @brief Download the OTA Image with a single streaming GET
+ *
+ * Request the OTA Image from the current receive offset to the end of the file and
+ * write the response body to storage in CY_OTA_CHUNK_SIZE pieces as it arrives.
+ * On failure, ctx->received_bytes tells the caller where to resume with ranged requests.
+ *
+ * @param[in]   ctx         - pointer to OTA agent context @ref cy_ota_context_t
+ * @param[in]   chunk_info  - chunk_info structure to use for writing
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          CY_RSLT_OTA_ERROR_APP_RETURNED_STOP
+ *          CY_RSLT_OTA_ERROR_WRITE_STORAGE
+ *          CY_RSLT_OTA_ERROR_GET_DATA
+ */
+static cy_rslt_t cy_ota_http_stream_data(cy_ota_context_t *ctx, cy_ota_storage_write_info_t *chunk_info)
+{
+    cy_rslt_t                    result;
+    cy_awsport_ssl_credentials_t *security = NULL;
+    cy_awsport_server_info_t     *server_info;
+    const char                   *value;
+    char                         *header_end = NULL;
+    uint32_t                     start_offset;
+    uint32_t                     buff_len = 0;
+    uint32_t                     header_len;
+    uint32_t                     value_len = 0;
+    uint32_t                     number;
+    uint32_t                     bytes;
+    uint16_t                     status_code;
+    int                          request_len;
+
+    start_offset = ctx->received_bytes;
+
+    cy_ota_http_get_server_info(ctx, CY_OTA_STATE_DATA_CONNECT, &server_info, &security);
+
+    /* Only one connection to the server at a time, the ranged
+     * fallback will re-connect the HTTP client if it is needed.
+     */
+    cy_ota_http_disconnect(ctx, false);
+
+    result = cy_awsport_network_create(&ctx->http.stream_socket, server_info, security, NULL, NULL);
     if(result != CY_RSLT_SUCCESS)
     {
-        /* Timer init failed */
-        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Timer Create Failed!\n", __func__);
-        ctx->sub_callback_mutex_inited = 0;
-        cy_rtos_deinit_mutex(&ctx->sub_callback_mutex);
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() cy_awsport_network_create() failed 0x%lx\n", __func__, result);
+        return CY_RSLT_OTA_ERROR_GET_DATA;
+    }
+    result = cy_awsport_network_connect(&ctx->http.stream_socket, CY_OTA_HTTP_TIMEOUT_SEND, CY_OTA_HTTP_TIMEOUT_RECEIVE);
+    if(result != CY_RSLT_SUCCESS)
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() cy_awsport_network_connect() failed 0x%lx\n", __func__, result);
+        cy_awsport_network_delete(&ctx->http.stream_socket);
         return CY_RSLT_OTA_ERROR_GET_DATA;
     }
 
-    /* start with first chunk of data */
-    range_start = 0;
-    range_end = CY_OTA_CHUNK_SIZE - 1;      /* end byte, not length ! */
-
-    /* Form GET request - re-use data buffer to save some RAM */
-    memset(ctx->http.file, 0x00, sizeof(ctx->http.file));
-    memset(ctx->http.json_doc, 0x00, sizeof(ctx->http.json_doc));
-    if(ctx->network_params.use_get_job_flow == CY_OTA_DIRECT_FLOW)
+    /* Send the GET request for the rest of the file */
+    request_len = snprintf( (char *)ctx->chunk_buffer, sizeof(ctx->chunk_buffer), CY_OTA_HTTP_GET_STREAM_TEMPLATE,
+                            ctx->http.file, server_info->host_name, server_info->port, (long)start_offset);
+    if( (request_len <= 0) || ((uint32_t)request_len >= sizeof(ctx->chunk_buffer)) ||
+        (cy_awsport_network_send(&ctx->http.stream_socket, ctx->chunk_buffer, (size_t)request_len) != request_len) )
     {
-        /* Caller gave us the file name directly - use what is params */
-        strncpy(ctx->http.file, ctx->network_params.http.file, (sizeof(ctx->http.file) - 1) );
-        snprintf(ctx->http.json_doc, sizeof(ctx->http.json_doc), CY_OTA_HTTP_GET_RANGE_TEMPLATE,
-                ctx->http.file, ctx->curr_server->host_name, ctx->curr_server->port,
-                (long)range_start, (long)range_end);
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() sending GET failed\n", __func__);
+        result = CY_RSLT_OTA_ERROR_GET_DATA;
+        goto stream_exit;
+    }
+
+    /* Read until we have the whole response header */
+    while(header_end == NULL)
+    {
+        if(buff_len >= CY_OTA_CHUNK_HEADER_SIZE)
+        {
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() response header larger than CY_OTA_CHUNK_HEADER_SIZE\n", __func__);
+            result = CY_RSLT_OTA_ERROR_GET_DATA;
+            goto stream_exit;
+        }
+        bytes = cy_ota_http_stream_receive(ctx, &ctx->chunk_buffer[buff_len], CY_OTA_CHUNK_HEADER_SIZE - buff_len);
+        if(bytes == 0)
+        {
+            result = CY_RSLT_OTA_ERROR_GET_DATA;
+            goto stream_exit;
+        }
+        buff_len += bytes;
+        header_end = strnstrn( (char *)ctx->chunk_buffer, (uint16_t)buff_len, HTTP_HEADERS_BODY_SEPARATOR, sizeof(HTTP_HEADERS_BODY_SEPARATOR) - 1);
+    }
+    header_len = (uint32_t)(header_end - (char *)ctx->chunk_buffer) + (sizeof(HTTP_HEADERS_BODY_SEPARATOR) - 1);
+
+    /* "HTTP/1.1 206 Partial Content", the status line ends at or before header_end */
+    status_code = 0;
+    if( (buff_len > (sizeof(HTTP_HEADER_STR) + 4) ) &&
+        (strncmp( (char *)ctx->chunk_buffer, HTTP_HEADER_STR, sizeof(HTTP_HEADER_STR) - 1) == 0) )
+    {
+        const char  *line_end = strnstrn( (char *)ctx->chunk_buffer, (uint16_t)header_len, "\r\n", 2);
+
+        value = memchr(ctx->chunk_buffer, ' ', (size_t)(line_end - (char *)ctx->chunk_buffer) );
+        if( (value != NULL) &&
+            (cy_ota_http_stream_parse_number(&value[1], (uint32_t)(line_end - &value[1]), &number) == true) )
+        {
+            status_code = (uint16_t)number;
+        }
+    }
+    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_INFO, "%s() response code: %d header len: %ld\n", __func__, status_code, header_len);
+
+    /* A server that ignored our Range returns 200 and the whole file */
+    if( (status_code != 206) && ( (status_code != 200) || (start_offset != 0) ) )
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Unexpected response code: %d\n", __func__, status_code);
+        result = CY_RSLT_OTA_ERROR_GET_DATA;
+        goto stream_exit;
+    }
+
+    /* Identify the OTA Image for the download checkpoint */
+    value = cy_ota_http_stream_find_value( (char *)ctx->chunk_buffer, header_len, HTTP_HEADER_ETAG, &value_len);
+    cy_ota_http_save_etag(ctx, value, value_len);
+
+    if(ctx->ota_storage_context.total_image_size == 0)
+    {
+        /* "Content-Range: bytes <start>-<end>/<full_size>" */
+        value = cy_ota_http_stream_find_value( (char *)ctx->chunk_buffer, header_len, HTTP_HEADER_CONTENT_RANGE, &value_len);
+        if(value != NULL)
+        {
+            const char *slash = memchr(value, '/', value_len);
+            if( (slash != NULL) &&
+                (cy_ota_http_stream_parse_number(&slash[1], (uint32_t)(&value[value_len] - &slash[1]), &number) == true) )
+            {
+                ctx->ota_storage_context.total_image_size = number;
+            }
+        }
+        else
+        {
+            value = cy_ota_http_stream_find_value( (char *)ctx->chunk_buffer, header_len, HTTP_HEADER_CONTENT_LENGTH, &value_len);
+            if( (value != NULL) &&
+                (cy_ota_http_stream_parse_number(value, value_len, &number) == true) )
+            {
+                ctx->ota_storage_context.total_image_size = start_offset + number;
+            }
+        }
+    }
+    if(ctx->ota_storage_context.total_image_size == 0)
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Could not determine the OTA Image size\n", __func__);
+        result = CY_RSLT_OTA_ERROR_GET_DATA;
+        goto stream_exit;
+    }
+    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_INFO, "%s() Streaming %ld of %ld bytes\n", __func__,
+                   (ctx->ota_storage_context.total_image_size - start_offset), ctx->ota_storage_context.total_image_size);
+
+    /* Move any body data that came with the header to the start of the buffer */
+    buff_len -= header_len;
+    memmove(ctx->chunk_buffer, &ctx->chunk_buffer[header_len], buff_len);
+
+    while(ctx->received_bytes < ctx->ota_storage_context.total_image_size)
+    {
+        uint32_t    chunk_size = ctx->ota_storage_context.total_image_size - ctx->received_bytes;
+        if(chunk_size > CY_OTA_CHUNK_SIZE)
+        {
+            chunk_size = CY_OTA_CHUNK_SIZE;
+        }
+
+        /* fill a full chunk (or the tail of the file) before writing */
+        while(buff_len < chunk_size)
+        {
+            bytes = cy_ota_http_stream_receive(ctx, &ctx->chunk_buffer[buff_len], chunk_size - buff_len);
+            if(bytes == 0)
+            {
+                cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_WARNING, "%s() Stream ended at %ld of %ld\n", __func__,
+                               ctx->received_bytes, ctx->ota_storage_context.total_image_size);
+                result = CY_RSLT_OTA_ERROR_GET_DATA;
+                goto stream_exit;
+            }
+            buff_len += bytes;
+        }
+
+        chunk_info->offset     = ctx->received_bytes;
+        chunk_info->buffer     = ctx->chunk_buffer;
+        chunk_info->size       = chunk_size;
+        chunk_info->total_size = ctx->ota_storage_context.total_image_size;
+
+        result = cy_ota_http_write_chunk_to_flash(ctx, chunk_info);
+        if(result != CY_RSLT_SUCCESS)
+        {
+            goto stream_exit;
+        }
+
+        /* keep any extra bytes for the next chunk */
+        buff_len -= chunk_size;
+        memmove(ctx->chunk_buffer, &ctx->chunk_buffer[chunk_size], buff_len);
+
+        if(ctx->packet_timeout_sec > 0 )
+        {
+            /* got some data - restart the download interval timer */
+            cy_ota_start_http_timer(ctx, ctx->packet_timeout_sec, CY_OTA_EVENT_PACKET_TIMEOUT);
+        }
+    }
+
+    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_INFO, "Done receiving all data! %ld of %ld\n", ctx->received_bytes, ctx->ota_storage_context.total_image_size);
+    cy_rtos_setbits_event(&ctx->ota_event, (uint32_t)CY_OTA_EVENT_DATA_DONE, 0);
+    cy_ota_stop_http_timer(ctx);
+    result = CY_RSLT_SUCCESS;
+
+stream_exit:
+    cy_awsport_network_disconnect(&ctx->http.stream_socket);
+    cy_awsport_network_delete(&ctx->http.stream_socket);
+
+    return result;
+}
+#endif  /* CY_OTA_HTTP_USE_STREAMING_GET */
+
+#if (CY_OTA_HTTP_ADAPTIVE_RANGE == 1)
+/**
+ * @brief Allocate the receive buffer and reset the range size controller
+ *
+ * Tries smaller buffers if CY_OTA_HTTP_RANGE_SIZE_MAX is not available.
+ * If none can be allocated, ctx->chunk_buffer is used with a fixed range size.
+ *
+ * @param[in]   ctx - pointer to OTA agent context @ref cy_ota_context_t
+ *
+ * @return  N/A
+ */
+static void cy_ota_http_adaptive_range_init(cy_ota_context_t *ctx)
+{
+    uint32_t    size_max = CY_OTA_HTTP_RANGE_SIZE_MAX;
+
+    ctx->http.range_buffer = NULL;
+    while( (size_max > CY_OTA_HTTP_RANGE_SIZE) && (size_max >= CY_OTA_HTTP_RANGE_SIZE_MIN) )
+    {
+        ctx->http.range_buffer = (uint8_t *)cy_ota_mem_alloc(ctx, CY_OTA_MEM_HTTP_RANGE, size_max + CY_OTA_CHUNK_HEADER_SIZE);
+        if(ctx->http.range_buffer != NULL)
+        {
+            break;
+        }
+        size_max /= 2;
+    }
+
+    if(ctx->http.range_buffer == NULL)
+    {
+        size_max = CY_OTA_HTTP_RANGE_SIZE;
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_WARNING, "%s() No range buffer, fixed range size %ld\n", __func__, (long)size_max);
+    }
+
+    /* whole chunks only */
+    size_max -= (size_max % CY_OTA_CHUNK_SIZE);
+
+    ctx->http.range_size_max = size_max;
+    ctx->http.range_size     = (CY_OTA_HTTP_RANGE_SIZE_MIN < size_max) ? CY_OTA_HTTP_RANGE_SIZE_MIN : size_max;
+    ctx->http.range_ssthresh = size_max;
+    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "%s() range size %ld max %ld\n", __func__,
+                   ctx->http.range_size, ctx->http.range_size_max);
+}
+
+/**
+ * @brief Free the adaptive range receive buffer
+ *
+ * @param[in]   ctx - pointer to OTA agent context @ref cy_ota_context_t
+ *
+ * @return  N/A
+ */
+static void cy_ota_http_adaptive_range_deinit(cy_ota_context_t *ctx)
+{
+    if(ctx->http.range_buffer != NULL)
+    {
+        cy_ota_mem_free(ctx, ctx->http.range_buffer);
+        ctx->http.range_buffer = NULL;
+    }
+}
+
+/**
+ * @brief Adjust the range size after a request
+ *
+ * Slow-start: double while below range_ssthresh and faster than the target,
+ *  then grow by one chunk. Halve when slower than twice the target.
+ *  On failure, remember half the current size and restart from the minimum.
+ *
+ * @param[in]   ctx         - pointer to OTA agent context @ref cy_ota_context_t
+ * @param[in]   success     - true if the request returned all the data asked for
+ * @param[in]   elapsed_ms  - time taken by the request
+ *
+ * @return  N/A
+ */
+static void cy_ota_http_adaptive_range_update(cy_ota_context_t *ctx, bool success, uint32_t elapsed_ms)
+{
+    uint32_t    size = ctx->http.range_size;
+
+    if(success == false)
+    {
+        ctx->http.range_ssthresh = size / 2;
+        size = CY_OTA_HTTP_RANGE_SIZE_MIN;
+    }
+    else if(elapsed_ms > (2 * CY_OTA_HTTP_RANGE_TARGET_MS) )
+    {
+        size /= 2;
+        ctx->http.range_ssthresh = size;
+    }
+    else if(elapsed_ms < CY_OTA_HTTP_RANGE_TARGET_MS)
+    {
+        size = (size < ctx->http.range_ssthresh) ? (size * 2) : (size + CY_OTA_CHUNK_SIZE);
+    }
+
+    size -= (size % CY_OTA_CHUNK_SIZE);
+    if(size < CY_OTA_HTTP_RANGE_SIZE_MIN)
+    {
+        size = CY_OTA_HTTP_RANGE_SIZE_MIN;
+    }
+    if(size > ctx->http.range_size_max)
+    {
+        size = ctx->http.range_size_max;
+    }
+
+    if(size != ctx->http.range_size)
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "%s() %ld ms for %ld bytes, range size now %ld\n", __func__,
+                       elapsed_ms, ctx->http.range_size, size);
+    }
+    ctx->http.range_size = size;
+}
+#endif  /* CY_OTA_HTTP_ADAPTIVE_RANGE */
+
+/**
+ * @brief Determine the next range to request on the main connection
+ *
+ * The range is the first part of the OTA Image not yet written,
+ *  at most CY_OTA_HTTP_RANGE_SIZE bytes (or the adaptive range size).
+ *
+ * @param[in]   ctx         - pointer to OTA agent context @ref cy_ota_context_t
+ * @param[out]  range_start - first byte to request
+ * @param[out]  range_end   - last byte to request (end byte, not length)
+ *
+ * @return  true  - range_start / range_end are set
+ *          false - the OTA Image is complete
+ */
+static bool cy_ota_http_next_range(cy_ota_context_t *ctx, uint32_t *range_start, uint32_t *range_end)
+{
+    uint32_t    hole_size;
+
+    if(cy_ota_range_map_is_complete(&ctx->received_ranges, ctx->ota_storage_context.total_image_size) == true)
+    {
+        return false;
+    }
+
+    *range_start = cy_ota_range_map_next_hole(&ctx->received_ranges, ctx->ota_storage_context.total_image_size, &hole_size);
+    if(hole_size == 0)
+    {
+        return false;
+    }
+#if (CY_OTA_HTTP_ADAPTIVE_RANGE == 1)
+    if(hole_size > ctx->http.range_size)
+    {
+        hole_size = ctx->http.range_size;
+    }
+#else
+    if(hole_size > CY_OTA_HTTP_RANGE_SIZE)
+    {
+        hole_size = CY_OTA_HTTP_RANGE_SIZE;
+    }
+#endif
+    *range_end = *range_start + hole_size - 1;  /* end byte, not length ! */
+
+    return true;
+}
+
+#if (CY_OTA_HTTP_PARALLEL_CONNECTIONS > 1)
+/**
+ * brief Notification of a parallel connection closing
+ *
+ * The worker notices the failure on its next request, nothing to do here.
+ */
+static void cy_ota_http_parallel_disconnect_callback(cy_http_client_t handle, cy_http_client_disconn_type_t type, void *user_data)
+{
+    /* for compiler warnings */
+    (void)handle;
+    (void)type;
+    (void)user_data;
+
+    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_INFO, "HTTP parallel connection disconnect callback \n");
+}
+
+/**
+ * @brief Claim and download ranges on one connection until none are left
+ *
+ * Used by the main connection and by each of the worker threads.
+ * Each range is claimed from the next hole in parallel_claimed, so ranges
+ *  already received are never fetched again.
+ * Range claims and storage writes are serialized with parallel_mutex, the storage
+ *  callbacks are called from whichever thread received the range.
+ * A range that fails is left as a hole in the range map,
+ *  to be filled in later on the main connection.
+ *
+ * @param[in]   ctx         - pointer to OTA agent context @ref cy_ota_context_t
+ * @param[in]   connection  - HTTP connection to use
+ * @param[in]   buffer      - receive buffer for this connection
+ * @param[in]   buffer_len  - size of the receive buffer
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          CY_RSLT_OTA_ERROR_GET_DATA          - this connection failed
+ *          CY_RSLT_OTA_ERROR_APP_RETURNED_STOP
+ *          CY_RSLT_OTA_ERROR_WRITE_STORAGE
+ */
+static cy_rslt_t cy_ota_http_parallel_get_ranges(cy_ota_context_t *ctx, cy_http_client_t connection,
+                                                  uint8_t *buffer, uint32_t buffer_len)
+{
+    cy_ota_storage_write_info_t     chunk_info;
+    cy_http_client_request_header_t request;
+    cy_http_client_response_t       response;
+    cy_rslt_t                       result = CY_RSLT_SUCCESS;
+    uint32_t                        range_start;
+    uint32_t                        range_end;
+    uint32_t                        hole_size;
+    uint32_t                        body_offset;
+
+    while(result == CY_RSLT_SUCCESS)
+    {
+        /* claim the next range */
+        cy_rtos_get_mutex(&ctx->http.parallel_mutex, CY_RTOS_NEVER_TIMEOUT);
+        if( (ctx->http.parallel_result != CY_RSLT_SUCCESS) || (ctx->stop_OTA_session != 0) )
+        {
+            cy_rtos_set_mutex(&ctx->http.parallel_mutex);
+            break;
+        }
+        /* next hole not yet written or claimed, never past the next written range */
+        range_start = cy_ota_range_map_next_hole(&ctx->http.parallel_claimed,
+                                                 ctx->ota_storage_context.total_image_size, &hole_size);
+        if( (hole_size == 0) || (range_start >= ctx->ota_storage_context.total_image_size) )
+        {
+            cy_rtos_set_mutex(&ctx->http.parallel_mutex);
+            break;
+        }
+        if(hole_size > CY_OTA_HTTP_RANGE_SIZE)
+        {
+            hole_size = CY_OTA_HTTP_RANGE_SIZE;
+        }
+        range_end = range_start + hole_size - 1;                /* end byte, not length ! */
+        if(cy_ota_range_map_add(&ctx->http.parallel_claimed, range_start, hole_size) != CY_RSLT_SUCCESS)
+        {
+            /* too many disjoint ranges - leave the rest for the main connection */
+            cy_rtos_set_mutex(&ctx->http.parallel_mutex);
+            break;
+        }
+        cy_rtos_set_mutex(&ctx->http.parallel_mutex);
+
+        memset(&request, 0x00, sizeof(request));
+        memset(&response, 0x00, sizeof(response));
+        request.method        = CY_HTTP_CLIENT_METHOD_GET;
+        request.resource_path = ctx->http.file;             /* Data file name */
+        request.buffer        = buffer;                     /* Location to store returned data */
+        request.buffer_len    = buffer_len;                 /* size of buffer */
+        request.headers_len   = 0;                          /* filled in by cy_http_client_write_header() */
+        request.range_start   = range_start;                /* start offset for this range */
+        request.range_end     = range_end;                  /* end offset for this range */
+
+        result = cy_http_client_write_header(connection, &request, cy_ota_http_data_headers, CY_NUM_DATA_HEADERS);
+        if(result == CY_RSLT_SUCCESS)
+        {
+            result = cy_http_client_send(connection, &request, NULL, 0, &response);
+        }
+        if( (result != CY_RSLT_SUCCESS) || (response.status_code != 206) ||
+            (response.body_len != (range_end - range_start + 1)) )
+        {
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_WARNING, "%s() range 0x%lx-0x%lx failed ret:0x%lx status:%d len:%ld\n", __func__,
+                           range_start, range_end, result, response.status_code, (long)response.body_len);
+            result = CY_RSLT_OTA_ERROR_GET_DATA;
+            break;
+        }
+
+        /* write the range in chunks, each at its own offset */
+        cy_rtos_get_mutex(&ctx->http.parallel_mutex, CY_RTOS_NEVER_TIMEOUT);
+        body_offset = 0;
+        while( (result == CY_RSLT_SUCCESS) && (ctx->http.parallel_result == CY_RSLT_SUCCESS) &&
+               (body_offset < response.body_len) )
+        {
+            uint32_t    write_size = response.body_len - body_offset;
+            if(write_size > CY_OTA_CHUNK_SIZE)
+            {
+                write_size = CY_OTA_CHUNK_SIZE;
+            }
+
+            memset(&chunk_info, 0x00, sizeof(chunk_info));
+            chunk_info.offset     = range_start + body_offset;
+            chunk_info.buffer     = (uint8_t *)&response.body[body_offset];
+            chunk_info.size       = write_size;
+            chunk_info.total_size = ctx->ota_storage_context.total_image_size;
+
+            result = cy_ota_http_write_chunk_to_flash(ctx, &chunk_info);
+            body_offset += write_size;
+        }
+        if(result != CY_RSLT_SUCCESS)
+        {
+            /* storage or Application failure stops all connections */
+            ctx->http.parallel_result = result;
+        }
+        else if(ctx->packet_timeout_sec > 0 )
+        {
+            /* got some data - restart the download interval timer */
+            cy_ota_start_http_timer(ctx, ctx->packet_timeout_sec, CY_OTA_EVENT_PACKET_TIMEOUT);
+        }
+        cy_rtos_set_mutex(&ctx->http.parallel_mutex);
+    }
+
+    return result;
+}
+
+/**
+ * @brief Worker thread for an additional parallel connection
+ *
+ * @param[in]   arg - pointer to worker @ref cy_ota_http_worker_t
+ */
+static void cy_ota_http_parallel_worker(cy_thread_arg_t arg)
+{
+    cy_ota_http_worker_t *worker = (cy_ota_http_worker_t *)arg;
+
+    worker->result = cy_ota_http_parallel_get_ranges(worker->ctx, worker->connection,
+                                                     worker->buffer, CY_OTA_CHUNK_BUFFER_SIZE);
+    cy_rtos_exit_thread();
+}
+
+/**
+ * @brief Download the rest of the OTA Image over parallel connections
+ *
+ * Opens up to (CY_OTA_HTTP_PARALLEL_CONNECTIONS - 1) additional connections to the data server,
+ *  and downloads disjoint ranges on those and the main connection at the same time.
+ * Connections that cannot be set up are skipped. Any ranges that are not
+ *  written when this returns are filled in by the caller on the main connection.
+ *
+ * NOTE: Requires total_image_size to be known.
+ *
+ * @param[in]   ctx - pointer to OTA agent context @ref cy_ota_context_t
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          CY_RSLT_OTA_ERROR_GET_DATA          - main connection failed, re-connect
+ *          CY_RSLT_OTA_ERROR_APP_RETURNED_STOP
+ *          CY_RSLT_OTA_ERROR_WRITE_STORAGE
+ */
+static cy_rslt_t cy_ota_http_parallel_download(cy_ota_context_t *ctx)
+{
+    cy_rslt_t                    result;
+    cy_awsport_ssl_credentials_t *security = NULL;
+    cy_awsport_server_info_t     *server_info;
+    cy_ota_http_worker_t         *worker;
+    uint16_t                     i;
+    uint16_t                     num_workers = 0;
+#ifndef COMPONENT_THREADX
+    void                         *stack;
+#endif
+
+    if(cy_rtos_init_mutex(&ctx->http.parallel_mutex) != CY_RSLT_SUCCESS)
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_WARNING, "%s() parallel_mutex init failed, single connection\n", __func__);
+        return CY_RSLT_SUCCESS;
+    }
+    ctx->http.parallel_result = CY_RSLT_SUCCESS;
+
+    /* Hand out only the holes, ranges received before (ex: resume) are skipped */
+    memcpy(&ctx->http.parallel_claimed, &ctx->received_ranges, sizeof(cy_ota_range_map_t));
+
+    cy_ota_http_get_server_info(ctx, CY_OTA_STATE_DATA_CONNECT, &server_info, &security);
+
+    for(i = 0; i < (CY_OTA_HTTP_PARALLEL_CONNECTIONS - 1); i++)
+    {
+        worker = &ctx->http.workers[i];
+        memset(worker, 0x00, sizeof(cy_ota_http_worker_t));
+        worker->ctx = ctx;
+
+        result = cy_http_client_create(security, server_info, cy_ota_http_parallel_disconnect_callback,
+                                       worker, &worker->connection);
+        if(result != CY_RSLT_SUCCESS)
+        {
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_WARNING, "%s() [%d] cy_http_client_create() failed 0x%lx\n", __func__, i, result);
+            continue;
+        }
+        result = cy_http_client_connect(worker->connection, CY_OTA_HTTP_TIMEOUT_SEND, CY_OTA_HTTP_TIMEOUT_RECEIVE);
+        if(result != CY_RSLT_SUCCESS)
+        {
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_WARNING, "%s() [%d] cy_http_client_connect() failed 0x%lx\n", __func__, i, result);
+            cy_http_client_delete(worker->connection);
+            continue;
+        }
+        worker->buffer = (uint8_t *)cy_ota_mem_alloc(ctx, (cy_ota_mem_id_t)(CY_OTA_MEM_HTTP_WORKER + i), CY_OTA_CHUNK_BUFFER_SIZE);
+        if(worker->buffer == NULL)
+        {
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_WARNING, "%s() [%d] buffer allocation failed\n", __func__, i);
+            cy_http_client_disconnect(worker->connection);
+            cy_http_client_delete(worker->connection);
+            continue;
+        }
+
+#ifdef COMPONENT_THREADX
+        result = cy_rtos_thread_create(&worker->thread,
+                                       &cy_ota_http_parallel_worker,
+                                       "CY OTA HTTP",
+                                       &ota_http_worker_thread_stack[ctx->agent_index][i],
+                                       OTA_HTTP_WORKER_THREAD_STACK_SIZE,
+                                       CY_RTOS_PRIORITY_NORMAL,
+                                       (cy_thread_arg_t)worker);
+#else
+        result = cy_ota_mem_thread_stack(ctx, CY_OTA_MEM_HTTP_WORKER_STACKS, i, OTA_HTTP_WORKER_THREAD_STACK_SIZE, &stack);
+        if(result == CY_RSLT_SUCCESS)
+        {
+            result = cy_rtos_create_thread(&worker->thread, cy_ota_http_parallel_worker,
+                                           "CY OTA HTTP", stack, OTA_HTTP_WORKER_THREAD_STACK_SIZE,
+                                           CY_RTOS_PRIORITY_NORMAL, (cy_thread_arg_t)worker);
+        }
+#endif
+        if(result != CY_RSLT_SUCCESS)
+        {
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_WARNING, "%s() [%d] thread create failed 0x%lx\n", __func__, i, result);
+            cy_ota_mem_free(ctx, worker->buffer);
+            worker->buffer = NULL;
+            cy_http_client_disconnect(worker->connection);
+            cy_http_client_delete(worker->connection);
+            continue;
+        }
+        worker->running = true;
+        num_workers++;
+    }
+    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_INFO, "%s() Downloading from 0x%lx on %d connections\n", __func__,
+                   cy_ota_range_map_next_hole(&ctx->received_ranges, ctx->ota_storage_context.total_image_size, NULL),
+                   (num_workers + 1));
+
+    /* The main connection takes part as well */
+    result = cy_ota_http_parallel_get_ranges(ctx, ctx->http.connection, ctx->chunk_buffer, sizeof(ctx->chunk_buffer));
+
+    for(i = 0; i < (CY_OTA_HTTP_PARALLEL_CONNECTIONS - 1); i++)
+    {
+        worker = &ctx->http.workers[i];
+        if(worker->running == true)
+        {
+            cy_rtos_join_thread(&worker->thread);
+            worker->running = false;
+
+            cy_ota_mem_free(ctx, worker->buffer);
+            worker->buffer = NULL;
+            cy_http_client_disconnect(worker->connection);
+            cy_http_client_delete(worker->connection);
+        }
+    }
+    cy_rtos_deinit_mutex(&ctx->http.parallel_mutex);
+
+    if(ctx->http.parallel_result != CY_RSLT_SUCCESS)
+    {
+        result = ctx->http.parallel_result;
+    }
+    return result;
+}
+#endif  /* CY_OTA_HTTP_PARALLEL_CONNECTIONS > 1 */
+
+/**
+ * @brief Start getting the OTA download
+ *
+ * Sets up the download and asks the App to continue. Without use_poll, the whole
+ * OTA Image is fetched with one streaming GET when enabled. The rest is fetched
+ * by cy_ota_http_get_data_step().
+ *
+ * @param[in]   ctx - pointer to OTA agent context @ref cy_ota_context_t
+ *
+ * @return  CY_RSLT_OTA_POLL_AGAIN - call cy_ota_http_get_data_step()
+ *          CY_RSLT_SUCCESS
+ *          CY_RSLT_OTA_ERROR_GET_DATA
+ *          CY_RSLT_OTA_ERROR_APP_RETURNED_STOP
+ *          CY_RSLT_OTA_ERROR_WRITE_STORAGE
+ */
+cy_rslt_t cy_ota_http_get_data_start(cy_ota_context_t *ctx)
+{
+    cy_rslt_t       result;
+    uint32_t        waitfor_clear;
+
+    cy_ota_callback_results_t   cb_result;
+
+    CY_OTA_CONTEXT_ASSERT(ctx);
+
+    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG2, "%s()\n", __func__);
+
+    if(cy_rtos_init_mutex(&ctx->sub_callback_mutex) != CY_RSLT_SUCCESS)
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() sub_callback_mutex init failed\n", __func__);
+        return CY_RSLT_OTA_ERROR_GET_DATA;
+    }
+    ctx->sub_callback_mutex_inited = 1;
+
+    /* clear any lingering events */
+    waitfor_clear = CY_OTA_EVENT_HTTP_EVENTS;
+    result = cy_rtos_waitbits_event(&ctx->ota_event, &waitfor_clear, 1, 0, 1);
+    if(waitfor_clear != 0)
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG2, "%s() Clearing waitfor: 0x%lx\n", __func__, waitfor_clear);
+    }
+
+    result = cy_rtos_init_timer(&ctx->http.http_timer, CY_TIMER_TYPE_ONCE,
+                        cy_ota_http_timer_callback, (cy_timer_callback_arg_t)ctx);
+    if(result != CY_RSLT_SUCCESS)
+    {
+        /* Timer init failed */
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Timer Create Failed!\n", __func__);
+        ctx->sub_callback_mutex_inited = 0;
+        cy_rtos_deinit_mutex(&ctx->sub_callback_mutex);
+        return CY_RSLT_OTA_ERROR_GET_DATA;
+    }
+
+#if (CY_OTA_HTTP_ADAPTIVE_RANGE == 1)
+    cy_ota_http_adaptive_range_init(ctx);
+#endif
+#if (CY_OTA_HTTP_PARALLEL_CONNECTIONS > 1)
+    ctx->http.parallel_started = false;
+#endif
+
+    /* start with first chunk(s) of data, or after the data kept from a checkpoint */
+    ctx->http.range_start = 0;
+    ctx->http.range_end = CY_OTA_HTTP_RANGE_SIZE - 1; /* end byte, not length ! */
+    (void)cy_ota_http_next_range(ctx, &ctx->http.range_start, &ctx->http.range_end);
+
+    /* Form GET request - re-use data buffer to save some RAM */
+    memset(ctx->http.file, 0x00, sizeof(ctx->http.file));
+    memset(ctx->json_doc, 0x00, sizeof(ctx->json_doc));
+    if(ctx->network_params.use_get_job_flow == CY_OTA_DIRECT_FLOW)
+    {
+        /* Caller gave us the file name directly - use what is params */
+        strncpy(ctx->http.file, ctx->network_params.http.file, (sizeof(ctx->http.file) - 1) );
+        snprintf(ctx->json_doc, sizeof(ctx->json_doc), CY_OTA_HTTP_GET_RANGE_TEMPLATE,
+                ctx->http.file, ctx->curr_server->host_name, ctx->curr_server->port,
+                (long)ctx->http.range_start, (long)ctx->http.range_end);
     }
     else
     {
         /* We got the file name from the Job file.
          * The Job redirect will have already changed the current server */
         strncpy(ctx->http.file, ctx->parsed_job.file, (sizeof(ctx->http.file) - 1) );
-        snprintf(ctx->http.json_doc, sizeof(ctx->http.json_doc), CY_OTA_HTTP_GET_RANGE_TEMPLATE,
+        snprintf(ctx->json_doc, sizeof(ctx->json_doc), CY_OTA_HTTP_GET_RANGE_TEMPLATE,
                 ctx->parsed_job.file, ctx->curr_server->host_name, ctx->curr_server->port,
-                (long)range_start, (long)range_end);
+                (long)ctx->http.range_start, (long)ctx->http.range_end);
     }
     cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "%d : %s() CALLING CB STATE_CHANGE %s stop_OTA_session:%d\n", __LINE__, __func__,
             cy_ota_get_state_string(ctx->curr_state), ctx->stop_OTA_session);
@@ -1004,8 +1842,7 @@ cy_rslt_t cy_ota_http_get_data(cy_ota_context_t *ctx)
         default:
         case CY_OTA_CB_RSLT_OTA_STOP:
             cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() App returned OTA Stop for STATE_CHANGE for DATA_DOWNLOAD\n", __func__);
-            result = CY_RSLT_OTA_ERROR_APP_RETURNED_STOP;
-            goto cleanup_and_exit;
+            return cy_ota_http_get_data_end(ctx, CY_RSLT_OTA_ERROR_APP_RETURNED_STOP);
 
         case CY_OTA_CB_RSLT_OTA_CONTINUE:
             /* Processing continues after switch() */
@@ -1013,142 +1850,263 @@ cy_rslt_t cy_ota_http_get_data(cy_ota_context_t *ctx)
 
         case CY_OTA_CB_RSLT_APP_SUCCESS:
             cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_NOTICE, "%s() App returned APP_SUCCESS for STATE_CHANGE for DATA_DOWNLOAD\n", __func__);
-            result = CY_RSLT_SUCCESS;
-            goto cleanup_and_exit;
+            return cy_ota_http_get_data_end(ctx, CY_RSLT_SUCCESS);
 
         case CY_OTA_CB_RSLT_APP_FAILED:
             cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() App returned APP_FAILED for STATE_CHANGE for DATA_DOWNLOAD\n", __func__);
-            result = CY_RSLT_OTA_ERROR_GET_DATA;
-            goto cleanup_and_exit;
+            return cy_ota_http_get_data_end(ctx, CY_RSLT_OTA_ERROR_GET_DATA);
     }
 
-    /* we only get here when there are no errors in our setup above. */
-    /* If we bail without doing anything here, then we need to look at getting the file size before
-     * getting here.
+#if (CY_OTA_HTTP_USE_STREAMING_GET == 1)
+    /* Stream the whole file with one GET, ranged requests below only resume a failed stream.
+     * A polled OTA Agent gets one range per step instead.
      */
-    while( ( (ctx->ota_storage_context.total_bytes_written == 0) ||
-              (ctx->ota_storage_context.total_bytes_written < ctx->ota_storage_context.total_image_size) ) &&
-            (range_end > range_start) )
+    if( (ctx->http.connection_from_app == false) && (ctx->agent_params.use_poll == false) )
     {
-        if(result == CY_RSLT_OTA_ERROR_GET_DATA)
+        result = cy_ota_http_stream_data(ctx, &ctx->http.chunk_info);
+        if( (result == CY_RSLT_OTA_ERROR_APP_RETURNED_STOP) || (result == CY_RSLT_OTA_ERROR_WRITE_STORAGE) )
         {
-            /* HTTP Client library Deinit is not required as we are retrying connection. */
-            cy_ota_http_disconnect(ctx, false);
+            return cy_ota_http_get_data_end(ctx, result);
         }
-
-        while((ctx->http.connection_established == false) && (ctx->contact_server_retry_count < CY_OTA_CONNECT_RETRIES))
-        {
-            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_INFO, "%s() Connection Not active Re-establishing connection. \n", __func__);
-            /* HTTP Client library Init is not required as its connection retry. */
-            result = cy_ota_http_connect(ctx, false);
-            ctx->contact_server_retry_count++;
-        }
-
         if(result != CY_RSLT_SUCCESS)
         {
-            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() %d Connection Not active exiting Download... \n", __func__, __LINE__);
-            goto cleanup_and_exit;
+            (void)cy_ota_http_next_range(ctx, &ctx->http.range_start, &ctx->http.range_end);
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_WARNING, "%s() Streaming GET failed, resume at 0x%lx with ranged requests\n", __func__, ctx->http.range_start);
         }
+    }
+#endif
 
-        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "while(ctx->ota_storage_context.total_bytes_written (%ld) < (%ld) ctx->total_image_size)\n", ctx->ota_storage_context.total_bytes_written, ctx->ota_storage_context.total_image_size);
-        /* Send a request and wait for a response
-         * The response call has a timeout value, so when we call waitbits_event below
-         * we do not use "forever".
-         */
-        cy_http_client_request_header_t request;                    // move into ctx structure ?
-        cy_http_client_header_t         *send_headers = NULL;
-        uint16_t                        num_send_headers=0;    /* Number of headers requested  */
-        cy_http_client_header_t         *read_headers = NULL;
-        uint16_t                        num_read_headers=0;    /* Number of headers requested  */
-        cy_http_client_response_t       response;                   // move into ctx structure ?
+    ctx->http.get_data_result = result;
+    return CY_RSLT_OTA_POLL_AGAIN;
+}
 
-        request.method        = CY_HTTP_CLIENT_METHOD_GET;
-        request.resource_path = ctx->http.file;             /* Data file name */
-        request.buffer        = ctx->chunk_buffer;          /* Location to store returned data */
-        request.buffer_len    = sizeof(ctx->chunk_buffer);  /* size of buffer */
-        request.headers_len   = 0;                          /* filled in by cy_http_client_write_header() */
-        request.range_start   = range_start;                /* start offset for this chunk */
-        request.range_end     = range_end;                  /* bytes to transfer this loop */
+/**
+ * @brief Get the next range of the OTA download
+ *
+ * Each call re-connects once if needed, or sends one ranged GET and writes the response.
+ *
+ * @param[in]   ctx - pointer to OTA agent context @ref cy_ota_context_t
+ *
+ * @return  CY_RSLT_OTA_POLL_AGAIN - call again
+ *          CY_RSLT_SUCCESS
+ *          CY_RSLT_OTA_ERROR_GET_DATA
+ *          CY_RSLT_OTA_ERROR_APP_RETURNED_STOP
+ *          CY_RSLT_OTA_ERROR_WRITE_STORAGE
+ */
+cy_rslt_t cy_ota_http_get_data_step(cy_ota_context_t *ctx)
+{
+    cy_rslt_t       result;
+    uint32_t        range_start;
+    uint32_t        range_end;
+#if (CY_OTA_HTTP_ADAPTIVE_RANGE == 1)
+    cy_time_t       request_start;
+    cy_time_t       request_end;
+#endif
+    cy_http_client_request_header_t request;
+    cy_http_client_header_t         *send_headers = NULL;
+    uint16_t                        num_send_headers=0;    /* Number of headers requested  */
+    cy_http_client_header_t         *read_headers = NULL;
+    uint16_t                        num_read_headers=0;    /* Number of headers requested  */
+    cy_http_client_response_t       response;
 
-        /* fill headers we want to see in the response */
-        if(cy_ota_http_init_headers(ctx, &send_headers, &num_send_headers, &read_headers, &num_read_headers) != CY_RSLT_SUCCESS)
+    CY_OTA_CONTEXT_ASSERT(ctx);
+
+    /* we only get here when there are no errors in our setup above. */
+    /* If we bail without doing anything here, then we need to look at getting the file size before
+     * getting here.
+     */
+    result = ctx->http.get_data_result;
+    if(cy_ota_range_map_is_complete(&ctx->received_ranges, ctx->ota_storage_context.total_image_size) == true)
+    {
+        return cy_ota_http_get_data_end(ctx, result);
+    }
+    range_start = ctx->http.range_start;
+    range_end = ctx->http.range_end;
+
+    if(result == CY_RSLT_OTA_ERROR_GET_DATA)
+    {
+        /* HTTP Client library Deinit is not required as we are retrying connection. */
+        cy_ota_http_disconnect(ctx, false);
+    }
+
+    if((ctx->http.connection_established == false) && (ctx->contact_server_retry_count < CY_OTA_CONNECT_RETRIES))
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_INFO, "%s() Connection Not active Re-establishing connection. \n", __func__);
+        /* HTTP Client library Init is not required as its connection retry. */
+        result = cy_ota_http_connect(ctx, false);
+        ctx->contact_server_retry_count++;
+        if((ctx->http.connection_established == false) && (ctx->contact_server_retry_count < CY_OTA_CONNECT_RETRIES))
         {
-            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "cy_ota_http_init_headers() failed for state: %s\n", cy_ota_get_state_string(ctx->curr_state));
+            /* Try again on the next step */
+            ctx->http.get_data_result = result;
+            return CY_RSLT_OTA_POLL_AGAIN;
         }
+    }
 
-        memset(&response, 0x00, sizeof(response));
+    if(result != CY_RSLT_SUCCESS)
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() %d Connection Not active exiting Download... \n", __func__, __LINE__);
+        return cy_ota_http_get_data_end(ctx, result);
+    }
 
-        result = cy_ota_http_send_get_response(ctx, &request,
-                                                send_headers, num_send_headers,
-                                                read_headers, num_read_headers,
-                                                &response);
+    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "while(ctx->received_bytes (%ld) < (%ld) ctx->total_image_size)\n", ctx->received_bytes, ctx->ota_storage_context.total_image_size);
+    /* Send a request and wait for a response
+     * The response call has a timeout value.
+     */
+    request.method        = CY_HTTP_CLIENT_METHOD_GET;
+    request.resource_path = ctx->http.file;             /* Data file name */
+    request.buffer        = ctx->chunk_buffer;          /* Location to store returned data */
+    request.buffer_len    = sizeof(ctx->chunk_buffer);  /* size of buffer */
+    request.headers_len   = 0;                          /* filled in by cy_http_client_write_header() */
+    request.range_start   = range_start;                /* start offset for this chunk */
+    request.range_end     = range_end;                  /* bytes to transfer this loop */
+#if (CY_OTA_HTTP_ADAPTIVE_RANGE == 1)
+    if(ctx->http.range_buffer != NULL)
+    {
+        request.buffer     = ctx->http.range_buffer;
+        request.buffer_len = ctx->http.range_size_max + CY_OTA_CHUNK_HEADER_SIZE;
+    }
+    cy_rtos_get_time(&request_start);
+#endif
 
-        if(result == CY_RSLT_SUCCESS)
-        {
-            ctx->contact_server_retry_count = 0;
+    /* fill headers we want to see in the response */
+    if(cy_ota_http_init_headers(ctx, &send_headers, &num_send_headers, &read_headers, &num_read_headers) != CY_RSLT_SUCCESS)
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "cy_ota_http_init_headers() failed for state: %s\n", cy_ota_get_state_string(ctx->curr_state));
+    }
 
-            /* set parameters for writing */
-            http_chunk_info.offset     = ctx->ota_storage_context.total_bytes_written;
-            http_chunk_info.buffer     = (uint8_t *)response.body;
-            http_chunk_info.size       = response.body_len;
-            http_chunk_info.total_size = ctx->ota_storage_context.total_image_size;  // is this correct? Is it set?
-
-            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "call cy_ota_http_write_chunk_to_flash(%p %d)\n", http_chunk_info.buffer, http_chunk_info.size);
-            result = cy_ota_http_write_chunk_to_flash(ctx, &http_chunk_info);
-            if(result == CY_RSLT_OTA_ERROR_APP_RETURNED_STOP)
-            {
-                cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_WARNING, "%s() cy_ota_storage_write() returned OTA_STOP 0x%lx\n", __func__, result);
-            }
-            else if(result != CY_RSLT_SUCCESS)
-            {
-                cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() cy_ota_storage_write() failed 0x%lx\n", __func__, result);
-                result = CY_RSLT_OTA_ERROR_WRITE_STORAGE;
-                break;  // drop out of while loop
-            }
-            else
+    memset(&response, 0x00, sizeof(response));
+
+    result = cy_ota_http_send_get_response(ctx, &request,
+                                            send_headers, num_send_headers,
+                                            read_headers, num_read_headers,
+                                            &response);
+
+#if (CY_OTA_HTTP_ADAPTIVE_RANGE == 1)
+    cy_rtos_get_time(&request_end);
+    cy_ota_http_adaptive_range_update(ctx,
+                                      ( (result == CY_RSLT_SUCCESS) && (response.body_len == (range_end - range_start + 1)) ),
+                                      (uint32_t)(request_end - request_start));
+#endif
+
+    if(result == CY_RSLT_SUCCESS)
+    {
+        uint32_t    body_offset = 0;
+
+        ctx->contact_server_retry_count = 0;
+
+        /* The response may hold up to CY_OTA_HTTP_PIPELINE_DEPTH chunks.
+         * Hand them to storage in order, one chunk at a time.
+         */
+        while( (result == CY_RSLT_SUCCESS) && (body_offset < response.body_len) )
+        {
+            uint32_t    write_size = response.body_len - body_offset;
+            if(write_size > CY_OTA_CHUNK_SIZE)
             {
-                result = CY_RSLT_SUCCESS;
+                write_size = CY_OTA_CHUNK_SIZE;
             }
+
+            /* set parameters for writing */
+            ctx->http.chunk_info.offset     = range_start + body_offset;
+            ctx->http.chunk_info.buffer     = (uint8_t *)&response.body[body_offset];
+            ctx->http.chunk_info.size       = write_size;
+            ctx->http.chunk_info.total_size = ctx->ota_storage_context.total_image_size;  // is this correct? Is it set?
+
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "call cy_ota_http_write_chunk_to_flash(%p %d)\n", ctx->http.chunk_info.buffer, ctx->http.chunk_info.size);
+            result = cy_ota_http_write_chunk_to_flash(ctx, &ctx->http.chunk_info);
+            body_offset += write_size;
+        }
+
+        if(result == CY_RSLT_OTA_ERROR_APP_RETURNED_STOP)
+        {
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_WARNING, "%s() cy_ota_storage_write() returned OTA_STOP 0x%lx\n", __func__, result);
+        }
+        else if(result != CY_RSLT_SUCCESS)
+        {
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() cy_ota_storage_write() failed 0x%lx\n", __func__, result);
+            return cy_ota_http_get_data_end(ctx, CY_RSLT_OTA_ERROR_WRITE_STORAGE);
         }
         else
         {
-            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "cy_ota_http_send_get_response() ret:0x%lx start:0x%lx =  0x%lx\n", result, request.range_start, range_start);
-            result = CY_RSLT_OTA_ERROR_GET_DATA;
+            result = CY_RSLT_SUCCESS;
         }
+    }
+    else
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "cy_ota_http_send_get_response() ret:0x%lx start:0x%lx =  0x%lx\n", result, request.range_start, range_start);
+        result = CY_RSLT_OTA_ERROR_GET_DATA;
+    }
 
-        if(result == CY_RSLT_SUCCESS)
+    if(result == CY_RSLT_SUCCESS)
+    {
+        if(ctx->ota_storage_context.total_image_size == 0)
         {
-            range_start = range_end + 1;
-            range_end += CY_OTA_CHUNK_SIZE;     /* end, not length */
-            if(range_end > ctx->ota_storage_context.total_image_size)
-            {
-                range_end = ctx->ota_storage_context.total_image_size - 1;
-            }
-            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_INFO, "After :: range_start: 0x%lx  end: 0x%lx total_image_size:0x%lx\n", range_start, range_end, ctx->ota_storage_context.total_image_size);
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Server did not report the OTA Image size\n", __func__);
+            return cy_ota_http_get_data_end(ctx, CY_RSLT_OTA_ERROR_GET_DATA);
+        }
 
-            /* Check the timing between packets */
-            if(ctx->packet_timeout_sec > 0 )
-            {
-                /* got some data - restart the download interval timer */
-                cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG2, "%s() RESTART PACKET TIMER %ld secs\n", __func__, ctx->packet_timeout_sec);
-                cy_ota_start_http_timer(ctx, ctx->packet_timeout_sec, CY_OTA_EVENT_PACKET_TIMEOUT);
-            }
+        /* Check the timing between packets */
+        if(ctx->packet_timeout_sec > 0 )
+        {
+            /* got some data - restart the download interval timer */
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG2, "%s() RESTART PACKET TIMER %ld secs\n", __func__, ctx->packet_timeout_sec);
+            cy_ota_start_http_timer(ctx, ctx->packet_timeout_sec, CY_OTA_EVENT_PACKET_TIMEOUT);
+        }
 
-            /* Check for finished getting data */
-            if( (ctx->ota_storage_context.total_bytes_written > 0) &&
-                 (ctx->ota_storage_context.total_bytes_written >= ctx->ota_storage_context.total_image_size) )
+#if (CY_OTA_HTTP_PARALLEL_CONNECTIONS > 1)
+        /* Now that the size is known, fetch the rest over parallel connections.
+         * A polled OTA Agent has no threads, it keeps to one connection.
+         */
+        if( (ctx->http.connection_from_app == false) && (ctx->http.parallel_started == false) &&
+            (ctx->agent_params.use_poll == false) )
+        {
+            ctx->http.parallel_started = true;
+            result = cy_ota_http_parallel_download(ctx);
+            if( (result == CY_RSLT_OTA_ERROR_APP_RETURNED_STOP) || (result == CY_RSLT_OTA_ERROR_WRITE_STORAGE) )
             {
-                cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_INFO, "Done writing all data! %ld of %ld\n", ctx->ota_storage_context.total_bytes_written, ctx->ota_storage_context.total_image_size);
-                cy_rtos_setbits_event(&ctx->ota_event, (uint32_t)CY_OTA_EVENT_DATA_DONE, 0);
-                /* stop timer asap */
-                cy_ota_stop_http_timer(ctx);
+                return cy_ota_http_get_data_end(ctx, result);
             }
         }
-    }   /* While not done loading */
+#endif
+    }
+
+    if( (result == CY_RSLT_SUCCESS) || (result == CY_RSLT_OTA_ERROR_GET_DATA) )
+    {
+        /* Request whatever is missing next, or check for finished getting data */
+        if(cy_ota_http_next_range(ctx, &range_start, &range_end) == true)
+        {
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_INFO, "After :: range_start: 0x%lx  end: 0x%lx total_image_size:0x%lx\n", range_start, range_end, ctx->ota_storage_context.total_image_size);
+        }
+        else
+        {
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_INFO, "Done receiving all data! %ld of %ld\n", ctx->received_bytes, ctx->ota_storage_context.total_image_size);
+            cy_rtos_setbits_event(&ctx->ota_event, (uint32_t)CY_OTA_EVENT_DATA_DONE, 0);
+            /* stop timer asap */
+            cy_ota_stop_http_timer(ctx);
+            result = CY_RSLT_SUCCESS;
+        }
+    }
+
+    ctx->http.get_data_result = result;
+    ctx->http.range_start = range_start;
+    ctx->http.range_end = range_end;
+    return CY_RSLT_OTA_POLL_AGAIN;
+}
+
+/**
+ * @brief Finish the OTA download, also to stop it before cy_ota_http_get_data_step() is done
+ *
+ * @param[in]   ctx     - pointer to OTA agent context @ref cy_ota_context_t
+ * @param[in]   result  - result of the download
+ *
+ * @return  result
+ */
+cy_rslt_t cy_ota_http_get_data_end(cy_ota_context_t *ctx, cy_rslt_t result)
+{
+    CY_OTA_CONTEXT_ASSERT(ctx);
 
     cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_INFO, "%s() HTTP GET DATA DONE result: 0x%lx\n", __func__, result);
 
-cleanup_and_exit:
     ctx->contact_server_retry_count = 0;
     ctx->sub_callback_mutex_inited = 0;
     cy_rtos_deinit_mutex(&ctx->sub_callback_mutex);
@@ -1157,6 +2115,10 @@ cleanup_and_exit:
     cy_ota_stop_http_timer(ctx);
     cy_rtos_deinit_timer(&ctx->http.http_timer);
 
+#if (CY_OTA_HTTP_ADAPTIVE_RANGE == 1)
+    cy_ota_http_adaptive_range_deinit(ctx);
+#endif
+
     return result;
 }
 
@@ -1210,7 +2172,7 @@ cy_rslt_t cy_ota_http_report_result(cy_ota_context_t *ctx, cy_rslt_t last_error)
     uint32_t                    buff_len;
 
     /* Create Result JSON Doc */
-    sprintf(ctx->http.json_doc, CY_OTA_HTTP_RESULT_JSON,
+    sprintf(ctx->json_doc, CY_OTA_HTTP_RESULT_JSON,
             ( (last_error == CY_RSLT_SUCCESS) ? CY_OTA_RESULT_SUCCESS : CY_OTA_RESULT_FAILURE),
             ctx->http.file);
 
@@ -1218,17 +2180,17 @@ cy_rslt_t cy_ota_http_report_result(cy_ota_context_t *ctx, cy_rslt_t last_error)
             cy_ota_get_state_string(ctx->curr_state), ctx->stop_OTA_session);
 
     cb_result = cy_ota_internal_call_cb(ctx, CY_OTA_REASON_STATE_CHANGE, ctx->curr_state);
-    buff_len = strlen(ctx->http.json_doc);
+    buff_len = strlen(ctx->json_doc);
 
     cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG2, "HTTP POST result     File After cb: %s\n", ctx->http.file);
-    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG2, "HTTP POST result json_doc After cb: %ld:%s\n",buff_len, ctx->http.json_doc);
+    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG2, "HTTP POST result json_doc After cb: %ld:%s\n",buff_len, ctx->json_doc);
 
     /* Form POST message for HTTP Server */
 
     /* Create Post Header */
     sprintf((char *)ctx->data_buffer, CY_OTA_HTTP_POST_TEMPLATE,
             ( (last_error == CY_RSLT_SUCCESS) ? CY_OTA_RESULT_SUCCESS : CY_OTA_RESULT_FAILURE),
-            (long)buff_len, ctx->http.json_doc);
+            (long)buff_len, ctx->json_doc);
     buff_len = strlen((char *)ctx->data_buffer);
 
     switch( cb_result )
@@ -1245,8 +2207,8 @@ cy_rslt_t cy_ota_http_report_result(cy_ota_context_t *ctx, cy_rslt_t last_error)
 
                 request.method        = CY_HTTP_CLIENT_METHOD_POST;
                 request.resource_path = ctx->http.file;                 /* OTA_HTTP_JOB_FILE ?? */
-                request.buffer        = (uint8_t *)ctx->http.json_doc;  /* Location to store returned data */
-                request.buffer_len    = sizeof(ctx->http.json_doc);     /* size of buffer */
+                request.buffer        = (uint8_t *)ctx->json_doc;  /* Location to store returned data */
+                request.buffer_len    = sizeof(ctx->json_doc);     /* size of buffer */
                 request.headers_len   = 0;                              /* filled in by cy_http_client_write_header() */
                 request.range_start   = 0;                              /* the job is reasonably small, get the whole thing */
                 request.range_end     = -1;
@@ -64,6 +64,25 @@ extern "C" {
  */
 #define CY_OTA_SIZE_OF_RECV_BUFFER              (4 * 1024)
 
+/**
+ * @brief Number of bytes requested with each HTTP range GET
+ *
+ *  CY_OTA_HTTP_PIPELINE_DEPTH chunks are requested at once and consumed in order.
+ */
+#if (CY_OTA_HTTP_PIPELINE_DEPTH < 1)
+#error "CY_OTA_HTTP_PIPELINE_DEPTH must be 1 or larger"
+#endif
+#define CY_OTA_HTTP_RANGE_SIZE                  (CY_OTA_CHUNK_SIZE * CY_OTA_HTTP_PIPELINE_DEPTH)
+
+/**
+ * @brief Size of the buffer used to receive data chunks (including transport headers)
+ */
+#ifdef COMPONENT_OTA_HTTP
+#define CY_OTA_CHUNK_BUFFER_SIZE                (CY_OTA_HTTP_RANGE_SIZE + CY_OTA_CHUNK_HEADER_SIZE)
+#else
+#define CY_OTA_CHUNK_BUFFER_SIZE                (CY_OTA_CHUNK_SIZE + CY_OTA_CHUNK_HEADER_SIZE)
+#endif
+
 /**
  * @brief Maximum size of signature scheme descriptive string
  *
@@ -106,6 +125,8 @@ typedef enum
 
     CY_OTA_EVENT_APP_STOPPED_OTA         = (1 << 13),    /**< MQTT / HTTP "Storage Write" returned OTA_STOP  */
 
+    CY_OTA_EVENT_MQTT_RX_FREE            = (1 << 14),    /**< OTA Agent thread freed an MQTT receive buffer  */
+
 
 } ota_events_t;
 
@@ -128,9 +149,11 @@ typedef enum
 #define CY_OTA_CONTEXT_ASSERT(ctx)  CY_ASSERT( (ctx!=NULL) && (ctx->tag==CY_OTA_TAG) )
 
 /**
- * @brief max number of packets to check for missing & duplicate packets
+ * @brief Maximum number of disjoint ranges tracked in a @ref cy_ota_range_map_t
  */
-#define CY_OTA_MAX_PACKETS     (2048)  /* Handle checking for 2M OTA code using 1k packets */
+#ifndef CY_OTA_RANGE_MAP_MAX_RANGES
+#define CY_OTA_RANGE_MAP_MAX_RANGES     (16)
+#endif
 
 /******************************************************************************
  *
@@ -139,6 +162,245 @@ typedef enum
  ******************************************************************************/
 
 
+/***********************************************************************
+ *
+ * Range map
+ *
+ **********************************************************************/
+
+/**
+ * @brief One range of OTA Image bytes [start, end)
+ */
+typedef struct cy_ota_range_s {
+    uint32_t            start;                                  /**< First byte offset in the range             */
+    uint32_t            end;                                    /**< One past the last byte offset in the range */
+} cy_ota_range_t;
+
+/**
+ * @brief Sorted, non-overlapping list of OTA Image ranges written to storage
+ */
+typedef struct cy_ota_range_map_s {
+    uint16_t            num_ranges;                             /**< Number of valid entries in range[]         */
+    cy_ota_range_t      range[CY_OTA_RANGE_MAP_MAX_RANGES];     /**< Ranges sorted by start offset              */
+} cy_ota_range_map_t;
+
+/***********************************************************************
+ *
+ * Storage writer
+ *
+ **********************************************************************/
+#if (CY_OTA_STORAGE_WRITER_BUFFERS == 1)
+#error "CY_OTA_STORAGE_WRITER_BUFFERS must be 0 or 2 and larger"
+#endif
+
+#if (CY_OTA_STORAGE_WRITER_BUFFERS > 0)
+/**
+ * @brief One chunk waiting to be written by the storage writer thread
+ */
+typedef struct cy_ota_writer_slot_s {
+    cy_ota_storage_write_info_t info;                           /**< Write info, buffer points to data[]        */
+    uint8_t             data[CY_OTA_CHUNK_SIZE];                /**< Copy of the received data                  */
+} cy_ota_writer_slot_t;
+
+/**
+ * @brief Storage writer thread data
+ */
+typedef struct cy_ota_writer_s {
+    bool                running;                                /**< true if the writer thread is running       */
+    cy_thread_t         thread;                                 /**< Writer thread                              */
+    cy_queue_t          free_queue;                             /**< Indexes of free slots                      */
+    cy_queue_t          full_queue;                             /**< Indexes of slots to write, in order        */
+    cy_ota_writer_slot_t *slots;                                /**< CY_OTA_STORAGE_WRITER_BUFFERS slots        */
+    cy_mutex_t          mutex;                                  /**< Guards result, written_ranges and stats    */
+    cy_rslt_t           result;                                 /**< First write error, stops all writes        */
+} cy_ota_writer_t;
+#endif
+
+/***********************************************************************
+ *
+ * Storage write coalescing
+ *
+ **********************************************************************/
+#if (CY_OTA_STORAGE_COALESCE_SIZE > 0)
+#if ( (CY_OTA_STORAGE_COALESCE_SIZE % CY_OTA_STORAGE_PAGE_SIZE) != 0)
+#error "CY_OTA_STORAGE_COALESCE_SIZE must be a multiple of CY_OTA_STORAGE_PAGE_SIZE"
+#endif
+
+/**
+ * @brief Storage write coalescing buffer
+ */
+typedef struct cy_ota_coalesce_s {
+    uint8_t             *buffer;                                /**< CY_OTA_STORAGE_COALESCE_SIZE bytes         */
+    uint32_t            start;                                  /**< OTA Image offset of buffer[0]              */
+    uint32_t            length;                                 /**< Bytes in buffer[]                          */
+    uint32_t            limit;                                  /**< length at which buffer[] ends on a page    */
+    cy_ota_storage_write_info_t info;                           /**< Last chunk info, for the other fields      */
+    cy_rslt_t           result;                                 /**< First write error                          */
+} cy_ota_coalesce_t;
+#endif
+
+/***********************************************************************
+ *
+ * Decompression
+ *
+ **********************************************************************/
+#if (CY_OTA_DECOMPRESS != CY_OTA_DECOMPRESS_NONE)
+#if (CY_OTA_DECOMPRESS != CY_OTA_DECOMPRESS_LZSS)
+#error "Unknown CY_OTA_DECOMPRESS"
+#endif
+#if ( (CY_OTA_DECOMPRESS_WINDOW_BITS_MAX < 4) || (CY_OTA_DECOMPRESS_WINDOW_BITS_MAX > 15) )
+#error "CY_OTA_DECOMPRESS_WINDOW_BITS_MAX must be 4 to 15"
+#endif
+
+/**
+ * @brief Streaming decompression
+ */
+typedef struct cy_ota_decompress_s {
+    bool                checked;                                /**< First write seen, active is valid          */
+    bool                active;                                 /**< OTA Image is compressed                    */
+    cy_rslt_t           result;                                 /**< First error                                */
+    uint32_t            in_offset;                              /**< Next compressed offset to decode           */
+    uint8_t             magic[4];                               /**< First bytes of the OTA Image until checked */
+    uint8_t             magic_len;                              /**< Bytes in magic[]                           */
+    uint8_t             header[12];                             /**< Compressed OTA Image header                */
+    uint8_t             header_len;                             /**< Bytes in header[]                          */
+    uint8_t             state;                                  /**< Decoder state                              */
+    uint8_t             window_bits;                            /**< From the header                            */
+    uint8_t             lookahead_bits;                         /**< From the header                            */
+    uint8_t             nbits;                                  /**< Bits not used yet in bits                  */
+    uint32_t            bits;                                   /**< Bits from the compressed data              */
+    uint32_t            backref_offset;                         /**< Offset of the back reference being decoded */
+    uint32_t            image_size;                             /**< Uncompressed size from the header          */
+    uint32_t            out_pos;                                /**< Bytes decoded                              */
+    uint32_t            window_mask;                            /**< (1 << window_bits) - 1                     */
+    uint8_t             *window;                                /**< Last decoded bytes, followed by out[]      */
+    uint8_t             *out;                                   /**< CY_OTA_STORAGE_PAGE_SIZE decoded bytes     */
+    uint32_t            out_len;                                /**< Bytes in out[]                             */
+    cy_ota_storage_write_info_t info;                           /**< Last chunk info, for the other fields      */
+} cy_ota_decompress_t;
+#endif
+
+/***********************************************************************
+ *
+ * Delta update
+ *
+ **********************************************************************/
+#if (CY_OTA_DELTA_UPDATE == 1)
+/**
+ * @brief Delta OTA Image header size
+ */
+#define CY_OTA_DELTA_HEADER_SIZE    (24)
+
+/**
+ * @brief Streaming patch application
+ */
+typedef struct cy_ota_delta_s {
+    bool                checked;                                /**< First write seen, active is valid          */
+    bool                active;                                 /**< OTA Image is a patch                       */
+    cy_rslt_t           result;                                 /**< First error                                */
+    uint32_t            in_offset;                              /**< Next patch offset to apply                 */
+    uint8_t             magic[4];                               /**< First bytes of the OTA Image until checked */
+    uint8_t             magic_len;                              /**< Bytes in magic[]                           */
+    uint8_t             header[CY_OTA_DELTA_HEADER_SIZE];       /**< Patch header                               */
+    uint8_t             header_len;                             /**< Bytes in header[]                          */
+    uint8_t             state;                                  /**< Patch parser state                         */
+    uint8_t             op;                                     /**< Operation being parsed / applied           */
+    uint8_t             varint_shift;                           /**< Bits of the varint being parsed            */
+    uint32_t            varint;                                 /**< Varint being parsed                        */
+    uint32_t            source_size;                            /**< Bytes of the running application used      */
+    uint32_t            source_offset;                          /**< Next source byte for COPY / ADD            */
+    uint32_t            length;                                 /**< Bytes left in the operation                */
+    uint32_t            image_size;                             /**< New OTA Image size from the header         */
+    uint32_t            out_pos;                                /**< Bytes of the new OTA Image built           */
+    uint8_t             *out;                                   /**< CY_OTA_STORAGE_PAGE_SIZE output bytes      */
+    uint32_t            out_len;                                /**< Bytes in out[]                             */
+    uint8_t             *source;                                /**< CY_OTA_STORAGE_PAGE_SIZE source bytes      */
+    uint32_t            source_len;                             /**< Bytes in source[]                          */
+    uint32_t            source_pos;                             /**< Next byte to use in source[]               */
+    cy_ota_storage_write_info_t info;                           /**< Last chunk info, for the other fields      */
+} cy_ota_delta_t;
+#endif
+
+/***********************************************************************
+ *
+ * TAR archive parsing
+ *
+ **********************************************************************/
+#if (CY_OTA_TAR_PARSER == 1)
+#if (CY_OTA_IMAGE_NUMBER > 31)
+#error "CY_OTA_TAR_PARSER supports up to 31 images"
+#endif
+
+/**
+ * @brief TAR header / data block size
+ */
+#define CY_OTA_TAR_BLOCK_SIZE       (512)
+
+/**
+ * @brief Streaming TAR archive parsing
+ */
+typedef struct cy_ota_tar_s {
+    bool                decided;                                /**< First block seen, active is valid          */
+    bool                active;                                 /**< OTA Image is a TAR archive                 */
+    cy_rslt_t           result;                                 /**< First error                                */
+    uint32_t            in_offset;                              /**< Next archive offset to parse               */
+    uint8_t             block[CY_OTA_TAR_BLOCK_SIZE];           /**< Header block being collected               */
+    uint32_t            block_len;                              /**< Bytes in block[]                           */
+    uint8_t             state;                                  /**< Parser state                               */
+    uint8_t             member_img;                             /**< imgID of the member, 0 = skipped           */
+    uint8_t             member_count;                           /**< Members assigned to an image so far        */
+    uint8_t             saved_img;                              /**< imgID before the archive                   */
+    uint32_t            member_size;                            /**< Size of the member being written           */
+    uint32_t            member_offset;                          /**< Bytes of the member written                */
+    uint32_t            pad_left;                               /**< Padding bytes left after the member        */
+    uint32_t            verified;                               /**< Bit (1 << imgID) set when verified         */
+    uint8_t             *reorder;                               /**< CY_OTA_TAR_REORDER_SIZE bytes from reorder_offset */
+    uint32_t            reorder_offset;                         /**< Archive offset of reorder[0]               */
+    cy_ota_range_map_t  held;                                   /**< Archive ranges held in reorder[]           */
+    cy_ota_storage_write_info_t info;                           /**< Last chunk info, for the other fields      */
+} cy_ota_tar_t;
+#endif
+
+/***********************************************************************
+ *
+ * OTA Image digest
+ *
+ **********************************************************************/
+#define CY_OTA_IMAGE_DIGEST     ( (CY_OTA_IMAGE_DIGEST_SHA256 == 1) || (CY_OTA_IMAGE_DIGEST_CRC32 == 1) )
+
+/**
+ * @brief SHA-256 block size
+ */
+#define CY_OTA_SHA256_BLOCK_SIZE    (64)
+
+/**
+ * @brief SHA-256 context
+ */
+typedef struct cy_ota_sha256_context_s {
+    uint32_t            state[8];                               /**< Hash state                                 */
+    uint64_t            length;                                 /**< Bytes hashed                               */
+    uint8_t             block[CY_OTA_SHA256_BLOCK_SIZE];        /**< Partial block                              */
+    uint32_t            used;                                   /**< Bytes in block[]                           */
+} cy_ota_sha256_context_t;
+
+#if (CY_OTA_IMAGE_DIGEST)
+/**
+ * @brief OTA Image digest computed while writing
+ */
+typedef struct cy_ota_digest_s {
+    bool                active;                                 /**< false after an error, no digest passed     */
+    uint32_t            offset;                                 /**< OTA Image [0, offset) has been hashed      */
+    cy_ota_range_map_t  written;                                /**< OTA Image ranges in storage                */
+    uint8_t             *read_buffer;                           /**< For reading back out of order data         */
+#if (CY_OTA_IMAGE_DIGEST_SHA256 == 1)
+    cy_ota_sha256_context_t sha256;                             /**< SHA-256 so far                             */
+#endif
+#if (CY_OTA_IMAGE_DIGEST_CRC32 == 1)
+    uint32_t            crc32;                                  /**< CRC32 so far                               */
+#endif
+} cy_ota_digest_t;
+#endif
+
 /***********************************************************************
  *
  * HTTP
@@ -146,6 +408,20 @@ typedef enum
  **********************************************************************/
 #ifdef COMPONENT_OTA_HTTP
 
+#if (CY_OTA_HTTP_PARALLEL_CONNECTIONS < 1)
+#error "CY_OTA_HTTP_PARALLEL_CONNECTIONS must be 1 or larger"
+#endif
+
+#if ( ( (2 * CY_OTA_HTTP_PARALLEL_CONNECTIONS) + 1) > CY_OTA_RANGE_MAP_MAX_RANGES)
+#error "Increase CY_OTA_RANGE_MAP_MAX_RANGES for CY_OTA_HTTP_PARALLEL_CONNECTIONS"
+#endif
+
+#if (CY_OTA_HTTP_ADAPTIVE_RANGE == 1)
+#if ( (CY_OTA_HTTP_RANGE_SIZE_MIN < CY_OTA_CHUNK_SIZE) || (CY_OTA_HTTP_RANGE_SIZE_MAX < CY_OTA_HTTP_RANGE_SIZE_MIN) )
+#error "Need CY_OTA_CHUNK_SIZE <= CY_OTA_HTTP_RANGE_SIZE_MIN <= CY_OTA_HTTP_RANGE_SIZE_MAX"
+#endif
+#endif
+
 /*
  * @brief Size of an HTTP header
  *
@@ -181,6 +457,30 @@ typedef enum
  *
  **********************************************************************/
 
+#if (CY_OTA_HTTP_PARALLEL_CONNECTIONS > 1)
+/**
+ * @brief Additional HTTP connection used for parallel range downloads
+ */
+typedef struct cy_ota_http_worker_s {
+    struct cy_ota_context_s *ctx;                               /**< Owning OTA context                         */
+    cy_thread_t         thread;                                 /**< Worker thread                              */
+    bool                running;                                /**< true if thread was created                 */
+    cy_http_client_t    connection;                             /**< Worker's own HTTP connection               */
+    uint8_t             *buffer;                                /**< Worker's receive buffer                    */
+    cy_rslt_t           result;                                 /**< Worker result                              */
+} cy_ota_http_worker_t;
+#endif
+
+/**
+ * @brief Number of HTTP response headers read
+ */
+#define CY_OTA_HTTP_NUM_READ_HEADERS    (5)
+
+/**
+ * @brief Size of an HTTP response header value
+ */
+#define CY_OTA_HTTP_HEADER_VALUE_LEN    (CY_OTA_CHECKPOINT_ETAG_SIZE)
+
 /**
  * @brief HTTP context data
  */
@@ -193,9 +493,33 @@ typedef struct cy_ota_http_context_s {
     ota_events_t        http_timer_event;                       /**< Event to trigger when timer goes off       */
 
 
-    char                json_doc[CY_OTA_JSON_DOC_BUFF_SIZE];    /**< Message to request OTA data            */
     char                file[CY_OTA_HTTP_FILENAME_SIZE];        /**< Filename for OTA data                  */
 
+    cy_http_client_header_t read_headers[CY_OTA_HTTP_NUM_READ_HEADERS];                     /**< Response headers to read   */
+    char                read_values[CY_OTA_HTTP_NUM_READ_HEADERS][CY_OTA_HTTP_HEADER_VALUE_LEN]; /**< Response header values */
+    cy_ota_storage_write_info_t chunk_info;                     /**< Chunk passed to storage for GET data       */
+    char                etag[CY_OTA_CHECKPOINT_ETAG_SIZE];      /**< ETag of the last OTA Image response, or "" */
+
+    cy_rslt_t           get_data_result;                        /**< Result of the last cy_ota_http_get_data_step() */
+    uint32_t            range_start;                            /**< Start of the next range to GET             */
+    uint32_t            range_end;                              /**< End byte of the next range to GET          */
+
+#if (CY_OTA_HTTP_USE_STREAMING_GET == 1)
+    NetworkContext_t    stream_socket;                          /**< Socket for the streaming GET               */
+#endif
+#if (CY_OTA_HTTP_ADAPTIVE_RANGE == 1)
+    uint8_t             *range_buffer;                          /**< Receive buffer for adaptive ranges         */
+    uint32_t            range_size;                             /**< Current range size to request              */
+    uint32_t            range_size_max;                         /**< Largest range that fits in range_buffer    */
+    uint32_t            range_ssthresh;                         /**< Stop doubling range_size at this size      */
+#endif
+#if (CY_OTA_HTTP_PARALLEL_CONNECTIONS > 1)
+    cy_mutex_t          parallel_mutex;                         /**< Serialize range claims and storage writes  */
+    cy_ota_range_map_t  parallel_claimed;                       /**< Ranges received or handed to a connection  */
+    cy_rslt_t           parallel_result;                        /**< First storage / App error, stops all       */
+    bool                parallel_started;                       /**< true once the parallel download was run    */
+    cy_ota_http_worker_t workers[CY_OTA_HTTP_PARALLEL_CONNECTIONS - 1];  /**< Additional connections            */
+#endif
 } cy_ota_http_context_t;
 #endif /* COMPONENT_OTA_HTTP    */
 
@@ -207,6 +531,8 @@ typedef struct cy_ota_http_context_s {
  **********************************************************************/
 
 #ifdef COMPONENT_OTA_MQTT
+#include <stdatomic.h>
+
 /* OTA MQTT main loop events to wait look for */
 #define CY_OTA_EVENT_MQTT_EVENTS  (CY_OTA_EVENT_SHUTDOWN_NOW | \
                                 CY_OTA_EVENT_PACKET_TIMEOUT | \
@@ -226,12 +552,57 @@ typedef struct cy_ota_http_context_s {
 /* Time to wait for MQTT subscription callback Mutex */
 #define CY_OTA_WAIT_MQTT_MUTEX_MS       (SECS_TO_MILLISECS(20) )
 
+#if (CY_OTA_MQTT_CHUNK_WINDOW < 1)
+#error "CY_OTA_MQTT_CHUNK_WINDOW must be at least 1"
+#endif
+
+#if ( (CY_OTA_MQTT_RX_BUFFERS < 1) || ((CY_OTA_MQTT_RX_BUFFERS & (CY_OTA_MQTT_RX_BUFFERS - 1)) != 0) )
+#error "CY_OTA_MQTT_RX_BUFFERS must be a power of 2"
+#endif
+
+#if (CY_OTA_MQTT_REASSEMBLY_SIZE > 0)
+#if ( (CY_OTA_MQTT_REASSEMBLY_SIZE < CY_OTA_CHUNK_SIZE) || ((CY_OTA_MQTT_REASSEMBLY_SIZE % CY_OTA_STORAGE_PAGE_SIZE) != 0) )
+#error "CY_OTA_MQTT_REASSEMBLY_SIZE must be a multiple of CY_OTA_STORAGE_PAGE_SIZE and at least CY_OTA_CHUNK_SIZE"
+#endif
+#endif
+
 /***********************************************************************
  *
  * Structures
  *
  **********************************************************************/
 
+/**
+ * @brief MQTT Payload type
+ */
+typedef enum {
+    CY_OTA_MQTT_HEADER_TYPE_ONE_FILE = 0    /**< OTA Image with single file (main application)  */
+} cy_ota_mqtt_header_ota_type_t;
+
+/**
+ * @brief MQTT Payload header (not the MQTT header, this is our data header)
+ */
+#pragma pack(push,1)
+typedef struct cy_ota_mqtt_chunk_payload_header_s {
+    const uint8_t   magic[sizeof(CY_OTA_MQTT_MAGIC) - 1];       /**< "OTAImage" @ref CY_OTA_MQTT_MAGIC                  */
+    const uint16_t  offset_to_data;                             /**< offset within this payload to start of data        */
+    const uint16_t  ota_image_type;                             /**< 0 = single application OTA Image  @ref cy_ota_mqtt_header_ota_type_t */
+    const uint16_t  update_version_major;                       /**< OTAImage Major version number                      */
+    const uint16_t  update_version_minor;                       /**< OTAImage minor version number                      */
+    const uint16_t  update_version_build;                       /**< OTAImage build version number                      */
+    const uint32_t  total_size;                                 /* total size of OTA Image (all chunk data concatenated)*/
+    const uint32_t  image_offset;                               /* offset within the final OTA Image of THIS chunk data */
+    const uint16_t  data_size;                                  /* Size of chunk data in THIS payload                   */
+    const uint16_t  total_num_payloads;                         /* Total number of payloads                             */
+    const uint16_t  this_payload_index;                         /* THIS payload index                                   */
+} cy_ota_mqtt_chunk_payload_header_t;
+#pragma pack(pop)
+
+/**
+ * @brief Size of each received payload buffer, one chunk of data plus our header
+ */
+#define CY_OTA_MQTT_RX_BUFFER_SIZE      (CY_OTA_CHUNK_SIZE + sizeof(cy_ota_mqtt_chunk_payload_header_t))
+
 /**
  * @brief MQTT context data
  */
@@ -247,9 +618,29 @@ typedef struct cy_ota_mqtt_context_s {
     ota_events_t        mqtt_timer_event;               /**< Event to trigger when timer goes off       */
     bool                mqtt_timer_inited;              /**< true if MQTT timer initialized             */
 
-    uint8_t             received_packets[CY_OTA_MAX_PACKETS];   /**< keep track of packets for missing / duplicates */
-
-    char                json_doc[CY_OTA_JSON_DOC_BUFF_SIZE];    /**< Message to request OTA data */
+    uint32_t            *received_packets;              /**< Bit set of received packets, sized from the first chunk header */
+    uint16_t            num_packets;                    /**< Number of packets in received_packets      */
+    uint16_t            duplicate_packets;              /**< Number of duplicate packets received       */
+    uint32_t            next_request_offset;            /**< Offset of the next chunk to request (per-chunk download) */
+    uint8_t             repair_tries;                   /**< Repair requests sent since one recovered packets */
+    bool                repair_active;                  /**< A repair request was sent, its packets may be arriving */
+    uint32_t            repair_missing;                 /**< Missing packets when the last repair was requested */
+    uint32_t            repair_list_end;                /**< Packet after the last one in the last repair request */
+    char                repair_list[CY_OTA_MQTT_REPAIR_LIST_SIZE];  /**< Missing packets for the repair request */
+
+    /* Received data payloads, from cy_ota_mqtt_callback() to the OTA Agent thread */
+    uint8_t             *rx_buffers;                    /**< CY_OTA_MQTT_RX_BUFFERS payload buffers, allocated for the download */
+    uint32_t            rx_len[CY_OTA_MQTT_RX_BUFFERS]; /**< Length of the payload in each buffer       */
+    atomic_uint         rx_head;                        /**< Payloads queued, written by the MQTT callback only */
+    atomic_uint         rx_tail;                        /**< Payloads consumed, written by the OTA Agent thread only */
+    uint32_t            rx_dropped;                     /**< Payloads dropped because all buffers were full */
+    cy_ota_storage_write_info_t chunk_info;             /**< Chunk being written by the OTA Agent thread */
+
+#if (CY_OTA_MQTT_REASSEMBLY_SIZE > 0)
+    uint8_t             *reasm_buffer;                  /**< CY_OTA_MQTT_REASSEMBLY_SIZE bytes, allocated for the download */
+    uint32_t            reasm_start;                    /**< OTA Image offset of reasm_buffer[0]        */
+    cy_ota_range_map_t  reasm_ranges;                   /**< Parts of reasm_buffer holding data         */
+#endif
 
     uint8_t             use_unique_topic;               /**< if == 1, create and use unique topic!      */
     char                unique_topic[CY_OTA_MQTT_UNIQUE_TOPIC_BUFF_SIZE]; /**< Topic for receiving OTA data */
@@ -307,7 +698,6 @@ typedef struct {
  * This struct holds the separated fields.
  */
 typedef struct cy_ota_job_parsed_info_s {
-        char                    job_doc[CY_OTA_JSON_DOC_BUFF_SIZE];         /**< Full Job doc sent from publisher   */
         cy_rslt_t               parse_result;                               /**< Parse result                       */
         /* separated pieces */
         char                    message[CY_OTA_MESSAGE_LEN];                /**< Message ex: "Update Available"     */
@@ -328,6 +718,10 @@ typedef struct cy_ota_job_parsed_info_s {
         char                    file[CY_OTA_HTTP_FILENAME_SIZE];            /**< File on Server (HTTP)              */
         uint32_t                file_size;                                  /**< size of file to download           */
         char                    topic[CY_OTA_MQTT_UNIQUE_TOPIC_BUFF_SIZE];  /**< Unique Topic                       */
+        char                    delta_base[CY_OTA_JOB_VERSION_LEN];         /**< Patch base version, "" = full image   */
+        uint16_t                delta_major;                                /**< Major Version the patch applies to */
+        uint16_t                delta_minor;                                /**< Minor Version the patch applies to */
+        uint16_t                delta_build;                                /**< Build Version the patch applies to */
 } cy_ota_job_parsed_info_t;
 
 /**
@@ -336,12 +730,16 @@ typedef struct cy_ota_job_parsed_info_s {
 typedef struct cy_ota_context_s
 {
     uint32_t                    tag;                        /**< Must be CY_OTA_TAG to be valid                             */
+    uint8_t                     *memory;                    /**< Caller's memory from cy_ota_agent_start_static(), NULL = heap */
     cy_ota_network_params_t     network_params;             /**< copy of initial connection parameters                      */
     cy_ota_agent_params_t       agent_params;               /**< copy of initial agent parameters                           */
     cy_event_t                  ota_event;                  /**< Event signaling @ref ota_events_t                          */
     cy_thread_t                 ota_agent_thread;           /**< OTA Agent Thread                                           */
 
     cy_ota_agent_state_t        curr_state;                 /**< current OTA system state                                   */
+    bool                        state_in_progress;          /**< State function returned CY_RSLT_OTA_POLL_AGAIN, cy_ota_agent_poll() calls it again */
+    cy_rslt_t                   last_error;                 /**< Last error of this OTA Agent, see cy_ota_get_agent_last_error() */
+    uint8_t                     agent_index;                /**< Slot of this OTA Agent, 0 to CY_OTA_MAX_AGENTS - 1          */
 
     uint8_t                     stop_OTA_session;           /**< App callback returned CY_RSLT_OTA_ERROR_APP_RETURNED_STOP  */
     uint32_t                    initial_timer_sec;          /**< Seconds before connecting after cy_ota_agent_start()       */
@@ -358,6 +756,34 @@ typedef struct cy_ota_context_s
 
     /* Storage and progress info */
     cy_ota_storage_context_t    ota_storage_context;
+    cy_ota_range_map_t          written_ranges;             /**< OTA Image ranges written to storage                        */
+    cy_ota_range_map_t          received_ranges;            /**< OTA Image ranges received, written or waiting to be        */
+    uint32_t                    received_bytes;             /**< Bytes received, written or waiting to be                   */
+    cy_ota_checkpoint_t         checkpoint;                 /**< Last download checkpoint loaded or saved                   */
+    uint32_t                    resume_offset;              /**< Bytes already in storage when the download started         */
+    bool                        resume_verified;            /**< true when the resumed OTA Image matches the checkpoint     */
+    uint32_t                    first_block_crc32;          /**< CRC32 of the first MQTT packet, saved in the checkpoint    */
+    uint32_t                    first_block_size;           /**< Size of the first MQTT packet, 0 if not received           */
+#if (CY_OTA_STORAGE_WRITER_BUFFERS > 0)
+    cy_ota_writer_t             writer;                     /**< Storage writer thread                                      */
+#endif
+#if (CY_OTA_STORAGE_COALESCE_SIZE > 0)
+    cy_ota_coalesce_t           coalesce;                   /**< Storage write coalescing                                   */
+#endif
+#if (CY_OTA_DECOMPRESS != CY_OTA_DECOMPRESS_NONE)
+    cy_ota_decompress_t         decompress;                 /**< Compressed OTA Image decoding                              */
+#endif
+#if (CY_OTA_DELTA_UPDATE == 1)
+    cy_ota_delta_t              delta;                      /**< Delta OTA Image (patch) application                        */
+#endif
+#if (CY_OTA_TAR_PARSER == 1)
+    cy_ota_tar_t                tar;                        /**< TAR archive parsing                                        */
+#endif
+#if (CY_OTA_IMAGE_DIGEST)
+    cy_ota_digest_t             digest;                     /**< OTA Image digest computed while writing                    */
+#endif
+    bool                        erase_ahead;                /**< true = storage is erased ahead of the data written         */
+    uint32_t                    erased_size;                /**< Erase-ahead: storage [0, erased_size) is erased            */
 
     cy_mutex_t                  sub_callback_mutex;         /**< Keep subscription callbacks from being time-sliced             */
     uint8_t                     sub_callback_mutex_inited;  /**< 1 = sub_callback_mutex initialized                             */
@@ -383,19 +809,185 @@ typedef struct cy_ota_context_s
     cy_ota_ble_context_t        ble;                        /**< Bluetooth® specific context data                               */
 #endif
 #if defined(COMPONENT_OTA_HTTP) || defined(COMPONENT_OTA_MQTT)
-    uint8_t                     data_buffer[CY_OTA_SIZE_OF_RECV_BUFFER];    /**< Used to get Job and Data                       */
     char                        job_doc[CY_OTA_JSON_DOC_BUFF_SIZE];         /**< Message to parse                               */
     cy_ota_job_parsed_info_t    parsed_job;                                 /**< Parsed Job JSON info                           */
+    char                        json_doc[CY_OTA_JSON_DOC_BUFF_SIZE];        /**< Request / result message, for the one HTTP or MQTT connection open */
 
-    uint8_t                     chunk_buffer[CY_OTA_CHUNK_SIZE + CY_OTA_CHUNK_HEADER_SIZE];    /**< Store Chunked data here     */
+    /* Each connection is closed before the next phase starts, see CY_OTA_CONTEXT_SHARED_SIZE */
+    union {
+        uint8_t                 chunk_buffer[CY_OTA_CHUNK_BUFFER_SIZE];     /**< Store Chunked data here, MQTT network buffer while connected */
+        uint8_t                 data_buffer[CY_OTA_SIZE_OF_RECV_BUFFER];    /**< HTTP result POST, no MQTT connection open      */
+    };
 #endif
+#if (CY_OTA_CALLBACK_V1 == 1)
     cy_ota_cb_struct_t          callback_data;              /**< For passing data to callback function                          */
+#endif
+#if defined(COMPONENT_OTA_HTTP) || defined(COMPONENT_OTA_MQTT)
+    cy_awsport_ssl_credentials_t *cb_credentials;           /**< Credentials from the last callback, for the connection         */
+#endif
+    bool                        cb_v2_active;               /**< In cb_func_v2, cy_ota_callback_override() allowed              */
 
     cy_ota_storage_write_info_t *storage;                   /**< pointer to a chunk of data to write                            */
     cy_ota_storage_interface_t  storage_iface;
     uint8_t                     storage_open;               /**< 1 = storage is open                                            */
 } cy_ota_context_t;
 
+/**
+ * @brief Bytes of cy_ota_context_t saved by sharing buffers
+ *
+ * chunk_buffer and data_buffer share storage, one json_doc is used by HTTP and MQTT,
+ * and the Job document is kept in job_doc only (not also in parsed_job).
+ */
+#if defined(COMPONENT_OTA_HTTP) || defined(COMPONENT_OTA_MQTT)
+#define CY_OTA_CONTEXT_SHARED_DATA_SIZE         ( (CY_OTA_SIZE_OF_RECV_BUFFER < CY_OTA_CHUNK_BUFFER_SIZE) ? \
+                                                  CY_OTA_SIZE_OF_RECV_BUFFER : CY_OTA_CHUNK_BUFFER_SIZE)
+#if defined(COMPONENT_OTA_HTTP) && defined(COMPONENT_OTA_MQTT)
+#define CY_OTA_CONTEXT_SHARED_SIZE              (CY_OTA_CONTEXT_SHARED_DATA_SIZE + (2 * CY_OTA_JSON_DOC_BUFF_SIZE) )
+#else
+#define CY_OTA_CONTEXT_SHARED_SIZE              (CY_OTA_CONTEXT_SHARED_DATA_SIZE + CY_OTA_JSON_DOC_BUFF_SIZE)
+#endif
+#else
+#define CY_OTA_CONTEXT_SHARED_SIZE              (0)
+#endif
+
+/***********************************************************************
+ *
+ * OTA Agent memory
+ *
+ **********************************************************************/
+
+/**
+ * @brief Alignment of the memory passed to cy_ota_agent_start_static() and of each buffer in it
+ */
+#define CY_OTA_MEM_ALIGNMENT                    (8UL)
+#define CY_OTA_MEM_ALIGN(size)                  ( ( (size) + (CY_OTA_MEM_ALIGNMENT - 1) ) & ~(CY_OTA_MEM_ALIGNMENT - 1) )
+
+/* We have a callback that calls into the application, and we don't want to have a stack overflow */
+#define OTA_AGENT_THREAD_STACK_SIZE             (12 * 1024)
+
+/* The writer calls into the application for each storage write */
+#define OTA_WRITER_THREAD_STACK_SIZE            (12 * 1024)
+
+/* Parallel connections write to storage, which calls into the application */
+#define OTA_HTTP_WORKER_THREAD_STACK_SIZE       (12 * 1024)
+
+/**
+ * @brief Buffers allocated while the OTA Agent runs
+ *
+ * With cy_ota_agent_start_static(), each buffer has a fixed place in the caller's
+ * memory after cy_ota_context_t, otherwise it is malloc()ed when needed.
+ */
+typedef enum
+{
+    CY_OTA_MEM_DECOMPRESS_WINDOW = 0,       /**< @ref cy_ota_decompress_t window and out        */
+    CY_OTA_MEM_DELTA_OUT,                   /**< @ref cy_ota_delta_t out and source             */
+    CY_OTA_MEM_TAR_REORDER,                 /**< @ref cy_ota_tar_t reorder                      */
+    CY_OTA_MEM_DIGEST_READ,                 /**< @ref cy_ota_digest_t read_buffer               */
+    CY_OTA_MEM_COALESCE,                    /**< @ref cy_ota_coalesce_t buffer                  */
+    CY_OTA_MEM_WRITER_SLOTS,                /**< @ref cy_ota_writer_t slots                     */
+    CY_OTA_MEM_HTTP_RANGE,                  /**< HTTP adaptive range receive buffer             */
+    CY_OTA_MEM_MQTT_PACKET_MAP,             /**< MQTT received packet bit set                   */
+    CY_OTA_MEM_MQTT_RX,                     /**< MQTT received payload buffers                  */
+    CY_OTA_MEM_MQTT_REASSEMBLY,             /**< MQTT reassembly buffer                         */
+    CY_OTA_MEM_AGENT_STACK,                 /**< OTA Agent thread stack                         */
+    CY_OTA_MEM_WRITER_STACK,                /**< @ref cy_ota_writer_t thread stack              */
+    CY_OTA_MEM_HTTP_WORKER_STACKS,          /**< HTTP parallel worker thread stacks, all workers */
+    CY_OTA_MEM_HTTP_WORKER                  /**< HTTP parallel worker buffers, one per worker   */
+} cy_ota_mem_id_t;
+
+#if (CY_OTA_DECOMPRESS != CY_OTA_DECOMPRESS_NONE)
+#define CY_OTA_MEM_DECOMPRESS_WINDOW_SIZE       ( (1UL << CY_OTA_DECOMPRESS_WINDOW_BITS_MAX) + CY_OTA_STORAGE_PAGE_SIZE)
+#else
+#define CY_OTA_MEM_DECOMPRESS_WINDOW_SIZE       (0)
+#endif
+
+#if (CY_OTA_DELTA_UPDATE == 1)
+#define CY_OTA_MEM_DELTA_OUT_SIZE               (2 * CY_OTA_STORAGE_PAGE_SIZE)
+#else
+#define CY_OTA_MEM_DELTA_OUT_SIZE               (0)
+#endif
+
+#if (CY_OTA_TAR_PARSER == 1)
+#define CY_OTA_MEM_TAR_REORDER_SIZE             (CY_OTA_TAR_REORDER_SIZE)
+#else
+#define CY_OTA_MEM_TAR_REORDER_SIZE             (0)
+#endif
+
+#if (CY_OTA_IMAGE_DIGEST)
+#define CY_OTA_MEM_DIGEST_READ_SIZE             (CY_OTA_CHUNK_SIZE)
+#else
+#define CY_OTA_MEM_DIGEST_READ_SIZE             (0)
+#endif
+
+#define CY_OTA_MEM_COALESCE_SIZE                (CY_OTA_STORAGE_COALESCE_SIZE)
+
+#if (CY_OTA_STORAGE_WRITER_BUFFERS > 0)
+#define CY_OTA_MEM_WRITER_SLOTS_SIZE            (CY_OTA_STORAGE_WRITER_BUFFERS * sizeof(cy_ota_writer_slot_t))
+#else
+#define CY_OTA_MEM_WRITER_SLOTS_SIZE            (0)
+#endif
+
+#if defined(COMPONENT_OTA_HTTP) && (CY_OTA_HTTP_ADAPTIVE_RANGE == 1) && (CY_OTA_HTTP_RANGE_SIZE_MAX > CY_OTA_HTTP_RANGE_SIZE)
+#define CY_OTA_MEM_HTTP_RANGE_SIZE              (CY_OTA_HTTP_RANGE_SIZE_MAX + CY_OTA_CHUNK_HEADER_SIZE)
+#else
+#define CY_OTA_MEM_HTTP_RANGE_SIZE              (0)
+#endif
+
+#ifdef COMPONENT_OTA_HTTP
+#define CY_OTA_MEM_HTTP_WORKERS                 (CY_OTA_HTTP_PARALLEL_CONNECTIONS - 1)
+#else
+#define CY_OTA_MEM_HTTP_WORKERS                 (0)
+#endif
+#define CY_OTA_MEM_HTTP_WORKER_SIZE             (CY_OTA_CHUNK_BUFFER_SIZE)
+
+#ifdef COMPONENT_OTA_MQTT
+#define CY_OTA_MEM_MQTT_PACKET_MAP_SIZE         ( ( (CY_OTA_MQTT_STATIC_MAX_PACKETS + 31) / 32) * sizeof(uint32_t) )
+#define CY_OTA_MEM_MQTT_RX_SIZE                 (CY_OTA_MQTT_RX_BUFFERS * CY_OTA_MQTT_RX_BUFFER_SIZE)
+#define CY_OTA_MEM_MQTT_REASSEMBLY_SIZE         (CY_OTA_MQTT_REASSEMBLY_SIZE)
+#else
+#define CY_OTA_MEM_MQTT_PACKET_MAP_SIZE         (0)
+#define CY_OTA_MEM_MQTT_RX_SIZE                 (0)
+#define CY_OTA_MEM_MQTT_REASSEMBLY_SIZE         (0)
+#endif
+
+/* ThreadX builds keep their static thread stacks */
+#if !defined(COMPONENT_THREADX) && (defined(COMPONENT_OTA_HTTP) || defined(COMPONENT_OTA_MQTT))
+#define CY_OTA_MEM_AGENT_STACK_SIZE             (OTA_AGENT_THREAD_STACK_SIZE)
+#else
+#define CY_OTA_MEM_AGENT_STACK_SIZE             (0)
+#endif
+
+#if !defined(COMPONENT_THREADX) && (CY_OTA_STORAGE_WRITER_BUFFERS > 0)
+#define CY_OTA_MEM_WRITER_STACK_SIZE            (OTA_WRITER_THREAD_STACK_SIZE)
+#else
+#define CY_OTA_MEM_WRITER_STACK_SIZE            (0)
+#endif
+
+#if !defined(COMPONENT_THREADX)
+#define CY_OTA_MEM_HTTP_WORKER_STACKS_SIZE      (CY_OTA_MEM_HTTP_WORKERS * CY_OTA_MEM_ALIGN(OTA_HTTP_WORKER_THREAD_STACK_SIZE) )
+#else
+#define CY_OTA_MEM_HTTP_WORKER_STACKS_SIZE      (0)
+#endif
+
+/**
+ * @brief Bytes of caller's memory cy_ota_agent_start_static() needs, see cy_ota_agent_memory_size()
+ */
+#define CY_OTA_AGENT_MEMORY_REQUIRED    ( CY_OTA_MEM_ALIGN(sizeof(cy_ota_context_t)) + \
+                                          CY_OTA_MEM_ALIGN(CY_OTA_MEM_DECOMPRESS_WINDOW_SIZE) + \
+                                          CY_OTA_MEM_ALIGN(CY_OTA_MEM_DELTA_OUT_SIZE) + \
+                                          CY_OTA_MEM_ALIGN(CY_OTA_MEM_TAR_REORDER_SIZE) + \
+                                          CY_OTA_MEM_ALIGN(CY_OTA_MEM_DIGEST_READ_SIZE) + \
+                                          CY_OTA_MEM_ALIGN(CY_OTA_MEM_COALESCE_SIZE) + \
+                                          CY_OTA_MEM_ALIGN(CY_OTA_MEM_WRITER_SLOTS_SIZE) + \
+                                          CY_OTA_MEM_ALIGN(CY_OTA_MEM_HTTP_RANGE_SIZE) + \
+                                          CY_OTA_MEM_ALIGN(CY_OTA_MEM_MQTT_PACKET_MAP_SIZE) + \
+                                          CY_OTA_MEM_ALIGN(CY_OTA_MEM_MQTT_RX_SIZE) + \
+                                          CY_OTA_MEM_ALIGN(CY_OTA_MEM_MQTT_REASSEMBLY_SIZE) + \
+                                          CY_OTA_MEM_ALIGN(CY_OTA_MEM_AGENT_STACK_SIZE) + \
+                                          CY_OTA_MEM_ALIGN(CY_OTA_MEM_WRITER_STACK_SIZE) + \
+                                          CY_OTA_MEM_HTTP_WORKER_STACKS_SIZE + \
+                                          (CY_OTA_MEM_HTTP_WORKERS * CY_OTA_MEM_ALIGN(CY_OTA_MEM_HTTP_WORKER_SIZE)) )
+
 /***********************************************************************
  *
  * Variables
@@ -432,6 +1024,49 @@ cy_ota_callback_results_t cy_ota_internal_call_cb(cy_ota_context_t *ctx,
                                                   cy_ota_cb_reason_t reason,
                                                   cy_ota_agent_state_t report_state);
 
+/* --------------------------------------------------------------- */
+
+/**
+ * @brief Get an OTA Agent buffer
+ *
+ * With cy_ota_agent_start_static(), returns the buffer's place in the caller's memory,
+ * NULL if size is larger. Otherwise malloc()s size bytes.
+ *
+ * @param   ctx     - OTA context
+ * @param   id      - buffer @ref cy_ota_mem_id_t, CY_OTA_MEM_HTTP_WORKER + worker index for workers
+ * @param   size    - bytes needed
+ *
+ * @return  pointer to the buffer, NULL if not available
+ */
+void *cy_ota_mem_alloc(cy_ota_context_t *ctx, cy_ota_mem_id_t id, uint32_t size);
+
+/**
+ * @brief Release a buffer from cy_ota_mem_alloc()
+ *
+ * @param   ctx     - OTA context
+ * @param   buffer  - buffer from cy_ota_mem_alloc(), may be NULL
+ *
+ * @return  N/A
+ */
+void cy_ota_mem_free(cy_ota_context_t *ctx, void *buffer);
+
+/**
+ * @brief Get the stack for an OTA Agent thread
+ *
+ * With cy_ota_agent_start_static(), the stack is in the caller's memory. Otherwise
+ * *stack is NULL and the RTOS allocates the stack when the thread is created.
+ *
+ * @param   ctx     - OTA context
+ * @param   id      - CY_OTA_MEM_AGENT_STACK, CY_OTA_MEM_WRITER_STACK or CY_OTA_MEM_HTTP_WORKER_STACKS
+ * @param   index   - worker index for CY_OTA_MEM_HTTP_WORKER_STACKS, else 0
+ * @param   size    - stack size
+ * @param   stack   - stack to pass to cy_rtos_create_thread()
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          CY_RSLT_OTA_ERROR_OUT_OF_MEMORY - no room reserved for the stack
+ */
+cy_rslt_t cy_ota_mem_thread_stack(cy_ota_context_t *ctx, cy_ota_mem_id_t id, uint32_t index, uint32_t size, void **stack);
+
 /***********************************************************************
  *
  * OTA Network abstraction
@@ -477,17 +1112,41 @@ cy_rslt_t cy_ota_http_get_job(cy_ota_context_t *ctx);
 cy_rslt_t cy_ota_mqtt_get_job(cy_ota_context_t *ctx);
 
 /**
- * @brief get the OTA download
+ * @brief Start getting the OTA download
  *
  * NOTE: Individual Network Connection type will do whatever is necessary
  *
  * @param[in]   ctx - pointer to OTA agent context @ref cy_ota_context_t
  *
- * @return  CY_RSLT_SUCCESS
- *          CY_RSLT_OTA_ERROR_GENERAL
+ * @return  CY_RSLT_OTA_POLL_AGAIN - call cy_ota_xxx_get_data_step() until it returns something else
+ *          Any other result is final, the download has already been ended.
+ */
+cy_rslt_t cy_ota_http_get_data_start(cy_ota_context_t *ctx);
+cy_rslt_t cy_ota_mqtt_get_data_start(cy_ota_context_t *ctx);
+
+/**
+ * @brief Do one step of the OTA download
+ *
+ * HTTP gets one range, MQTT handles one event. Without use_poll, MQTT waits for the event.
+ *
+ * @param[in]   ctx - pointer to OTA agent context @ref cy_ota_context_t
+ *
+ * @return  CY_RSLT_OTA_POLL_AGAIN - call again
+ *          Any other result is final, the download has already been ended.
+ */
+cy_rslt_t cy_ota_http_get_data_step(cy_ota_context_t *ctx);
+cy_rslt_t cy_ota_mqtt_get_data_step(cy_ota_context_t *ctx);
+
+/**
+ * @brief End the OTA download, also to stop it early
+ *
+ * @param[in]   ctx     - pointer to OTA agent context @ref cy_ota_context_t
+ * @param[in]   result  - result of the download
+ *
+ * @return  result
  */
-cy_rslt_t cy_ota_http_get_data(cy_ota_context_t *ctx);
-cy_rslt_t cy_ota_mqtt_get_data(cy_ota_context_t *ctx);
+cy_rslt_t cy_ota_http_get_data_end(cy_ota_context_t *ctx, cy_rslt_t result);
+cy_rslt_t cy_ota_mqtt_get_data_end(cy_ota_context_t *ctx, cy_rslt_t result);
 
 /**
  * @brief Disconnect from Broker/Server
@@ -530,6 +1189,464 @@ void cy_ota_mqtt_create_unique_topic(cy_ota_context_t *ctx);
 
 void cy_ota_print_data(const char *buffer, uint32_t length);
 
+/**
+ * @brief Clear a range map
+ *
+ * @param[in]   map     - pointer to range map @ref cy_ota_range_map_t
+ *
+ * @return  N/A
+ */
+void cy_ota_range_map_clear(cy_ota_range_map_t *map);
+
+/**
+ * @brief Add a range of written bytes to a range map
+ *
+ * Adjacent and overlapping ranges are merged.
+ *
+ * @param[in]   map     - pointer to range map @ref cy_ota_range_map_t
+ * @param[in]   offset  - offset of the first byte written
+ * @param[in]   size    - number of bytes written
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          CY_RSLT_OTA_ERROR_OUT_OF_MEMORY - CY_OTA_RANGE_MAP_MAX_RANGES exceeded
+ */
+cy_rslt_t cy_ota_range_map_add(cy_ota_range_map_t *map, uint32_t offset, uint32_t size);
+
+/**
+ * @brief Find the first range of bytes not yet written
+ *
+ * @param[in]   map         - pointer to range map @ref cy_ota_range_map_t
+ * @param[in]   total_size  - total size of the OTA Image, 0 if not known yet
+ * @param[out]  hole_size   - size of the missing range, 0 if none is missing
+ *
+ * @return  offset of the first missing byte
+ */
+uint32_t cy_ota_range_map_next_hole(const cy_ota_range_map_t *map, uint32_t total_size, uint32_t *hole_size);
+
+/**
+ * @brief Check if all bytes of the OTA Image have been written
+ *
+ * @param[in]   map         - pointer to range map @ref cy_ota_range_map_t
+ * @param[in]   total_size  - total size of the OTA Image
+ *
+ * @return  true if [0, total_size) is covered
+ */
+bool cy_ota_range_map_is_complete(const cy_ota_range_map_t *map, uint32_t total_size);
+
+#if defined(COMPONENT_OTA_HTTP) || defined(COMPONENT_OTA_MQTT)
+/**
+ * @brief Check that the OTA Image being downloaded matches the resume checkpoint
+ *
+ * Call before writing data to storage. If a download was resumed and the
+ *  server now reports a different OTA Image size or ETag, the checkpoint is
+ *  cleared so the next attempt starts from the beginning.
+ *
+ * @param[in]   ctx         - pointer to OTA agent context @ref cy_ota_context_t
+ * @param[in]   total_size  - OTA Image size reported by the server, 0 if not known
+ * @param[in]   etag        - HTTP ETag of the response ("" if none), NULL for MQTT
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          CY_RSLT_OTA_ERROR_GET_DATA - OTA Image does not match the checkpoint
+ */
+cy_rslt_t cy_ota_checkpoint_check_image(cy_ota_context_t *ctx, uint32_t total_size, const char *etag);
+
+/**
+ * @brief Remember or check the first packet of an MQTT download
+ *
+ * A new download saves the CRC32 of the packet at offset 0 with the checkpoint.
+ *  A resumed download compares the packet, requested again, and the OTA Image size
+ *  and packet count from its header with the checkpoint.
+ *
+ * @param[in]   ctx         - pointer to OTA agent context @ref cy_ota_context_t
+ * @param[in]   chunk_info  - the chunk at offset 0
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          CY_RSLT_OTA_ERROR_GET_DATA - OTA Image does not match the checkpoint
+ */
+cy_rslt_t cy_ota_checkpoint_first_block(cy_ota_context_t *ctx, const cy_ota_storage_write_info_t *chunk_info);
+
+/**
+ * @brief Clear the checkpoint so the next attempt starts from the beginning
+ *
+ * @param[in]   ctx         - pointer to OTA agent context @ref cy_ota_context_t
+ *
+ * @return  N/A
+ */
+void cy_ota_checkpoint_discard(cy_ota_context_t *ctx);
+
+/**
+ * @brief Save a download checkpoint if enough progress has been made
+ *
+ * Call after writing data to storage.
+ *
+ * @param[in]   ctx         - pointer to OTA agent context @ref cy_ota_context_t
+ * @param[in]   persisted   - ranges of the OTA Image that are in storage
+ *
+ * @return  N/A
+ */
+void cy_ota_checkpoint_update(cy_ota_context_t *ctx, const cy_ota_range_map_t *persisted);
+
+/**
+ * @brief Record a chunk that is now in storage
+ *
+ * Updates written_ranges and the written stats, and saves a checkpoint if needed.
+ * With the storage writer thread, called from that thread once the write is done.
+ *
+ * @param[in]   ctx         - pointer to OTA agent context @ref cy_ota_context_t
+ * @param[in]   chunk_info  - the chunk that was written
+ *
+ * @return  N/A
+ */
+void cy_ota_storage_written(cy_ota_context_t *ctx, const cy_ota_storage_write_info_t *chunk_info);
+#endif
+
+#if (CY_OTA_STORAGE_WRITER_BUFFERS > 0)
+/**
+ * @brief Start the storage writer thread
+ *
+ * @param[in]   ctx - pointer to OTA agent context @ref cy_ota_context_t
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          CY_RSLT_OTA_ERROR_OUT_OF_MEMORY
+ *          CY_RSLT_OTA_ERROR_GENERAL
+ */
+cy_rslt_t cy_ota_writer_start(cy_ota_context_t *ctx);
+
+/**
+ * @brief Queue a chunk for the storage writer thread
+ *
+ * The data is copied, chunk_info may be re-used on return.
+ * Waits for a free buffer if the writer is behind.
+ *
+ * @param[in]   ctx         - pointer to OTA agent context @ref cy_ota_context_t
+ * @param[in]   chunk_info  - chunk to write @ref cy_ota_storage_write_info_t
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          CY_RSLT_OTA_ERROR_WRITE_STORAGE     - a previous write failed
+ *          CY_RSLT_OTA_ERROR_APP_RETURNED_STOP - App stopped OTA on a previous write
+ */
+cy_rslt_t cy_ota_writer_submit(cy_ota_context_t *ctx, cy_ota_storage_write_info_t *chunk_info);
+
+/**
+ * @brief Write all queued chunks and stop the storage writer thread
+ *
+ * @param[in]   ctx - pointer to OTA agent context @ref cy_ota_context_t
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          CY_RSLT_OTA_ERROR_WRITE_STORAGE
+ *          CY_RSLT_OTA_ERROR_APP_RETURNED_STOP
+ */
+cy_rslt_t cy_ota_writer_stop(cy_ota_context_t *ctx);
+#endif
+
+#if (CY_OTA_STORAGE_WRITER_BUFFERS > 0) && (defined(COMPONENT_OTA_HTTP) || defined(COMPONENT_OTA_MQTT))
+/**
+ * @brief Lock written_ranges and the written stats while the storage writer thread runs
+ *
+ * @param[in]   ctx - pointer to OTA agent context @ref cy_ota_context_t
+ */
+void cy_ota_writer_lock(cy_ota_context_t *ctx);
+
+/**
+ * @brief Unlock after @ref cy_ota_writer_lock
+ *
+ * @param[in]   ctx - pointer to OTA agent context @ref cy_ota_context_t
+ */
+void cy_ota_writer_unlock(cy_ota_context_t *ctx);
+#else
+#define cy_ota_writer_lock(ctx)         (void)(ctx)
+#define cy_ota_writer_unlock(ctx)       (void)(ctx)
+#endif
+
+/**
+ * @brief Start a SHA-256
+ *
+ * @param[out]  sha     - SHA-256 context
+ */
+void cy_ota_sha256_init(cy_ota_sha256_context_t *sha);
+
+/**
+ * @brief Add data to a SHA-256
+ *
+ * @param[in]   sha     - SHA-256 context
+ * @param[in]   buffer  - data
+ * @param[in]   size    - bytes of data
+ */
+void cy_ota_sha256_update(cy_ota_sha256_context_t *sha, const uint8_t *buffer, uint32_t size);
+
+/**
+ * @brief Finish a SHA-256
+ *
+ * @param[in]   sha     - SHA-256 context
+ * @param[out]  digest  - CY_OTA_SHA256_DIGEST_SIZE bytes
+ */
+void cy_ota_sha256_finish(cy_ota_sha256_context_t *sha, uint8_t digest[CY_OTA_SHA256_DIGEST_SIZE]);
+
+#if (CY_OTA_IMAGE_DIGEST)
+/**
+ * @brief Start computing the OTA Image digest as data is written
+ *
+ * Data already in storage from a resumed download is read back when the
+ *  first write arrives.
+ *
+ * @param[in]   ctx             - pointer to OTA agent context @ref cy_ota_context_t
+ * @param[in]   resume_offset   - OTA Image [0, resume_offset) is already in storage
+ */
+void cy_ota_digest_start(cy_ota_context_t *ctx, uint32_t resume_offset);
+
+/**
+ * @brief Finish the OTA Image digest
+ *
+ * Sets ota_storage_context image_digest_flags, image_sha256 and image_crc32
+ *  if the whole OTA Image was hashed. Call after the last write is flushed.
+ *
+ * @param[in]   ctx     - pointer to OTA agent context @ref cy_ota_context_t
+ */
+void cy_ota_digest_finish(cy_ota_context_t *ctx);
+#endif
+
+/**
+ * @brief Open storage for a new download
+ *
+ * When the storage interface provides ota_file_open_no_erase() and ota_file_erase(),
+ *  storage is opened without erasing it, and cy_ota_storage_write() erases ahead of
+ *  the data written. Otherwise ota_file_open() erases the slot.
+ *
+ * @param[in]   ctx     - pointer to OTA agent context @ref cy_ota_context_t
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          Error from ota_file_open() or ota_file_open_no_erase()
+ */
+cy_rslt_t cy_ota_storage_open(cy_ota_context_t *ctx);
+
+/**
+ * @brief Write a chunk to storage
+ *
+ * A compressed OTA Image is decoded first (CY_OTA_DECOMPRESS), then a patch is
+ *  applied (CY_OTA_DELTA_UPDATE).
+ * With CY_OTA_STORAGE_COALESCE_SIZE > 0 and the buffer started, contiguous data is
+ *  collected and passed to ota_file_write() in page aligned writes. Otherwise the
+ *  chunk is passed straight to ota_file_write(). With erase-ahead, storage is erased
+ *  before it is written.
+ *
+ * @param[in]   ctx         - pointer to OTA agent context @ref cy_ota_context_t
+ * @param[in]   chunk_info  - chunk to write @ref cy_ota_storage_write_info_t
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          Error from ota_file_write()
+ */
+cy_rslt_t cy_ota_storage_write(cy_ota_context_t *ctx, cy_ota_storage_write_info_t *chunk_info);
+
+/**
+ * @brief Write decompressed data
+ *
+ * cy_ota_storage_write() after decompression: a patch is applied (CY_OTA_DELTA_UPDATE),
+ *  other data is passed to cy_ota_storage_write_image().
+ *
+ * @param[in]   ctx         - pointer to OTA agent context @ref cy_ota_context_t
+ * @param[in]   chunk_info  - decompressed data @ref cy_ota_storage_write_info_t
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          Error from cy_ota_delta_write() or cy_ota_storage_write_image()
+ */
+cy_rslt_t cy_ota_storage_write_decoded(cy_ota_context_t *ctx, cy_ota_storage_write_info_t *chunk_info);
+
+/**
+ * @brief Write OTA Image data to storage
+ *
+ * cy_ota_storage_write() after decompression and patching: a TAR archive is
+ *  split into its images (CY_OTA_TAR_PARSER), other data is passed to
+ *  cy_ota_storage_write_slot().
+ *
+ * @param[in]   ctx         - pointer to OTA agent context @ref cy_ota_context_t
+ * @param[in]   chunk_info  - OTA Image data to write @ref cy_ota_storage_write_info_t
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          Error from cy_ota_tar_write() or cy_ota_storage_write_slot()
+ */
+cy_rslt_t cy_ota_storage_write_image(cy_ota_context_t *ctx, cy_ota_storage_write_info_t *chunk_info);
+
+/**
+ * @brief Write data to the slot of ota_storage_context imgID
+ *
+ * Coalescing, erase-ahead, ota_file_write() and the OTA Image digest.
+ *
+ * @param[in]   ctx         - pointer to OTA agent context @ref cy_ota_context_t
+ * @param[in]   chunk_info  - data to write, offset from the start of the slot @ref cy_ota_storage_write_info_t
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          Error from ota_file_write()
+ */
+cy_rslt_t cy_ota_storage_write_slot(cy_ota_context_t *ctx, cy_ota_storage_write_info_t *chunk_info);
+
+#if (CY_OTA_DECOMPRESS != CY_OTA_DECOMPRESS_NONE)
+/**
+ * @brief Reset decompression for a new download
+ *
+ * @param[in]   ctx             - pointer to OTA agent context @ref cy_ota_context_t
+ * @param[in]   resume_offset   - bytes already in storage, > 0 means not compressed
+ */
+void cy_ota_decompress_start(cy_ota_context_t *ctx, uint32_t resume_offset);
+
+/**
+ * @brief Decode a chunk of a compressed OTA Image
+ *
+ * The first 4 bytes of the OTA Image decide if it is compressed. They are held
+ *  until all 4 have arrived, data past them before that is an error. An
+ *  uncompressed OTA Image is passed to cy_ota_storage_write_decoded() as is.
+ *
+ * @param[in]   ctx         - pointer to OTA agent context @ref cy_ota_context_t
+ * @param[in]   chunk_info  - received data @ref cy_ota_storage_write_info_t
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          CY_RSLT_OTA_ERROR_WRITE_STORAGE - data out of order, or before the format is known
+ *          CY_RSLT_OTA_ERROR_UNSUPPORTED   - unsupported compressed OTA Image
+ *          CY_RSLT_OTA_ERROR_GENERAL       - corrupt compressed data
+ *          Error from cy_ota_storage_write_decoded()
+ */
+cy_rslt_t cy_ota_decompress_write(cy_ota_context_t *ctx, cy_ota_storage_write_info_t *chunk_info);
+
+/**
+ * @brief Write the last decoded data and check the whole OTA Image was decoded
+ *
+ * On success, ota_storage_context total_image_size is set to the uncompressed size.
+ *
+ * @param[in]   ctx     - pointer to OTA agent context @ref cy_ota_context_t
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          CY_RSLT_OTA_ERROR_GENERAL - OTA Image not complete
+ *          Error from cy_ota_decompress_write()
+ */
+cy_rslt_t cy_ota_decompress_finish(cy_ota_context_t *ctx);
+#endif
+
+#if (CY_OTA_DELTA_UPDATE == 1)
+/**
+ * @brief Reset patch application for a new download
+ *
+ * @param[in]   ctx             - pointer to OTA agent context @ref cy_ota_context_t
+ * @param[in]   resume_offset   - bytes already in storage, > 0 means not a patch
+ */
+void cy_ota_delta_start(cy_ota_context_t *ctx, uint32_t resume_offset);
+
+/**
+ * @brief Apply a chunk of a delta OTA Image (patch)
+ *
+ * The first 4 bytes of the OTA Image decide if it is a patch. They are held
+ *  until all 4 have arrived, data past them before that is an error. A full
+ *  OTA Image is passed to cy_ota_storage_write_image() as is.
+ *
+ * @param[in]   ctx         - pointer to OTA agent context @ref cy_ota_context_t
+ * @param[in]   chunk_info  - patch data @ref cy_ota_storage_write_info_t
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          CY_RSLT_OTA_ERROR_WRITE_STORAGE   - data out of order, or before the format is known
+ *          CY_RSLT_OTA_ERROR_UNSUPPORTED     - no ota_file_read_source(), or unsupported patch
+ *          CY_RSLT_OTA_ERROR_INVALID_VERSION - patch is not for the running application
+ *          CY_RSLT_OTA_ERROR_READ_STORAGE    - error from ota_file_read_source()
+ *          CY_RSLT_OTA_ERROR_GENERAL         - corrupt patch
+ *          Error from cy_ota_storage_write_image()
+ */
+cy_rslt_t cy_ota_delta_write(cy_ota_context_t *ctx, cy_ota_storage_write_info_t *chunk_info);
+
+/**
+ * @brief Write the last output and check the whole patch was applied
+ *
+ * On success, ota_storage_context total_image_size is set to the new OTA Image size.
+ *
+ * @param[in]   ctx     - pointer to OTA agent context @ref cy_ota_context_t
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          CY_RSLT_OTA_ERROR_GENERAL - OTA Image not complete
+ *          Error from cy_ota_delta_write()
+ */
+cy_rslt_t cy_ota_delta_finish(cy_ota_context_t *ctx);
+#endif
+
+#if (CY_OTA_TAR_PARSER == 1)
+/**
+ * @brief Reset TAR archive parsing for a new download
+ *
+ * @param[in]   ctx             - pointer to OTA agent context @ref cy_ota_context_t
+ * @param[in]   resume_offset   - bytes already in storage, > 0 means not a TAR archive
+ */
+void cy_ota_tar_start(cy_ota_context_t *ctx, uint32_t resume_offset);
+
+/**
+ * @brief Parse a chunk of a TAR archive
+ *
+ * The first block decides if the OTA Image is a TAR archive. Other OTA Images are
+ *  passed to cy_ota_storage_write_slot() as is. Member data is written to the slot
+ *  of the member's imgID.
+ *
+ * @param[in]   ctx         - pointer to OTA agent context @ref cy_ota_context_t
+ * @param[in]   chunk_info  - OTA Image data @ref cy_ota_storage_write_info_t
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          CY_RSLT_OTA_ERROR_WRITE_STORAGE - data too far ahead for the reorder buffer
+ *          CY_RSLT_OTA_ERROR_UNSUPPORTED   - member not assigned to an image
+ *          CY_RSLT_OTA_ERROR_VERIFY        - ota_file_verify() failed for a completed member
+ *          CY_RSLT_OTA_ERROR_GENERAL       - corrupt archive
+ *          Error from cy_ota_storage_write_slot()
+ */
+cy_rslt_t cy_ota_tar_write(cy_ota_context_t *ctx, cy_ota_storage_write_info_t *chunk_info);
+
+/**
+ * @brief Write any data still held and check the whole archive was parsed
+ *
+ * @param[in]   ctx     - pointer to OTA agent context @ref cy_ota_context_t
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          CY_RSLT_OTA_ERROR_GENERAL - archive not complete
+ *          Error from cy_ota_tar_write()
+ */
+cy_rslt_t cy_ota_tar_finish(cy_ota_context_t *ctx);
+
+/**
+ * @brief Check if an image was verified when its TAR archive member completed
+ *
+ * @param[in]   ctx     - pointer to OTA agent context @ref cy_ota_context_t
+ * @param[in]   imgID   - image to check
+ *
+ * @return  true = ota_file_verify() already succeeded for this image
+ */
+bool cy_ota_tar_verified(const cy_ota_context_t *ctx, uint8_t imgID);
+#endif
+
+#if (CY_OTA_STORAGE_COALESCE_SIZE > 0)
+/**
+ * @brief Allocate the storage write coalescing buffer
+ *
+ * Without the buffer, cy_ota_storage_write() writes each chunk directly.
+ *
+ * @param[in]   ctx     - pointer to OTA agent context @ref cy_ota_context_t
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          CY_RSLT_OTA_ERROR_OUT_OF_MEMORY
+ */
+cy_rslt_t cy_ota_coalesce_start(cy_ota_context_t *ctx);
+
+/**
+ * @brief Write the data held in the coalescing buffer
+ *
+ * @param[in]   ctx     - pointer to OTA agent context @ref cy_ota_context_t
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          Error from ota_file_write()
+ */
+cy_rslt_t cy_ota_coalesce_flush(cy_ota_context_t *ctx);
+
+/**
+ * @brief Write the data held in the coalescing buffer and free it
+ *
+ * @param[in]   ctx     - pointer to OTA agent context @ref cy_ota_context_t
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          Error from ota_file_write()
+ */
+cy_rslt_t cy_ota_coalesce_stop(cy_ota_context_t *ctx);
+#endif
+
 #ifdef __cplusplus
     }
 #endif
@@ -39,6 +39,7 @@
 #include <stdlib.h>
 #include <ctype.h>
 #include <string.h>
+#include <stdatomic.h>
 
 #include "cy_ota_api.h"
 
@@ -158,33 +159,6 @@
  *
  **********************************************************************/
 
-/**
- * @brief MQTT Payload type
- */
-typedef enum {
-    CY_OTA_MQTT_HEADER_TYPE_ONE_FILE = 0    /**< OTA Image with single file (main application)  */
-} cy_ota_mqtt_header_ota_type_t;
-
-/**
- * @brief MQTT Payload header (not the MQTT header, this is our data header)
- */
-#pragma pack(push,1)
-typedef struct cy_ota_mqtt_chunk_payload_header_s {
-    const uint8_t   magic[sizeof(CY_OTA_MQTT_MAGIC) - 1];       /**< "OTAImage" @ref CY_OTA_MQTT_MAGIC                  */
-    const uint16_t  offset_to_data;                             /**< offset within this payload to start of data        */
-    const uint16_t  ota_image_type;                             /**< 0 = single application OTA Image  @ref cy_ota_mqtt_header_ota_type_t */
-    const uint16_t  update_version_major;                       /**< OTAImage Major version number                      */
-    const uint16_t  update_version_minor;                       /**< OTAImage minor version number                      */
-    const uint16_t  update_version_build;                       /**< OTAImage build version number                      */
-    const uint32_t  total_size;                                 /* total size of OTA Image (all chunk data concatenated)*/
-    const uint32_t  image_offset;                               /* offset within the final OTA Image of THIS chunk data */
-    const uint16_t  data_size;                                  /* Size of chunk data in THIS payload                   */
-    const uint16_t  total_num_payloads;                         /* Total number of payloads                             */
-    const uint16_t  this_payload_index;                         /* THIS payload index                                   */
-} cy_ota_mqtt_chunk_payload_header_t;
-#pragma pack(pop)
-
-
 /***********************************************************************
  *
  * Variables
@@ -278,7 +252,7 @@ static cy_rslt_t cy_ota_mqtt_create_json_request(cy_ota_context_t *ctx,
     cy_rslt_t   result = CY_RSLT_SUCCESS;
     uint32_t    needed_size;
 
-    (void)memset(ctx->mqtt.json_doc, 0x00, sizeof(ctx->mqtt.json_doc) );
+    (void)memset(ctx->json_doc, 0x00, sizeof(ctx->json_doc) );
 
     (void)filename;        /* Coverity fix */
     (void)offset;          /* Coverity fix */
@@ -287,28 +261,29 @@ static cy_rslt_t cy_ota_mqtt_create_json_request(cy_ota_context_t *ctx,
 #ifdef CY_MQTT_GET_ALL_DATA_WITH_ONE_CALL
     /* Current default. Send one request for the entire file,
      * Publisher.py will chunk and send separate chunks.
+     * When resuming, message_doc is CY_OTA_DOWNLOAD_RESUME_REQUEST and includes the offset.
      */
-    needed_size = snprintf(NULL, 0, message_doc, APP_VERSION_MAJOR, APP_VERSION_MINOR, APP_VERSION_BUILD, ctx->mqtt.unique_topic);
-    if(needed_size > (sizeof(ctx->mqtt.json_doc)-1) )
+    needed_size = snprintf(NULL, 0, message_doc, APP_VERSION_MAJOR, APP_VERSION_MINOR, APP_VERSION_BUILD, ctx->mqtt.unique_topic, offset);
+    if(needed_size > (sizeof(ctx->json_doc)-1) )
     {
         cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Need to increase size of job_doc from CY_OTA_JSON_DOC_BUFF_SIZE (%ld) to at least (%ld)\n", __func__, CY_OTA_JSON_DOC_BUFF_SIZE, needed_size);
         return CY_RSLT_OTA_ERROR_OUT_OF_MEMORY;
     }
-    sprintf(ctx->mqtt.json_doc, message_doc, APP_VERSION_MAJOR, APP_VERSION_MINOR, APP_VERSION_BUILD, ctx->mqtt.unique_topic);
+    sprintf(ctx->json_doc, message_doc, APP_VERSION_MAJOR, APP_VERSION_MINOR, APP_VERSION_BUILD, ctx->mqtt.unique_topic, offset);
 #else
     /* This code is for requesting each chunk separately. */
     needed_size = snprintf(NULL, 0, message_doc, APP_VERSION_MAJOR, APP_VERSION_MINOR, APP_VERSION_BUILD, ctx->mqtt.unique_topic,
             filename, offset, size);
-    if(needed_size > (sizeof(ctx->mqtt.json_doc)-1) )
+    if(needed_size > (sizeof(ctx->json_doc)-1) )
     {
         cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Need to increase size of job_doc from CY_OTA_JSON_DOC_BUFF_SIZE (%ld) to at least (%ld)\n", __func__, CY_OTA_JSON_DOC_BUFF_SIZE, needed_size);
         return CY_RSLT_OTA_ERROR_OUT_OF_MEMORY;
     }
-    sprintf(ctx->mqtt.json_doc, message_doc, APP_VERSION_MAJOR, APP_VERSION_MINOR, APP_VERSION_BUILD, ctx->mqtt.unique_topic,
+    sprintf(ctx->json_doc, message_doc, APP_VERSION_MAJOR, APP_VERSION_MINOR, APP_VERSION_BUILD, ctx->mqtt.unique_topic,
             filename, offset, size);
 #endif
 
-    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG2, "%s() Messg: %s\n", __func__, ctx->mqtt.json_doc);
+    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG2, "%s() Messg: %s\n", __func__, ctx->json_doc);
 
     return result;
 }
@@ -348,6 +323,366 @@ static cy_rslt_t cy_ota_mqtt_publish_request(cy_ota_context_t *ctx, char *mqtt_t
     return CY_RSLT_SUCCESS;
 }
 
+/**
+ * @brief Allocate the received packet bit set
+ *
+ * Sized from the total number of packets in the first chunk header.
+ * Does nothing if the bit set is already allocated.
+ *
+ * @param[in]   ctx         - ptr to OTA context
+ * @param[in]   num_packets - total number of packets in the OTA Image
+ *
+ * @return      CY_RSLT_SUCCESS
+ *              CY_RSLT_OTA_ERROR_OUT_OF_MEMORY
+ */
+static cy_rslt_t cy_ota_mqtt_packet_map_alloc(cy_ota_context_t *ctx, uint16_t num_packets)
+{
+    uint32_t    size;
+
+    if(ctx->mqtt.received_packets != NULL)
+    {
+        return CY_RSLT_SUCCESS;
+    }
+
+    size = ((num_packets + 31) / 32) * sizeof(uint32_t);
+    ctx->mqtt.received_packets = (uint32_t *)cy_ota_mem_alloc(ctx, CY_OTA_MEM_MQTT_PACKET_MAP, size);
+    if(ctx->mqtt.received_packets == NULL)
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() allocation of %ld bytes for %d packets failed\n", __func__, size, num_packets);
+        return CY_RSLT_OTA_ERROR_OUT_OF_MEMORY;
+    }
+    memset(ctx->mqtt.received_packets, 0x00, size);
+    ctx->mqtt.num_packets       = num_packets;
+    ctx->mqtt.duplicate_packets = 0;
+
+    return CY_RSLT_SUCCESS;
+}
+
+/**
+ * @brief Free the received packet bit set
+ *
+ * @param[in]   ctx - ptr to OTA context
+ */
+static void cy_ota_mqtt_packet_map_free(cy_ota_context_t *ctx)
+{
+    if(ctx->mqtt.received_packets != NULL)
+    {
+        cy_ota_mem_free(ctx, ctx->mqtt.received_packets);
+    }
+    ctx->mqtt.received_packets  = NULL;
+    ctx->mqtt.num_packets       = 0;
+}
+
+/**
+ * @brief Check if a packet has been received
+ *
+ * @param[in]   ctx     - ptr to OTA context
+ * @param[in]   packet  - packet index
+ *
+ * @return      true if the packet has been received
+ */
+static bool cy_ota_mqtt_packet_map_test(const cy_ota_context_t *ctx, uint32_t packet)
+{
+    if( (ctx->mqtt.received_packets == NULL) || (packet >= ctx->mqtt.num_packets) )
+    {
+        return false;
+    }
+    return ( (ctx->mqtt.received_packets[packet / 32] & (1UL << (packet % 32))) != 0 );
+}
+
+/**
+ * @brief Find the first packet at or after start that has (or has not) been received
+ *
+ * Whole words with no match are skipped.
+ *
+ * @param[in]   ctx         - ptr to OTA context
+ * @param[in]   start       - first packet index to check
+ * @param[in]   received    - true to find a received packet, false to find a missing one
+ *
+ * @return      packet index, ctx->mqtt.num_packets if there is none
+ */
+static uint32_t cy_ota_mqtt_packet_map_find(const cy_ota_context_t *ctx, uint32_t start, bool received)
+{
+    uint32_t    no_match = (received == true) ? 0UL : 0xFFFFFFFFUL;
+    uint32_t    packet = start;
+
+    if(ctx->mqtt.received_packets == NULL)
+    {
+        return 0;
+    }
+
+    while(packet < ctx->mqtt.num_packets)
+    {
+        if( ((packet % 32) == 0) && (ctx->mqtt.received_packets[packet / 32] == no_match) )
+        {
+            packet += 32;
+            continue;
+        }
+        if(cy_ota_mqtt_packet_map_test(ctx, packet) == received)
+        {
+            return packet;
+        }
+        packet++;
+    }
+    return ctx->mqtt.num_packets;
+}
+
+#ifndef CY_MQTT_GET_ALL_DATA_WITH_ONE_CALL
+/**
+ * @brief Publish chunk requests until CY_OTA_MQTT_CHUNK_WINDOW requests are outstanding
+ *
+ * Chunks are requested in order, so a request is outstanding until the bytes it asked
+ *  for have been written. Duplicate packets are not counted as written.
+ * Nothing is requested until the first chunk has told us the size of the OTA Image.
+ *
+ * @param[in]   ctx - ptr to OTA context
+ *
+ * @return      CY_RSLT_SUCCESS
+ *              CY_RSLT_OTA_ERROR_MQTT_PUBLISH
+ */
+static cy_rslt_t cy_ota_mqtt_fill_chunk_window(cy_ota_context_t *ctx)
+{
+    cy_rslt_t   result;
+    uint32_t    total_size = ctx->ota_storage_context.total_image_size;
+    uint32_t    outstanding;
+    uint32_t    chunk_size;
+
+    while(ctx->mqtt.next_request_offset < total_size)
+    {
+        outstanding = 0;
+        if(ctx->mqtt.next_request_offset > ctx->received_bytes)
+        {
+            outstanding = (ctx->mqtt.next_request_offset - ctx->received_bytes + (CY_OTA_CHUNK_SIZE - 1)) / CY_OTA_CHUNK_SIZE;
+        }
+        if(outstanding >= CY_OTA_MQTT_CHUNK_WINDOW)
+        {
+            break;
+        }
+
+        chunk_size = CY_OTA_CHUNK_SIZE;
+        if(chunk_size > (total_size - ctx->mqtt.next_request_offset) )
+        {
+            chunk_size = total_size - ctx->mqtt.next_request_offset;
+        }
+
+        result = cy_ota_mqtt_create_json_request(ctx, CY_OTA_DOWNLOAD_CHUNK_REQUEST,
+                                                 ctx->parsed_job.file, ctx->mqtt.next_request_offset, chunk_size);
+        if(result != CY_RSLT_SUCCESS)
+        {
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() cy_ota_mqtt_create_json_request() for Data failed\n", __func__);
+            return CY_RSLT_OTA_ERROR_MQTT_PUBLISH;
+        }
+
+        result = cy_ota_mqtt_publish_request(ctx, (char *)SUBSCRIBER_PUBLISH_TOPIC, ctx->json_doc);
+        if(result != CY_RSLT_SUCCESS)
+        {
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() cy_ota_mqtt_publish_request() for Data failed\n", __func__);
+            return result;
+        }
+
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG2, "%s() Requested offset:%ld size:%ld outstanding:%ld\n", __func__,
+                       ctx->mqtt.next_request_offset, chunk_size, outstanding + 1);
+        ctx->mqtt.next_request_offset += chunk_size;
+    }
+
+    return CY_RSLT_SUCCESS;
+}
+#endif
+
+/**
+ * @brief Get the packets that can be missing
+ *
+ * @param[in]   ctx     - ptr to OTA context
+ * @param[out]  first   - first packet of the download
+ * @param[out]  end     - packet after the last one requested
+ */
+static void cy_ota_mqtt_repair_range(const cy_ota_context_t *ctx, uint32_t *first, uint32_t *end)
+{
+    /* A resumed download starts at the packet holding resume_offset */
+    *first = ctx->resume_offset / CY_OTA_CHUNK_SIZE;
+    *end = ctx->mqtt.num_packets;
+#ifndef CY_MQTT_GET_ALL_DATA_WITH_ONE_CALL
+    /* Only the chunks we have requested can be missing */
+    if(*end > (*first + ((ctx->mqtt.next_request_offset - ctx->resume_offset + (CY_OTA_CHUNK_SIZE - 1)) / CY_OTA_CHUNK_SIZE)) )
+    {
+        *end = *first + ((ctx->mqtt.next_request_offset - ctx->resume_offset + (CY_OTA_CHUNK_SIZE - 1)) / CY_OTA_CHUNK_SIZE);
+    }
+#endif
+}
+
+/**
+ * @brief Count the missing packets
+ *
+ * @param[in]   ctx - ptr to OTA context
+ *
+ * @return      number of missing packets
+ */
+static uint32_t cy_ota_mqtt_repair_count_missing(const cy_ota_context_t *ctx)
+{
+    uint32_t    missing = 0;
+    uint32_t    run_start;
+    uint32_t    end;
+    uint32_t    i;
+
+    cy_ota_mqtt_repair_range(ctx, &i, &end);
+    while(i < end)
+    {
+        run_start = cy_ota_mqtt_packet_map_find(ctx, i, false);
+        if(run_start >= end)
+        {
+            break;
+        }
+        i = cy_ota_mqtt_packet_map_find(ctx, run_start, true);
+        if(i > end)
+        {
+            i = end;
+        }
+        missing += i - run_start;
+    }
+    return missing;
+}
+
+/**
+ * @brief Ask the Publisher to resend the packets we are missing
+ *
+ * The missing payload indices are sent as a list of runs, ex: "3,7-9".
+ * Runs that do not fit in CY_OTA_MQTT_REPAIR_LIST_SIZE are requested in a later repair.
+ *
+ * @param[in]   ctx - ptr to OTA context
+ *
+ * @return      CY_RSLT_SUCCESS
+ *              CY_RSLT_OTA_ERROR_GET_DATA      - no missing packets known
+ *              CY_RSLT_OTA_ERROR_OUT_OF_MEMORY
+ *              CY_RSLT_OTA_ERROR_MQTT_PUBLISH
+ */
+static cy_rslt_t cy_ota_mqtt_request_repair(cy_ota_context_t *ctx)
+{
+    char        *list = ctx->mqtt.repair_list;
+    uint32_t    len = 0;
+    uint32_t    needed_size;
+    uint32_t    num_packets;
+    uint32_t    run_start;
+    uint32_t    i;
+    int         written;
+
+    cy_ota_mqtt_repair_range(ctx, &i, &num_packets);
+
+    list[0] = 0;
+    while(i < num_packets)
+    {
+        run_start = cy_ota_mqtt_packet_map_find(ctx, i, false);
+        if(run_start >= num_packets)
+        {
+            break;
+        }
+        i = cy_ota_mqtt_packet_map_find(ctx, run_start, true);
+        if(i > num_packets)
+        {
+            i = num_packets;
+        }
+
+        if(run_start == (i - 1) )
+        {
+            written = snprintf(&list[len], sizeof(ctx->mqtt.repair_list) - len, "%s%ld", (len > 0) ? "," : "", run_start);
+        }
+        else
+        {
+            written = snprintf(&list[len], sizeof(ctx->mqtt.repair_list) - len, "%s%ld-%ld", (len > 0) ? "," : "", run_start, (i - 1));
+        }
+        if( (written < 0) || ((uint32_t)written >= (sizeof(ctx->mqtt.repair_list) - len)) )
+        {
+            /* list is full, ask for the rest next time */
+            list[len] = 0;
+            i = run_start;
+            break;
+        }
+        len += (uint32_t)written;
+    }
+    ctx->mqtt.repair_list_end = i;
+
+    if(len == 0)
+    {
+        return CY_RSLT_OTA_ERROR_GET_DATA;
+    }
+
+    needed_size = snprintf(NULL, 0, CY_OTA_DOWNLOAD_REPAIR_REQUEST, APP_VERSION_MAJOR, APP_VERSION_MINOR, APP_VERSION_BUILD,
+                           ctx->mqtt.unique_topic, ctx->resume_offset, list);
+    if(needed_size > (sizeof(ctx->json_doc)-1) )
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Need to increase size of job_doc from CY_OTA_JSON_DOC_BUFF_SIZE (%ld) to at least (%ld)\n", __func__, CY_OTA_JSON_DOC_BUFF_SIZE, needed_size);
+        return CY_RSLT_OTA_ERROR_OUT_OF_MEMORY;
+    }
+    (void)memset(ctx->json_doc, 0x00, sizeof(ctx->json_doc) );
+    sprintf(ctx->json_doc, CY_OTA_DOWNLOAD_REPAIR_REQUEST, APP_VERSION_MAJOR, APP_VERSION_MINOR, APP_VERSION_BUILD,
+            ctx->mqtt.unique_topic, ctx->resume_offset, list);
+
+    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_NOTICE, "MQTT: Request repair %d of %d, packets: %s\n", ctx->mqtt.repair_tries, CY_OTA_MQTT_REPAIR_TRIES, list);
+
+    return cy_ota_mqtt_publish_request(ctx, (char *)SUBSCRIBER_PUBLISH_TOPIC, ctx->json_doc);
+}
+
+/**
+ * @brief Seconds to wait for the next packet
+ *
+ * @param[in]   ctx - ptr to OTA context
+ *
+ * @return      packet timeout, shorter while repairing
+ */
+static uint32_t cy_ota_mqtt_packet_timeout_secs(const cy_ota_context_t *ctx)
+{
+    if( (ctx->mqtt.repair_active == true) && (ctx->packet_timeout_sec > CY_OTA_MQTT_REPAIR_TIMEOUT_SECS) )
+    {
+        return CY_OTA_MQTT_REPAIR_TIMEOUT_SECS;
+    }
+    return ctx->packet_timeout_sec;
+}
+
+/**
+ * @brief Send the next repair request
+ *
+ * A repair that got some of the missing packets does not count against CY_OTA_MQTT_REPAIR_TRIES.
+ *
+ * @param[in]   ctx - ptr to OTA context
+ *
+ * @return      CY_RSLT_SUCCESS
+ *              CY_RSLT_OTA_ERROR_GET_DATA      - no missing packets known, or out of tries
+ *              CY_RSLT_OTA_ERROR_OUT_OF_MEMORY
+ *              CY_RSLT_OTA_ERROR_MQTT_PUBLISH
+ */
+static cy_rslt_t cy_ota_mqtt_next_repair(cy_ota_context_t *ctx)
+{
+    cy_rslt_t   result;
+    uint32_t    missing;
+
+    missing = cy_ota_mqtt_repair_count_missing(ctx);
+    if(missing == 0)
+    {
+        return CY_RSLT_OTA_ERROR_GET_DATA;
+    }
+    if( (ctx->mqtt.repair_active == true) && (missing < ctx->mqtt.repair_missing) )
+    {
+        /* The last repair got packets, keep going */
+        ctx->mqtt.repair_tries = 0;
+    }
+    if(ctx->mqtt.repair_tries >= CY_OTA_MQTT_REPAIR_TRIES)
+    {
+        return CY_RSLT_OTA_ERROR_GET_DATA;
+    }
+
+    ctx->mqtt.repair_tries++;
+    ctx->mqtt.repair_missing = missing;
+    result = cy_ota_mqtt_request_repair(ctx);
+    if(result == CY_RSLT_SUCCESS)
+    {
+        ctx->mqtt.repair_active = true;
+        if(ctx->packet_timeout_sec > 0)
+        {
+            cy_ota_start_mqtt_timer(ctx, cy_ota_mqtt_packet_timeout_secs(ctx), CY_OTA_EVENT_PACKET_TIMEOUT);
+        }
+    }
+    return result;
+}
+
 static cy_rslt_t cy_ota_subscribe_to_unique_topic(cy_ota_context_t *ctx)
 {
     char        *unique_topic[1];
@@ -456,6 +791,369 @@ static cy_rslt_t cy_ota_mqtt_parse_chunk(const uint8_t *buffer, uint32_t length,
     return CY_RSLT_SUCCESS;
 }
 
+/**
+ * @brief Allocate the received payload buffers
+ *
+ * @param[in]   ctx - ptr to OTA context
+ *
+ * @return      CY_RSLT_SUCCESS
+ *              CY_RSLT_OTA_ERROR_OUT_OF_MEMORY
+ */
+static cy_rslt_t cy_ota_mqtt_rx_ring_init(cy_ota_context_t *ctx)
+{
+    uint32_t    waitfor_clear;
+
+    atomic_init(&ctx->mqtt.rx_head, 0);
+    atomic_init(&ctx->mqtt.rx_tail, 0);
+
+    /* clear a free buffer signal left from the last download */
+    waitfor_clear = CY_OTA_EVENT_MQTT_RX_FREE;
+    (void)cy_rtos_waitbits_event(&ctx->ota_event, &waitfor_clear, 1, 0, 0);
+    ctx->mqtt.rx_dropped = 0;
+    ctx->mqtt.rx_buffers = (uint8_t *)cy_ota_mem_alloc(ctx, CY_OTA_MEM_MQTT_RX, CY_OTA_MQTT_RX_BUFFERS * CY_OTA_MQTT_RX_BUFFER_SIZE);
+    if(ctx->mqtt.rx_buffers == NULL)
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() allocation of %d receive buffers failed\n", __func__, CY_OTA_MQTT_RX_BUFFERS);
+        return CY_RSLT_OTA_ERROR_OUT_OF_MEMORY;
+    }
+    return CY_RSLT_SUCCESS;
+}
+
+/**
+ * @brief Free the received payload buffers
+ *
+ * @param[in]   ctx - ptr to OTA context
+ */
+static void cy_ota_mqtt_rx_ring_deinit(cy_ota_context_t *ctx)
+{
+    if(ctx->mqtt.rx_buffers != NULL)
+    {
+        cy_ota_mem_free(ctx, ctx->mqtt.rx_buffers);
+    }
+    ctx->mqtt.rx_buffers = NULL;
+    if(ctx->mqtt.rx_dropped > 0)
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "MQTT: %ld payloads dropped, increase CY_OTA_MQTT_RX_BUFFERS (%d)\n", ctx->mqtt.rx_dropped, CY_OTA_MQTT_RX_BUFFERS);
+    }
+}
+
+/**
+ * @brief Queue a received data payload for the OTA Agent thread
+ *
+ * Called from cy_ota_mqtt_callback() only (single producer). The MQTT library does
+ *  not keep the payload after the callback returns, so it is copied. When all buffers
+ *  are full, waits up to CY_OTA_MQTT_RX_WAIT_MS for the OTA Agent thread to free one.
+ *
+ * @param[in]   ctx         - ptr to OTA context
+ * @param[in]   payload     - received MQTT payload
+ * @param[in]   payload_len - length of the payload
+ *
+ * @return      CY_RSLT_SUCCESS
+ *              CY_RSLT_OTA_ERROR_GET_DATA      - payload larger than a buffer
+ */
+static cy_rslt_t cy_ota_mqtt_rx_ring_put(cy_ota_context_t *ctx, const void *payload, uint32_t payload_len)
+{
+    uint32_t    head = atomic_load_explicit(&ctx->mqtt.rx_head, memory_order_relaxed);
+    uint32_t    index;
+    uint32_t    waitfor;
+
+    if(ctx->mqtt.rx_buffers == NULL)
+    {
+        /* download is ending */
+        return CY_RSLT_SUCCESS;
+    }
+
+    if(payload_len > CY_OTA_MQTT_RX_BUFFER_SIZE)
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Payload %ld larger than CY_OTA_CHUNK_SIZE + header (%ld)\n", __func__, payload_len, CY_OTA_MQTT_RX_BUFFER_SIZE);
+        return CY_RSLT_OTA_ERROR_GET_DATA;
+    }
+
+    /* Hold off the Broker until the OTA Agent thread frees a buffer */
+    while( (head - atomic_load_explicit(&ctx->mqtt.rx_tail, memory_order_acquire)) >= CY_OTA_MQTT_RX_BUFFERS)
+    {
+        waitfor = CY_OTA_EVENT_MQTT_RX_FREE;
+        if( (cy_rtos_waitbits_event(&ctx->ota_event, &waitfor, 1, 0, CY_OTA_MQTT_RX_WAIT_MS) != CY_RSLT_SUCCESS) ||
+            ((waitfor & CY_OTA_EVENT_MQTT_RX_FREE) == 0) )
+        {
+            /* The repair phase asks for it again */
+            ctx->mqtt.rx_dropped++;
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Receive buffers full for %d ms, payload dropped\n", __func__, CY_OTA_MQTT_RX_WAIT_MS);
+            return CY_RSLT_SUCCESS;
+        }
+    }
+
+    index = head & (CY_OTA_MQTT_RX_BUFFERS - 1);
+    memcpy(&ctx->mqtt.rx_buffers[index * CY_OTA_MQTT_RX_BUFFER_SIZE], payload, payload_len);
+    ctx->mqtt.rx_len[index] = payload_len;
+
+    /* Payload must be visible before the consumer sees the new head */
+    atomic_store_explicit(&ctx->mqtt.rx_head, head + 1, memory_order_release);
+
+    return CY_RSLT_SUCCESS;
+}
+
+/**
+ * @brief Store OTA data and track it for the download checkpoint
+ *
+ * @param[in]   ctx         - ptr to OTA context
+ * @param[in]   chunk_info  - ptr to a chunk_info structure
+ *
+ * @return      CY_RSLT_SUCCESS
+ *              CY_RSLT_OTA_ERROR_WRITE_STORAGE
+ *              CY_RSLT_OTA_ERROR_APP_RETURNED_STOP
+ */
+static cy_rslt_t cy_ota_mqtt_store(cy_ota_context_t *ctx, cy_ota_storage_write_info_t *chunk_info)
+{
+    cy_rslt_t                 result;
+    cy_ota_callback_results_t cb_result;
+
+#if (CY_OTA_STORAGE_WRITER_BUFFERS > 0)
+    if(ctx->writer.running == true)
+    {
+        /* The writer thread stores the chunk while we receive the next one */
+        result = cy_ota_writer_submit(ctx, chunk_info);
+        if(result != CY_RSLT_SUCCESS)
+        {
+            return result;
+        }
+    }
+    else
+#endif
+    {
+        /* store the chunk */
+        ctx->storage = chunk_info;
+        cb_result = cy_ota_internal_call_cb(ctx, CY_OTA_REASON_STATE_CHANGE, CY_OTA_STATE_STORAGE_WRITE);
+        switch( cb_result )
+        {
+            default:
+                /* Fall through */
+            case CY_OTA_CB_RSLT_OTA_CONTINUE:
+                result = cy_ota_storage_write(ctx, chunk_info);
+                if(result != CY_RSLT_SUCCESS)
+                {
+                    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Write failed\n", __func__);
+                    cy_rtos_setbits_event(&ctx->ota_event, (uint32_t)CY_OTA_EVENT_DATA_FAIL, 0);
+                    return result;
+                }
+                break;
+            case CY_OTA_CB_RSLT_OTA_STOP:
+                cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() App returned OTA Stop for STATE_CHANGE for OTA platform storage block write API\n", __func__);
+                return CY_RSLT_OTA_ERROR_APP_RETURNED_STOP;
+            case CY_OTA_CB_RSLT_APP_SUCCESS:
+                cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_NOTICE, "%s() App returned APP_SUCCESS for STATE_CHANGE for OTA platform storage block write API\n", __func__);
+                break;
+            case CY_OTA_CB_RSLT_APP_FAILED:
+                cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() App returned APP_FAILED for STATE_CHANGE for OTA platform storage block write API\n", __func__);
+                return CY_RSLT_OTA_ERROR_WRITE_STORAGE;
+            case CY_OTA_CB_NUM_RESULTS:
+                return CY_RSLT_OTA_ERROR_WRITE_STORAGE;
+        }
+        cy_ota_storage_written(ctx, chunk_info);
+    }
+
+    /* Track the received ranges, the written ones are tracked once in storage */
+    (void)cy_ota_range_map_add(&ctx->received_ranges, chunk_info->offset, chunk_info->size);
+
+    return CY_RSLT_SUCCESS;
+}
+
+#if (CY_OTA_MQTT_REASSEMBLY_SIZE > 0)
+/**
+ * @brief Allocate the reassembly buffer
+ *
+ * The buffer starts at the first byte of the OTA Image not yet written.
+ * Without the buffer, chunks are written directly.
+ *
+ * @param[in]   ctx - ptr to OTA context
+ */
+static void cy_ota_mqtt_reasm_init(cy_ota_context_t *ctx)
+{
+    cy_ota_range_map_clear(&ctx->mqtt.reasm_ranges);
+    ctx->mqtt.reasm_start  = cy_ota_range_map_next_hole(&ctx->received_ranges, 0, NULL);
+    ctx->mqtt.reasm_buffer = (uint8_t *)cy_ota_mem_alloc(ctx, CY_OTA_MEM_MQTT_REASSEMBLY, CY_OTA_MQTT_REASSEMBLY_SIZE);
+    if(ctx->mqtt.reasm_buffer == NULL)
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_WARNING, "%s() allocation of %d bytes failed, write chunks directly\n", __func__, CY_OTA_MQTT_REASSEMBLY_SIZE);
+    }
+}
+
+/**
+ * @brief Free the reassembly buffer
+ *
+ * @param[in]   ctx - ptr to OTA context
+ */
+static void cy_ota_mqtt_reasm_deinit(cy_ota_context_t *ctx)
+{
+    if(ctx->mqtt.reasm_buffer != NULL)
+    {
+        cy_ota_mem_free(ctx, ctx->mqtt.reasm_buffer);
+    }
+    ctx->mqtt.reasm_buffer = NULL;
+    cy_ota_range_map_clear(&ctx->mqtt.reasm_ranges);
+}
+
+/**
+ * @brief Store part of the reassembly buffer
+ *
+ * @param[in]   ctx     - ptr to OTA context
+ * @param[in]   offset  - offset in the OTA Image
+ * @param[in]   size    - number of bytes
+ *
+ * @return      result from cy_ota_mqtt_store()
+ */
+static cy_rslt_t cy_ota_mqtt_reasm_write(cy_ota_context_t *ctx, uint32_t offset, uint32_t size)
+{
+    cy_ota_storage_write_info_t info = ctx->mqtt.chunk_info;
+
+    info.offset = offset;
+    info.size   = size;
+    info.buffer = &ctx->mqtt.reasm_buffer[offset - ctx->mqtt.reasm_start];
+
+    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG2, "%s() offset:%ld size:%ld\n", __func__, offset, size);
+    return cy_ota_mqtt_store(ctx, &info);
+}
+
+/**
+ * @brief Move the start of the reassembly buffer forward
+ *
+ * @param[in]   ctx         - ptr to OTA context
+ * @param[in]   new_start   - new OTA Image offset of the start of the buffer
+ */
+static void cy_ota_mqtt_reasm_slide(cy_ota_context_t *ctx, uint32_t new_start)
+{
+    cy_ota_range_map_t  *map = &ctx->mqtt.reasm_ranges;
+    uint32_t            delta = new_start - ctx->mqtt.reasm_start;
+    uint32_t            used = 0;
+    uint16_t            i;
+    uint16_t            j = 0;
+
+    if(map->num_ranges > 0)
+    {
+        used = map->range[map->num_ranges - 1].end - ctx->mqtt.reasm_start;
+    }
+    if(used > delta)
+    {
+        memmove(ctx->mqtt.reasm_buffer, &ctx->mqtt.reasm_buffer[delta], used - delta);
+    }
+    ctx->mqtt.reasm_start = new_start;
+
+    /* drop the ranges that are now before the buffer */
+    for(i = 0; i < map->num_ranges; i++)
+    {
+        if(map->range[i].end <= new_start)
+        {
+            continue;
+        }
+        map->range[j] = map->range[i];
+        if(map->range[j].start < new_start)
+        {
+            map->range[j].start = new_start;
+        }
+        j++;
+    }
+    map->num_ranges = j;
+}
+
+/**
+ * @brief Write the data at the start of the reassembly buffer
+ *
+ * Contiguous data from the start of the buffer is written up to the last complete
+ *  CY_OTA_STORAGE_PAGE_SIZE page. The partial page at the end is written when the
+ *  data is followed by the end of the OTA Image or by data already written directly.
+ *
+ * @param[in]   ctx - ptr to OTA context
+ * @param[in]   all - true to write everything in the buffer (end of download)
+ *
+ * @return      result from cy_ota_mqtt_store()
+ */
+static cy_rslt_t cy_ota_mqtt_reasm_flush(cy_ota_context_t *ctx, bool all)
+{
+    cy_ota_range_map_t  *map = &ctx->mqtt.reasm_ranges;
+    cy_rslt_t           result = CY_RSLT_SUCCESS;
+    uint32_t            emit_end;
+    uint32_t            next_start;
+    uint16_t            i;
+
+    if(ctx->mqtt.reasm_buffer == NULL)
+    {
+        return CY_RSLT_SUCCESS;
+    }
+
+    if(all == true)
+    {
+        for(i = 0; (i < map->num_ranges) && (result == CY_RSLT_SUCCESS); i++)
+        {
+            result = cy_ota_mqtt_reasm_write(ctx, map->range[i].start, map->range[i].end - map->range[i].start);
+        }
+        cy_ota_range_map_clear(map);
+        return result;
+    }
+
+    while( (map->num_ranges > 0) && (map->range[0].start == ctx->mqtt.reasm_start) )
+    {
+        emit_end   = map->range[0].end;
+        next_start = emit_end;
+
+        /* Data after this was written directly, nothing more will arrive for it */
+        for(i = 0; i < ctx->received_ranges.num_ranges; i++)
+        {
+            if( (ctx->received_ranges.range[i].start <= emit_end) && (ctx->received_ranges.range[i].end > emit_end) )
+            {
+                next_start = ctx->received_ranges.range[i].end;
+            }
+        }
+
+        if( (next_start == emit_end) && (emit_end < ctx->ota_storage_context.total_image_size) )
+        {
+            /* wait for the rest of the last page */
+            emit_end   = emit_end - (emit_end % CY_OTA_STORAGE_PAGE_SIZE);
+            next_start = emit_end;
+            if(emit_end <= ctx->mqtt.reasm_start)
+            {
+                break;
+            }
+        }
+
+        result = cy_ota_mqtt_reasm_write(ctx, ctx->mqtt.reasm_start, emit_end - ctx->mqtt.reasm_start);
+        if(result != CY_RSLT_SUCCESS)
+        {
+            break;
+        }
+        cy_ota_mqtt_reasm_slide(ctx, next_start);
+    }
+
+    return result;
+}
+
+/**
+ * @brief Add a chunk to the reassembly buffer
+ *
+ * A chunk that does not fit in the buffer is written directly.
+ *
+ * @param[in]   ctx         - ptr to OTA context
+ * @param[in]   chunk_info  - ptr to a chunk_info structure
+ *
+ * @return      result from cy_ota_mqtt_store()
+ */
+static cy_rslt_t cy_ota_mqtt_reasm_add(cy_ota_context_t *ctx, cy_ota_storage_write_info_t *chunk_info)
+{
+    if( (ctx->mqtt.reasm_buffer == NULL) ||
+        (chunk_info->offset < ctx->mqtt.reasm_start) ||
+        ((chunk_info->offset + chunk_info->size) > (ctx->mqtt.reasm_start + CY_OTA_MQTT_REASSEMBLY_SIZE)) ||
+        (cy_ota_range_map_add(&ctx->mqtt.reasm_ranges, chunk_info->offset, chunk_info->size) != CY_RSLT_SUCCESS) )
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG2, "%s() offset:%ld outside of buffer at %ld, write directly\n", __func__,
+                       chunk_info->offset, ctx->mqtt.reasm_start);
+        return cy_ota_mqtt_store(ctx, chunk_info);
+    }
+
+    memcpy(&ctx->mqtt.reasm_buffer[chunk_info->offset - ctx->mqtt.reasm_start], chunk_info->buffer, chunk_info->size);
+
+    return cy_ota_mqtt_reasm_flush(ctx, false);
+}
+#endif  /* CY_OTA_MQTT_REASSEMBLY_SIZE > 0 */
+
 /**
  * @brief Write a chunk of OTA data to FLASH
  *
@@ -469,7 +1167,6 @@ static cy_rslt_t cy_ota_mqtt_parse_chunk(const uint8_t *buffer, uint32_t length,
 static cy_rslt_t cy_ota_mqtt_write_chunk_to_flash(cy_ota_context_t *ctx, cy_ota_storage_write_info_t *chunk_info)
 {
     cy_rslt_t                 result;
-    cy_ota_callback_results_t cb_result;
 
     cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG2, "%s()\n", __func__);
 
@@ -481,76 +1178,182 @@ static cy_rslt_t cy_ota_mqtt_write_chunk_to_flash(cy_ota_context_t *ctx, cy_ota_
 
     ctx->ota_storage_context.num_packets_received++;    /* this is so we don't have a false failure with the per packet timer */
 
+    /* A resumed download must continue the same OTA Image */
+    if(cy_ota_checkpoint_check_image(ctx, chunk_info->total_size, NULL) != CY_RSLT_SUCCESS)
+    {
+        return CY_RSLT_OTA_ERROR_GET_DATA;
+    }
+
+    /* The first packet identifies the OTA Image for the download checkpoint */
+    if( (chunk_info->offset == 0) &&
+        (cy_ota_checkpoint_first_block(ctx, chunk_info) != CY_RSLT_SUCCESS) )
+    {
+        return CY_RSLT_OTA_ERROR_GET_DATA;
+    }
+
+    /* Data before the checkpoint is already in storage, do not write or count it twice */
+    if( (chunk_info->offset + chunk_info->size) <= ctx->resume_offset)
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG2, "PACKET offset:%ld is before resume offset %ld - not written\n",
+                       chunk_info->offset, ctx->resume_offset);
+        return CY_RSLT_SUCCESS;
+    }
+
     cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_INFO, "%s() num_packets_received: %d\n", __func__, ctx->ota_storage_context.num_packets_received);
 
     /* check for receipt of duplicate packets - do not write twice */
-    if(chunk_info->packet_number >= CY_OTA_MAX_PACKETS)
+    result = cy_ota_mqtt_packet_map_alloc(ctx, chunk_info->total_packets);
+    if(result != CY_RSLT_SUCCESS)
+    {
+        return result;
+    }
+    /* Not part of this OTA Image - drop it, it does not count toward completion */
+    if(chunk_info->packet_number >= ctx->mqtt.num_packets)
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "MQTT PACKET index %d too large, OTA Image has %d packets - dropped\n", chunk_info->packet_number, ctx->mqtt.num_packets);
+        return CY_RSLT_SUCCESS;
+    }
+    if( (chunk_info->offset > ctx->ota_storage_context.total_image_size) ||
+        (chunk_info->size > (ctx->ota_storage_context.total_image_size - chunk_info->offset)) )
     {
-        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "MQTT PACKET index %d too large. increase  CY_OTA_MAX_PACKETS (%d)\n", chunk_info->packet_number, CY_OTA_MAX_PACKETS);
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "MQTT PACKET index %d offset:%ld size:%ld past end of OTA Image %ld - dropped\n", chunk_info->packet_number,
+                       chunk_info->offset, chunk_info->size, ctx->ota_storage_context.total_image_size);
+        return CY_RSLT_SUCCESS;
+    }
+    if(cy_ota_mqtt_packet_map_test(ctx, chunk_info->packet_number) == true)
+    {
+        ctx->mqtt.duplicate_packets++;
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG2, "DEBUG PACKET index %d Duplicate - not written\n", chunk_info->packet_number);
+        return CY_RSLT_SUCCESS;
     }
     else
     {
-        ctx->mqtt.received_packets[chunk_info->packet_number]++;
-        if(ctx->mqtt.received_packets[chunk_info->packet_number] > 1)
+        ctx->mqtt.received_packets[chunk_info->packet_number / 32] |= (1UL << (chunk_info->packet_number % 32));
+    }
+
+#if (CY_OTA_MQTT_REASSEMBLY_SIZE > 0)
+    /* Collect the chunk into contiguous, page aligned writes */
+    result = cy_ota_mqtt_reasm_add(ctx, chunk_info);
+#else
+    result = cy_ota_mqtt_store(ctx, chunk_info);
+#endif
+    if(result != CY_RSLT_SUCCESS)
+    {
+        return result;
+    }
+
+    /* Test for out-of-order chunks
+     * Out of order is a problem for TAR archives parsed by the
+     * storage layer, those must use HTTP for Connection.
+     * With CY_OTA_TAR_PARSER=1 the Agent holds chunks that arrive
+     * early (up to CY_OTA_TAR_REORDER_SIZE bytes ahead).
+     */
+    if( (chunk_info->packet_number > 0) &&
+         (chunk_info->packet_number != (ctx->ota_storage_context.last_packet_received + 1) ) )
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG2, "OUT OF ORDER last:%d current:%d\n",
+                    ctx->ota_storage_context.last_packet_received, chunk_info->packet_number);
+    }
+
+    /* update the stats */
+    ctx->ota_storage_context.last_packet_received   = chunk_info->packet_number;
+    ctx->ota_storage_context.total_packets          = chunk_info->total_packets;
+    ctx->received_bytes                            += chunk_info->size;
+
+    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG2, "Received packet %d of %d to offset:%ld  %ld of %ld\n",
+        ctx->ota_storage_context.last_packet_received, ctx->ota_storage_context.total_packets,
+            chunk_info->offset, ctx->received_bytes, ctx->ota_storage_context.total_image_size);
+
+    return CY_RSLT_SUCCESS;
+}
+
+/**
+ * @brief Parse and write the payloads queued by cy_ota_mqtt_callback()
+ *
+ * Called from the OTA Agent thread only (single consumer).
+ *
+ * @param[in]   ctx - ptr to OTA context
+ *
+ * @return      CY_RSLT_SUCCESS
+ *              Error from cy_ota_mqtt_parse_chunk() or cy_ota_mqtt_write_chunk_to_flash()
+ */
+static cy_rslt_t cy_ota_mqtt_rx_ring_drain(cy_ota_context_t *ctx)
+{
+    cy_rslt_t   result = CY_RSLT_SUCCESS;
+    uint32_t    tail = atomic_load_explicit(&ctx->mqtt.rx_tail, memory_order_relaxed);
+    uint32_t    index;
+
+    /* Read the payload only after seeing the head that published it */
+    while( (result == CY_RSLT_SUCCESS) && (tail != atomic_load_explicit(&ctx->mqtt.rx_head, memory_order_acquire)) )
+    {
+        index = tail & (CY_OTA_MQTT_RX_BUFFERS - 1);
+
+        result = cy_ota_mqtt_parse_chunk(&ctx->mqtt.rx_buffers[index * CY_OTA_MQTT_RX_BUFFER_SIZE], ctx->mqtt.rx_len[index], &ctx->mqtt.chunk_info);
+        if(result == CY_RSLT_SUCCESS)
         {
-            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG2, "DEBUG PACKET index %d Duplicate - not written\n", chunk_info->packet_number);
-            return CY_RSLT_SUCCESS;
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG2, "Received packet %d of %d\n", ctx->mqtt.chunk_info.packet_number, ctx->mqtt.chunk_info.total_packets);
+
+            /* update ctx with appropriate sizes */
+            if(ctx->ota_storage_context.total_image_size == 0)
+            {
+                ctx->ota_storage_context.total_image_size = ctx->mqtt.chunk_info.total_size;
+            }
+
+            /* write the data */
+            result = cy_ota_mqtt_write_chunk_to_flash(ctx, &ctx->mqtt.chunk_info);
         }
+        else
+        {
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG2, "Packet had errors in header\n");
+        }
+
+        /* Done with the buffer, let the callback reuse it */
+        tail++;
+        atomic_store_explicit(&ctx->mqtt.rx_tail, tail, memory_order_release);
+        cy_rtos_setbits_event(&ctx->ota_event, (uint32_t)CY_OTA_EVENT_MQTT_RX_FREE, 0);
+    }
+
+    return result;
+}
+
+/**
+ * @brief Signal the OTA Agent thread with the result of handling a received payload
+ *
+ * @param[in]   ctx     - ptr to OTA context
+ * @param[in]   result  - result of handling the payload
+ */
+static void cy_ota_mqtt_set_result_event(cy_ota_context_t *ctx, cy_rslt_t result)
+{
+    if(result == CY_RSLT_OTA_ERROR_MALFORMED_JOB_DOC)
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, " CY_RSLT_OTA_ERROR_MALFORMED_JOB_DOC !\n");
+        cy_rtos_setbits_event(&ctx->ota_event, (uint32_t)CY_OTA_EVENT_MALFORMED_JOB_DOC, 0);
+    }
+    else if(result == CY_RSLT_OTA_ERROR_WRITE_STORAGE)
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, " CY_OTA_EVENT_STORAGE_ERROR !\n");
+        cy_rtos_setbits_event(&ctx->ota_event, (uint32_t)CY_OTA_EVENT_STORAGE_ERROR, 0);
+    }
+    else if(result == CY_RSLT_OTA_ERROR_APP_RETURNED_STOP)
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, " CY_OTA_EVENT_APP_STOPPED_OTA !\n");
+        cy_rtos_setbits_event(&ctx->ota_event, (uint32_t)CY_OTA_EVENT_APP_STOPPED_OTA, 0);
+    }
+    else if(result == CY_RSLT_OTA_ERROR_INVALID_VERSION)
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, " CY_OTA_EVENT_INVALID_VERSION !\n");
+        cy_rtos_setbits_event(&ctx->ota_event, (uint32_t)CY_OTA_EVENT_INVALID_VERSION, 0);
     }
-
-    /* store the chunk */
-    ctx->storage = chunk_info;
-    cb_result = cy_ota_internal_call_cb(ctx, CY_OTA_REASON_STATE_CHANGE, CY_OTA_STATE_STORAGE_WRITE);
-    switch( cb_result )
+    else if(result != CY_RSLT_SUCCESS)
     {
-        default:
-            /* Fall through */
-        case CY_OTA_CB_RSLT_OTA_CONTINUE:
-            result = ctx->storage_iface.ota_file_write(&(ctx->ota_storage_context), chunk_info);
-            if(result != CY_RSLT_SUCCESS)
-            {
-                cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Write failed\n", __func__);
-                cy_rtos_setbits_event(&ctx->ota_event, (uint32_t)CY_OTA_EVENT_DATA_FAIL, 0);
-                return result;
-            }
-            break;
-        case CY_OTA_CB_RSLT_OTA_STOP:
-            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() App returned OTA Stop for STATE_CHANGE for OTA platform storage block write API\n", __func__);
-            return CY_RSLT_OTA_ERROR_APP_RETURNED_STOP;
-        case CY_OTA_CB_RSLT_APP_SUCCESS:
-            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_NOTICE, "%s() App returned APP_SUCCESS for STATE_CHANGE for OTA platform storage block write API\n", __func__);
-            break;
-        case CY_OTA_CB_RSLT_APP_FAILED:
-            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() App returned APP_FAILED for STATE_CHANGE for OTA platform storage block write API\n", __func__);
-            return CY_RSLT_OTA_ERROR_WRITE_STORAGE;
-        case CY_OTA_CB_NUM_RESULTS:
-            return CY_RSLT_OTA_ERROR_WRITE_STORAGE;
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, " CY_OTA_EVENT_DATA_FAIL !\n");
+        cy_rtos_setbits_event(&ctx->ota_event, (uint32_t)CY_OTA_EVENT_DATA_FAIL, 0);
     }
-
-    /* Test for out-of-order chunks
-     * Out of order will be a problem when using
-     * TAR archives for multi-file downloads.
-     * Tar archives must use HTTP for Connection.
-     */
-    if( (chunk_info->packet_number > 0) &&
-         (chunk_info->packet_number != (ctx->ota_storage_context.last_packet_received + 1) ) )
+    else
     {
-        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG2, "OUT OF ORDER last:%d current:%d\n",
-                    ctx->ota_storage_context.last_packet_received, chunk_info->packet_number);
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, " CY_OTA_EVENT_GOT_DATA!\n");
+        cy_rtos_setbits_event(&ctx->ota_event, (uint32_t)CY_OTA_EVENT_GOT_DATA, 0);
     }
-
-    /* update the stats */
-    ctx->ota_storage_context.total_bytes_written   += chunk_info->size;
-    ctx->ota_storage_context.last_offset            = chunk_info->offset;
-    ctx->ota_storage_context.last_size              = chunk_info->size;
-    ctx->ota_storage_context.last_packet_received   = chunk_info->packet_number;
-    ctx->ota_storage_context.total_packets          = chunk_info->total_packets;
-
-    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG2, "Written packet %d of %d to offset:%ld  %ld of %ld\n",
-        ctx->ota_storage_context.last_packet_received, ctx->ota_storage_context.total_packets,
-            ctx->ota_storage_context.last_offset, ctx->ota_storage_context.total_bytes_written, ctx->ota_storage_context.total_image_size);
-
-    return CY_RSLT_SUCCESS;
 }
 
 /**
@@ -567,8 +1370,6 @@ static cy_rslt_t cy_ota_mqtt_write_chunk_to_flash(cy_ota_context_t *ctx, cy_ota_
 
 static void cy_ota_mqtt_callback( cy_mqtt_t mqtt_handle, cy_mqtt_event_t event, void *user_data )
 {
-    /* static so that it does not use stack space */
-    static cy_ota_storage_write_info_t mqtt_chunk_info;
     cy_rslt_t   result = CY_RSLT_SUCCESS;
     cy_ota_context_t *ctx = (cy_ota_context_t *)user_data;
 
@@ -702,26 +1503,8 @@ static void cy_ota_mqtt_callback( cy_mqtt_t mqtt_handle, cy_mqtt_event_t event,
        }
        else if(ctx->curr_state == CY_OTA_STATE_DATA_DOWNLOAD)
        {
-           result = cy_ota_mqtt_parse_chunk( (const uint8_t *)pub_msg->payload, (uint32_t)pub_msg->payload_len, &mqtt_chunk_info);
-
-           if(result == CY_RSLT_SUCCESS)
-           {
-                cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG2, "Received packet %d of %d\n", mqtt_chunk_info.packet_number, mqtt_chunk_info.total_packets);
-
-                /* update ctx with appropriate sizes */
-                if(ctx->ota_storage_context.total_image_size == 0)
-                {
-                ctx->ota_storage_context.total_image_size = mqtt_chunk_info.total_size;
-                }
-
-                /* write the data */
-                result = cy_ota_mqtt_write_chunk_to_flash(ctx, &mqtt_chunk_info);
-                /* Errors handled below in _callback_exit */
-            }
-            else
-            {
-                cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG2, "Packet %d had errors in header\n", mqtt_chunk_info.packet_number);
-            }
+           /* The OTA Agent thread parses and writes the data, do not wait for FLASH here */
+           result = cy_ota_mqtt_rx_ring_put(ctx, pub_msg->payload, (uint32_t)pub_msg->payload_len);
        }
        else
        {
@@ -731,36 +1514,7 @@ static void cy_ota_mqtt_callback( cy_mqtt_t mqtt_handle, cy_mqtt_event_t event,
 _callback_exit:
 
        /* Handle Job and Data error conditions */
-       if(result == CY_RSLT_OTA_ERROR_MALFORMED_JOB_DOC)
-       {
-           cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, " CY_RSLT_OTA_ERROR_MALFORMED_JOB_DOC !\n");
-           cy_rtos_setbits_event(&ctx->ota_event, (uint32_t)CY_OTA_EVENT_MALFORMED_JOB_DOC, 0);
-       }
-       else if(result == CY_RSLT_OTA_ERROR_WRITE_STORAGE)
-       {
-           cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, " CY_OTA_EVENT_STORAGE_ERROR !\n");
-           cy_rtos_setbits_event(&ctx->ota_event, (uint32_t)CY_OTA_EVENT_STORAGE_ERROR, 0);
-       }
-       else if(result == CY_RSLT_OTA_ERROR_APP_RETURNED_STOP)
-       {
-           cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, " CY_OTA_EVENT_APP_STOPPED_OTA !\n");
-           cy_rtos_setbits_event(&ctx->ota_event, (uint32_t)CY_OTA_EVENT_APP_STOPPED_OTA, 0);
-       }
-       else if(result == CY_RSLT_OTA_ERROR_INVALID_VERSION)
-       {
-           cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, " CY_OTA_EVENT_INVALID_VERSION !\n");
-           cy_rtos_setbits_event(&ctx->ota_event, (uint32_t)CY_OTA_EVENT_INVALID_VERSION, 0);
-       }
-       else if(result != CY_RSLT_SUCCESS)
-       {
-           cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, " CY_OTA_EVENT_DATA_FAIL !\n");
-           cy_rtos_setbits_event(&ctx->ota_event, (uint32_t)CY_OTA_EVENT_DATA_FAIL, 0);
-       }
-       else
-       {
-           cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, " CY_OTA_EVENT_GOT_DATA!\n");
-           cy_rtos_setbits_event(&ctx->ota_event, (uint32_t)CY_OTA_EVENT_GOT_DATA, 0);
-       }
+       cy_ota_mqtt_set_result_event(ctx, result);
        cy_rtos_set_mutex(&ctx->sub_callback_mutex);
     }
 
@@ -965,15 +1719,43 @@ cy_rslt_t cy_ota_mqtt_validate_network_params(const cy_ota_network_params_t *net
     return CY_RSLT_SUCCESS;
 }
 
+/**
+ * @brief Subscribe to the topics from the Application
+ *
+ * @param[in]   ctx - pointer to OTA agent context @ref cy_ota_context_t
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          CY_RSLT_OTA_ERROR_GENERAL
+ */
+static cy_rslt_t cy_ota_mqtt_subscribe_app_topics(cy_ota_context_t *ctx)
+{
+    cy_rslt_t   result;
+
+    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "MQTT Subscribe topics from Application.\n");
+    result = cy_ota_modify_subscriptions(ctx,
+                                         CY_OTA_MQTT_SUBSCRIBE,
+                                         ctx->network_params.mqtt.numTopicFilters,
+                                         ctx->network_params.mqtt.pTopicFilters);
+    if(result != CY_RSLT_SUCCESS)
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "MQTT subscribe failed\n");
+        cy_ota_mqtt_disconnect(ctx);
+    }
+    return result;
+}
+
 /**
  * @brief Connect to OTA Update server
  *
  * NOTE: Individual Network Connection type will do whatever is necessary
  *       This function must have it's own timeout for connection failure
  *
+ * A polled OTA Agent connects on one call and subscribes on the next.
+ *
  * @param[in]   ctx - pointer to OTA agent context @ref cy_ota_context_t
  *
  * @return  CY_RSLT_SUCCESS
+ *          CY_RSLT_OTA_POLL_AGAIN - connected, call again to subscribe
  *          CY_RSLT_OTA_ERROR_GENERAL
  */
 cy_rslt_t cy_ota_mqtt_connect(cy_ota_context_t *ctx)
@@ -986,6 +1768,12 @@ cy_rslt_t cy_ota_mqtt_connect(cy_ota_context_t *ctx)
 
     CY_OTA_CONTEXT_ASSERT(ctx);
 
+    if(ctx->mqtt.connection_established == true)
+    {
+        /* Connected by the last cy_ota_agent_poll() */
+        return cy_ota_mqtt_subscribe_app_topics(ctx);
+    }
+
     (void)server;
 
     security = &ctx->network_params.mqtt.credentials;
@@ -1000,9 +1788,9 @@ cy_rslt_t cy_ota_mqtt_connect(cy_ota_context_t *ctx)
     {
         server.host_name = ctx->parsed_job.broker_server.host_name;
         server.port = ctx->parsed_job.broker_server.port;
-        if(ctx->callback_data.credentials != NULL)
+        if(ctx->cb_credentials != NULL)
         {
-            security = ctx->callback_data.credentials;
+            security = ctx->cb_credentials;
         }
     }
 
@@ -1073,16 +1861,11 @@ cy_rslt_t cy_ota_mqtt_connect(cy_ota_context_t *ctx)
                        server.port,
                        (security == NULL) ? "No" : "Yes");
 
-        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "MQTT Subscribe topics from Application.\n");
-        result = cy_ota_modify_subscriptions(ctx,
-                                             CY_OTA_MQTT_SUBSCRIBE,
-                                             ctx->network_params.mqtt.numTopicFilters,
-                                             ctx->network_params.mqtt.pTopicFilters);
-        if(result != CY_RSLT_SUCCESS)
+        if(ctx->agent_params.use_poll != false)
         {
-            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "MQTT subscribe failed\n");
-            cy_ota_mqtt_disconnect(ctx);
+            return CY_RSLT_OTA_POLL_AGAIN;
         }
+        result = cy_ota_mqtt_subscribe_app_topics(ctx);
     }
     return result;
 }
@@ -1148,7 +1931,7 @@ cy_rslt_t cy_ota_mqtt_get_job(cy_ota_context_t *ctx)
         goto cleanup_and_exit;
     }
 
-    result = cy_ota_mqtt_publish_request(ctx, (char *)SUBSCRIBER_PUBLISH_TOPIC, ctx->mqtt.json_doc);
+    result = cy_ota_mqtt_publish_request(ctx, (char *)SUBSCRIBER_PUBLISH_TOPIC, ctx->json_doc);
     if(result != CY_RSLT_SUCCESS)
     {
         cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "%s() cy_ota_mqtt_publish_request() failed\n", __func__);
@@ -1160,7 +1943,7 @@ cy_rslt_t cy_ota_mqtt_get_job(cy_ota_context_t *ctx)
     {
         uint32_t waitfor;
 
-        /* get event */
+    /* get event */
         waitfor = CY_OTA_EVENT_MQTT_EVENTS;
         result = cy_rtos_waitbits_event(&ctx->ota_event, &waitfor, 1, 0, CY_OTA_WAIT_MQTT_EVENTS_MS);
         cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG2, "%s() MQTT cy_rtos_waitbits_event: 0x%lx result:0x%lx\n", __func__, waitfor, result);
@@ -1238,22 +2021,55 @@ cy_rslt_t cy_ota_mqtt_get_job(cy_ota_context_t *ctx)
 }
 
 /**
- * @brief get the OTA download
+ * @brief Free what cy_ota_mqtt_get_data_start() set up
  *
- * NOTE: Individual Network Connection type will do whatever is necessary
- *      ex: MQTT
- *          - subscribe to start data transfer
- *          TCP
- *          - pull the data from the server
+ * @param[in]   ctx     - pointer to OTA agent context @ref cy_ota_context_t
+ * @param[in]   result  - result of the download
+ *
+ * @return  result
+ */
+static cy_rslt_t cy_ota_mqtt_get_data_cleanup(cy_ota_context_t *ctx, cy_rslt_t result)
+{
+#if (CY_OTA_MQTT_REASSEMBLY_SIZE > 0)
+    cy_ota_mqtt_reasm_deinit(ctx);
+#endif
+
+    if(ctx->mqtt.mqtt_timer_inited)
+    {
+        /* we completed the download, stop the timer */
+        cy_ota_stop_mqtt_timer(ctx);
+
+        cy_rtos_deinit_timer(&ctx->mqtt.mqtt_timer);
+    }
+    ctx->mqtt.mqtt_timer_inited = false;
+
+    ctx->sub_callback_mutex_inited = 0;
+
+    /* Wait for a callback queueing a packet before freeing the buffers */
+    if(cy_rtos_get_mutex(&ctx->sub_callback_mutex, CY_OTA_WAIT_MQTT_MUTEX_MS) == CY_RSLT_SUCCESS)
+    {
+        cy_ota_mqtt_packet_map_free(ctx);
+        cy_ota_mqtt_rx_ring_deinit(ctx);
+        cy_rtos_set_mutex(&ctx->sub_callback_mutex);
+    }
+    cy_rtos_deinit_mutex(&ctx->sub_callback_mutex);
+
+    return result;
+}
+
+/**
+ * @brief Start getting the OTA download
+ *
+ * Subscribes and publishes the request for the data. The data is handled by cy_ota_mqtt_get_data_step().
  *
  * @param[in]   ctx - pointer to OTA agent context @ref cy_ota_context_t
  *
- * @return  CY_RSLT_SUCCESS
+ * @return  CY_RSLT_OTA_POLL_AGAIN - call cy_ota_mqtt_get_data_step()
+ *          CY_RSLT_SUCCESS
  *          CY_RSLT_OTA_ERROR_GENERAL
  */
-cy_rslt_t cy_ota_mqtt_get_data(cy_ota_context_t *ctx)
+cy_rslt_t cy_ota_mqtt_get_data_start(cy_ota_context_t *ctx)
 {
-    uint16_t                    i;
     uint32_t                    waitfor_clear;
     cy_rslt_t                   result = CY_RSLT_SUCCESS;
     cy_ota_callback_results_t   cb_result;
@@ -1275,6 +2091,16 @@ cy_rslt_t cy_ota_mqtt_get_data(cy_ota_context_t *ctx)
     }
     ctx->sub_callback_mutex_inited = 1;
 
+    /* Buffers for data received by cy_ota_mqtt_callback() */
+    result = cy_ota_mqtt_rx_ring_init(ctx);
+    if(result != CY_RSLT_SUCCESS)
+    {
+        return cy_ota_mqtt_get_data_cleanup(ctx, result);
+    }
+#if (CY_OTA_MQTT_REASSEMBLY_SIZE > 0)
+    cy_ota_mqtt_reasm_init(ctx);
+#endif
+
     /* clear any lingering events */
     waitfor_clear = CY_OTA_EVENT_MQTT_EVENTS;
     result = cy_rtos_waitbits_event(&ctx->ota_event, &waitfor_clear, 1, 0, 1);
@@ -1288,21 +2114,26 @@ cy_rslt_t cy_ota_mqtt_get_data(cy_ota_context_t *ctx)
     if(result != CY_RSLT_SUCCESS)
     {
         cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "%s() subscribe/publish () failed result:0x%lx\n", __func__, result);
-        goto cleanup_and_exit;
+        return cy_ota_mqtt_get_data_cleanup(ctx, result);
     }
 
     /* Create json doc for the request */
-    memset(ctx->mqtt.json_doc, 0x00, sizeof(ctx->mqtt.json_doc));
+    memset(ctx->json_doc, 0x00, sizeof(ctx->json_doc));
 #ifdef CY_MQTT_GET_ALL_DATA_WITH_ONE_CALL
     /* Current default. Send one request for the entire file,
      * Publisher.py will chunk and send separate chunks.
      */
-    result = cy_ota_mqtt_create_json_request(ctx, CY_OTA_DOWNLOAD_REQUEST, "", 0, 0);
+    result = cy_ota_mqtt_create_json_request(ctx,
+                                             (ctx->resume_offset > 0) ? CY_OTA_DOWNLOAD_RESUME_REQUEST : CY_OTA_DOWNLOAD_REQUEST,
+                                             "", ctx->resume_offset, 0);
 #else
     /* This code is for requesting each chunk separately. */
     cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "MQTT Subscribe for CHUNK download DATA Messages..............\n");
     result = cy_ota_mqtt_create_json_request(ctx, CY_OTA_DOWNLOAD_CHUNK_REQUEST,
-                                                        ctx->parsed_job.file, 0, CY_OTA_CHUNK_SIZE);
+                                                        ctx->parsed_job.file, ctx->resume_offset, CY_OTA_CHUNK_SIZE);
+
+    /* The rest of the request window is filled once we know the OTA Image size */
+    ctx->mqtt.next_request_offset = ctx->resume_offset + CY_OTA_CHUNK_SIZE;
 #endif
 
     if(result != CY_RSLT_SUCCESS)
@@ -1320,32 +2151,48 @@ cy_rslt_t cy_ota_mqtt_get_data(cy_ota_context_t *ctx)
         default:
             /* Fall through */
         case CY_OTA_CB_RSLT_OTA_CONTINUE:
-            result = cy_ota_mqtt_publish_request(ctx, (char *)SUBSCRIBER_PUBLISH_TOPIC, ctx->mqtt.json_doc);
+            result = cy_ota_mqtt_publish_request(ctx, (char *)SUBSCRIBER_PUBLISH_TOPIC, ctx->json_doc);
             if(result != CY_RSLT_SUCCESS)
             {
                 cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() cy_ota_mqtt_publish_request() for Data failed\n", __func__);
-                goto cleanup_and_exit;
+                return cy_ota_mqtt_get_data_cleanup(ctx, result);
+            }
+            if( (ctx->resume_offset > 0) && (ctx->resume_verified == false) )
+            {
+                /* Ask for the first packet again, to check it against the checkpoint */
+                result = cy_ota_mqtt_create_json_request(ctx, CY_OTA_DOWNLOAD_CHUNK_REQUEST,
+                                                         ctx->parsed_job.file, 0, ctx->first_block_size);
+                if(result == CY_RSLT_SUCCESS)
+                {
+                    result = cy_ota_mqtt_publish_request(ctx, (char *)SUBSCRIBER_PUBLISH_TOPIC, ctx->json_doc);
+                }
+                if(result != CY_RSLT_SUCCESS)
+                {
+                    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() request for the first packet failed\n", __func__);
+                    result = CY_RSLT_OTA_ERROR_MQTT_PUBLISH;
+                    return cy_ota_mqtt_get_data_cleanup(ctx, result);
+                }
             }
             break;
 
         case CY_OTA_CB_RSLT_OTA_STOP:
             cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() App returned OTA Stop for STATE_CHANGE for DATA_DOWNLOAD\n", __func__);
             result = CY_RSLT_OTA_ERROR_APP_RETURNED_STOP;
-            goto cleanup_and_exit;
+            return cy_ota_mqtt_get_data_cleanup(ctx, result);
 
         case CY_OTA_CB_RSLT_APP_SUCCESS:
             cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_NOTICE, "%s() App returned APP_SUCCESS for STATE_CHANGE for DATA_DOWNLOAD\n", __func__);
             result = CY_RSLT_SUCCESS;
-            goto cleanup_and_exit;
+            return cy_ota_mqtt_get_data_cleanup(ctx, result);
 
         case CY_OTA_CB_RSLT_APP_FAILED:
             cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() App returned APP_FAILURE for STATE_CHANGE for DATA_DOWNLOAD\n", __func__);
             result = CY_RSLT_OTA_ERROR_GET_DATA;
-            goto cleanup_and_exit;
+            return cy_ota_mqtt_get_data_cleanup(ctx, result);
 
         case CY_OTA_CB_NUM_RESULTS:
             result = CY_RSLT_OTA_ERROR_GET_DATA;
-            goto cleanup_and_exit;
+            return cy_ota_mqtt_get_data_cleanup(ctx, result);
     }
 
     /* Create download interval timer */
@@ -1356,7 +2203,7 @@ cy_rslt_t cy_ota_mqtt_get_data(cy_ota_context_t *ctx)
        /* Event create failed */
        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Timer Create Failed!\n", __func__);
        result = CY_RSLT_OTA_ERROR_GET_DATA;
-       goto cleanup_and_exit;
+       return cy_ota_mqtt_get_data_cleanup(ctx, result);
    }
    ctx->mqtt.mqtt_timer_inited = true;
 
@@ -1367,184 +2214,255 @@ cy_rslt_t cy_ota_mqtt_get_data(cy_ota_context_t *ctx)
        cy_ota_start_mqtt_timer(ctx, ctx->packet_timeout_sec, CY_OTA_EVENT_PACKET_TIMEOUT);
    }
 
-   /* clear out tally of received / written packets */
-    memset(&ctx->mqtt.received_packets, 0, sizeof(ctx->mqtt.received_packets) );
+   /* clear out tally of received / written packets, allocated when the first packet arrives */
+    cy_ota_mqtt_packet_map_free(ctx);
+    ctx->mqtt.repair_tries = 0;
+    ctx->mqtt.repair_active = false;
+    ctx->mqtt.repair_missing = 0;
+    ctx->mqtt.repair_list_end = 0;
+
+    return CY_RSLT_OTA_POLL_AGAIN;
+}
+
+/**
+ * @brief Handle one event of the OTA download
+ *
+ * Without use_poll, waits for the event.
+ *
+ * @param[in]   ctx - pointer to OTA agent context @ref cy_ota_context_t
+ *
+ * @return  CY_RSLT_OTA_POLL_AGAIN - call again
+ *          CY_RSLT_SUCCESS
+ *          CY_RSLT_OTA_ERROR_GENERAL
+ */
+cy_rslt_t cy_ota_mqtt_get_data_step(cy_ota_context_t *ctx)
+{
+    cy_rslt_t   result;
+    uint32_t    waitfor;
+
+    CY_OTA_CONTEXT_ASSERT(ctx);
+
+    /* get event */
+    waitfor = CY_OTA_EVENT_MQTT_EVENTS;
+    result = cy_rtos_waitbits_event(&ctx->ota_event, &waitfor, 1, 0,
+                                    (ctx->agent_params.use_poll == false) ? CY_OTA_WAIT_MQTT_EVENTS_MS : 0);
+    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG2, "%s() MQTT cy_rtos_waitbits_event: 0x%lx type:%d mod:0x%lx code:%d\n", __func__, waitfor, CY_RSLT_GET_TYPE(result), CY_RSLT_GET_MODULE(result), CY_RSLT_GET_CODE(result) );
 
-    while(true)
+    /* We only want to act on events we are waiting on.
+     * For timeouts, just step again.
+     */
+    if(waitfor == 0)
     {
-        uint32_t waitfor;
+        return CY_RSLT_OTA_POLL_AGAIN;
+    }
 
-        /* get event */
-        waitfor = CY_OTA_EVENT_MQTT_EVENTS;
-        result = cy_rtos_waitbits_event(&ctx->ota_event, &waitfor, 1, 0, CY_OTA_WAIT_MQTT_EVENTS_MS);
-        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG2, "%s() MQTT cy_rtos_waitbits_event: 0x%lx type:%d mod:0x%lx code:%d\n", __func__, waitfor, CY_RSLT_GET_TYPE(result), CY_RSLT_GET_MODULE(result), CY_RSLT_GET_CODE(result) );
+    if(waitfor & CY_OTA_EVENT_SHUTDOWN_NOW)
+    {
+        /* Pass along to Agent thread */
+        cy_rtos_setbits_event(&ctx->ota_event, (uint32_t)CY_OTA_EVENT_SHUTDOWN_NOW, 0);
+        result = CY_RSLT_SUCCESS;
+        return cy_ota_mqtt_get_data_end(ctx, result);
+    }
 
-        /* We only want to act on events we are waiting on.
-         * For timeouts, just loop around.
+    if(waitfor & CY_OTA_EVENT_DATA_DOWNLOAD_TIMEOUT)
+    {
+        /* This was generated by a timer in cy_ota_agent.c
+         * Pass along to Agent thread.
          */
-        if(waitfor == 0)
-        {
-            continue;
-        }
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_WARNING, "MQTT: Download Timeout\n");
+        result = CY_RSLT_OTA_NO_UPDATE_AVAILABLE;
+        return cy_ota_mqtt_get_data_end(ctx, result);
+    }
 
-        if(waitfor & CY_OTA_EVENT_SHUTDOWN_NOW)
-        {
-            /* Pass along to Agent thread */
-            cy_rtos_setbits_event(&ctx->ota_event, (uint32_t)CY_OTA_EVENT_SHUTDOWN_NOW, 0);
-            result = CY_RSLT_SUCCESS;
-            break;
-        }
+    if(waitfor & CY_OTA_EVENT_STORAGE_ERROR)
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Storage write error\n", __func__);
+        result = CY_RSLT_OTA_ERROR_WRITE_STORAGE;
+        return cy_ota_mqtt_get_data_end(ctx, result);
+    }
 
-        if(waitfor & CY_OTA_EVENT_DATA_DOWNLOAD_TIMEOUT)
+    if(waitfor & CY_OTA_EVENT_APP_STOPPED_OTA)
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG2, "%s() App told us to stop\n", __func__);
+        result = CY_RSLT_OTA_ERROR_APP_RETURNED_STOP;
+        return cy_ota_mqtt_get_data_end(ctx, result);
+    }
+
+    if(waitfor & CY_OTA_EVENT_GOT_DATA)
+    {
+        /* Parse and write the data queued by cy_ota_mqtt_callback() */
+        result = cy_ota_mqtt_rx_ring_drain(ctx);
+        if(result != CY_RSLT_SUCCESS)
         {
-            /* This was generated by a timer in cy_ota_agent.c
-             * Pass along to Agent thread.
-             */
-            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_WARNING, "MQTT: Download Timeout\n");
-            result = CY_RSLT_OTA_NO_UPDATE_AVAILABLE;
-            break;
+            /* handled on the next step */
+            cy_ota_mqtt_set_result_event(ctx, result);
+            return CY_RSLT_OTA_POLL_AGAIN;
         }
 
-        if(waitfor & CY_OTA_EVENT_STORAGE_ERROR)
+        if(ctx->packet_timeout_sec > 0 )
         {
-            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Storage write error\n", __func__);
-            result = CY_RSLT_OTA_ERROR_WRITE_STORAGE;
-            break;
+            /* got some data - restart the download interval timer */
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "%s() RESTART PACKET TIMER %ld secs\n", __func__, cy_ota_mqtt_packet_timeout_secs(ctx));
+            cy_ota_start_mqtt_timer(ctx, cy_ota_mqtt_packet_timeout_secs(ctx), CY_OTA_EVENT_PACKET_TIMEOUT);
         }
 
-        if(waitfor & CY_OTA_EVENT_APP_STOPPED_OTA)
+        if( (ctx->received_bytes >= ctx->ota_storage_context.total_image_size) &&
+            ( (ctx->resume_offset == 0) || (ctx->resume_verified == true) ) )
         {
-            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG2, "%s() App told us to stop\n", __func__);
-            result = CY_RSLT_OTA_ERROR_APP_RETURNED_STOP;
-            break;
+            /* stop timer asap so we don't get a timeout */
+            cy_ota_stop_mqtt_timer(ctx);
+
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_INFO, "Done receiving all data! %ld of %ld\n", ctx->received_bytes, ctx->ota_storage_context.total_image_size);
+            cy_rtos_setbits_event(&ctx->ota_event, (uint32_t)CY_OTA_EVENT_DATA_DONE, 0);
         }
 
-        if(waitfor & CY_OTA_EVENT_GOT_DATA)
+        /* The Publisher sends the packets in order. If the last one arrived
+         * and we are not done, ask for the missing ones now rather than
+         * waiting for the packet timeout. Same once the packets of the last
+         * repair are in.
+         */
+        if( (ctx->received_bytes < ctx->ota_storage_context.total_image_size) &&
+            (CY_OTA_MQTT_REPAIR_TRIES > 0) && (ctx->mqtt.num_packets > 0) )
         {
-            if(ctx->packet_timeout_sec > 0 )
-            {
-                /* got some data - restart the download interval timer */
-                cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "%s() RESTART PACKET TIMER %ld secs\n", __func__, ctx->packet_timeout_sec);
-                cy_ota_start_mqtt_timer(ctx, ctx->packet_timeout_sec, CY_OTA_EVENT_PACKET_TIMEOUT);
-            }
+            uint32_t    first;
+            uint32_t    end;
+            bool        send_repair = false;
 
-            if(ctx->ota_storage_context.total_bytes_written >= ctx->ota_storage_context.total_image_size)
+            cy_ota_mqtt_repair_range(ctx, &first, &end);
+            if(ctx->mqtt.repair_active == true)
             {
-                /* stop timer asap so we don't get a timeout */
-                cy_ota_stop_mqtt_timer(ctx);
-
-                cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_INFO, "Done writing all data! %ld of %ld\n", ctx->ota_storage_context.total_bytes_written, ctx->ota_storage_context.total_image_size);
-                cy_rtos_setbits_event(&ctx->ota_event, (uint32_t)CY_OTA_EVENT_DATA_DONE, 0);
+                send_repair = (cy_ota_mqtt_packet_map_find(ctx, first, false) >= ctx->mqtt.repair_list_end);
             }
-
-#ifndef CY_MQTT_GET_ALL_DATA_WITH_ONE_CALL
-            /* This code is only used if we are going to ask the MQTT broker
-             * separately for each chunk of data.
-             *
-             * Request next chunk */
-            int32_t chunk_size = (int32_t)CY_OTA_CHUNK_SIZE;
-            if(chunk_size > (ctx->ota_storage_context.total_image_size - ctx->ota_storage_context.total_bytes_written) )
+#ifdef CY_MQTT_GET_ALL_DATA_WITH_ONE_CALL
+            else
             {
-                chunk_size = -1;    /* get the rest of the data */
+                send_repair = cy_ota_mqtt_packet_map_test(ctx, ctx->mqtt.num_packets - 1);
             }
-            result = cy_ota_mqtt_create_json_request( ctx, CY_OTA_DOWNLOAD_CHUNK_REQUEST,
-                    ctx->parsed_job.file, ctx->ota_storage_context.total_bytes_written, chunk_size);
-            if(result != CY_RSLT_SUCCESS)
+#endif
+            if( (send_repair == true) && (cy_ota_mqtt_next_repair(ctx) != CY_RSLT_SUCCESS) )
             {
-                cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() cy_ota_mqtt_create_json_request() for Data failed\n", __func__);
-                goto cleanup_and_exit;
+                cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_WARNING, "%s() Repair request failed, wait for packet timeout\n", __func__);
             }
+        }
 
-            result = cy_ota_mqtt_publish_request(ctx, (char *)SUBSCRIBER_PUBLISH_TOPIC, ctx->mqtt.json_doc);
+#ifndef CY_MQTT_GET_ALL_DATA_WITH_ONE_CALL
+        /* This code is only used if we are going to ask the MQTT broker
+         * separately for each chunk of data.
+         *
+         * Keep CY_OTA_MQTT_CHUNK_WINDOW chunk requests outstanding */
+        if(ctx->received_bytes < ctx->ota_storage_context.total_image_size)
+        {
+            result = cy_ota_mqtt_fill_chunk_window(ctx);
             if(result != CY_RSLT_SUCCESS)
             {
-                cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() cy_ota_mqtt_publish_request() for Data failed\n", __func__);
-                goto cleanup_and_exit;
+                return cy_ota_mqtt_get_data_cleanup(ctx, result);
             }
-#endif
-            continue;
         }
+#endif
+        return CY_RSLT_OTA_POLL_AGAIN;
+    }
 
-        if(waitfor & CY_OTA_EVENT_PACKET_TIMEOUT)
+    if(waitfor & CY_OTA_EVENT_PACKET_TIMEOUT)
+    {
+        /* We set a timer and if packets take too long, we will assume the broker forgot about us.
+         * Set with CY_OTA_PACKET_INTERVAL_SECS.
+         */
+        if(ctx->ota_storage_context.num_packets_received > ctx->ota_storage_context.last_num_packets_received)
         {
-            /* We set a timer and if packets take too long, we will assume the broker forgot about us.
-             * Set with CY_OTA_PACKET_INTERVAL_SECS.
+            /* If we received packets since the last time we were here, just continue.
+             * This thread may be held off for a while, and we don't want a false failure.
              */
-            if(ctx->ota_storage_context.num_packets_received > ctx->ota_storage_context.last_num_packets_received)
-            {
-                /* If we received packets since the last time we were here, just continue.
-                 * This thread may be held off for a while, and we don't want a false failure.
-                 */
-                cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_WARNING, "%s() RESTART PACKET TIMER %ld secs\n", __func__, ctx->packet_timeout_sec);
-                cy_ota_start_mqtt_timer(ctx, ctx->packet_timeout_sec, CY_OTA_EVENT_PACKET_TIMEOUT);
-
-                /* update our variable */
-                ctx->ota_storage_context.last_num_packets_received = ctx->ota_storage_context.num_packets_received;
-                continue;
-            }
-            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_WARNING, "OTA Timeout waiting for a packet (%d seconds), fail\n", ctx->packet_timeout_sec);
-            cy_rtos_setbits_event(&ctx->ota_event, (uint32_t)CY_OTA_EVENT_DATA_FAIL, 0);
-        }
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_WARNING, "%s() RESTART PACKET TIMER %ld secs\n", __func__, cy_ota_mqtt_packet_timeout_secs(ctx));
+            cy_ota_start_mqtt_timer(ctx, cy_ota_mqtt_packet_timeout_secs(ctx), CY_OTA_EVENT_PACKET_TIMEOUT);
 
-        if(waitfor & CY_OTA_EVENT_DATA_DONE)
-        {
-            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "Got all the data !\n");
-            result = CY_RSLT_SUCCESS;
-            break;
+            /* update our variable */
+            ctx->ota_storage_context.last_num_packets_received = ctx->ota_storage_context.num_packets_received;
+            return CY_RSLT_OTA_POLL_AGAIN;
         }
-
-        if(waitfor & CY_OTA_EVENT_INVALID_VERSION)
+        /* Without the first packet the resumed data cannot be trusted */
+        if( (ctx->resume_offset > 0) && (ctx->resume_verified == false) &&
+            (ctx->received_bytes >= ctx->ota_storage_context.total_image_size) )
         {
-            result = CY_RSLT_OTA_ERROR_INVALID_VERSION;
-            break;
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "OTA Image first packet not received, cannot match checkpoint, start over\n");
+            cy_ota_checkpoint_discard(ctx);
+            cy_rtos_setbits_event(&ctx->ota_event, (uint32_t)CY_OTA_EVENT_DATA_FAIL, 0);
+            return CY_RSLT_OTA_POLL_AGAIN;
         }
-
-        if(waitfor & CY_OTA_EVENT_DATA_FAIL)
+        /* Ask for only the packets we are missing before failing the whole download */
+        if( (ctx->mqtt.num_packets > 0) && (cy_ota_mqtt_next_repair(ctx) == CY_RSLT_SUCCESS) )
         {
-            result = CY_RSLT_OTA_ERROR_GET_DATA;
-            break;
+            return CY_RSLT_OTA_POLL_AGAIN;
         }
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_WARNING, "OTA Timeout waiting for a packet (%d seconds), fail\n", ctx->packet_timeout_sec);
+        cy_rtos_setbits_event(&ctx->ota_event, (uint32_t)CY_OTA_EVENT_DATA_FAIL, 0);
+    }
 
-        if(waitfor & CY_OTA_EVENT_DROPPED_US)
-        {
-            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "%s() MQTT Broker disconnected state:%d %s\n", __func__, ctx->curr_state, cy_ota_get_state_string(ctx->curr_state));
-            result = CY_RSLT_OTA_ERROR_SERVER_DROPPED;
-            break;
-        }
-    }   /* While 1 */
+    if(waitfor & CY_OTA_EVENT_DATA_DONE)
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "Got all the data !\n");
+        result = CY_RSLT_SUCCESS;
+        return cy_ota_mqtt_get_data_end(ctx, result);
+    }
 
-    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG2, "%s() MQTT DONE result: 0x%lx\n", __func__, result);
+    if(waitfor & CY_OTA_EVENT_INVALID_VERSION)
+    {
+        result = CY_RSLT_OTA_ERROR_INVALID_VERSION;
+        return cy_ota_mqtt_get_data_end(ctx, result);
+    }
 
-    for(i = 0; i < ctx->ota_storage_context.total_packets; i++)
+    if(waitfor & CY_OTA_EVENT_DATA_FAIL)
     {
-        if(ctx->mqtt.received_packets[i] == 0 )
-        {
-            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG1, "PACKET %d missing!\n", i);
-        }
-        else if(ctx->mqtt.received_packets[i] > 1 )
-        {
-            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG1, "PACKET %d Duplicate!\n", i);
-        }
-        else
-        {
-            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG2, "PACKET %d Normal!\n", i);
-        }
+        result = CY_RSLT_OTA_ERROR_GET_DATA;
+        return cy_ota_mqtt_get_data_end(ctx, result);
     }
 
- cleanup_and_exit:
-    if(ctx->mqtt.mqtt_timer_inited)
+    if(waitfor & CY_OTA_EVENT_DROPPED_US)
     {
-        /* we completed the download, stop the timer */
-        cy_ota_stop_mqtt_timer(ctx);
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "%s() MQTT Broker disconnected state:%d %s\n", __func__, ctx->curr_state, cy_ota_get_state_string(ctx->curr_state));
+        result = CY_RSLT_OTA_ERROR_SERVER_DROPPED;
+        return cy_ota_mqtt_get_data_end(ctx, result);
+    }
 
-        cy_rtos_deinit_timer(&ctx->mqtt.mqtt_timer);
+    return CY_RSLT_OTA_POLL_AGAIN;
+}
+
+/**
+ * @brief End the OTA download, also to stop it before cy_ota_mqtt_get_data_step() is done
+ *
+ * @param[in]   ctx     - pointer to OTA agent context @ref cy_ota_context_t
+ * @param[in]   result  - result of the download
+ *
+ * @return  result
+ */
+cy_rslt_t cy_ota_mqtt_get_data_end(cy_ota_context_t *ctx, cy_rslt_t result)
+{
+    uint32_t    i;
+
+    CY_OTA_CONTEXT_ASSERT(ctx);
+
+    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG2, "%s() MQTT DONE result: 0x%lx\n", __func__, result);
+
+#if (CY_OTA_MQTT_REASSEMBLY_SIZE > 0)
+    /* Write what is left in the reassembly buffer, also on failure so a resume can use it */
+    if( (cy_ota_mqtt_reasm_flush(ctx, true) != CY_RSLT_SUCCESS) && (result == CY_RSLT_SUCCESS) )
+    {
+        result = CY_RSLT_OTA_ERROR_WRITE_STORAGE;
     }
-    ctx->mqtt.mqtt_timer_inited = false;
+#endif
 
-    ctx->sub_callback_mutex_inited = 0;
-    cy_rtos_deinit_mutex(&ctx->sub_callback_mutex);
+    i = cy_ota_mqtt_packet_map_find(ctx, 0, false);
+    while(i < ctx->mqtt.num_packets)
+    {
+        uint32_t run_end = cy_ota_mqtt_packet_map_find(ctx, i, true);
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG1, "PACKETS %d - %d missing!\n", i, (run_end - 1));
+        i = cy_ota_mqtt_packet_map_find(ctx, run_end, false);
+    }
+    if(ctx->mqtt.duplicate_packets > 0)
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG1, "%d Duplicate PACKETS!\n", ctx->mqtt.duplicate_packets);
+    }
 
-    return result;
+    return cy_ota_mqtt_get_data_cleanup(ctx, result);
 }
 
 /**
@@ -1604,7 +2522,7 @@ cy_rslt_t cy_ota_mqtt_report_result(cy_ota_context_t *ctx, cy_rslt_t last_error)
     cy_ota_callback_results_t   cb_result;
     cy_rslt_t                   result = CY_RSLT_SUCCESS;
 
-    sprintf(ctx->mqtt.json_doc, CY_OTA_MQTT_RESULT_JSON,
+    sprintf(ctx->json_doc, CY_OTA_MQTT_RESULT_JSON,
             ( (last_error == CY_RSLT_SUCCESS) ? CY_OTA_RESULT_SUCCESS : CY_OTA_RESULT_FAILURE),
             ctx->mqtt.unique_topic);
 
@@ -1616,7 +2534,7 @@ cy_rslt_t cy_ota_mqtt_report_result(cy_ota_context_t *ctx, cy_rslt_t last_error)
     {
         default:
         case CY_OTA_CB_RSLT_OTA_CONTINUE:
-            result = cy_ota_mqtt_publish_request(ctx, (char *)SUBSCRIBER_PUBLISH_TOPIC, ctx->mqtt.json_doc);
+            result = cy_ota_mqtt_publish_request(ctx, (char *)SUBSCRIBER_PUBLISH_TOPIC, ctx->json_doc);
             break;
         case CY_OTA_CB_RSLT_OTA_STOP:
             cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() App returned OTA Stop for STATE_CHANGE for SEND_RESULT\n", __func__);
@@ -0,0 +1,221 @@
+/*
+ * Copyright 2025, Cypress Semiconductor Corporation (an Infineon company) or
+ * an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+ *
+ * This software, including source code, documentation and related
+ * materials ("Software") is owned by Cypress Semiconductor Corporation
+ * or one of its affiliates ("Cypress") and is protected by and subject to
+ * worldwide patent protection (United States and foreign),
+ * United States copyright laws and international treaty provisions.
+ * Therefore, you may use this Software only as provided in the license
+ * agreement accompanying the software package from which you
+ * obtained this Software ("EULA").
+ * If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+ * non-transferable license to copy, modify, and compile the Software
+ * source code solely for use in connection with Cypress's
+ * integrated circuit products.  Any reproduction, modification, translation,
+ * compilation, or representation of this Software except as specified
+ * above is prohibited without the express written permission of Cypress.
+ *
+ * Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+ * reserves the right to make changes to the Software without notice. Cypress
+ * does not assume any liability arising out of the application or use of the
+ * Software or any product or circuit described in the Software. Cypress does
+ * not authorize its products for use in any products where a malfunction or
+ * failure of the Cypress product may reasonably be expected to result in
+ * significant property damage, injury or death ("High Risk Product"). By
+ * including Cypress's product in a High Risk Product, the manufacturer
+ * of such system or application assumes all risk of such use and in doing
+ * so agrees to indemnify Cypress against all liability.
+ */
+
+/*
+ *  Cypress OTA Agent SHA-256
+ *
+ *  Small SHA-256 (FIPS 180-4) for the streaming OTA Image digest, so the
+ *  digest does not depend on the TLS library being part of the build.
+ */
+
+#include <string.h>
+
+#include "cy_ota_api.h"
+#include "cy_ota_internal.h"
+
+/***********************************************************************
+ *
+ * defines & enums
+ *
+ **********************************************************************/
+#define ROTR32(x, n)    ( ((x) >> (n)) | ((x) << (32 - (n))) )
+
+#define SHA256_CH(x, y, z)      ( ((x) & (y)) ^ (~(x) & (z)) )
+#define SHA256_MAJ(x, y, z)     ( ((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)) )
+#define SHA256_BSIG0(x)         ( ROTR32((x),  2) ^ ROTR32((x), 13) ^ ROTR32((x), 22) )
+#define SHA256_BSIG1(x)         ( ROTR32((x),  6) ^ ROTR32((x), 11) ^ ROTR32((x), 25) )
+#define SHA256_SSIG0(x)         ( ROTR32((x),  7) ^ ROTR32((x), 18) ^ ((x) >>  3) )
+#define SHA256_SSIG1(x)         ( ROTR32((x), 17) ^ ROTR32((x), 19) ^ ((x) >> 10) )
+
+/***********************************************************************
+ *
+ * Data
+ *
+ **********************************************************************/
+static const uint32_t cy_ota_sha256_k[64] =
+{
+    0x428a2f98U, 0x71374491U, 0xb5c0fbcfU, 0xe9b5dba5U, 0x3956c25bU, 0x59f111f1U, 0x923f82a4U, 0xab1c5ed5U,
+    0xd807aa98U, 0x12835b01U, 0x243185beU, 0x550c7dc3U, 0x72be5d74U, 0x80deb1feU, 0x9bdc06a7U, 0xc19bf174U,
+    0xe49b69c1U, 0xefbe4786U, 0x0fc19dc6U, 0x240ca1ccU, 0x2de92c6fU, 0x4a7484aaU, 0x5cb0a9dcU, 0x76f988daU,
+    0x983e5152U, 0xa831c66dU, 0xb00327c8U, 0xbf597fc7U, 0xc6e00bf3U, 0xd5a79147U, 0x06ca6351U, 0x14292967U,
+    0x27b70a85U, 0x2e1b2138U, 0x4d2c6dfcU, 0x53380d13U, 0x650a7354U, 0x766a0abbU, 0x81c2c92eU, 0x92722c85U,
+    0xa2bfe8a1U, 0xa81a664bU, 0xc24b8b70U, 0xc76c51a3U, 0xd192e819U, 0xd6990624U, 0xf40e3585U, 0x106aa070U,
+    0x19a4c116U, 0x1e376c08U, 0x2748774cU, 0x34b0bcb5U, 0x391c0cb3U, 0x4ed8aa4aU, 0x5b9cca4fU, 0x682e6ff3U,
+    0x748f82eeU, 0x78a5636fU, 0x84c87814U, 0x8cc70208U, 0x90befffaU, 0xa4506cebU, 0xbef9a3f7U, 0xc67178f2U,
+};
+
+/***********************************************************************
+ *
+ * Functions
+ *
+ **********************************************************************/
+
+/**
+ * @brief Process one 64 byte block
+ *
+ * @param[in]   state   - hash state
+ * @param[in]   block   - 64 bytes of message
+ */
+static void cy_ota_sha256_block(uint32_t state[8], const uint8_t *block)
+{
+    uint32_t    w[64];
+    uint32_t    a, b, c, d, e, f, g, h;
+    uint32_t    t1, t2;
+    int         i;
+
+    for(i = 0; i < 16; i++)
+    {
+        w[i] = ( ((uint32_t)block[(i * 4) + 0] << 24) | ((uint32_t)block[(i * 4) + 1] << 16) |
+                 ((uint32_t)block[(i * 4) + 2] <<  8) |  (uint32_t)block[(i * 4) + 3] );
+    }
+    for( ; i < 64; i++)
+    {
+        w[i] = SHA256_SSIG1(w[i - 2]) + w[i - 7] + SHA256_SSIG0(w[i - 15]) + w[i - 16];
+    }
+
+    a = state[0];
+    b = state[1];
+    c = state[2];
+    d = state[3];
+    e = state[4];
+    f = state[5];
+    g = state[6];
+    h = state[7];
+
+    for(i = 0; i < 64; i++)
+    {
+        t1 = h + SHA256_BSIG1(e) + SHA256_CH(e, f, g) + cy_ota_sha256_k[i] + w[i];
+        t2 = SHA256_BSIG0(a) + SHA256_MAJ(a, b, c);
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
+
+void cy_ota_sha256_init(cy_ota_sha256_context_t *sha)
+{
+    sha->state[0] = 0x6a09e667U;
+    sha->state[1] = 0xbb67ae85U;
+    sha->state[2] = 0x3c6ef372U;
+    sha->state[3] = 0xa54ff53aU;
+    sha->state[4] = 0x510e527fU;
+    sha->state[5] = 0x9b05688cU;
+    sha->state[6] = 0x1f83d9abU;
+    sha->state[7] = 0x5be0cd19U;
+    sha->length   = 0;
+    sha->used     = 0;
+}
+
+void cy_ota_sha256_update(cy_ota_sha256_context_t *sha, const uint8_t *buffer, uint32_t size)
+{
+    uint32_t    copy;
+
+    sha->length += size;
+
+    /* Finish a partial block first */
+    if(sha->used > 0)
+    {
+        copy = CY_OTA_SHA256_BLOCK_SIZE - sha->used;
+        if(copy > size)
+        {
+            copy = size;
+        }
+        memcpy(&sha->block[sha->used], buffer, copy);
+        sha->used += copy;
+        buffer    += copy;
+        size      -= copy;
+        if(sha->used < CY_OTA_SHA256_BLOCK_SIZE)
+        {
+            return;
+        }
+        cy_ota_sha256_block(sha->state, sha->block);
+        sha->used = 0;
+    }
+
+    /* Whole blocks straight from the caller's buffer */
+    while(size >= CY_OTA_SHA256_BLOCK_SIZE)
+    {
+        cy_ota_sha256_block(sha->state, buffer);
+        buffer += CY_OTA_SHA256_BLOCK_SIZE;
+        size   -= CY_OTA_SHA256_BLOCK_SIZE;
+    }
+
+    if(size > 0)
+    {
+        memcpy(sha->block, buffer, size);
+        sha->used = size;
+    }
+}
+
+void cy_ota_sha256_finish(cy_ota_sha256_context_t *sha, uint8_t digest[CY_OTA_SHA256_DIGEST_SIZE])
+{
+    uint64_t    bits = sha->length * 8;
+    int         i;
+
+    /* Pad with 0x80, zeros, then the message length in bits */
+    sha->block[sha->used++] = 0x80;
+    if(sha->used > (CY_OTA_SHA256_BLOCK_SIZE - 8))
+    {
+        memset(&sha->block[sha->used], 0x00, (CY_OTA_SHA256_BLOCK_SIZE - sha->used));
+        cy_ota_sha256_block(sha->state, sha->block);
+        sha->used = 0;
+    }
+    memset(&sha->block[sha->used], 0x00, ((CY_OTA_SHA256_BLOCK_SIZE - 8) - sha->used));
+    for(i = 0; i < 8; i++)
+    {
+        sha->block[(CY_OTA_SHA256_BLOCK_SIZE - 1) - i] = (uint8_t)(bits >> (i * 8));
+    }
+    cy_ota_sha256_block(sha->state, sha->block);
+
+    for(i = 0; i < 8; i++)
+    {
+        digest[(i * 4) + 0] = (uint8_t)(sha->state[i] >> 24);
+        digest[(i * 4) + 1] = (uint8_t)(sha->state[i] >> 16);
+        digest[(i * 4) + 2] = (uint8_t)(sha->state[i] >>  8);
+        digest[(i * 4) + 3] = (uint8_t)(sha->state[i]);
+    }
+}
@@ -0,0 +1,565 @@
+/*
+ * Copyright 2025, Cypress Semiconductor Corporation (an Infineon company) or
+ * an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+ *
+ * This software, including source code, documentation and related
+ * materials ("Software") is owned by Cypress Semiconductor Corporation
+ * or one of its affiliates ("Cypress") and is protected by and subject to
+ * worldwide patent protection (United States and foreign),
+ * United States copyright laws and international treaty provisions.
+ * Therefore, you may use this Software only as provided in the license
+ * agreement accompanying the software package from which you
+ * obtained this Software ("EULA").
+ * If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+ * non-transferable license to copy, modify, and compile the Software
+ * source code solely for use in connection with Cypress's
+ * integrated circuit products.  Any reproduction, modification, translation,
+ * compilation, or representation of this Software except as specified
+ * above is prohibited without the express written permission of Cypress.
+ *
+ * Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+ * reserves the right to make changes to the Software without notice. Cypress
+ * does not assume any liability arising out of the application or use of the
+ * Software or any product or circuit described in the Software. Cypress does
+ * not authorize its products for use in any products where a malfunction or
+ * failure of the Cypress product may reasonably be expected to result in
+ * significant property damage, injury or death ("High Risk Product"). By
+ * including Cypress's product in a High Risk Product, the manufacturer
+ * of such system or application assumes all risk of such use and in doing
+ * so agrees to indemnify Cypress against all liability.
+ */
+
+/*
+ *  Cypress OTA Agent storage write path
+ *
+ *  Decompresses received data, applies patches, splits TAR archives, collects
+ *  data so that storage is written in fewer, larger, page aligned writes,
+ *  erases storage ahead of the data written, and computes the OTA Image
+ *  digest as it is written.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cy_ota_api.h"
+#include "cy_ota_internal.h"
+#include "cy_ota_log.h"
+
+/***********************************************************************
+ *
+ * defines & enums
+ *
+ **********************************************************************/
+#define CY_OTA_SECTOR_ROUND_UP(x)   ( ( ((x) + (CY_OTA_STORAGE_SECTOR_SIZE - 1)) / CY_OTA_STORAGE_SECTOR_SIZE) * CY_OTA_STORAGE_SECTOR_SIZE)
+
+/***********************************************************************
+ *
+ * Functions
+ *
+ **********************************************************************/
+
+/**
+ * @brief Erase storage for a write, or one sector ahead of it
+ *
+ * @param[in]   ctx         - pointer to OTA agent context @ref cy_ota_context_t
+ * @param[in]   end         - OTA Image offset just past the data to write
+ * @param[in]   total_size  - OTA Image size, 0 = unknown
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          Error from ota_file_erase()
+ */
+static cy_rslt_t cy_ota_storage_erase_ahead(cy_ota_context_t *ctx, uint32_t end, uint32_t total_size)
+{
+    cy_rslt_t   result;
+    uint32_t    target;
+    uint32_t    limit;
+
+    if(ctx->erase_ahead == false)
+    {
+        return CY_RSLT_SUCCESS;
+    }
+
+    /* Storage under the write must be erased now */
+    target = CY_OTA_SECTOR_ROUND_UP(end);
+    if(ctx->erased_size < target)
+    {
+        result = ctx->storage_iface.ota_file_erase(&(ctx->ota_storage_context), ctx->erased_size, (target - ctx->erased_size));
+        if(result != CY_RSLT_SUCCESS)
+        {
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Erase failed at offset 0x%lx size 0x%lx\n", __func__, ctx->erased_size, (target - ctx->erased_size));
+            return result;
+        }
+        ctx->erased_size = target;
+        return CY_RSLT_SUCCESS;
+    }
+
+    /* Build up the distance ahead one sector per write, so no write waits for more than one erase */
+    limit = end + CY_OTA_STORAGE_ERASE_AHEAD_SIZE;
+    if( (total_size > 0) && (limit > CY_OTA_SECTOR_ROUND_UP(total_size)) )
+    {
+        limit = CY_OTA_SECTOR_ROUND_UP(total_size);
+    }
+    if(ctx->erased_size < limit)
+    {
+        result = ctx->storage_iface.ota_file_erase(&(ctx->ota_storage_context), ctx->erased_size, CY_OTA_STORAGE_SECTOR_SIZE);
+        if(result != CY_RSLT_SUCCESS)
+        {
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Erase failed at offset 0x%lx\n", __func__, ctx->erased_size);
+            return result;
+        }
+        ctx->erased_size += CY_OTA_STORAGE_SECTOR_SIZE;
+    }
+
+    return CY_RSLT_SUCCESS;
+}
+
+#if (CY_OTA_IMAGE_DIGEST)
+/**
+ * @brief Add the next contiguous data to the OTA Image digest
+ *
+ * @param[in]   ctx     - pointer to OTA agent context @ref cy_ota_context_t
+ * @param[in]   buffer  - data at OTA Image offset ctx->digest.offset
+ * @param[in]   size    - bytes of data
+ */
+static void cy_ota_digest_hash(cy_ota_context_t *ctx, const uint8_t *buffer, uint32_t size)
+{
+#if (CY_OTA_IMAGE_DIGEST_SHA256 == 1)
+    cy_ota_sha256_update(&ctx->digest.sha256, buffer, size);
+#endif
+#if (CY_OTA_IMAGE_DIGEST_CRC32 == 1)
+    ctx->digest.crc32 = cy_ota_crc32_update(ctx->digest.crc32, buffer, size);
+#endif
+    ctx->digest.offset += size;
+}
+
+/**
+ * @brief Read data written out of order back from storage and add it to the digest
+ *
+ * @param[in]   ctx     - pointer to OTA agent context @ref cy_ota_context_t
+ * @param[in]   end     - OTA Image offset to read up to
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          CY_RSLT_OTA_ERROR_UNSUPPORTED
+ *          CY_RSLT_OTA_ERROR_OUT_OF_MEMORY
+ *          CY_RSLT_OTA_ERROR_READ_STORAGE
+ */
+static cy_rslt_t cy_ota_digest_read_back(cy_ota_context_t *ctx, uint32_t end)
+{
+    cy_ota_storage_read_info_t  info;
+
+    /* A TAR archive is not stored at its download offsets */
+    if( (ctx->storage_iface.ota_file_read == NULL) || (ctx->ota_storage_context.ota_is_tar_archive != 0) )
+    {
+        return CY_RSLT_OTA_ERROR_UNSUPPORTED;
+    }
+
+    if(ctx->digest.read_buffer == NULL)
+    {
+        ctx->digest.read_buffer = (uint8_t *)cy_ota_mem_alloc(ctx, CY_OTA_MEM_DIGEST_READ, CY_OTA_CHUNK_SIZE);
+        if(ctx->digest.read_buffer == NULL)
+        {
+            return CY_RSLT_OTA_ERROR_OUT_OF_MEMORY;
+        }
+    }
+
+    while(ctx->digest.offset < end)
+    {
+        memset(&info, 0x00, sizeof(info));
+        info.total_size = ctx->ota_storage_context.total_image_size;
+        info.offset     = ctx->digest.offset;
+        info.buffer     = ctx->digest.read_buffer;
+        info.size       = end - ctx->digest.offset;
+        if(info.size > CY_OTA_CHUNK_SIZE)
+        {
+            info.size = CY_OTA_CHUNK_SIZE;
+        }
+        if(ctx->storage_iface.ota_file_read(&(ctx->ota_storage_context), &info) != CY_RSLT_SUCCESS)
+        {
+            return CY_RSLT_OTA_ERROR_READ_STORAGE;
+        }
+        cy_ota_digest_hash(ctx, info.buffer, info.size);
+    }
+
+    return CY_RSLT_SUCCESS;
+}
+
+/**
+ * @brief Add written data to the OTA Image digest
+ *
+ * Data is hashed in OTA Image order. Data written ahead of a hole is hashed
+ *  (read back from storage) once the hole is written.
+ *
+ * @param[in]   ctx     - pointer to OTA agent context @ref cy_ota_context_t
+ * @param[in]   info    - chunk written to storage @ref cy_ota_storage_write_info_t
+ */
+static void cy_ota_digest_update(cy_ota_context_t *ctx, const cy_ota_storage_write_info_t *info)
+{
+    cy_rslt_t   result;
+    uint32_t    info_end;
+    uint32_t    end;
+    uint32_t    stop;
+
+    if(ctx->digest.active == false)
+    {
+        return;
+    }
+
+    if(cy_ota_range_map_add(&ctx->digest.written, info->offset, info->size) != CY_RSLT_SUCCESS)
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_NOTICE, "%s() Too many out of order writes, no OTA Image digest\n", __func__);
+        ctx->digest.active = false;
+        return;
+    }
+
+    /* End of the data in storage from the start of the OTA Image */
+    end = cy_ota_range_map_next_hole(&ctx->digest.written, 0, NULL);
+    info_end = info->offset + info->size;
+
+    while(ctx->digest.offset < end)
+    {
+        if( (ctx->digest.offset >= info->offset) && (ctx->digest.offset < info_end) )
+        {
+            stop = (info_end < end) ? info_end : end;
+            cy_ota_digest_hash(ctx, &info->buffer[ctx->digest.offset - info->offset], (stop - ctx->digest.offset));
+            continue;
+        }
+
+        /* Written earlier, out of order */
+        stop = ( (info->offset > ctx->digest.offset) && (info->offset < end) ) ? info->offset : end;
+        result = cy_ota_digest_read_back(ctx, stop);
+        if(result != CY_RSLT_SUCCESS)
+        {
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_NOTICE, "%s() Read back failed 0x%lx, no OTA Image digest\n", __func__, result);
+            ctx->digest.active = false;
+            return;
+        }
+    }
+}
+
+void cy_ota_digest_start(cy_ota_context_t *ctx, uint32_t resume_offset)
+{
+    CY_OTA_CONTEXT_ASSERT(ctx);
+
+    if(ctx->digest.read_buffer != NULL)
+    {
+        cy_ota_mem_free(ctx, ctx->digest.read_buffer);
+        ctx->digest.read_buffer = NULL;
+    }
+    ctx->digest.active = true;
+    ctx->digest.offset = 0;
+    cy_ota_range_map_clear(&ctx->digest.written);
+    (void)cy_ota_range_map_add(&ctx->digest.written, 0, resume_offset);
+#if (CY_OTA_IMAGE_DIGEST_SHA256 == 1)
+    cy_ota_sha256_init(&ctx->digest.sha256);
+#endif
+#if (CY_OTA_IMAGE_DIGEST_CRC32 == 1)
+    ctx->digest.crc32 = 0;
+#endif
+    ctx->ota_storage_context.image_digest_flags = 0;
+}
+
+void cy_ota_digest_finish(cy_ota_context_t *ctx)
+{
+    uint8_t     flags = 0;
+
+    CY_OTA_CONTEXT_ASSERT(ctx);
+
+    if( (ctx->digest.active == true) &&
+        (ctx->ota_storage_context.total_image_size > 0) &&
+        (ctx->digest.offset == ctx->ota_storage_context.total_image_size) )
+    {
+#if (CY_OTA_IMAGE_DIGEST_SHA256 == 1)
+        cy_ota_sha256_finish(&ctx->digest.sha256, ctx->ota_storage_context.image_sha256);
+        flags |= CY_OTA_IMAGE_DIGEST_FLAG_SHA256;
+#endif
+#if (CY_OTA_IMAGE_DIGEST_CRC32 == 1)
+        ctx->ota_storage_context.image_crc32 = ctx->digest.crc32;
+        flags |= CY_OTA_IMAGE_DIGEST_FLAG_CRC32;
+#endif
+    }
+    else
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_NOTICE, "%s() Hashed 0x%lx of 0x%lx, no OTA Image digest\n", __func__,
+                       ctx->digest.offset, ctx->ota_storage_context.total_image_size);
+    }
+    ctx->ota_storage_context.image_digest_flags = flags;
+
+    ctx->digest.active = false;
+    if(ctx->digest.read_buffer != NULL)
+    {
+        cy_ota_mem_free(ctx, ctx->digest.read_buffer);
+        ctx->digest.read_buffer = NULL;
+    }
+}
+#endif  /* CY_OTA_IMAGE_DIGEST */
+
+/**
+ * @brief Pass a write to the storage interface, erasing ahead of it first
+ *        and adding it to the OTA Image digest after
+ *
+ * @param[in]   ctx     - pointer to OTA agent context @ref cy_ota_context_t
+ * @param[in]   info    - chunk to write @ref cy_ota_storage_write_info_t
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          Error from ota_file_erase() or ota_file_write()
+ */
+static cy_rslt_t cy_ota_storage_file_write(cy_ota_context_t *ctx, cy_ota_storage_write_info_t *info)
+{
+    cy_rslt_t   result;
+    uint32_t    total_size;
+
+    /* Decompressed data carries the uncompressed size */
+    total_size = info->total_size;
+    if(total_size == 0)
+    {
+        total_size = ctx->ota_storage_context.total_image_size;
+    }
+
+    result = cy_ota_storage_erase_ahead(ctx, (info->offset + info->size), total_size);
+    if(result != CY_RSLT_SUCCESS)
+    {
+        return result;
+    }
+
+    result = ctx->storage_iface.ota_file_write(&(ctx->ota_storage_context), info);
+#if (CY_OTA_IMAGE_DIGEST)
+    if(result == CY_RSLT_SUCCESS)
+    {
+        cy_ota_digest_update(ctx, info);
+    }
+#endif
+    return result;
+}
+
+cy_rslt_t cy_ota_storage_open(cy_ota_context_t *ctx)
+{
+    cy_rslt_t   result;
+
+    CY_OTA_CONTEXT_ASSERT(ctx);
+
+    ctx->erase_ahead = false;
+    ctx->erased_size = 0;
+
+#if (CY_OTA_STORAGE_ERASE_AHEAD_SIZE > 0)
+    if( (ctx->storage_iface.ota_file_open_no_erase != NULL) &&
+        (ctx->storage_iface.ota_file_erase != NULL) )
+    {
+        result = ctx->storage_iface.ota_file_open_no_erase(&(ctx->ota_storage_context));
+        if(result == CY_RSLT_SUCCESS)
+        {
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "%s() Erase %d bytes ahead of writes\n", __func__, CY_OTA_STORAGE_ERASE_AHEAD_SIZE);
+            ctx->erase_ahead = true;
+        }
+        return result;
+    }
+#endif
+
+    /* Erases the whole slot */
+    result = ctx->storage_iface.ota_file_open(&(ctx->ota_storage_context));
+    return result;
+}
+
+#if (CY_OTA_STORAGE_COALESCE_SIZE > 0)
+/**
+ * @brief Write part of the coalescing buffer or the caller's buffer
+ *
+ * @param[in]   ctx     - pointer to OTA agent context @ref cy_ota_context_t
+ * @param[in]   offset  - OTA Image offset
+ * @param[in]   buffer  - data to write
+ * @param[in]   size    - bytes to write
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          Error from ota_file_write()
+ */
+static cy_rslt_t cy_ota_coalesce_write(cy_ota_context_t *ctx, uint32_t offset, uint8_t *buffer, uint32_t size)
+{
+    cy_ota_storage_write_info_t info;
+    cy_rslt_t                   result;
+
+    info        = ctx->coalesce.info;
+    info.offset = offset;
+    info.buffer = buffer;
+    info.size   = size;
+
+    result = cy_ota_storage_file_write(ctx, &info);
+    if(result != CY_RSLT_SUCCESS)
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Write failed at offset 0x%lx size 0x%lx\n", __func__, offset, size);
+        /* The data is already counted as written, so every later write must fail */
+        ctx->coalesce.result = result;
+    }
+    return result;
+}
+
+cy_rslt_t cy_ota_coalesce_start(cy_ota_context_t *ctx)
+{
+    CY_OTA_CONTEXT_ASSERT(ctx);
+
+    if(ctx->coalesce.buffer == NULL)
+    {
+        ctx->coalesce.buffer = (uint8_t *)cy_ota_mem_alloc(ctx, CY_OTA_MEM_COALESCE, CY_OTA_STORAGE_COALESCE_SIZE);
+        if(ctx->coalesce.buffer == NULL)
+        {
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Out of memory for %d byte coalescing buffer\n", __func__, CY_OTA_STORAGE_COALESCE_SIZE);
+            return CY_RSLT_OTA_ERROR_OUT_OF_MEMORY;
+        }
+    }
+    ctx->coalesce.start  = 0;
+    ctx->coalesce.length = 0;
+    ctx->coalesce.limit  = 0;
+    ctx->coalesce.result = CY_RSLT_SUCCESS;
+
+    return CY_RSLT_SUCCESS;
+}
+
+cy_rslt_t cy_ota_coalesce_flush(cy_ota_context_t *ctx)
+{
+    uint32_t    length;
+
+    CY_OTA_CONTEXT_ASSERT(ctx);
+
+    length = ctx->coalesce.length;
+    ctx->coalesce.length = 0;
+    if( (length == 0) || (ctx->coalesce.result != CY_RSLT_SUCCESS) )
+    {
+        return ctx->coalesce.result;
+    }
+
+    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG2, "%s() offset 0x%lx size 0x%lx\n", __func__, ctx->coalesce.start, length);
+    return cy_ota_coalesce_write(ctx, ctx->coalesce.start, ctx->coalesce.buffer, length);
+}
+
+cy_rslt_t cy_ota_coalesce_stop(cy_ota_context_t *ctx)
+{
+    cy_rslt_t   result;
+
+    CY_OTA_CONTEXT_ASSERT(ctx);
+
+    if(ctx->coalesce.buffer == NULL)
+    {
+        return CY_RSLT_SUCCESS;
+    }
+
+    result = cy_ota_coalesce_flush(ctx);
+    cy_ota_mem_free(ctx, ctx->coalesce.buffer);
+    ctx->coalesce.buffer = NULL;
+
+    return result;
+}
+#endif  /* CY_OTA_STORAGE_COALESCE_SIZE > 0 */
+
+cy_rslt_t cy_ota_storage_write(cy_ota_context_t *ctx, cy_ota_storage_write_info_t *chunk_info)
+{
+    CY_OTA_CONTEXT_ASSERT(ctx);
+
+#if (CY_OTA_DECOMPRESS != CY_OTA_DECOMPRESS_NONE)
+    return cy_ota_decompress_write(ctx, chunk_info);
+#else
+    return cy_ota_storage_write_decoded(ctx, chunk_info);
+#endif
+}
+
+cy_rslt_t cy_ota_storage_write_decoded(cy_ota_context_t *ctx, cy_ota_storage_write_info_t *chunk_info)
+{
+    CY_OTA_CONTEXT_ASSERT(ctx);
+
+#if (CY_OTA_DELTA_UPDATE == 1)
+    return cy_ota_delta_write(ctx, chunk_info);
+#else
+    return cy_ota_storage_write_image(ctx, chunk_info);
+#endif
+}
+
+cy_rslt_t cy_ota_storage_write_image(cy_ota_context_t *ctx, cy_ota_storage_write_info_t *chunk_info)
+{
+    CY_OTA_CONTEXT_ASSERT(ctx);
+
+#if (CY_OTA_TAR_PARSER == 1)
+    return cy_ota_tar_write(ctx, chunk_info);
+#else
+    return cy_ota_storage_write_slot(ctx, chunk_info);
+#endif
+}
+
+cy_rslt_t cy_ota_storage_write_slot(cy_ota_context_t *ctx, cy_ota_storage_write_info_t *chunk_info)
+{
+#if (CY_OTA_STORAGE_COALESCE_SIZE > 0)
+    cy_rslt_t   result;
+    uint32_t    offset;
+    uint32_t    done = 0;
+    uint32_t    size;
+#endif
+
+    CY_OTA_CONTEXT_ASSERT(ctx);
+
+#if (CY_OTA_STORAGE_COALESCE_SIZE > 0)
+    if(ctx->coalesce.buffer != NULL)
+    {
+        if(ctx->coalesce.result != CY_RSLT_SUCCESS)
+        {
+            return ctx->coalesce.result;
+        }
+        ctx->coalesce.info = *chunk_info;
+
+        /* Data that does not continue the buffer starts a new one */
+        if( (ctx->coalesce.length > 0) &&
+            (chunk_info->offset != (ctx->coalesce.start + ctx->coalesce.length)) )
+        {
+            result = cy_ota_coalesce_flush(ctx);
+            if(result != CY_RSLT_SUCCESS)
+            {
+                return result;
+            }
+        }
+
+        while(done < chunk_info->size)
+        {
+            offset = chunk_info->offset + done;
+            size   = chunk_info->size - done;
+
+            if(ctx->coalesce.length == 0)
+            {
+                /* Whole pages from the caller's buffer do not need to be copied */
+                if( ((offset % CY_OTA_STORAGE_PAGE_SIZE) == 0) && (size >= CY_OTA_STORAGE_COALESCE_SIZE) )
+                {
+                    size -= (size % CY_OTA_STORAGE_PAGE_SIZE);
+                    result = cy_ota_coalesce_write(ctx, offset, &chunk_info->buffer[done], size);
+                    if(result != CY_RSLT_SUCCESS)
+                    {
+                        return result;
+                    }
+                    done += size;
+                    continue;
+                }
+
+                /* Fill the buffer up to a page boundary */
+                ctx->coalesce.start = offset;
+                ctx->coalesce.limit = CY_OTA_STORAGE_COALESCE_SIZE - (offset % CY_OTA_STORAGE_PAGE_SIZE);
+            }
+
+            if(size > (ctx->coalesce.limit - ctx->coalesce.length))
+            {
+                size = ctx->coalesce.limit - ctx->coalesce.length;
+            }
+            memcpy(&ctx->coalesce.buffer[ctx->coalesce.length], &chunk_info->buffer[done], size);
+            ctx->coalesce.length += size;
+            done += size;
+
+            if(ctx->coalesce.length == ctx->coalesce.limit)
+            {
+                result = cy_ota_coalesce_flush(ctx);
+                if(result != CY_RSLT_SUCCESS)
+                {
+                    return result;
+                }
+            }
+        }
+        return CY_RSLT_SUCCESS;
+    }
+#endif
+
+    return cy_ota_storage_file_write(ctx, chunk_info);
+}
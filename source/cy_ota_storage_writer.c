@@ -0,0 +1,379 @@
+/*
+ * Copyright 2025, Cypress Semiconductor Corporation (an Infineon company) or
+ * an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+ *
+ * This software, including source code, documentation and related
+ * materials ("Software") is owned by Cypress Semiconductor Corporation
+ * or one of its affiliates ("Cypress") and is protected by and subject to
+ * worldwide patent protection (United States and foreign),
+ * United States copyright laws and international treaty provisions.
+ * Therefore, you may use this Software only as provided in the license
+ * agreement accompanying the software package from which you
+ * obtained this Software ("EULA").
+ * If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+ * non-transferable license to copy, modify, and compile the Software
+ * source code solely for use in connection with Cypress's
+ * integrated circuit products.  Any reproduction, modification, translation,
+ * compilation, or representation of this Software except as specified
+ * above is prohibited without the express written permission of Cypress.
+ *
+ * Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+ * reserves the right to make changes to the Software without notice. Cypress
+ * does not assume any liability arising out of the application or use of the
+ * Software or any product or circuit described in the Software. Cypress does
+ * not authorize its products for use in any products where a malfunction or
+ * failure of the Cypress product may reasonably be expected to result in
+ * significant property damage, injury or death ("High Risk Product"). By
+ * including Cypress's product in a High Risk Product, the manufacturer
+ * of such system or application assumes all risk of such use and in doing
+ * so agrees to indemnify Cypress against all liability.
+ */
+
+/*
+ *  Cypress OTA Agent storage writer thread
+ *
+ *  Writes received data to storage on a separate thread, so that receiving
+ *  the next chunk over the network overlaps writing the current one.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cy_ota_api.h"
+
+#if defined(COMPONENT_OTA_HTTP) || defined(COMPONENT_OTA_MQTT)
+
+#include "cy_ota_internal.h"
+
+#if (CY_OTA_STORAGE_WRITER_BUFFERS > 0)
+
+#include "cyabs_rtos.h"
+#include "cy_ota_log.h"
+
+/***********************************************************************
+ *
+ * defines & enums
+ *
+ **********************************************************************/
+/* Slot index that tells the writer thread to exit */
+#define OTA_WRITER_STOP_INDEX           (0xFF)
+
+#if (CY_OTA_STORAGE_WRITER_BUFFERS >= OTA_WRITER_STOP_INDEX)
+#error "CY_OTA_STORAGE_WRITER_BUFFERS too large"
+#endif
+
+#ifdef COMPONENT_THREADX
+__attribute__((aligned(8)))
+static uint8_t ota_writer_thread_stack[CY_OTA_MAX_AGENTS][OTA_WRITER_THREAD_STACK_SIZE] = { {0} };
+#endif
+
+/***********************************************************************
+ *
+ * Functions
+ *
+ **********************************************************************/
+
+/**
+ * @brief Write one chunk to storage (writer thread)
+ *
+ * @param[in]   ctx         - pointer to OTA agent context @ref cy_ota_context_t
+ * @param[in]   chunk_info  - chunk to write @ref cy_ota_storage_write_info_t
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          CY_RSLT_OTA_ERROR_WRITE_STORAGE
+ *          CY_RSLT_OTA_ERROR_APP_RETURNED_STOP
+ */
+static cy_rslt_t cy_ota_writer_write(cy_ota_context_t *ctx, cy_ota_storage_write_info_t *chunk_info)
+{
+    cy_ota_callback_results_t cb_result;
+
+    /* store the chunk for temporary use in the callback */
+    ctx->storage = chunk_info;
+    cb_result = cy_ota_internal_call_cb(ctx, CY_OTA_REASON_STATE_CHANGE, CY_OTA_STATE_STORAGE_WRITE);
+    switch( cb_result )
+    {
+        default:
+        /* Fall through */
+        case CY_OTA_CB_RSLT_OTA_CONTINUE:
+            if(cy_ota_storage_write(ctx, chunk_info) != CY_RSLT_SUCCESS)
+            {
+                cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Write failed at offset 0x%lx\n", __func__, chunk_info->offset);
+                return CY_RSLT_OTA_ERROR_WRITE_STORAGE;
+            }
+            break;
+
+        case CY_OTA_CB_RSLT_OTA_STOP:
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() App returned OTA Stop for STATE_CHANGE for OTA platform storage block write API\n", __func__);
+            return CY_RSLT_OTA_ERROR_APP_RETURNED_STOP;
+
+        case CY_OTA_CB_RSLT_APP_SUCCESS:
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_NOTICE, "%s() App returned APP_SUCCESS for STATE_CHANGE for OTA platform storage block write API\n", __func__);
+            break;
+
+        case CY_OTA_CB_RSLT_APP_FAILED:
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() App returned APP_FAILED for STATE_CHANGE for OTA platform storage block write API\n", __func__);
+            return CY_RSLT_OTA_ERROR_WRITE_STORAGE;
+    }
+
+    return CY_RSLT_SUCCESS;
+}
+
+/**
+ * @brief Get the writer result under the writer mutex
+ *
+ * @param[in]   ctx - pointer to OTA agent context @ref cy_ota_context_t
+ *
+ * @return  First write error, CY_RSLT_SUCCESS if none
+ */
+static cy_rslt_t cy_ota_writer_result(cy_ota_context_t *ctx)
+{
+    cy_rslt_t   result;
+
+    cy_rtos_get_mutex(&ctx->writer.mutex, CY_RTOS_NEVER_TIMEOUT);
+    result = ctx->writer.result;
+    cy_rtos_set_mutex(&ctx->writer.mutex);
+
+    return result;
+}
+
+/**
+ * @brief Storage writer thread
+ *
+ * Writes queued slots in order. After the first error, the remaining
+ *  slots are released without writing so the network side never blocks.
+ *
+ * @param[in]   arg - pointer to OTA agent context @ref cy_ota_context_t
+ */
+static void cy_ota_writer_thread(cy_thread_arg_t arg)
+{
+    cy_ota_context_t        *ctx = (cy_ota_context_t *)arg;
+    cy_ota_writer_slot_t    *slot;
+    cy_rslt_t               result;
+    uint8_t                 index;
+
+    while(1)
+    {
+        if(cy_rtos_get_queue(&ctx->writer.full_queue, &index, CY_RTOS_NEVER_TIMEOUT, false) != CY_RSLT_SUCCESS)
+        {
+            continue;
+        }
+        if(index == OTA_WRITER_STOP_INDEX)
+        {
+            break;
+        }
+
+        slot = &ctx->writer.slots[index];
+        if(cy_ota_writer_result(ctx) == CY_RSLT_SUCCESS)
+        {
+            result = cy_ota_writer_write(ctx, &slot->info);
+            if(result == CY_RSLT_SUCCESS)
+            {
+                /* only now is the chunk in storage */
+                cy_ota_storage_written(ctx, &slot->info);
+            }
+            else
+            {
+                cy_rtos_get_mutex(&ctx->writer.mutex, CY_RTOS_NEVER_TIMEOUT);
+                ctx->writer.result = result;
+                cy_rtos_set_mutex(&ctx->writer.mutex);
+                cy_rtos_setbits_event(&ctx->ota_event,
+                                      (uint32_t)( (result == CY_RSLT_OTA_ERROR_APP_RETURNED_STOP) ?
+                                                  CY_OTA_EVENT_APP_STOPPED_OTA : CY_OTA_EVENT_STORAGE_ERROR), 0);
+            }
+        }
+
+        (void)cy_rtos_put_queue(&ctx->writer.free_queue, &index, CY_RTOS_NEVER_TIMEOUT, false);
+    }
+
+    cy_rtos_exit_thread();
+}
+
+cy_rslt_t cy_ota_writer_start(cy_ota_context_t *ctx)
+{
+    cy_rslt_t   result;
+    uint8_t     index;
+#ifndef COMPONENT_THREADX
+    void        *stack;
+#endif
+
+    CY_OTA_CONTEXT_ASSERT(ctx);
+
+    memset(&ctx->writer, 0x00, sizeof(ctx->writer));
+    ctx->writer.result = CY_RSLT_SUCCESS;
+
+    ctx->writer.slots = (cy_ota_writer_slot_t *)cy_ota_mem_alloc(ctx, CY_OTA_MEM_WRITER_SLOTS, CY_OTA_STORAGE_WRITER_BUFFERS * sizeof(cy_ota_writer_slot_t));
+    if(ctx->writer.slots == NULL)
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Out of memory for %d writer buffers\n", __func__, CY_OTA_STORAGE_WRITER_BUFFERS);
+        return CY_RSLT_OTA_ERROR_OUT_OF_MEMORY;
+    }
+
+    if(cy_rtos_init_mutex(&ctx->writer.mutex) != CY_RSLT_SUCCESS)
+    {
+        result = CY_RSLT_OTA_ERROR_GENERAL;
+        goto _writer_free_slots;
+    }
+    if(cy_rtos_init_queue(&ctx->writer.free_queue, CY_OTA_STORAGE_WRITER_BUFFERS, sizeof(uint8_t)) != CY_RSLT_SUCCESS)
+    {
+        result = CY_RSLT_OTA_ERROR_GENERAL;
+        goto _writer_free_mutex;
+    }
+    /* one extra entry for OTA_WRITER_STOP_INDEX */
+    if(cy_rtos_init_queue(&ctx->writer.full_queue, (CY_OTA_STORAGE_WRITER_BUFFERS + 1), sizeof(uint8_t)) != CY_RSLT_SUCCESS)
+    {
+        result = CY_RSLT_OTA_ERROR_GENERAL;
+        goto _writer_free_queue;
+    }
+
+    for(index = 0; index < CY_OTA_STORAGE_WRITER_BUFFERS; index++)
+    {
+        (void)cy_rtos_put_queue(&ctx->writer.free_queue, &index, 0, false);
+    }
+
+#ifdef COMPONENT_THREADX
+    result = cy_rtos_thread_create(&ctx->writer.thread,
+                                   &cy_ota_writer_thread,
+                                   "CY OTA Writer",
+                                   &ota_writer_thread_stack[ctx->agent_index],
+                                   OTA_WRITER_THREAD_STACK_SIZE,
+                                   CY_RTOS_PRIORITY_NORMAL,
+                                   (cy_thread_arg_t)ctx);
+#else
+    result = cy_ota_mem_thread_stack(ctx, CY_OTA_MEM_WRITER_STACK, 0, OTA_WRITER_THREAD_STACK_SIZE, &stack);
+    if(result == CY_RSLT_SUCCESS)
+    {
+        result = cy_rtos_create_thread(&ctx->writer.thread, cy_ota_writer_thread,
+                                       "CY OTA Writer", stack, OTA_WRITER_THREAD_STACK_SIZE,
+                                       CY_RTOS_PRIORITY_NORMAL, (cy_thread_arg_t)ctx);
+    }
+#endif
+    if(result != CY_RSLT_SUCCESS)
+    {
+        result = CY_RSLT_OTA_ERROR_GENERAL;
+        goto _writer_free_full_queue;
+    }
+
+    ctx->writer.running = true;
+    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "%s() Storage writer started with %d buffers\n", __func__, CY_OTA_STORAGE_WRITER_BUFFERS);
+    return CY_RSLT_SUCCESS;
+
+_writer_free_full_queue:
+    cy_rtos_deinit_queue(&ctx->writer.full_queue);
+_writer_free_queue:
+    cy_rtos_deinit_queue(&ctx->writer.free_queue);
+_writer_free_mutex:
+    cy_rtos_deinit_mutex(&ctx->writer.mutex);
+_writer_free_slots:
+    cy_ota_mem_free(ctx, ctx->writer.slots);
+    ctx->writer.slots = NULL;
+    return result;
+}
+
+cy_rslt_t cy_ota_writer_submit(cy_ota_context_t *ctx, cy_ota_storage_write_info_t *chunk_info)
+{
+    cy_ota_writer_slot_t    *slot;
+    cy_rslt_t               result;
+    uint32_t                done = 0;
+    uint32_t                size;
+    size_t                  num_free = 0;
+    uint8_t                 index;
+
+    CY_OTA_CONTEXT_ASSERT(ctx);
+
+    /* Larger chunks are split over several slots */
+    while(done < chunk_info->size)
+    {
+        result = cy_ota_writer_result(ctx);
+        if(result != CY_RSLT_SUCCESS)
+        {
+            return result;
+        }
+
+        /* Wait for a free slot - this is where the network side waits when the writer is behind */
+        if( (cy_rtos_count_queue(&ctx->writer.free_queue, &num_free) == CY_RSLT_SUCCESS) && (num_free == 0) )
+        {
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG2, "%s() Writer behind, waiting\n", __func__);
+        }
+        if(cy_rtos_get_queue(&ctx->writer.free_queue, &index, CY_RTOS_NEVER_TIMEOUT, false) != CY_RSLT_SUCCESS)
+        {
+            return CY_RSLT_OTA_ERROR_WRITE_STORAGE;
+        }
+
+        size = chunk_info->size - done;
+        if(size > CY_OTA_CHUNK_SIZE)
+        {
+            size = CY_OTA_CHUNK_SIZE;
+        }
+
+        slot = &ctx->writer.slots[index];
+        slot->info        = *chunk_info;
+        slot->info.offset = chunk_info->offset + done;
+        slot->info.buffer = slot->data;
+        slot->info.size   = size;
+        memcpy(slot->data, &chunk_info->buffer[done], size);
+
+        if(cy_rtos_put_queue(&ctx->writer.full_queue, &index, CY_RTOS_NEVER_TIMEOUT, false) != CY_RSLT_SUCCESS)
+        {
+            return CY_RSLT_OTA_ERROR_WRITE_STORAGE;
+        }
+        done += size;
+    }
+
+    return cy_ota_writer_result(ctx);
+}
+
+void cy_ota_writer_lock(cy_ota_context_t *ctx)
+{
+    if(ctx->writer.running == true)
+    {
+        cy_rtos_get_mutex(&ctx->writer.mutex, CY_RTOS_NEVER_TIMEOUT);
+    }
+}
+
+void cy_ota_writer_unlock(cy_ota_context_t *ctx)
+{
+    if(ctx->writer.running == true)
+    {
+        cy_rtos_set_mutex(&ctx->writer.mutex);
+    }
+}
+
+cy_rslt_t cy_ota_writer_stop(cy_ota_context_t *ctx)
+{
+    uint8_t     index = OTA_WRITER_STOP_INDEX;
+
+    CY_OTA_CONTEXT_ASSERT(ctx);
+
+    if(ctx->writer.running == false)
+    {
+        return CY_RSLT_SUCCESS;
+    }
+
+    /* The queue is in order, so all chunks are written before the writer sees this */
+    (void)cy_rtos_put_queue(&ctx->writer.full_queue, &index, CY_RTOS_NEVER_TIMEOUT, false);
+    cy_rtos_join_thread(&ctx->writer.thread);
+    ctx->writer.running = false;
+
+    cy_rtos_deinit_queue(&ctx->writer.full_queue);
+    cy_rtos_deinit_queue(&ctx->writer.free_queue);
+    cy_rtos_deinit_mutex(&ctx->writer.mutex);
+    cy_ota_mem_free(ctx, ctx->writer.slots);
+    ctx->writer.slots = NULL;
+
+    if(ctx->writer.result != CY_RSLT_SUCCESS)
+    {
+        /* Chunks the writer did not store must be received again */
+        ctx->received_ranges = ctx->written_ranges;
+        ctx->received_bytes  = ctx->ota_storage_context.total_bytes_written;
+    }
+    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_DEBUG, "%s() Storage writer stopped result: 0x%lx\n", __func__, ctx->writer.result);
+
+    return ctx->writer.result;
+}
+
+#endif  /* CY_OTA_STORAGE_WRITER_BUFFERS > 0 */
+
+#endif  /* defined(COMPONENT_OTA_HTTP) || defined(COMPONENT_OTA_MQTT) */
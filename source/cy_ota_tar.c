@@ -0,0 +1,660 @@
+/*
+ * Copyright 2025, Cypress Semiconductor Corporation (an Infineon company) or
+ * an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+ *
+ * This software, including source code, documentation and related
+ * materials ("Software") is owned by Cypress Semiconductor Corporation
+ * or one of its affiliates ("Cypress") and is protected by and subject to
+ * worldwide patent protection (United States and foreign),
+ * United States copyright laws and international treaty provisions.
+ * Therefore, you may use this Software only as provided in the license
+ * agreement accompanying the software package from which you
+ * obtained this Software ("EULA").
+ * If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+ * non-transferable license to copy, modify, and compile the Software
+ * source code solely for use in connection with Cypress's
+ * integrated circuit products.  Any reproduction, modification, translation,
+ * compilation, or representation of this Software except as specified
+ * above is prohibited without the express written permission of Cypress.
+ *
+ * Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+ * reserves the right to make changes to the Software without notice. Cypress
+ * does not assume any liability arising out of the application or use of the
+ * Software or any product or circuit described in the Software. Cypress does
+ * not authorize its products for use in any products where a malfunction or
+ * failure of the Cypress product may reasonably be expected to result in
+ * significant property damage, injury or death ("High Risk Product"). By
+ * including Cypress's product in a High Risk Product, the manufacturer
+ * of such system or application assumes all risk of such use and in doing
+ * so agrees to indemnify Cypress against all liability.
+ */
+
+
+/*
+ *  Cypress OTA Agent TAR archive parsing
+ *
+ *  Splits a TAR archive (multi-image OTA update) as it is received and writes
+ *  each member to the slot of its image, at offsets from the start of the member.
+ *
+ *  The archive is parsed in order, 512 byte header blocks followed by the member
+ *  data padded to 512 bytes. Data that arrives ahead of the parser (ex: MQTT) is
+ *  held in a reorder buffer until the gap is filled.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cy_ota_api.h"
+#include "cy_ota_internal.h"
+#include "cy_ota_log.h"
+
+#if (CY_OTA_TAR_PARSER == 1)
+
+/***********************************************************************
+ *
+ * defines & enums
+ *
+ **********************************************************************/
+/* ustar header fields */
+#define CY_OTA_TAR_NAME_OFFSET          (0)
+#define CY_OTA_TAR_NAME_SIZE            (100)
+#define CY_OTA_TAR_SIZE_OFFSET          (124)
+#define CY_OTA_TAR_SIZE_SIZE            (12)
+#define CY_OTA_TAR_CHKSUM_OFFSET        (148)
+#define CY_OTA_TAR_CHKSUM_SIZE          (8)
+#define CY_OTA_TAR_TYPE_OFFSET          (156)
+#define CY_OTA_TAR_MAGIC_OFFSET         (257)
+#define CY_OTA_TAR_MAGIC                "ustar"
+#define CY_OTA_TAR_MAGIC_SIZE           (5)
+
+/* Regular file type flags */
+#define CY_OTA_TAR_TYPE_FILE            ('0')
+#define CY_OTA_TAR_TYPE_FILE_OLD        ('\0')
+
+/* Archive members that are not images */
+#define CY_OTA_TAR_SKIP_SUFFIX          ".json"
+
+typedef enum
+{
+    CY_OTA_TAR_STATE_HEADER = 0,            /* collecting a header block        */
+    CY_OTA_TAR_STATE_DATA,                  /* member data                      */
+    CY_OTA_TAR_STATE_PAD,                   /* padding after the member data    */
+    CY_OTA_TAR_STATE_END,                   /* end of archive block seen        */
+} cy_ota_tar_state_t;
+
+/***********************************************************************
+ *
+ * Functions
+ *
+ **********************************************************************/
+
+static uint32_t cy_ota_tar_octal(const uint8_t *field, uint32_t size)
+{
+    uint32_t    value = 0;
+    uint32_t    i = 0;
+
+    while( (i < size) && (field[i] == ' ') )
+    {
+        i++;
+    }
+    while( (i < size) && (field[i] >= '0') && (field[i] <= '7') )
+    {
+        value = (value << 3) + (uint32_t)(field[i] - '0');
+        i++;
+    }
+    return value;
+}
+
+/**
+ * @brief Write archive data at its archive offset, for an OTA Image that is not a TAR archive
+ *
+ * @param[in]   ctx     - pointer to OTA agent context @ref cy_ota_context_t
+ * @param[in]   offset  - OTA Image offset
+ * @param[in]   buffer  - data
+ * @param[in]   size    - bytes of data
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          Error from cy_ota_storage_write_slot()
+ */
+static cy_rslt_t cy_ota_tar_pass(cy_ota_context_t *ctx, uint32_t offset, uint8_t *buffer, uint32_t size)
+{
+    cy_ota_storage_write_info_t info;
+
+    if(size == 0)
+    {
+        return CY_RSLT_SUCCESS;
+    }
+    info        = ctx->tar.info;
+    info.offset = offset;
+    info.buffer = buffer;
+    info.size   = size;
+    return cy_ota_storage_write_slot(ctx, &info);
+}
+
+/**
+ * @brief Not a TAR archive: write everything held at its OTA Image offset
+ *
+ * @param[in]   ctx     - pointer to OTA agent context @ref cy_ota_context_t
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          Error from cy_ota_storage_write_slot()
+ */
+static cy_rslt_t cy_ota_tar_release(cy_ota_context_t *ctx)
+{
+    cy_ota_tar_t        *tr = &ctx->tar;
+    cy_ota_range_t      *range;
+    cy_rslt_t           result = CY_RSLT_SUCCESS;
+    uint16_t            i;
+
+    tr->decided = true;
+    tr->active  = false;
+
+    /* The first bytes were collected for the TAR header check */
+    if(tr->block_len > 0)
+    {
+        result = cy_ota_tar_pass(ctx, 0, tr->block, tr->block_len);
+        tr->block_len = 0;
+    }
+
+    /* The header check moved in_offset, the held data is still at reorder_offset */
+    for(i = 0; (i < tr->held.num_ranges) && (result == CY_RSLT_SUCCESS); i++)
+    {
+        range = &tr->held.range[i];
+        if( (tr->reorder == NULL) || (range->start < tr->reorder_offset) ||
+            ( (range->end - tr->reorder_offset) > CY_OTA_TAR_REORDER_SIZE) )
+        {
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Held range 0x%lx-0x%lx not in the reorder buffer at 0x%lx\n",
+                           __func__, range->start, range->end, tr->reorder_offset);
+            result = CY_RSLT_OTA_ERROR_GENERAL;
+            break;
+        }
+        result = cy_ota_tar_pass(ctx, range->start, &tr->reorder[range->start - tr->reorder_offset], (range->end - range->start));
+    }
+    cy_ota_range_map_clear(&tr->held);
+
+    if(tr->reorder != NULL)
+    {
+        cy_ota_mem_free(ctx, tr->reorder);
+        tr->reorder = NULL;
+    }
+    return result;
+}
+
+/**
+ * @brief Hold data that arrived ahead of the parser
+ *
+ * @param[in]   ctx         - pointer to OTA agent context @ref cy_ota_context_t
+ * @param[in]   chunk_info  - data past in_offset @ref cy_ota_storage_write_info_t
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          CY_RSLT_OTA_ERROR_WRITE_STORAGE - does not fit in the reorder buffer
+ *          CY_RSLT_OTA_ERROR_OUT_OF_MEMORY
+ */
+static cy_rslt_t cy_ota_tar_hold(cy_ota_context_t *ctx, cy_ota_storage_write_info_t *chunk_info)
+{
+    cy_ota_tar_t    *tr = &ctx->tar;
+
+    if(tr->held.num_ranges == 0)
+    {
+        tr->reorder_offset = tr->in_offset;
+    }
+    if( (CY_OTA_TAR_REORDER_SIZE == 0) || (chunk_info->size > CY_OTA_TAR_REORDER_SIZE) ||
+        ( (chunk_info->offset - tr->reorder_offset) > (CY_OTA_TAR_REORDER_SIZE - chunk_info->size) ) )
+    {
+        return CY_RSLT_OTA_ERROR_WRITE_STORAGE;
+    }
+
+    if(tr->reorder == NULL)
+    {
+        tr->reorder = (uint8_t *)cy_ota_mem_alloc(ctx, CY_OTA_MEM_TAR_REORDER, CY_OTA_TAR_REORDER_SIZE);
+        if(tr->reorder == NULL)
+        {
+            return CY_RSLT_OTA_ERROR_OUT_OF_MEMORY;
+        }
+    }
+
+    memcpy(&tr->reorder[chunk_info->offset - tr->reorder_offset], chunk_info->buffer, chunk_info->size);
+    return cy_ota_range_map_add(&tr->held, chunk_info->offset, chunk_info->size);
+}
+
+/**
+ * @brief Move the reorder buffer up to in_offset after the parser has advanced
+ *
+ * @param[in]   ctx         - pointer to OTA agent context @ref cy_ota_context_t
+ */
+static void cy_ota_tar_slide(cy_ota_context_t *ctx)
+{
+    cy_ota_tar_t    *tr = &ctx->tar;
+    uint32_t        moved = tr->in_offset - tr->reorder_offset;
+    uint16_t        i;
+    uint16_t        kept = 0;
+
+    tr->reorder_offset = tr->in_offset;
+    if( (moved == 0) || (tr->held.num_ranges == 0) )
+    {
+        return;
+    }
+
+    if(moved < CY_OTA_TAR_REORDER_SIZE)
+    {
+        memmove(tr->reorder, &tr->reorder[moved], (CY_OTA_TAR_REORDER_SIZE - moved));
+    }
+    for(i = 0; i < tr->held.num_ranges; i++)
+    {
+        if(tr->held.range[i].end <= tr->in_offset)
+        {
+            continue;
+        }
+        tr->held.range[kept] = tr->held.range[i];
+        if(tr->held.range[kept].start < tr->in_offset)
+        {
+            tr->held.range[kept].start = tr->in_offset;
+        }
+        kept++;
+    }
+    tr->held.num_ranges = kept;
+}
+
+/**
+ * @brief A member is in storage: verify its image
+ *
+ * @param[in]   ctx     - pointer to OTA agent context @ref cy_ota_context_t
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          CY_RSLT_OTA_ERROR_VERIFY
+ *          Error from the storage write path
+ */
+static cy_rslt_t cy_ota_tar_member_done(cy_ota_context_t *ctx)
+{
+    cy_ota_tar_t    *tr = &ctx->tar;
+    cy_rslt_t       result = CY_RSLT_SUCCESS;
+
+    if(tr->member_img == 0)
+    {
+        return CY_RSLT_SUCCESS;
+    }
+    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_INFO, "%s() Image %d complete, %ld bytes\n", __func__, tr->member_img, tr->member_size);
+
+#if (CY_OTA_STORAGE_COALESCE_SIZE > 0)
+    /* The member must be in storage before the slot changes or it is verified */
+    result = cy_ota_coalesce_flush(ctx);
+    if(result != CY_RSLT_SUCCESS)
+    {
+        return result;
+    }
+#endif
+
+#if (CY_OTA_TAR_VERIFY_MEMBERS == 1)
+    result = ctx->storage_iface.ota_file_verify(&(ctx->ota_storage_context));
+    if(result != CY_RSLT_SUCCESS)
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Image %d verify failed 0x%lx\n", __func__, tr->member_img, result);
+        return CY_RSLT_OTA_ERROR_VERIFY;
+    }
+    tr->verified |= (1UL << tr->member_img);
+#endif
+
+    return result;
+}
+
+/**
+ * @brief Parse a header block and start its member
+ *
+ * @param[in]   ctx     - pointer to OTA agent context @ref cy_ota_context_t
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          CY_RSLT_OTA_ERROR_GENERAL     - bad header
+ *          CY_RSLT_OTA_ERROR_UNSUPPORTED - member not assigned to an image
+ *          Error from cy_ota_tar_member_done()
+ */
+static cy_rslt_t cy_ota_tar_header(cy_ota_context_t *ctx)
+{
+    cy_ota_tar_t    *tr = &ctx->tar;
+    cy_rslt_t       result;
+    char            name[CY_OTA_TAR_NAME_SIZE + 1];
+    uint32_t        chksum = 0;
+    uint32_t        name_len;
+    uint32_t        i;
+    uint8_t         type;
+    uint8_t         img = 0;
+
+    for(i = 0; i < CY_OTA_TAR_BLOCK_SIZE; i++)
+    {
+        chksum += ( (i >= CY_OTA_TAR_CHKSUM_OFFSET) && (i < (CY_OTA_TAR_CHKSUM_OFFSET + CY_OTA_TAR_CHKSUM_SIZE)) ) ?
+                  (uint32_t)' ' : tr->block[i];
+    }
+
+    /* The archive ends with zero blocks */
+    if(chksum == (CY_OTA_TAR_CHKSUM_SIZE * (uint32_t)' '))
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_INFO, "%s() End of archive, %d images\n", __func__, tr->member_count);
+        tr->state = CY_OTA_TAR_STATE_END;
+        return CY_RSLT_SUCCESS;
+    }
+
+    if( (memcmp(&tr->block[CY_OTA_TAR_MAGIC_OFFSET], CY_OTA_TAR_MAGIC, CY_OTA_TAR_MAGIC_SIZE) != 0) ||
+        (chksum != cy_ota_tar_octal(&tr->block[CY_OTA_TAR_CHKSUM_OFFSET], CY_OTA_TAR_CHKSUM_SIZE)) )
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Bad TAR header at 0x%lx\n", __func__, (tr->in_offset - CY_OTA_TAR_BLOCK_SIZE));
+        return CY_RSLT_OTA_ERROR_GENERAL;
+    }
+
+    memcpy(name, &tr->block[CY_OTA_TAR_NAME_OFFSET], CY_OTA_TAR_NAME_SIZE);
+    name[CY_OTA_TAR_NAME_SIZE] = 0;
+    name_len = strlen(name);
+    tr->member_size   = cy_ota_tar_octal(&tr->block[CY_OTA_TAR_SIZE_OFFSET], CY_OTA_TAR_SIZE_SIZE);
+    tr->member_offset = 0;
+    tr->pad_left      = (CY_OTA_TAR_BLOCK_SIZE - (tr->member_size % CY_OTA_TAR_BLOCK_SIZE)) % CY_OTA_TAR_BLOCK_SIZE;
+    type = tr->block[CY_OTA_TAR_TYPE_OFFSET];
+
+    /* Only regular files are images (not directories, links, pax headers) */
+    if( (type == CY_OTA_TAR_TYPE_FILE) || (type == CY_OTA_TAR_TYPE_FILE_OLD) )
+    {
+        if(ctx->storage_iface.ota_file_tar_member != NULL)
+        {
+            result = ctx->storage_iface.ota_file_tar_member(&(ctx->ota_storage_context), name, tr->member_size, &img);
+            if(result != CY_RSLT_SUCCESS)
+            {
+                cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Member %s rejected 0x%lx\n", __func__, name, result);
+                return CY_RSLT_OTA_ERROR_UNSUPPORTED;
+            }
+        }
+        else if( (name_len < strlen(CY_OTA_TAR_SKIP_SUFFIX)) ||
+                 (strcmp(&name[name_len - strlen(CY_OTA_TAR_SKIP_SUFFIX)], CY_OTA_TAR_SKIP_SUFFIX) != 0) )
+        {
+            img = tr->member_count + 1;
+        }
+    }
+    if(img > CY_OTA_IMAGE_NUMBER)
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Member %s for image %d, %d images\n", __func__, name, img, CY_OTA_IMAGE_NUMBER);
+        return CY_RSLT_OTA_ERROR_UNSUPPORTED;
+    }
+
+    tr->member_img = img;
+    if(img != 0)
+    {
+        tr->member_count++;
+        ctx->ota_storage_context.imgID = img;
+        /* A new slot, nothing erased yet */
+        ctx->erased_size = 0;
+    }
+    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_NOTICE, "TAR member %s, %ld bytes -> %s %d\n", name, tr->member_size,
+                   (img != 0) ? "image" : "skipped", img);
+
+    if(tr->member_size > 0)
+    {
+        tr->state = CY_OTA_TAR_STATE_DATA;
+        return CY_RSLT_SUCCESS;
+    }
+    tr->state = CY_OTA_TAR_STATE_HEADER;
+    return cy_ota_tar_member_done(ctx);
+}
+
+/**
+ * @brief The first block is collected: decide if the OTA Image is a TAR archive
+ *
+ * @param[in]   ctx     - pointer to OTA agent context @ref cy_ota_context_t
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          Error from cy_ota_tar_release()
+ */
+static cy_rslt_t cy_ota_tar_detect(cy_ota_context_t *ctx)
+{
+    cy_ota_tar_t    *tr = &ctx->tar;
+
+    if(memcmp(&tr->block[CY_OTA_TAR_MAGIC_OFFSET], CY_OTA_TAR_MAGIC, CY_OTA_TAR_MAGIC_SIZE) != 0)
+    {
+        return cy_ota_tar_release(ctx);
+    }
+
+    cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_NOTICE, "TAR archive, writing each image to its slot\n");
+    tr->decided   = true;
+    tr->active    = true;
+    tr->saved_img = ctx->ota_storage_context.imgID;
+#if (CY_OTA_IMAGE_DIGEST)
+    /* The digest is for a single OTA Image */
+    ctx->digest.active = false;
+#endif
+    return CY_RSLT_SUCCESS;
+}
+
+/**
+ * @brief Parse archive data at in_offset
+ *
+ * @param[in]   ctx     - pointer to OTA agent context @ref cy_ota_context_t
+ * @param[in]   buffer  - archive data
+ * @param[in]   size    - bytes of archive data
+ * @param[in]   held    - true if buffer is in reorder[], part of a held range
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          Error from the header checks or the storage write path
+ */
+static cy_rslt_t cy_ota_tar_data(cy_ota_context_t *ctx, uint8_t *buffer, uint32_t size, bool held)
+{
+    cy_ota_tar_t                *tr = &ctx->tar;
+    cy_ota_storage_write_info_t info;
+    cy_rslt_t                   result = CY_RSLT_SUCCESS;
+    uint32_t                    n;
+
+    while( (size > 0) && (result == CY_RSLT_SUCCESS) )
+    {
+        if(tr->decided && (tr->active == false))
+        {
+            result = cy_ota_tar_pass(ctx, tr->in_offset, buffer, size);
+            n = size;
+        }
+        else
+        {
+            switch(tr->state)
+            {
+                case CY_OTA_TAR_STATE_HEADER:
+                    n = CY_OTA_TAR_BLOCK_SIZE - tr->block_len;
+                    n = (size < n) ? size : n;
+                    memcpy(&tr->block[tr->block_len], buffer, n);
+                    tr->block_len += n;
+                    if(tr->block_len == CY_OTA_TAR_BLOCK_SIZE)
+                    {
+                        tr->in_offset += n;
+                        buffer        += n;
+                        size          -= n;
+                        n = 0;
+                        if(tr->decided == false)
+                        {
+                            result = cy_ota_tar_detect(ctx);
+                            if( (result != CY_RSLT_SUCCESS) || (tr->active == false) )
+                            {
+                                if(held)
+                                {
+                                    /* cy_ota_tar_release() wrote the held data, reorder[] is gone */
+                                    return result;
+                                }
+                                break;
+                            }
+                        }
+                        tr->block_len = 0;
+                        result = cy_ota_tar_header(ctx);
+                    }
+                    break;
+
+                case CY_OTA_TAR_STATE_DATA:
+                    n = tr->member_size - tr->member_offset;
+                    n = (size < n) ? size : n;
+                    if(tr->member_img != 0)
+                    {
+                        info            = tr->info;
+                        info.total_size = tr->member_size;
+                        info.offset     = tr->member_offset;
+                        info.buffer     = buffer;
+                        info.size       = n;
+                        result = cy_ota_storage_write_slot(ctx, &info);
+                    }
+                    tr->member_offset += n;
+                    if( (result == CY_RSLT_SUCCESS) && (tr->member_offset == tr->member_size) )
+                    {
+                        tr->state = (tr->pad_left > 0) ? CY_OTA_TAR_STATE_PAD : CY_OTA_TAR_STATE_HEADER;
+                        result = cy_ota_tar_member_done(ctx);
+                    }
+                    break;
+
+                case CY_OTA_TAR_STATE_PAD:
+                    n = (size < tr->pad_left) ? size : tr->pad_left;
+                    tr->pad_left -= n;
+                    if(tr->pad_left == 0)
+                    {
+                        tr->state = CY_OTA_TAR_STATE_HEADER;
+                    }
+                    break;
+
+                default:
+                    /* Zero blocks after the end of the archive */
+                    n = size;
+                    break;
+            }
+        }
+        tr->in_offset += n;
+        buffer        += n;
+        size          -= n;
+    }
+
+    return result;
+}
+
+void cy_ota_tar_start(cy_ota_context_t *ctx, uint32_t resume_offset)
+{
+    CY_OTA_CONTEXT_ASSERT(ctx);
+
+    if(ctx->tar.reorder != NULL)
+    {
+        cy_ota_mem_free(ctx, ctx->tar.reorder);
+    }
+    memset(&ctx->tar, 0x00, sizeof(ctx->tar));
+    ctx->tar.result = CY_RSLT_SUCCESS;
+
+    /* A TAR archive is never checkpointed, so a resumed download is not one */
+    if(resume_offset > 0)
+    {
+        ctx->tar.decided = true;
+    }
+}
+
+cy_rslt_t cy_ota_tar_write(cy_ota_context_t *ctx, cy_ota_storage_write_info_t *chunk_info)
+{
+    cy_ota_tar_t    *tr = &ctx->tar;
+    cy_rslt_t       result;
+    uint32_t        skip;
+
+    CY_OTA_CONTEXT_ASSERT(ctx);
+
+    if(tr->decided && (tr->active == false))
+    {
+        return cy_ota_storage_write_slot(ctx, chunk_info);
+    }
+    if(tr->result != CY_RSLT_SUCCESS)
+    {
+        return tr->result;
+    }
+    tr->info = *chunk_info;
+
+    /* Data already parsed (ex: MQTT duplicate) */
+    if( (chunk_info->offset + chunk_info->size) <= tr->in_offset)
+    {
+        return CY_RSLT_SUCCESS;
+    }
+
+    if(chunk_info->offset > tr->in_offset)
+    {
+        result = cy_ota_tar_hold(ctx, chunk_info);
+        if( (result != CY_RSLT_SUCCESS) && (tr->decided == false) )
+        {
+            /* Not the start of a TAR archive, write everything as received */
+            result = cy_ota_tar_release(ctx);
+            if(result == CY_RSLT_SUCCESS)
+            {
+                result = cy_ota_storage_write_slot(ctx, chunk_info);
+            }
+            return result;
+        }
+        if(result != CY_RSLT_SUCCESS)
+        {
+            cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Offset 0x%lx too far ahead of 0x%lx, increase CY_OTA_TAR_REORDER_SIZE\n",
+                           __func__, chunk_info->offset, tr->in_offset);
+        }
+        tr->result = result;
+        return result;
+    }
+
+    skip = tr->in_offset - chunk_info->offset;
+    result = cy_ota_tar_data(ctx, &chunk_info->buffer[skip], (chunk_info->size - skip), false);
+
+    /* Parse the data held for the gap just filled */
+    while( (result == CY_RSLT_SUCCESS) && (tr->reorder != NULL) )
+    {
+        cy_ota_tar_slide(ctx);
+        if( (tr->held.num_ranges == 0) || (tr->held.range[0].start != tr->in_offset) )
+        {
+            break;
+        }
+        result = cy_ota_tar_data(ctx, tr->reorder, (tr->held.range[0].end - tr->in_offset), true);
+    }
+
+    /* Not a TAR archive, the rest of the held data goes at its OTA Image offset */
+    if( (result == CY_RSLT_SUCCESS) && tr->decided && (tr->active == false) )
+    {
+        result = cy_ota_tar_release(ctx);
+    }
+
+    tr->result = result;
+    return result;
+}
+
+cy_rslt_t cy_ota_tar_finish(cy_ota_context_t *ctx)
+{
+    cy_ota_tar_t    *tr = &ctx->tar;
+    cy_rslt_t       result;
+
+    CY_OTA_CONTEXT_ASSERT(ctx);
+
+    if(tr->active == false)
+    {
+        /* OTA Image shorter than a TAR header, or not a TAR archive */
+        result = tr->result;
+        if( (result == CY_RSLT_SUCCESS) && (tr->decided == false) )
+        {
+            result = cy_ota_tar_release(ctx);
+        }
+        tr->decided = true;
+        tr->result  = result;
+        return result;
+    }
+
+    result = tr->result;
+    if( (result == CY_RSLT_SUCCESS) &&
+        ( (tr->held.num_ranges > 0) || (tr->block_len > 0) ||
+          ( (tr->state != CY_OTA_TAR_STATE_END) && (tr->state != CY_OTA_TAR_STATE_HEADER) ) ) )
+    {
+        cy_ota_log_msg(CYLF_MIDDLEWARE, CY_LOG_ERR, "%s() Archive ends inside a member at 0x%lx\n", __func__, tr->in_offset);
+        result = CY_RSLT_OTA_ERROR_GENERAL;
+    }
+
+    if(tr->reorder != NULL)
+    {
+        cy_ota_mem_free(ctx, tr->reorder);
+        tr->reorder = NULL;
+    }
+    cy_ota_range_map_clear(&tr->held);
+    ctx->ota_storage_context.imgID = tr->saved_img;
+    tr->result = result;
+
+    return result;
+}
+
+bool cy_ota_tar_verified(const cy_ota_context_t *ctx, uint8_t imgID)
+{
+    return ( (ctx->tar.active == true) && ((ctx->tar.verified & (1UL << imgID)) != 0) );
+}
+
+#endif  /* CY_OTA_TAR_PARSER == 1 */